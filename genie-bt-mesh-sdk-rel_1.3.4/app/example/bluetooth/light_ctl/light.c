@@ -70,33 +70,12 @@ bool genie_sal_ota_is_allow_reboot(void)
 #endif
 
 #ifdef CONFIG_MESH_MODEL_TRANS
-static void _mesh_delay_timer_cb(void *p_timer, void *p_arg)
+static void _mesh_delay_work_handler(struct k_work *p_work)
 {
-    sig_model_element_state_t *p_elem = (sig_model_element_state_t *)p_arg;
+    sig_model_element_state_t *p_elem = CONTAINER_OF(p_work, sig_model_element_state_t, state.delay_work);
 
     sig_model_transition_timer_stop(p_elem);
-    sig_model_event(SIG_MODEL_EVT_DELAY_END, p_arg);
-}
-
-static void _mesh_trans_timer_cycle(void *p_timer, void *p_arg)
-{
-    sig_model_element_state_t *p_elem = (sig_model_element_state_t *)p_arg;
-    sig_model_state_t *p_state = &p_elem->state;
-
-    sig_model_transition_timer_stop(p_elem);
-
-    //do cycle
-    sig_model_event(SIG_MODEL_EVT_TRANS_CYCLE, p_arg);
-    //BT_DBG(">>>>>%d %d", (u32_t)cur_time, (u32_t)p_elem->state.trans_end_time);
-
-    if (p_state->trans == 0)
-    {
-        sig_model_event(SIG_MODEL_EVT_TRANS_END, p_arg);
-    }
-    else
-    {
-        k_timer_start(&p_state->trans_timer, SIG_MODEL_TRANSITION_INTERVAL);
-    }
+    sig_model_event(SIG_MODEL_EVT_DELAY_END, p_elem);
 }
 #endif
 
@@ -151,10 +130,10 @@ void light_elem_state_init(void)
 #endif
 
 #ifdef CONFIG_MESH_MODEL_TRANS
-        k_timer_init(&light_elem_stat[index].state.delay_timer, _mesh_delay_timer_cb, &light_elem_stat[index]);
-        k_timer_init(&light_elem_stat[index].state.trans_timer, _mesh_trans_timer_cycle, &light_elem_stat[index]);
+        k_delayed_work_init(&light_elem_stat[index].state.delay_work, _mesh_delay_work_handler);
 
         light_elem_stat[index].state.trans = TRANSITION_DEFAULT_VALUE;
+        light_elem_stat[index].state.trans_ease = TRANSITION_DEFAULT_EASE;
         light_elem_stat[index].state.delay = DELAY_DEFAULT_VAULE;
         if (light_elem_stat[index].state.trans)
         {
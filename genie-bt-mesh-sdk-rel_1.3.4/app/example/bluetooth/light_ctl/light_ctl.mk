@@ -38,6 +38,9 @@ MESH_MODEL_SCENE_SRV = 1
 #Enable transition/delay time for Generic Model
 #MESH_MODEL_ENABLE_TRANSITION = 1
 
+#Transition curve, one of sig_model_trans_ease_e, linear by default
+#GLOBAL_DEFINES += TRANSITION_DEFAULT_EASE=SIG_MODEL_TRANS_EASE_IN_OUT
+
 #enable use gpio uart for debug log print
 GENIE_GPIO_UART = 1
 
@@ -60,7 +63,6 @@ GLOBAL_DEFINES += CONFIG_BT_RX_BUF_LEN=143
 GLOBAL_DEFINES += CONFIG_BT_L2CAP_TX_MTU=135
 GLOBAL_DEFINES += CONFIG_AIS_TOTAL_FRAME=6
 GLOBAL_DEFINES += CONFIG_BT_RX_BUF_COUNT=4
-GLOBAL_DEFINES += GENIE_DEFAULT_DURATION=205
 
 #enable debug log
 CONFIG_DEBUG_MODE = 0
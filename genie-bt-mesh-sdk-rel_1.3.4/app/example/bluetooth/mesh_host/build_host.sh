@@ -0,0 +1,70 @@
+#!/bin/sh
+#
+# Host build of the examples that run on the POSIX port (mesh_host, mesh_sim).
+# There is no Linux board in this tree, so these examples are not aos build
+# targets; this is their only build. The port and the virtual radio are
+# picked here, and only GLOBAL_DEFINES are read from the example's .mk.
+#
+# usage: build_host.sh <mesh_host|mesh_sim> [extra gcc flags]
+#
+
+set -e
+
+APP=$1
+if [ -z "$APP" ]; then
+    echo "usage: $0 <mesh_host|mesh_sim> [extra gcc flags]"
+    exit 1
+fi
+shift
+
+ROOT=$(cd "$(dirname "$0")/../../../.." && pwd)
+APP_DIR=$ROOT/app/example/bluetooth/$APP
+BT=$ROOT/network/bluetooth
+OUT=${OUT:-$ROOT/out/$APP@host}
+
+if [ ! -f "$APP_DIR/$APP.mk" ]; then
+    echo "no such example: $APP"
+    exit 1
+fi
+
+# Defines from the example and the components it pulls in
+DEFINES="-DCONFIG_BT_PORT_POSIX -DCONFIG_BLUETOOTH -DCRC16_ENABLED"
+for d in $(sed -n 's/^GLOBAL_DEFINES += //p' "$APP_DIR/$APP.mk"); do
+    DEFINES="$DEFINES -D$d"
+done
+
+# Same order as the GLOBAL_INCLUDES of bt_common, ref_impl and bt_mesh
+INCLUDES="-I$BT/bt_common/include \
+          -I$BT/bt_common/tinycrypt/include \
+          -I$BT/bt_common/port/include \
+          -I$BT/bt_mesh/ref_impl \
+          -I$BT/bt_host/include \
+          -I$BT/bt_host/host \
+          -I$BT/bt_mesh/inc \
+          -I$BT/bt_mesh/inc/api \
+          -I$BT/bt_mesh/inc/api/mesh \
+          -I$ROOT/genie_service \
+          -I$ROOT/genie_service/core/inc \
+          -I$ROOT/genie_service/core/inc/sig_models \
+          -I$ROOT/genie_service/sal/inc \
+          -I$ROOT/osal/include \
+          -I$ROOT/kernel/hal/include/hal \
+          -I$ROOT/utility/log/include"
+
+SOURCES="$APP_DIR/$APP.c"
+for f in access adv beacon crypto cfg_srv cfg_cli health_srv health_cli main \
+         net prov proxy transport friend lpn shell; do
+    SOURCES="$SOURCES $BT/bt_mesh/src/$f.c"
+done
+for f in atomic_c buf log poll event_scheduler work queue port/posix_port; do
+    SOURCES="$SOURCES $BT/bt_common/$f.c"
+done
+for f in cmac_mode aes_encrypt aes_decrypt utils sha256 hmac hmac_prng ecc \
+         ecc_dh ecc_platform_specific; do
+    SOURCES="$SOURCES $BT/bt_common/tinycrypt/source/$f.c"
+done
+SOURCES="$SOURCES $BT/bt_mesh/ref_impl/mesh_hal_sec.c $BT/bt_mesh/ref_impl/mesh_hal_vradio.c"
+
+mkdir -p "$OUT"
+gcc -O2 -g $DEFINES $INCLUDES "$@" $SOURCES -o "$OUT/$APP" -lpthread -lm
+echo "$OUT/$APP"
@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2015-2019 Alibaba Group Holding Limited
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr.h>
+#include <misc/util.h>
+#include <misc/byteorder.h>
+#include <net/buf.h>
+#include <bluetooth.h>
+#include <crypto.h>
+#include <api/mesh.h>
+
+#include "mesh_hal_vradio.h"
+#include "genie_event.h"
+
+/*
+ * Host mesh node on the virtual radio.
+ *
+ * Every process self-provisions into the same network with fixed keys and
+ * the unicast address given on the command line, adds the application key
+ * through its own Configuration Server (which binds it to every model, as
+ * on a genie device), then sends a counter to the destination once per
+ * second and prints what it hears.
+ * Start two or more processes on the same host to get a working network.
+ */
+
+#define MESH_HOST_CID 0x01A8
+#define MESH_HOST_MODEL_ID 0x0000
+#define MESH_HOST_OP_COUNTER BT_MESH_MODEL_OP_3(0xD0, MESH_HOST_CID)
+
+#define MESH_HOST_NET_IDX 0x0000
+#define MESH_HOST_APP_IDX 0x0000
+
+static const u8_t net_key[16] = {
+    0x7d, 0xd7, 0x36, 0x4c, 0xd8, 0x42, 0xad, 0x18,
+    0xc1, 0x7c, 0x2b, 0x82, 0x0c, 0x84, 0xc3, 0xd6,
+};
+
+static const u8_t app_key[16] = {
+    0x63, 0x96, 0x47, 0x71, 0x73, 0x4f, 0xbd, 0x76,
+    0xe3, 0xb4, 0x05, 0x19, 0xd1, 0xd9, 0x4a, 0x48,
+};
+
+static u8_t dev_key[16];
+static u8_t dev_uuid[16];
+
+static struct bt_mesh_cfg_cli cfg_cli = {};
+
+static u32_t rx_count;
+
+static void counter_recv(struct bt_mesh_model *model,
+                         struct bt_mesh_msg_ctx *ctx,
+                         struct net_buf_simple *buf)
+{
+    rx_count++;
+    printf("rx counter %u from 0x%04x ttl %u\n",
+           (unsigned)net_buf_simple_pull_le32(buf), ctx->addr, ctx->recv_ttl);
+}
+
+static const struct bt_mesh_model_op vendor_op[] = {
+    {MESH_HOST_OP_COUNTER, 4, counter_recv},
+    BT_MESH_MODEL_OP_END,
+};
+
+static struct bt_mesh_model root_models[] = {
+    BT_MESH_MODEL_CFG_SRV(),
+    BT_MESH_MODEL_CFG_CLI(&cfg_cli),
+    BT_MESH_MODEL_HEALTH_SRV(),
+};
+
+static struct bt_mesh_model vnd_models[] = {
+    BT_MESH_MODEL_VND(MESH_HOST_CID, MESH_HOST_MODEL_ID, vendor_op, NULL,
+                      NULL),
+};
+
+static struct bt_mesh_elem elements[] = {
+    BT_MESH_ELEM(0, root_models, vnd_models, 0),
+};
+
+static const struct bt_mesh_comp comp = {
+    .cid = MESH_HOST_CID,
+    .elem = elements,
+    .elem_count = ARRAY_SIZE(elements),
+};
+
+static const struct bt_mesh_prov prov = {
+    .uuid = dev_uuid,
+};
+
+/* Hooks the stack normally gets from genie_service. */
+void genie_event(genie_event_e event, void *args)
+{
+}
+
+void genie_mesh_load_group_addr(void)
+{
+}
+
+uint8_t genie_reset_get_hw_reset_flag(void)
+{
+    return 0;
+}
+
+bool genie_transport_tx_in_progress(void)
+{
+    return false;
+}
+
+uint8_t *genie_crypto_get_auth(const uint8_t random[16])
+{
+    static uint8_t auth[16];
+
+    return auth;
+}
+
+static int self_configure(u16_t addr)
+{
+    u8_t status;
+    int err;
+
+    err = bt_mesh_cfg_app_key_add(MESH_HOST_NET_IDX, addr, MESH_HOST_NET_IDX,
+                                  MESH_HOST_APP_IDX, app_key, &status);
+    if (err || status)
+    {
+        printf("app key add failed (err %d status 0x%02x)\n", err, status);
+        return err ? err : -EIO;
+    }
+
+    return 0;
+}
+
+static void counter_send(u16_t dst, u32_t counter)
+{
+    struct net_buf_simple *msg = NET_BUF_SIMPLE(3 + 4 + 4);
+    struct bt_mesh_msg_ctx ctx = {
+        .net_idx = MESH_HOST_NET_IDX,
+        .app_idx = MESH_HOST_APP_IDX,
+        .addr = dst,
+        .send_ttl = BT_MESH_TTL_DEFAULT,
+    };
+    int err;
+
+    bt_mesh_model_msg_init(msg, MESH_HOST_OP_COUNTER);
+    net_buf_simple_add_le32(msg, counter);
+
+    err = bt_mesh_model_send(&vnd_models[0], &ctx, msg, NULL, NULL);
+    if (err)
+    {
+        printf("send failed (err %d)\n", err);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    struct bt_mesh_vradio_stats stats;
+    u16_t addr, dst = BT_MESH_ADDR_ALL_NODES;
+    u32_t counter, rounds = 0;
+    int err;
+
+    if (argc < 2)
+    {
+        printf("usage: %s <unicast addr> [dst addr] [seconds]\n", argv[0]);
+        return 1;
+    }
+
+    addr = strtoul(argv[1], NULL, 0);
+    if (argc > 2)
+    {
+        dst = strtoul(argv[2], NULL, 0);
+    }
+    if (argc > 3)
+    {
+        rounds = strtoul(argv[3], NULL, 0);
+    }
+
+    k_os_init();
+
+    err = bt_mesh_vradio_init(NULL, 0);
+    if (err)
+    {
+        printf("vradio init failed (err %d)\n", err);
+        return 1;
+    }
+
+    bt_rand(dev_key, sizeof(dev_key));
+    bt_rand(dev_uuid, sizeof(dev_uuid));
+
+    err = bt_mesh_init(&prov, &comp);
+    if (err)
+    {
+        printf("mesh init failed (err %d)\n", err);
+        return 1;
+    }
+
+    err = bt_mesh_provision(net_key, MESH_HOST_NET_IDX, 0, 0, 0, addr,
+                            dev_key);
+    if (err)
+    {
+        printf("provision failed (err %d)\n", err);
+        return 1;
+    }
+
+    if (self_configure(addr))
+    {
+        return 1;
+    }
+
+    printf("node 0x%04x up, sending to 0x%04x\n", addr, dst);
+
+    for (counter = 0; !rounds || counter < rounds; counter++)
+    {
+        counter_send(dst, counter);
+        k_sleep(1000);
+    }
+
+    bt_mesh_vradio_stats_get(&stats);
+    printf("sent %u received %u (radio tx %u rx %u drop %u)\n",
+           (unsigned)counter, (unsigned)rx_count, (unsigned)stats.tx,
+           (unsigned)stats.rx, (unsigned)stats.rx_drop);
+
+    return 0;
+}
@@ -0,0 +1,1154 @@
+/*
+ * Copyright (C) 2015-2019 Alibaba Group Holding Limited
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <zephyr.h>
+#include <misc/util.h>
+#include <misc/byteorder.h>
+#include <net/buf.h>
+#include <bluetooth.h>
+#include <crypto.h>
+#include <api/mesh.h>
+
+#include "adv.h"
+#include "access.h"
+#include "net.h"
+#include "transport.h"
+#include "mesh_hal_vradio.h"
+#include "genie_event.h"
+
+/*
+ * Mesh network simulator on a virtual clock.
+ *
+ * The stack keeps its state in globals, so every node is a process of its
+ * own, forked from the simulator and running the unmodified stack on the
+ * POSIX port in virtual clock mode. The simulator process is the medium and
+ * the clock: a node runs until all of its tasks block, reports the PDUs it
+ * sent and the next uptime it waits for, and sleeps until told to run at a
+ * later virtual time with the PDUs that reached it meanwhile. Nodes that run
+ * at the same virtual time run in parallel on the host; everything else is
+ * ordered by node number, so a run replays exactly for a given seed.
+ *
+ * Medium model: nodes are placed at random in a square area, RSSI follows
+ * a log-distance path loss and PDUs below the receiver sensitivity are not
+ * heard. Every PDU heard arrives after a fixed latency, may be lost at
+ * random, and is destroyed when another PDU reaches the same receiver in
+ * the same millisecond or the receiver is itself transmitting.
+ */
+
+#define MESH_SIM_CID 0x01A8
+#define MESH_SIM_MODEL_ID 0x0000
+#define MESH_SIM_OP_DATA BT_MESH_MODEL_OP_3(0xD1, MESH_SIM_CID)
+
+#define MESH_SIM_NET_IDX 0x0000
+#define MESH_SIM_APP_IDX 0x0000
+
+/* With -g, node n subscribes to group MESH_SIM_GROUP + n % groups */
+#define MESH_SIM_GROUP 0xc000
+
+/* Counter and send time; longer payloads are padded and get segmented. */
+#define MESH_SIM_PAYLOAD_MIN 8
+#define MESH_SIM_PAYLOAD_MAX 256
+
+/* Path loss at 1 m, path loss exponent and receiver sensitivity */
+#define MESH_SIM_PL_1M 40.0
+#define MESH_SIM_PL_EXP 3.0
+#define MESH_SIM_SENSITIVITY (-90)
+
+enum
+{
+    SIM_MSG_IDLE,
+    SIM_MSG_TX,
+    SIM_MSG_STATS,
+    SIM_MSG_RX,
+    SIM_MSG_RUN,
+    SIM_MSG_STOP,
+};
+
+struct sim_node_stats
+{
+    uint32_t app_tx;
+    uint32_t app_expect; /* Deliveries due: one per message or subscriber */
+    uint32_t app_rx;
+    uint32_t send_fail;
+    uint32_t seg_ok;
+    uint32_t seg_fail;
+    uint32_t latency_max;
+    uint64_t latency_sum;
+    struct bt_mesh_vradio_stats radio;
+    struct bt_mesh_adv_stats adv[BT_MESH_ADV_PRIO_COUNT];
+    struct bt_mesh_seg_stats seg;
+    struct bt_mesh_sub_stats sub;
+};
+
+/* One message between the simulator and a node. IDLE carries the deadline
+ * (-1 for none) and RUN the virtual time to resume at.
+ */
+struct sim_msg
+{
+    uint8_t type;
+    int8_t rssi;
+    uint8_t len;
+    int64_t time;
+    union
+    {
+        uint8_t pdu[BT_MESH_VRADIO_PDU_MAX];
+        struct sim_node_stats stats;
+    };
+};
+
+static struct
+{
+    int nodes;
+    int seconds;
+    uint64_t seed;
+    int area;
+    int loss;
+    int latency;
+    bool collisions;
+    int interval;
+    int payload;
+    int relays;
+    int groups;
+} cfg = {
+    .nodes = 20,
+    .seconds = 20,
+    .seed = 1,
+    .area = 100,
+    .loss = 0,
+    .latency = 1,
+    .collisions = true,
+    .interval = 5000,
+    .payload = MESH_SIM_PAYLOAD_MIN,
+    .relays = 100,
+};
+
+/* splitmix64: small, fast and the same on every host */
+static uint64_t sim_rand(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static uint32_t sim_rand_below(uint64_t *state, uint32_t n)
+{
+    return (uint32_t)(sim_rand(state) % n);
+}
+
+static void sim_send(int fd, const struct sim_msg *msg)
+{
+    if (send(fd, msg, sizeof(*msg), 0) != sizeof(*msg))
+    {
+        perror("mesh_sim send");
+        _exit(1);
+    }
+}
+
+static int sim_recv(int fd, struct sim_msg *msg)
+{
+    return recv(fd, msg, sizeof(*msg), 0) == sizeof(*msg) ? 0 : -EIO;
+}
+
+/*
+ * Node side
+ */
+
+static const u8_t net_key[16] = {
+    0x7d, 0xd7, 0x36, 0x4c, 0xd8, 0x42, 0xad, 0x18,
+    0xc1, 0x7c, 0x2b, 0x82, 0x0c, 0x84, 0xc3, 0xd6,
+};
+
+static const u8_t app_key[16] = {
+    0x63, 0x96, 0x47, 0x71, 0x73, 0x4f, 0xbd, 0x76,
+    0xe3, 0xb4, 0x05, 0x19, 0xd1, 0xd9, 0x4a, 0x48,
+};
+
+static struct
+{
+    int fd;
+    u16_t addr;
+    uint64_t rand;
+    struct sim_node_stats stats;
+} node;
+
+static u8_t dev_key[16];
+static u8_t dev_uuid[16];
+
+static struct bt_mesh_cfg_cli cfg_cli = {};
+
+static void data_recv(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx,
+                      struct net_buf_simple *buf)
+{
+    u32_t latency;
+
+    net_buf_simple_pull_le32(buf);
+    latency = k_uptime_get_32() - net_buf_simple_pull_le32(buf);
+
+    node.stats.app_rx++;
+    node.stats.latency_sum += latency;
+    node.stats.latency_max = max(node.stats.latency_max, latency);
+}
+
+static const struct bt_mesh_model_op vendor_op[] = {
+    {MESH_SIM_OP_DATA, MESH_SIM_PAYLOAD_MIN, data_recv},
+    BT_MESH_MODEL_OP_END,
+};
+
+static struct bt_mesh_model root_models[] = {
+    BT_MESH_MODEL_CFG_SRV(),
+    BT_MESH_MODEL_CFG_CLI(&cfg_cli),
+    BT_MESH_MODEL_HEALTH_SRV(),
+};
+
+static struct bt_mesh_model vnd_models[] = {
+    BT_MESH_MODEL_VND(MESH_SIM_CID, MESH_SIM_MODEL_ID, vendor_op, NULL, NULL),
+};
+
+static struct bt_mesh_elem elements[] = {
+    BT_MESH_ELEM(0, root_models, vnd_models, 0),
+};
+
+static const struct bt_mesh_comp comp = {
+    .cid = MESH_SIM_CID,
+    .elem = elements,
+    .elem_count = ARRAY_SIZE(elements),
+};
+
+static const struct bt_mesh_prov prov = {
+    .uuid = dev_uuid,
+};
+
+/* Hooks the stack normally gets from genie_service. */
+void genie_event(genie_event_e event, void *args)
+{
+}
+
+void genie_mesh_load_group_addr(void)
+{
+}
+
+uint8_t genie_reset_get_hw_reset_flag(void)
+{
+    return 0;
+}
+
+bool genie_transport_tx_in_progress(void)
+{
+    return false;
+}
+
+uint8_t *genie_crypto_get_auth(const uint8_t random[16])
+{
+    static uint8_t auth[16];
+
+    return auth;
+}
+
+static int node_bearer_send(const uint8_t *pdu, size_t len)
+{
+    struct sim_msg msg = {
+        .type = SIM_MSG_TX,
+        .len = len,
+    };
+
+    memcpy(msg.pdu, pdu, len);
+    sim_send(node.fd, &msg);
+    return 0;
+}
+
+static int node_bearer_rand(void *buf, size_t len)
+{
+    uint8_t *p = buf;
+    uint64_t r;
+
+    while (len)
+    {
+        r = sim_rand(&node.rand);
+        memcpy(p, &r, min(len, sizeof(r)));
+        p += min(len, sizeof(r));
+        len -= min(len, sizeof(r));
+    }
+
+    return 0;
+}
+
+static const struct bt_mesh_vradio_bearer node_bearer = {
+    .send = node_bearer_send,
+    .rand = node_bearer_rand,
+};
+
+static void node_report(void)
+{
+    struct sim_msg msg = {
+        .type = SIM_MSG_STATS,
+    };
+
+    bt_mesh_vradio_stats_get(&node.stats.radio);
+    bt_mesh_adv_stats_get(node.stats.adv);
+    bt_mesh_seg_stats_get(&node.stats.seg);
+    bt_mesh_sub_stats_get(&node.stats.sub);
+    msg.stats = node.stats;
+    sim_send(node.fd, &msg);
+}
+
+static int64_t node_idle(int64_t deadline)
+{
+    struct sim_msg msg = {
+        .type = SIM_MSG_IDLE,
+        .time = deadline,
+    };
+
+    sim_send(node.fd, &msg);
+
+    while (!sim_recv(node.fd, &msg))
+    {
+        switch (msg.type)
+        {
+            case SIM_MSG_RX:
+                bt_mesh_vradio_input(msg.pdu, msg.len, msg.rssi);
+                break;
+            case SIM_MSG_RUN:
+                return msg.time;
+            case SIM_MSG_STOP:
+                node_report();
+                _exit(0);
+            default:
+                break;
+        }
+    }
+
+    _exit(1);
+}
+
+static void data_send_end(int err, void *cb_data)
+{
+    if (cfg.payload <= MESH_SIM_PAYLOAD_MIN)
+    {
+        return;
+    }
+
+    if (err)
+    {
+        node.stats.seg_fail++;
+    }
+    else
+    {
+        node.stats.seg_ok++;
+    }
+}
+
+static const struct bt_mesh_send_cb data_send_cb = {
+    .end = data_send_end,
+};
+
+static void data_send(u16_t dst, u32_t counter)
+{
+    struct net_buf_simple *msg = NET_BUF_SIMPLE(3 + MESH_SIM_PAYLOAD_MAX + 4);
+    struct bt_mesh_msg_ctx ctx = {
+        .net_idx = MESH_SIM_NET_IDX,
+        .app_idx = MESH_SIM_APP_IDX,
+        .addr = dst,
+        .send_ttl = BT_MESH_TTL_DEFAULT,
+    };
+
+    bt_mesh_model_msg_init(msg, MESH_SIM_OP_DATA);
+    net_buf_simple_add_le32(msg, counter);
+    net_buf_simple_add_le32(msg, k_uptime_get_32());
+    memset(net_buf_simple_add(msg, cfg.payload - MESH_SIM_PAYLOAD_MIN), 0,
+           cfg.payload - MESH_SIM_PAYLOAD_MIN);
+
+    if (bt_mesh_model_send(&vnd_models[0], &ctx, msg, &data_send_cb, NULL))
+    {
+        node.stats.send_fail++;
+        return;
+    }
+
+    node.stats.app_tx++;
+
+    if (BT_MESH_ADDR_IS_GROUP(dst))
+    {
+        dst -= MESH_SIM_GROUP;
+        node.stats.app_expect += cfg.nodes / cfg.groups +
+                                 (dst < cfg.nodes % cfg.groups);
+    }
+    else
+    {
+        node.stats.app_expect++;
+    }
+}
+
+static void node_main(int id, int fd, bool relay)
+{
+    u32_t counter;
+    u16_t dst;
+    u8_t status;
+    int err;
+
+    node.fd = fd;
+    node.addr = id + 1;
+    node.rand = cfg.seed * 0x100000001b3ULL + id;
+
+    k_os_set_virtual_clock(node_idle);
+    k_os_init();
+
+    err = bt_mesh_vradio_attach(&node_bearer);
+    if (err)
+    {
+        goto fail;
+    }
+
+    bt_rand(dev_key, sizeof(dev_key));
+    bt_rand(dev_uuid, sizeof(dev_uuid));
+
+    err = bt_mesh_init(&prov, &comp);
+    if (err)
+    {
+        goto fail;
+    }
+
+    err = bt_mesh_provision(net_key, MESH_SIM_NET_IDX, 0, 0, 0, node.addr,
+                            dev_key);
+    if (err)
+    {
+        goto fail;
+    }
+
+    if (!relay)
+    {
+        cfg_srv.relay = BT_MESH_RELAY_DISABLED;
+    }
+
+    /* The Configuration Server binds the key to every model. */
+    err = bt_mesh_cfg_app_key_add(MESH_SIM_NET_IDX, node.addr,
+                                  MESH_SIM_NET_IDX, MESH_SIM_APP_IDX,
+                                  app_key, &status);
+    if (err || status)
+    {
+        err = err ? err : -EIO;
+        goto fail;
+    }
+
+    if (cfg.groups)
+    {
+        err = bt_mesh_cfg_mod_sub_add_vnd(MESH_SIM_NET_IDX, node.addr,
+                                          node.addr,
+                                          MESH_SIM_GROUP + id % cfg.groups,
+                                          MESH_SIM_MODEL_ID, MESH_SIM_CID,
+                                          &status);
+        if (err || status)
+        {
+            err = err ? err : -EIO;
+            goto fail;
+        }
+    }
+
+    /* Spread the first messages over one interval, then keep the
+     * interval with +-25% jitter.
+     */
+    k_sleep(sim_rand_below(&node.rand, cfg.interval));
+    for (counter = 0;; counter++)
+    {
+        if (cfg.groups)
+        {
+            data_send(MESH_SIM_GROUP + sim_rand_below(&node.rand, cfg.groups),
+                      counter);
+        }
+        else if (cfg.nodes > 1)
+        {
+            dst = 1 + sim_rand_below(&node.rand, cfg.nodes - 1);
+            data_send(dst >= node.addr ? dst + 1 : dst, counter);
+        }
+
+        k_sleep(cfg.interval * 3 / 4 +
+                sim_rand_below(&node.rand, cfg.interval / 2 + 1));
+    }
+
+fail:
+    fprintf(stderr, "node 0x%04x: start failed (err %d)\n", node.addr, err);
+    _exit(1);
+}
+
+/*
+ * Simulator side
+ */
+
+struct sim_link
+{
+    uint16_t node;
+    int8_t rssi;
+};
+
+struct sim_node
+{
+    pid_t pid;
+    int fd;
+    double x;
+    double y;
+    int64_t deadline;
+    int64_t last_tx;
+    bool run;
+    uint16_t rx_count;
+    struct sim_link *links;
+    int link_count;
+    struct sim_node_stats stats;
+};
+
+struct sim_event
+{
+    int64_t time;
+    uint32_t seq;
+    uint16_t src;
+    uint16_t dst;
+    int8_t rssi;
+    uint8_t len;
+    uint8_t pdu[BT_MESH_VRADIO_PDU_MAX];
+};
+
+static struct
+{
+    struct sim_node *nodes;
+    uint64_t rand;
+    int64_t now;
+
+    /* Pending deliveries, a binary min-heap on (time, seq) */
+    struct sim_event *events;
+    size_t event_count;
+    size_t event_size;
+    uint32_t event_seq;
+
+    uint64_t pdu_tx;
+    uint64_t heard;
+    uint64_t lost;
+    uint64_t collided;
+    uint64_t steps;
+} sim;
+
+static bool event_before(const struct sim_event *a, const struct sim_event *b)
+{
+    return a->time < b->time || (a->time == b->time && a->seq < b->seq);
+}
+
+static void event_push(const struct sim_event *ev)
+{
+    struct sim_event tmp;
+    size_t i, parent;
+
+    if (sim.event_count == sim.event_size)
+    {
+        sim.event_size = sim.event_size ? sim.event_size * 2 : 1024;
+        sim.events = realloc(sim.events, sim.event_size * sizeof(*ev));
+        if (sim.events == NULL)
+        {
+            perror("mesh_sim");
+            exit(1);
+        }
+    }
+
+    i = sim.event_count++;
+    sim.events[i] = *ev;
+    sim.events[i].seq = sim.event_seq++;
+
+    for (; i; i = parent)
+    {
+        parent = (i - 1) / 2;
+        if (!event_before(&sim.events[i], &sim.events[parent]))
+        {
+            break;
+        }
+
+        tmp = sim.events[i];
+        sim.events[i] = sim.events[parent];
+        sim.events[parent] = tmp;
+    }
+}
+
+static void event_pop(struct sim_event *ev)
+{
+    struct sim_event tmp;
+    size_t i = 0, child;
+
+    *ev = sim.events[0];
+    sim.events[0] = sim.events[--sim.event_count];
+
+    while ((child = 2 * i + 1) < sim.event_count)
+    {
+        if (child + 1 < sim.event_count &&
+            event_before(&sim.events[child + 1], &sim.events[child]))
+        {
+            child++;
+        }
+
+        if (!event_before(&sim.events[child], &sim.events[i]))
+        {
+            break;
+        }
+
+        tmp = sim.events[i];
+        sim.events[i] = sim.events[child];
+        sim.events[child] = tmp;
+        i = child;
+    }
+}
+
+static void sim_place(void)
+{
+    struct sim_node *a, *b;
+    double d, rssi;
+    int i, j;
+
+    for (i = 0; i < cfg.nodes; i++)
+    {
+        sim.nodes[i].x = sim_rand_below(&sim.rand, cfg.area * 1000) / 1000.0;
+        sim.nodes[i].y = sim_rand_below(&sim.rand, cfg.area * 1000) / 1000.0;
+    }
+
+    for (i = 0; i < cfg.nodes; i++)
+    {
+        a = &sim.nodes[i];
+        a->links = calloc(cfg.nodes, sizeof(*a->links));
+        if (a->links == NULL)
+        {
+            perror("mesh_sim");
+            exit(1);
+        }
+
+        for (j = 0; j < cfg.nodes; j++)
+        {
+            b = &sim.nodes[j];
+            d = max(1.0, hypot(a->x - b->x, a->y - b->y));
+            rssi = -(MESH_SIM_PL_1M + 10 * MESH_SIM_PL_EXP * log10(d));
+            if (i != j && rssi >= MESH_SIM_SENSITIVITY)
+            {
+                a->links[a->link_count].node = j;
+                a->links[a->link_count].rssi = (int8_t)lround(rssi);
+                a->link_count++;
+            }
+        }
+    }
+}
+
+static void sim_tx(int src, const struct sim_msg *msg)
+{
+    struct sim_node *n = &sim.nodes[src];
+    struct sim_event ev;
+    int i;
+
+    sim.pdu_tx++;
+    n->last_tx = sim.now;
+
+    ev.time = sim.now + cfg.latency;
+    ev.src = src;
+    ev.len = msg->len;
+    memcpy(ev.pdu, msg->pdu, msg->len);
+
+    for (i = 0; i < n->link_count; i++)
+    {
+        sim.heard++;
+        if (cfg.loss && sim_rand_below(&sim.rand, 100) < cfg.loss)
+        {
+            sim.lost++;
+            continue;
+        }
+
+        ev.dst = n->links[i].node;
+        ev.rssi = n->links[i].rssi;
+        event_push(&ev);
+    }
+}
+
+/* Read from every node that ran until it blocks again. */
+static void sim_collect(void)
+{
+    struct sim_node *n;
+    struct sim_msg msg;
+    int i;
+
+    for (i = 0; i < cfg.nodes; i++)
+    {
+        n = &sim.nodes[i];
+        if (!n->run)
+        {
+            continue;
+        }
+
+        while (1)
+        {
+            if (sim_recv(n->fd, &msg))
+            {
+                fprintf(stderr, "node %d died at %lld ms\n", i,
+                        (long long)sim.now);
+                exit(1);
+            }
+
+            if (msg.type == SIM_MSG_TX)
+            {
+                sim_tx(i, &msg);
+            }
+            else if (msg.type == SIM_MSG_IDLE)
+            {
+                n->deadline = msg.time;
+                n->run = false;
+                break;
+            }
+        }
+    }
+}
+
+static int64_t sim_next(void)
+{
+    int64_t next = sim.event_count ? sim.events[0].time : -1;
+    int i;
+
+    for (i = 0; i < cfg.nodes; i++)
+    {
+        if (sim.nodes[i].deadline >= 0 &&
+            (next < 0 || sim.nodes[i].deadline < next))
+        {
+            next = sim.nodes[i].deadline;
+        }
+    }
+
+    return next;
+}
+
+/* Deliver everything due at sim.now and let the nodes concerned run. */
+static void sim_step(void)
+{
+    struct sim_event *due;
+    struct sim_msg msg;
+    size_t count = 0, i;
+    struct sim_node *n;
+
+    due = malloc(max(sim.event_count, (size_t)1) * sizeof(*due));
+    if (due == NULL)
+    {
+        perror("mesh_sim");
+        exit(1);
+    }
+
+    while (sim.event_count && sim.events[0].time == sim.now)
+    {
+        event_pop(&due[count]);
+        sim.nodes[due[count].dst].rx_count++;
+        count++;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        n = &sim.nodes[due[i].dst];
+        if (cfg.collisions &&
+            (n->rx_count > 1 || n->last_tx == sim.now - cfg.latency))
+        {
+            sim.collided++;
+            continue;
+        }
+
+        msg.type = SIM_MSG_RX;
+        msg.rssi = due[i].rssi;
+        msg.len = due[i].len;
+        memcpy(msg.pdu, due[i].pdu, due[i].len);
+        sim_send(n->fd, &msg);
+        n->run = true;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        sim.nodes[due[i].dst].rx_count = 0;
+    }
+    free(due);
+
+    msg.type = SIM_MSG_RUN;
+    msg.time = sim.now;
+    for (i = 0; i < cfg.nodes; i++)
+    {
+        n = &sim.nodes[i];
+        if (n->deadline >= 0 && n->deadline <= sim.now)
+        {
+            n->run = true;
+        }
+
+        if (n->run)
+        {
+            n->deadline = -1;
+            sim_send(n->fd, &msg);
+        }
+    }
+
+    sim.steps++;
+    sim_collect();
+}
+
+static void sim_spawn(void)
+{
+    int fds[2];
+    bool relay;
+    pid_t pid;
+    int i, j;
+
+    for (i = 0; i < cfg.nodes; i++)
+    {
+        relay = sim_rand_below(&sim.rand, 100) < cfg.relays;
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds))
+        {
+            perror("mesh_sim socketpair");
+            exit(1);
+        }
+
+        fflush(NULL);
+        pid = fork();
+        if (pid < 0)
+        {
+            perror("mesh_sim fork");
+            exit(1);
+        }
+
+        if (pid == 0)
+        {
+            for (j = 0; j < i; j++)
+            {
+                close(sim.nodes[j].fd);
+            }
+            close(fds[0]);
+            node_main(i, fds[1], relay);
+        }
+
+        close(fds[1]);
+        sim.nodes[i].pid = pid;
+        sim.nodes[i].fd = fds[0];
+        sim.nodes[i].deadline = -1;
+        sim.nodes[i].last_tx = -1;
+        sim.nodes[i].run = true;
+    }
+
+    /* Let every node boot and self-configure up to its first block. */
+    sim_collect();
+}
+
+static void sim_stop(void)
+{
+    struct sim_msg msg = {
+        .type = SIM_MSG_STOP,
+    };
+    struct sim_node *n;
+    int i;
+
+    for (i = 0; i < cfg.nodes; i++)
+    {
+        sim_send(sim.nodes[i].fd, &msg);
+    }
+
+    for (i = 0; i < cfg.nodes; i++)
+    {
+        n = &sim.nodes[i];
+        while (!sim_recv(n->fd, &msg) && msg.type != SIM_MSG_STATS)
+        {
+        }
+
+        if (msg.type == SIM_MSG_STATS)
+        {
+            n->stats = msg.stats;
+        }
+
+        close(n->fd);
+        waitpid(n->pid, NULL, 0);
+    }
+}
+
+/* Upper bound of the latency slot holding the given share */
+static const char *sim_latency_bound(char *str, const uint32_t *hist,
+                                     int slots, uint32_t total, double share)
+{
+    uint32_t sum = 0;
+    int i;
+
+    for (i = 0; i < slots - 1; i++)
+    {
+        sum += hist[i];
+        if (sum >= share * total)
+        {
+            sprintf(str, "%u", 1U << i);
+            return str;
+        }
+    }
+
+    sprintf(str, "%u+", 1U << (i - 1));
+    return str;
+}
+
+static void sim_report_adv(const struct bt_mesh_adv_stats *adv)
+{
+    static const char *const name[BT_MESH_ADV_PRIO_COUNT] = {
+        "ctl", "local", "beacon", "relay"};
+    char p50[12], p90[12], p99[12];
+    uint32_t first;
+    int prio, i;
+
+    for (prio = 0; prio < BT_MESH_ADV_PRIO_COUNT; prio++)
+    {
+        for (first = 0, i = 0; i < BT_MESH_ADV_LATENCY_HIST; i++)
+        {
+            first += adv[prio].latency_hist[i];
+        }
+
+        printf("adv %s: %u queued, %u late, %u dropped, %u rejected, "
+               "first transmission within %s/%s/%s ms for 50/90/99%%\n",
+               name[prio], (unsigned)adv[prio].queued,
+               (unsigned)adv[prio].late, (unsigned)adv[prio].dropped,
+               (unsigned)adv[prio].rejected,
+               sim_latency_bound(p50, adv[prio].latency_hist,
+                                 BT_MESH_ADV_LATENCY_HIST, first, 0.5),
+               sim_latency_bound(p90, adv[prio].latency_hist,
+                                 BT_MESH_ADV_LATENCY_HIST, first, 0.9),
+               sim_latency_bound(p99, adv[prio].latency_hist,
+                                 BT_MESH_ADV_LATENCY_HIST, first, 0.99));
+    }
+}
+
+static void sim_report(double real_s)
+{
+    struct sim_node_stats total = {};
+    struct sim_node_stats *s;
+    char p50[12], p90[12], p99[12];
+    uint64_t links = 0;
+    uint32_t busiest = 0;
+    int isolated = 0;
+    int i, j, k;
+
+    for (i = 0; i < cfg.nodes; i++)
+    {
+        s = &sim.nodes[i].stats;
+        total.app_tx += s->app_tx;
+        total.app_expect += s->app_expect;
+        total.app_rx += s->app_rx;
+        total.send_fail += s->send_fail;
+        total.seg_ok += s->seg_ok;
+        total.seg_fail += s->seg_fail;
+        total.seg.pool_size = s->seg.pool_size;
+        total.seg.pool_peak = max(total.seg.pool_peak, s->seg.pool_peak);
+        total.seg.pool_rejected += s->seg.pool_rejected;
+        total.seg.rx_complete += s->seg.rx_complete;
+        total.seg.rx_canceled += s->seg.rx_canceled;
+        total.seg.rx_dup_acked += s->seg.rx_dup_acked;
+        total.seg.tx_retransmit += s->seg.tx_retransmit;
+        total.seg.tx_timeouts += s->seg.tx_timeouts;
+        total.seg.tx_ack_resends += s->seg.tx_ack_resends;
+        total.sub.lookups += s->sub.lookups;
+        total.sub.filtered += s->sub.filtered;
+        total.sub.false_pos += s->sub.false_pos;
+        total.sub.skip_group += s->sub.skip_group;
+        total.sub.skip_unicast += s->sub.skip_unicast;
+        total.sub.skip_octets += s->sub.skip_octets;
+        for (j = 0; j < BT_MESH_SEG_LATENCY_HIST; j++)
+        {
+            total.seg.rx_latency_hist[j] += s->seg.rx_latency_hist[j];
+        }
+        total.latency_sum += s->latency_sum;
+        total.latency_max = max(total.latency_max, s->latency_max);
+        total.radio.tx += s->radio.tx;
+        total.radio.rx += s->radio.rx;
+        total.radio.rx_drop += s->radio.rx_drop;
+        for (j = 0; j < BT_MESH_ADV_PRIO_COUNT; j++)
+        {
+            total.adv[j].queued += s->adv[j].queued;
+            total.adv[j].late += s->adv[j].late;
+            total.adv[j].dropped += s->adv[j].dropped;
+            total.adv[j].rejected += s->adv[j].rejected;
+            for (k = 0; k < BT_MESH_ADV_LATENCY_HIST; k++)
+            {
+                total.adv[j].latency_hist[k] += s->adv[j].latency_hist[k];
+            }
+        }
+        busiest = max(busiest, s->radio.tx);
+
+        links += sim.nodes[i].link_count;
+        isolated += !sim.nodes[i].link_count;
+    }
+
+    printf("nodes %d area %dx%d m seed %llu: %d s virtual in %.1f s, "
+           "%llu steps\n",
+           cfg.nodes, cfg.area, cfg.area, (unsigned long long)cfg.seed,
+           cfg.seconds, real_s, (unsigned long long)sim.steps);
+    printf("topology: %.1f neighbours per node, %d isolated\n",
+           cfg.nodes ? (double)links / cfg.nodes : 0.0, isolated);
+    printf("app: sent %u delivered %u (%.1f%%) send errors %u, "
+           "latency avg %.1f ms max %u ms\n",
+           (unsigned)total.app_tx, (unsigned)total.app_rx,
+           total.app_expect ? 100.0 * total.app_rx / total.app_expect : 0.0,
+           (unsigned)total.send_fail,
+           total.app_rx ? (double)total.latency_sum / total.app_rx : 0.0,
+           (unsigned)total.latency_max);
+    if (cfg.payload > MESH_SIM_PAYLOAD_MIN)
+    {
+        printf("segmented: %u acked %u failed (%.1f%% complete), "
+               "rx pool peak %u of %u slots, %u sessions refused\n",
+               (unsigned)total.seg_ok, (unsigned)total.seg_fail,
+               total.seg_ok + total.seg_fail ?
+                   100.0 * total.seg_ok / (total.seg_ok + total.seg_fail) :
+                   0.0,
+               total.seg.pool_peak, total.seg.pool_size,
+               (unsigned)total.seg.pool_rejected);
+        printf("retransmission: %u segments, %u timeouts, %u block ack "
+               "resends\n", (unsigned)total.seg.tx_retransmit,
+               (unsigned)total.seg.tx_timeouts,
+               (unsigned)total.seg.tx_ack_resends);
+        printf("reassembly: %u complete, %u canceled, %u late segments "
+               "acked, within %s/%s/%s ms for 50/90/99%%\n",
+               (unsigned)total.seg.rx_complete,
+               (unsigned)total.seg.rx_canceled,
+               (unsigned)total.seg.rx_dup_acked,
+               sim_latency_bound(p50, total.seg.rx_latency_hist,
+                                 BT_MESH_SEG_LATENCY_HIST,
+                                 total.seg.rx_complete, 0.5),
+               sim_latency_bound(p90, total.seg.rx_latency_hist,
+                                 BT_MESH_SEG_LATENCY_HIST,
+                                 total.seg.rx_complete, 0.9),
+               sim_latency_bound(p99, total.seg.rx_latency_hist,
+                                 BT_MESH_SEG_LATENCY_HIST,
+                                 total.seg.rx_complete, 0.99));
+    }
+    printf("rx filter: %u group lookups, %u filtered, %u false positives; "
+           "not decrypted %u group %u unicast PDUs (%u octets)\n",
+           (unsigned)total.sub.lookups, (unsigned)total.sub.filtered,
+           (unsigned)total.sub.false_pos, (unsigned)total.sub.skip_group,
+           (unsigned)total.sub.skip_unicast, (unsigned)total.sub.skip_octets);
+    printf("radio: %llu PDUs sent (%.1f per app message), %u queued, "
+           "%u dropped on full rx queue\n",
+           (unsigned long long)sim.pdu_tx,
+           total.app_tx ? (double)sim.pdu_tx / total.app_tx : 0.0,
+           (unsigned)total.radio.rx, (unsigned)total.radio.rx_drop);
+    printf("throughput: %.1f PDU/s per node, %.1f PDU/s busiest node\n",
+           cfg.seconds ? (double)sim.pdu_tx / cfg.nodes / cfg.seconds : 0.0,
+           cfg.seconds ? (double)busiest / cfg.seconds : 0.0);
+    sim_report_adv(total.adv);
+    printf("medium: %llu in range, %llu lost, %llu collided\n",
+           (unsigned long long)sim.heard, (unsigned long long)sim.lost,
+           (unsigned long long)sim.collided);
+}
+
+static void usage(const char *name)
+{
+    printf("usage: %s [options]\n"
+           "  -n nodes       number of nodes (%d)\n"
+           "  -t seconds     virtual run time (%d)\n"
+           "  -s seed        random seed (%llu)\n"
+           "  -a metres      side of the square area (%d)\n"
+           "  -l percent     random loss per reception (%d)\n"
+           "  -d ms          delivery latency, at least 1 (%d)\n"
+           "  -c             no collisions\n"
+           "  -i ms          mean interval between messages per node (%d)\n"
+           "  -p bytes       payload size, over %d is segmented (%d)\n"
+           "  -r percent     share of nodes that relay (%d)\n"
+           "  -g groups      send to this many groups instead of nodes (%d)\n",
+           name, cfg.nodes, cfg.seconds, (unsigned long long)cfg.seed,
+           cfg.area, cfg.loss, cfg.latency, cfg.interval, MESH_SIM_PAYLOAD_MIN,
+           cfg.payload, cfg.relays, cfg.groups);
+}
+
+int main(int argc, char *argv[])
+{
+    struct timespec start, end;
+    struct rlimit nofile;
+    int64_t next;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:t:s:a:l:d:ci:p:r:g:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n':
+                cfg.nodes = atoi(optarg);
+                break;
+            case 't':
+                cfg.seconds = atoi(optarg);
+                break;
+            case 's':
+                cfg.seed = strtoull(optarg, NULL, 0);
+                break;
+            case 'a':
+                cfg.area = atoi(optarg);
+                break;
+            case 'l':
+                cfg.loss = atoi(optarg);
+                break;
+            case 'd':
+                cfg.latency = atoi(optarg);
+                break;
+            case 'c':
+                cfg.collisions = false;
+                break;
+            case 'i':
+                cfg.interval = atoi(optarg);
+                break;
+            case 'p':
+                cfg.payload = atoi(optarg);
+                break;
+            case 'r':
+                cfg.relays = atoi(optarg);
+                break;
+            case 'g':
+                cfg.groups = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (cfg.nodes < 1 || cfg.nodes > 0x7fff || cfg.area < 1 ||
+        cfg.latency < 1 || cfg.interval < 1 || cfg.groups < 0 ||
+        cfg.groups > 0x3f00 ||
+        cfg.payload < MESH_SIM_PAYLOAD_MIN ||
+        cfg.payload > MESH_SIM_PAYLOAD_MAX)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* One socket per node */
+    if (!getrlimit(RLIMIT_NOFILE, &nofile))
+    {
+        nofile.rlim_cur = nofile.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &nofile);
+    }
+
+    sim.rand = cfg.seed;
+    sim.nodes = calloc(cfg.nodes, sizeof(*sim.nodes));
+    if (sim.nodes == NULL)
+    {
+        perror("mesh_sim");
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    sim_place();
+    sim_spawn();
+
+    while ((next = sim_next()) >= 0 && next <= cfg.seconds * 1000LL)
+    {
+        sim.now = next;
+        sim_step();
+    }
+
+    sim_stop();
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    sim_report((end.tv_sec - start.tv_sec) +
+               (end.tv_nsec - start.tv_nsec) / 1e9);
+
+    return 0;
+}
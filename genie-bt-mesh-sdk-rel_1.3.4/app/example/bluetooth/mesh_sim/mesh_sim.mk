@@ -0,0 +1,21 @@
+NAME := mesh_sim
+
+# Host only: build_host.sh compiles this example with the host gcc and
+# takes GLOBAL_DEFINES from this file. It is not an aos build target.
+
+$(NAME)_SOURCES  := mesh_sim.c
+
+# Mesh function select
+GLOBAL_DEFINES += CONFIG_BT_MESH
+GLOBAL_DEFINES += CONFIG_BT_MESH_PROV
+GLOBAL_DEFINES += CONFIG_BT_MESH_PB_ADV
+GLOBAL_DEFINES += CONFIG_BT_MESH_RELAY
+#GLOBAL_DEFINES += CONFIG_BT_MESH_FRIEND
+
+# Mesh foundation model select
+GLOBAL_DEFINES += CONFIG_BT_MESH_CFG_SRV
+GLOBAL_DEFINES += CONFIG_BT_MESH_CFG_CLI
+GLOBAL_DEFINES += CONFIG_BT_MESH_HEALTH_SRV
+
+#Print stack errors and warnings
+#GLOBAL_DEFINES += USE_BT_MESH_CUSTOM_ERR_LOG
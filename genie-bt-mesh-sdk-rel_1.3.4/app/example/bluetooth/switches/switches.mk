@@ -61,7 +61,6 @@ GLOBAL_DEFINES += CONFIG_AIS_TOTAL_FRAME=6
 GLOBAL_DEFINES += CONFIG_BT_RX_BUF_COUNT=4
 
 #Config for low power +++++
-GLOBAL_DEFINES += GENIE_DEFAULT_DURATION=205
 GLOBAL_DEFINES += CONFIG_ADV_SCAN_INTERVAL_TIMER=1
 GLOBAL_DEFINES += CONFIG_ADV_INTERVAL_TIMER=20
 #GLOBAL_DEFINES += CONFIG_SCAN_DURATION_AFTER_GENIE_MODEL_SEND=300
@@ -41,6 +41,7 @@ typedef enum
     GENIE_EVT_SDK_CTRL_RELAY_SET,
 #endif
     GENIE_EVT_SDK_SEQ_UPDATE,
+    GENIE_EVT_SDK_RPL_UPDATE,
 
     GENIE_EVT_TIMEOUT = 50,
     GENIE_EVT_DOWN_MSG,
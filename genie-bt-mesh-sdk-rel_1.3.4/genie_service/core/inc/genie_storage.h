@@ -8,6 +8,13 @@
 #define GENIE_KV_SEQ_KEY "seq"
 #define GENIE_SEQ_MAGIC_NUMBER (0xA8)
 #define GENIE_SEQ_SAVE_INTERVAL (100)
+#define GENIE_KV_RPL_KEY "rpl"
+
+#ifndef CONFIG_GENIE_STORAGE_CACHE_COUNT
+#define CONFIG_GENIE_STORAGE_CACHE_COUNT 8
+#endif
+#define GENIE_STORAGE_CACHE_RECORD_MAX (32) //reliable records up to this size are cached, multiple of 16
+#define GENIE_STORAGE_FLUSH_DELAY (1000)    //unit ms, idle time before dirty records go to flash
 
 enum
 {
@@ -116,6 +123,15 @@ genie_storage_status_e genie_storage_write_reliable(uint16_t index, uint8_t *p_b
  */
 genie_storage_status_e genie_storage_delete_reliable(uint16_t index);
 
+/**
+ * @brief write every cached reliable record that is not on flash yet.
+ *        genie_storage_write_reliable() only updates the RAM cache and the
+ *        flush runs after GENIE_STORAGE_FLUSH_DELAY of idle, call this where
+ *        the data must survive a reset, e.g. after keys or before sleep.
+ * @return the status of the first failed write, 0 means successed.
+ */
+genie_storage_status_e genie_storage_flush(void);
+
 /**
  * @brief read the user raw date from flash
  * @param[in] index refers to the flash partition to be read.
@@ -278,6 +294,36 @@ genie_storage_status_e genie_storage_read_seq(uint32_t *p_seq);
  */
 genie_storage_status_e genie_storage_delete_seq(void);
 
+/**
+ * @brief start a batch of replay protection list entries, the entries
+ *        saved until genie_storage_rpl_commit() are written together
+ * @return the status of operation, 0 means successed.
+ */
+genie_storage_status_e genie_storage_rpl_begin(void);
+
+/**
+ * @brief write the batch of replay protection list entries to flash
+ * @return the status of operation, 0 means successed.
+ */
+genie_storage_status_e genie_storage_rpl_commit(void);
+
+/**
+ * @brief save one replay protection list entry to flash, an entry
+ *        without source address deletes the saved one
+ * @param[in] slot: index of the entry in the replay protection list
+ * @param[in] p_rpl: the entry
+ * @return the status of operation, 0 means successed.
+ */
+genie_storage_status_e genie_storage_write_rpl(uint16_t slot, const struct bt_mesh_rpl *p_rpl);
+
+/**
+ * @brief read one replay protection list entry from flash
+ * @param[in] slot: index of the entry in the replay protection list
+ * @param[out] p_rpl: the entry
+ * @return the status of operation, 0 means successed.
+ */
+genie_storage_status_e genie_storage_read_rpl(uint16_t slot, struct bt_mesh_rpl *p_rpl);
+
 /**
  * @brief erase everyting on flash except the trituple info
  * @return the status of operation, 0 means successed.
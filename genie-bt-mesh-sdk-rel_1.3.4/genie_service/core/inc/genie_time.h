@@ -5,9 +5,6 @@
 #ifndef __GENIE_TIME_H__
 #define __GENIE_TIME_H__
 
-#define GENIE_TIME_HW_TEIMER_ID (0)
-#define GENIE_TIME_HW_TEIMER_PERIOD (1000 * 1000)
-
 #define DEF_SYNC_PERIOD 180
 #define DEF_SYNC_DELAY 10
 #define DEF_SYNC_DELAY_RETRY 10
@@ -23,6 +20,12 @@
 
 #define GENIE_TIME_MAX (40)
 
+//longest sleep between two wakeups of the time scheduler, in seconds
+#define GENIE_TIME_WAKEUP_MAX (30 * MINU)
+
+//timers overdue by more than this when the clock catches up are skipped, in seconds
+#define GENIE_TIME_OVERDUE_MAX (5 * MINU)
+
 typedef int (*genie_time_event_func_t)(uint8_t event, uint8_t index, vendor_attr_data_t *data);
 
 typedef enum
@@ -63,14 +66,17 @@ typedef struct _genie_time_timer_s
 {
     uint8_t init : 1;
     uint8_t update : 1;
-    timer_dev_t timer;
-    sys_slist_t timer_list_active;
+    sys_slist_t timer_list_active; //ordered by unixtime_match, soonest first
     sys_slist_t timer_list_idle;
-    uint32_t unix_time;
+    uint32_t unix_time;   //UTC pushed by the last time update
+    int64_t uptime_base; //k_uptime_get() when unix_time was pushed
     uint32_t unix_time_sync_match;
     uint8_t unix_time_sync_retry_times;
     genie_time_event_func_t genie_time_event_cb;
+    //kernel objects below are created once and outlive genie_time_finalize
+    uint8_t created;
     struct k_work work;
+    k_timer_t timer;
     struct k_sem lock;
 } genie_time_timer_t;
 
@@ -106,4 +112,9 @@ int genie_time_init(void);
 int genie_time_finalize(void);
 int genie_time_handle_model_mesg(genie_transport_model_param_t *p_msg);
 
+//UTC now, 0 until the first time update
+uint32_t genie_time_local_unixtime_get(void);
+//local calendar time now, all zero until the first time update
+utc_time_t genie_time_local_time_get(void);
+
 #endif
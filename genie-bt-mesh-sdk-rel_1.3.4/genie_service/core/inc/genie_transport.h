@@ -25,6 +25,10 @@
 #define CONFIG_VENDOR_SEND_MSG_MAX 8
 #endif
 
+//8 segments less opcode, tid and TransMIC
+#define GENIE_TRANSPORT_PAYLOAD_MAX (8 * GENIE_TRANSPORT_EACH_PDU_SIZE - 8)
+#define GENIE_TRANSPORT_TID_INDEX_SIZE (16) //power of 2
+
 typedef struct _genie_transport_tid_queue_s
 {
     uint8_t tid;
@@ -80,14 +84,33 @@ typedef struct _genie_transport_model_param_s
     uint8_t *data;
 } genie_transport_model_param_t;
 
+/**
+ * Nodes come from a pool of CONFIG_VENDOR_SEND_MSG_MAX and hold the payload
+ * inline, msg.data points at payload. A node goes back to the pool when its
+ * last reference is dropped.
+ * */
 typedef struct _genie_transport_node_s
 {
-    sys_dnode_t node;
+    sys_snode_t next; //free pool
+    struct _genie_transport_node_s *tid_next;
+    uint8_t ref;
+    uint8_t heap_index;
     uint8_t left_retry;
     long long timeout;
     genie_transport_model_param_t msg;
+    uint8_t payload[GENIE_TRANSPORT_PAYLOAD_MAX];
 } genie_transport_node_t;
 
+typedef struct _genie_transport_stats_s
+{
+    uint32_t sent;       //first transmissions
+    uint32_t retransmit; //retransmissions
+    uint32_t acked;
+    uint32_t timeout;    //messages dropped with no retry left
+    uint32_t alloc_fail; //pool exhausted or payload too long
+    uint8_t peak;        //most nodes waiting for ack at once
+} genie_transport_stats_t;
+
 typedef struct _genie_transport_payload_s
 {
     uint8_t element_id;
@@ -138,6 +161,10 @@ bool genie_transport_tx_in_progress(void);
  */
 int genie_transport_ack(uint8_t tid);
 
+void genie_transport_stats_get(genie_transport_stats_t *p_stats);
+
+void genie_transport_stats_reset(void);
+
 void genie_transport_init(void);
 
 #endif
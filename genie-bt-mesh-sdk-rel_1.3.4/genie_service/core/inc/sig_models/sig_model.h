@@ -35,14 +35,24 @@ typedef struct
 #endif
 
     u8_t delay; //unit:5ms
-    struct k_timer delay_timer;
+    struct k_delayed_work delay_work; //runs in the BLE task, as mesh RX does
 #ifdef CONFIG_MESH_MODEL_TRANS
     u8_t trans; //unit:100ms
 
+    u8_t trans_ease; //sig_model_trans_ease_e
+
     u32_t trans_start_time;
     u32_t trans_end_time;
 
-    struct k_timer trans_timer;
+    sys_snode_t trans_node; //linked on the transition engine while running
+    u32_t trans_rate;       //Q16.16 progress per ms
+    u32_t trans_tick;       //ms between two steps
+#ifdef CONFIG_MESH_MODEL_LIGHTNESS_SRV
+    u16_t trans_lightness; //lightness when the transition started
+#endif
+#ifdef CONFIG_MESH_MODEL_CTL_SRV
+    u16_t trans_color_temperature;
+#endif
 #endif
 } sig_model_state_t;
 
@@ -1,7 +1,9 @@
 #ifndef __SIG_MODEL_TRANSITION_H__
 #define __SIG_MODEL_TRANSITION_H__
 
-#define SIG_MODEL_TRANSITION_INTERVAL 20
+#include "sig_model_transition_curve.h"
+
+#define SIG_MODEL_TRANSITION_INTERVAL 20 //Unit:ms, shortest step of the transition engine
 
 #define TRANSITION_TIME_UNIT_1 (100)            //Unit:ms
 #define TRANSITION_TIME_UNIT_2 (1000)           //Unit:ms
@@ -16,11 +18,16 @@
 #define TRANSITION_TIME_VALUE_MASK (0x3F)
 
 #define TRANSITION_DEFAULT_VALUE (0x41)
+#ifndef TRANSITION_DEFAULT_EASE
+#define TRANSITION_DEFAULT_EASE SIG_MODEL_TRANS_EASE_LINEAR //sig_model_trans_ease_e, may be overridden by the app
+#endif
 #define DELAY_DEFAULT_VAULE (100)
 #define DELAY_TIME_UNIT (5)
 
 void sig_model_transition_timer_stop(sig_model_element_state_t *p_elem);
 
+uint8_t sig_model_transition_start(sig_model_element_state_t *p_elem);
+
 u32_t sig_model_transition_get_transition_time(uint8_t byte);
 
 uint8_t sig_model_transition_get_remain_time_byte(sig_model_state_t *p_state, bool is_ack);
@@ -0,0 +1,80 @@
+#ifndef __SIG_MODEL_TRANSITION_CURVE_H__
+#define __SIG_MODEL_TRANSITION_CURVE_H__
+
+#include <stdint.h>
+
+/* Transition progress is a Q16 fraction: 0 at the start, SIG_MODEL_TRANS_Q16_ONE
+ * at the end. Only integer math is used so the last step lands exactly on the
+ * target value.
+ */
+#define SIG_MODEL_TRANS_Q16_SHIFT 16
+#define SIG_MODEL_TRANS_Q16_ONE (1UL << SIG_MODEL_TRANS_Q16_SHIFT)
+
+typedef enum
+{
+    SIG_MODEL_TRANS_EASE_LINEAR = 0,
+    SIG_MODEL_TRANS_EASE_IN,     //slow start, p^2
+    SIG_MODEL_TRANS_EASE_OUT,    //slow end, 1-(1-p)^2
+    SIG_MODEL_TRANS_EASE_IN_OUT, //smoothstep, p^2*(3-2p)
+    SIG_MODEL_TRANS_EASE_NUM,
+} sig_model_trans_ease_e;
+
+//progress per ms in Q16.16, computed once when the transition starts
+static inline uint32_t sig_model_trans_rate(uint32_t duration)
+{
+    if (duration <= 1)
+    {
+        return UINT32_MAX;
+    }
+
+    return (uint32_t)(((uint64_t)1 << 32) / duration);
+}
+
+static inline uint32_t sig_model_trans_progress(uint32_t rate, uint32_t elapsed, uint32_t duration)
+{
+    uint64_t progress;
+
+    if (elapsed >= duration)
+    {
+        return SIG_MODEL_TRANS_Q16_ONE;
+    }
+
+    progress = ((uint64_t)elapsed * rate) >> SIG_MODEL_TRANS_Q16_SHIFT;
+
+    return progress < SIG_MODEL_TRANS_Q16_ONE ? (uint32_t)progress : SIG_MODEL_TRANS_Q16_ONE;
+}
+
+//maps progress onto the curve, ease(0) == 0 and ease(ONE) == ONE for every curve
+static inline uint32_t sig_model_trans_ease(uint32_t progress, uint8_t ease)
+{
+    uint32_t square;
+    uint32_t rest;
+
+    switch (ease)
+    {
+    case SIG_MODEL_TRANS_EASE_IN:
+        return (uint32_t)(((uint64_t)progress * progress) >> SIG_MODEL_TRANS_Q16_SHIFT);
+    case SIG_MODEL_TRANS_EASE_OUT:
+        rest = SIG_MODEL_TRANS_Q16_ONE - progress;
+        return SIG_MODEL_TRANS_Q16_ONE - (uint32_t)(((uint64_t)rest * rest) >> SIG_MODEL_TRANS_Q16_SHIFT);
+    case SIG_MODEL_TRANS_EASE_IN_OUT:
+        square = (uint32_t)(((uint64_t)progress * progress) >> SIG_MODEL_TRANS_Q16_SHIFT);
+        return (uint32_t)(((uint64_t)square * (3 * SIG_MODEL_TRANS_Q16_ONE - 2 * progress)) >> SIG_MODEL_TRANS_Q16_SHIFT);
+    default:
+        return progress;
+    }
+}
+
+static inline uint16_t sig_model_trans_value(uint16_t start, uint16_t target, uint32_t progress)
+{
+    int32_t delta = (int32_t)target - (int32_t)start;
+
+    if (progress >= SIG_MODEL_TRANS_Q16_ONE)
+    {
+        return target;
+    }
+
+    return (uint16_t)(start + (int32_t)(((int64_t)delta * progress) >> SIG_MODEL_TRANS_Q16_SHIFT));
+}
+
+#endif
@@ -222,6 +222,7 @@ static void sn_number_handle(char *pwbuf, int blen, int argc, char **argv)
 
 static void _reboot_handle(char *pwbuf, int blen, int argc, char **argv)
 {
+    genie_storage_flush();
     aos_reboot();
 }
 
@@ -254,6 +255,21 @@ static void _get_mm_info(char *pwbuf, int blen, int argc, char **argv)
 #endif
 }
 
+static void _transport_stats(char *pwbuf, int blen, int argc, char **argv)
+{
+    genie_transport_stats_t stats;
+
+    if (argc == 2 && !strncmp(argv[1], "reset", 5))
+    {
+        genie_transport_stats_reset();
+        return;
+    }
+
+    genie_transport_stats_get(&stats);
+    printf("sent:%u retx:%u acked:%u timeout:%u alloc_fail:%u peak:%u\r\n", (unsigned int)stats.sent, (unsigned int)stats.retransmit,
+           (unsigned int)stats.acked, (unsigned int)stats.timeout, (unsigned int)stats.alloc_fail, stats.peak);
+}
+
 static uint8_t retry_mode = 0;
 static uint8_t *p_payload = NULL;
 static genie_transport_payload_param_t *p_transport_payload_param = NULL;
@@ -523,6 +539,7 @@ static const struct cli_command genie_cmds[] = {
 /*[Genie end] add by wenbing.cwb at 2021-04-29*/
     {"get_info", "get sw info", _get_sw_info},
     {"mm_info", "get mm info", _get_mm_info},
+    {"tx_stats", "tx_stats [reset]", _transport_stats},
     {"mesg", "mesg d4 1 f000 010203", _send_msg},
 };
 
@@ -146,6 +146,7 @@ static genie_event_e _genie_event_handle_appkey_add(uint8_t *p_status)
             genie_storage_write_devkey(devkey);
             genie_storage_write_netkey(&netkey);
             genie_storage_write_appkey(0, &appkey);
+            genie_storage_flush(); //keys must be on flash before reporting success
 #endif
             genie_provision_set_state(GENIE_PROVISION_SUCCESS);
 
@@ -172,7 +173,7 @@ static genie_event_e _genie_event_handle_appkey1_add(uint8_t *p_status)
         appkey.key_index = 1;
         memcpy(appkey.key, bt_mesh.app_keys[1].keys[0].val, 16);
 
-        if (GENIE_STORAGE_SUCCESS == genie_storage_write_appkey(1, &appkey))
+        if (GENIE_STORAGE_SUCCESS == genie_storage_write_appkey(1, &appkey) && GENIE_STORAGE_SUCCESS == genie_storage_flush())
         {
             bt_mesh_model_set_appkey_id(appkey.key_index);
         }
@@ -227,6 +228,38 @@ static genie_event_e _genie_event_handle_seq_update(void)
     return GENIE_EVT_NONE;
 }
 
+#ifndef CONFIG_BT_SETTINGS
+static int _genie_event_begin_rpl(void)
+{
+    return genie_storage_rpl_begin() == GENIE_STORAGE_SUCCESS ? 0 : -1;
+}
+
+static void _genie_event_store_rpl(u16_t slot, const struct bt_mesh_rpl *rpl)
+{
+    genie_storage_write_rpl(slot, rpl);
+}
+
+static int _genie_event_commit_rpl(void)
+{
+    return genie_storage_rpl_commit() == GENIE_STORAGE_SUCCESS ? 0 : -1;
+}
+
+//all RPL changes of one pass go to flash as one kv batch
+static const struct bt_mesh_rpl_store_cb genie_rpl_store_cb = {
+    .begin = _genie_event_begin_rpl,
+    .store = _genie_event_store_rpl,
+    .commit = _genie_event_commit_rpl,
+};
+#endif
+
+static genie_event_e _genie_event_handle_rpl_update(void)
+{
+#ifndef CONFIG_BT_SETTINGS
+    bt_mesh_rpl_store_pending(&genie_rpl_store_cb);
+#endif
+    return GENIE_EVT_NONE;
+}
+
 static genie_event_e _genie_event_handle_ais_discon(void)
 {
     if (0 == bt_mesh_prov_enable(BT_MESH_PROV_GATT | BT_MESH_PROV_ADV))
@@ -386,7 +419,7 @@ void genie_event(genie_event_e event, void *p_arg)
         return;
     }
 
-    if ((event != GENIE_EVT_SDK_SEQ_UPDATE) && (event != GENIE_EVT_USER_TRANS_CYCLE))
+    if ((event != GENIE_EVT_SDK_SEQ_UPDATE) && (event != GENIE_EVT_SDK_RPL_UPDATE) && (event != GENIE_EVT_USER_TRANS_CYCLE))
     {
         GENIE_LOG_INFO("GenieE:%d", event);
     }
@@ -506,6 +539,7 @@ void genie_event(genie_event_e event, void *p_arg)
         {
             netkey.ivi = *(uint32_t *)p_arg;
             genie_storage_write_netkey(&netkey);
+            genie_storage_flush();
         }
         next_event = GENIE_EVT_NONE;
     }
@@ -538,6 +572,11 @@ void genie_event(genie_event_e event, void *p_arg)
         next_event = _genie_event_handle_seq_update();
     }
     break;
+    case GENIE_EVT_SDK_RPL_UPDATE:
+    {
+        next_event = _genie_event_handle_rpl_update();
+    }
+    break;
     case GENIE_EVT_VENDOR_MODEL_MSG:
     {
         next_event = _genie_event_handle_vnd_msg((genie_transport_model_param_t *)p_arg);
@@ -382,6 +382,7 @@ int genie_lpm_enable(bool force)
     if (0 == ret || -EALREADY == ret)
     {
         genie_lpm_ctx.has_disabled = 0;
+        genie_storage_flush();
         genie_sal_sleep_enable();
         genie_lpm_ctx.status = STATUS_SLEEP;
 
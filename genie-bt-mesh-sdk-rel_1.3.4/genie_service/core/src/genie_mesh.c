@@ -250,6 +250,8 @@ int genie_mesh_init(struct bt_mesh_elem *p_mesh_elem, unsigned int mesh_elem_cou
 int genie_mesh_start(genie_provision_t *p_genie_provision)
 {
     mesh_appkey_para_t appkey1;
+    struct bt_mesh_rpl rpl;
+    uint16_t i;
 
     bt_mesh_provision(p_genie_provision->netkey.key, p_genie_provision->netkey.net_index, p_genie_provision->netkey.flag, p_genie_provision->netkey.ivi, p_genie_provision->seq, p_genie_provision->addr, p_genie_provision->devkey);
     genie_appkey_register(p_genie_provision->appkey.net_index, p_genie_provision->appkey.key_index, p_genie_provision->appkey.key, p_genie_provision->appkey.flag);
@@ -261,6 +263,14 @@ int genie_mesh_start(genie_provision_t *p_genie_provision)
         bt_mesh_model_set_appkey_id(appkey1.key_index);
     }
 
+    for (i = 0; i < CONFIG_BT_MESH_CRPL; i++)
+    {
+        if (genie_storage_read_rpl(i, &rpl) == GENIE_STORAGE_SUCCESS)
+        {
+            bt_mesh_rpl_restore(i, &rpl);
+        }
+    }
+
     return 0;
 }
 
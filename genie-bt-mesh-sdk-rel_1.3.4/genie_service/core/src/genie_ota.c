@@ -77,6 +77,7 @@ static void _ais_set_ota_change(void)
 
     BT_DBG("switch to %d", ota_image_id & 0xFF);
     genie_storage_write_reliable(GFI_OTA_IMAGE_ID, (uint8_t *)&ota_image_id, sizeof(ota_image_id));
+    genie_storage_flush();
 #endif
 
     genie_ota_ctx.ota_ready = 1;
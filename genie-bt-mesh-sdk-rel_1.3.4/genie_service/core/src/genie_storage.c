@@ -9,6 +9,28 @@ static uint8_t g_enc_key[16] = {
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
 
+/**
+ * Write-back cache of decrypted reliable records. A write only updates the
+ * slot and marks it dirty, storage_flush_work writes all dirty slots once
+ * the writes have been idle for GENIE_STORAGE_FLUSH_DELAY. It runs in the
+ * BLE task, never in the timer task, as the flush encrypts, allocates and
+ * may wait for the KV garbage collection.
+ * */
+typedef struct
+{
+    uint16_t index; //GENIE_STORAGE_INDEX_START means the slot is free
+    uint8_t size;   //record size on flash, multiple of 16
+    uint8_t dirty;
+    uint32_t stamp; //last use, the oldest slot is reused first
+    uint8_t data[GENIE_STORAGE_CACHE_RECORD_MAX];
+} genie_storage_cache_t;
+
+static genie_storage_cache_t storage_cache[CONFIG_GENIE_STORAGE_CACHE_COUNT];
+static uint32_t storage_cache_clock;
+static struct k_delayed_work storage_flush_work;
+static aos_mutex_t storage_mutex;
+static uint8_t storage_rpl_txn; //set while the RPL entries are staged in a kv batch
+
 static genie_storage_status_e _genie_storage_encrypt(uint8_t *p_buff, uint16_t size)
 {
     uint8_t data_temp[16];
@@ -55,6 +77,11 @@ static void _ginie_flash_get_enc_key(uint8_t project_key[16])
 }
 #endif
 
+static void _genie_storage_flush_work_handler(struct k_work *p_work)
+{
+    genie_storage_flush();
+}
+
 genie_storage_status_e genie_storage_init(void)
 {
     static uint8_t flash_already_inited = 0;
@@ -67,6 +94,10 @@ genie_storage_status_e genie_storage_init(void)
 
     flash_already_inited = 1;
 
+    memset(storage_cache, 0, sizeof(storage_cache));
+    aos_mutex_new(&storage_mutex);
+    k_delayed_work_init(&storage_flush_work, _genie_storage_flush_work_handler);
+
 #ifdef PROJECT_SECRET_KEY
     char key_char[] = PROJECT_SECRET_KEY;
     uint8_t prj_key[16];
@@ -148,6 +179,279 @@ static uint16_t _genie_storage_get_reliable_size(uint16_t data_size)
     }
 }
 
+static bool _genie_storage_cacheable(uint16_t index, uint16_t data_size)
+{
+    return index != GFI_MESH_TRITUPLE && _genie_storage_get_reliable_size(data_size) <= GENIE_STORAGE_CACHE_RECORD_MAX;
+}
+
+static genie_storage_cache_t *_genie_storage_cache_find(uint16_t index)
+{
+    uint8_t i = 0;
+
+    for (i = 0; i < CONFIG_GENIE_STORAGE_CACHE_COUNT; i++)
+    {
+        if (storage_cache[i].index == index)
+        {
+            storage_cache[i].stamp = ++storage_cache_clock;
+            return &storage_cache[i];
+        }
+    }
+
+    return NULL;
+}
+
+static genie_storage_status_e _genie_storage_cache_writeback(genie_storage_cache_t *p_cache)
+{
+    genie_storage_status_e ret = GENIE_STORAGE_SUCCESS;
+    uint8_t buff[GENIE_STORAGE_CACHE_RECORD_MAX];
+
+    memcpy(buff, p_cache->data, p_cache->size);
+    _genie_storage_encrypt(buff, p_cache->size);
+
+    ret = _genie_storage_write(p_cache->index, buff, p_cache->size);
+    if (ret == GENIE_STORAGE_SUCCESS)
+    {
+        p_cache->dirty = 0;
+    }
+    else
+    {
+        GENIE_LOG_ERR("flush index(%d) failed(%d)", p_cache->index, ret);
+    }
+
+    return ret;
+}
+
+//writes every dirty slot in one kv batch, so a power cut keeps all of them or none
+static genie_storage_status_e _genie_storage_cache_commit(void)
+{
+    uint8_t i = 0;
+    char key[10] = {0};
+    uint8_t buff[GENIE_STORAGE_CACHE_RECORD_MAX];
+
+    //opening a batch costs a buffer and the kv lock, skip it when nothing is dirty
+    for (i = 0; i < CONFIG_GENIE_STORAGE_CACHE_COUNT; i++)
+    {
+        if (storage_cache[i].index != GENIE_STORAGE_INDEX_START && storage_cache[i].dirty)
+        {
+            break;
+        }
+    }
+
+    if (i == CONFIG_GENIE_STORAGE_CACHE_COUNT)
+    {
+        return GENIE_STORAGE_SUCCESS;
+    }
+
+    if (aos_kv_txn_begin() != 0)
+    {
+        return GENIE_STORAGE_WRITE_FAIL;
+    }
+
+    for (i = 0; i < CONFIG_GENIE_STORAGE_CACHE_COUNT; i++)
+    {
+        if (storage_cache[i].index == GENIE_STORAGE_INDEX_START || !storage_cache[i].dirty)
+        {
+            continue;
+        }
+
+        memcpy(buff, storage_cache[i].data, storage_cache[i].size);
+        _genie_storage_encrypt(buff, storage_cache[i].size);
+
+        snprintf(key, sizeof(key), "%s_%d", "key", storage_cache[i].index);
+        if (aos_kv_txn_set(key, buff, (int)storage_cache[i].size) != 0)
+        {
+            aos_kv_txn_abort();
+            return GENIE_STORAGE_WRITE_FAIL;
+        }
+    }
+
+    if (aos_kv_txn_commit() != 0)
+    {
+        return GENIE_STORAGE_WRITE_FAIL;
+    }
+
+    for (i = 0; i < CONFIG_GENIE_STORAGE_CACHE_COUNT; i++)
+    {
+        storage_cache[i].dirty = 0;
+    }
+
+    return GENIE_STORAGE_SUCCESS;
+}
+
+//free slot first, then the oldest clean one, then write back the oldest dirty one
+static genie_storage_cache_t *_genie_storage_cache_alloc(uint16_t index)
+{
+    genie_storage_cache_t *p_clean = NULL;
+    genie_storage_cache_t *p_dirty = NULL;
+    genie_storage_cache_t *p_cache = NULL;
+    uint8_t i = 0;
+
+    for (i = 0; i < CONFIG_GENIE_STORAGE_CACHE_COUNT; i++)
+    {
+        p_cache = &storage_cache[i];
+        if (p_cache->index == GENIE_STORAGE_INDEX_START)
+        {
+            break;
+        }
+
+        if (p_cache->dirty)
+        {
+            p_dirty = (!p_dirty || p_cache->stamp < p_dirty->stamp) ? p_cache : p_dirty;
+        }
+        else
+        {
+            p_clean = (!p_clean || p_cache->stamp < p_clean->stamp) ? p_cache : p_clean;
+        }
+    }
+
+    if (i == CONFIG_GENIE_STORAGE_CACHE_COUNT)
+    {
+        p_cache = p_clean;
+        if (!p_cache)
+        {
+            p_cache = p_dirty;
+            if (_genie_storage_cache_writeback(p_cache) != GENIE_STORAGE_SUCCESS)
+            {
+                return NULL;
+            }
+        }
+    }
+
+    memset(p_cache, 0, sizeof(genie_storage_cache_t));
+    p_cache->index = index;
+    p_cache->stamp = ++storage_cache_clock;
+
+    return p_cache;
+}
+
+static genie_storage_status_e _genie_storage_cache_read(uint16_t index, uint8_t *p_data, uint16_t data_size)
+{
+    genie_storage_status_e ret = GENIE_STORAGE_READ_FAIL;
+    genie_storage_cache_t *p_cache = NULL;
+
+    aos_mutex_lock(&storage_mutex, AOS_WAIT_FOREVER);
+    p_cache = _genie_storage_cache_find(index);
+    if (p_cache && p_cache->size == _genie_storage_get_reliable_size(data_size))
+    {
+        memcpy(p_data, p_cache->data, data_size);
+        ret = GENIE_STORAGE_SUCCESS;
+    }
+    else if (p_cache)
+    {
+        //read with another size, go to flash like before the cache
+        if (!p_cache->dirty || _genie_storage_cache_writeback(p_cache) == GENIE_STORAGE_SUCCESS)
+        {
+            p_cache->index = GENIE_STORAGE_INDEX_START;
+        }
+    }
+    aos_mutex_unlock(&storage_mutex);
+
+    return ret;
+}
+
+static void _genie_storage_cache_fill(uint16_t index, uint8_t *p_buff, uint16_t buff_size)
+{
+    genie_storage_cache_t *p_cache = NULL;
+
+    aos_mutex_lock(&storage_mutex, AOS_WAIT_FOREVER);
+    p_cache = _genie_storage_cache_find(index);
+    if (!p_cache)
+    {
+        p_cache = _genie_storage_cache_alloc(index);
+    }
+
+    if (p_cache && !p_cache->dirty)
+    {
+        memcpy(p_cache->data, p_buff, buff_size);
+        p_cache->size = buff_size;
+    }
+    aos_mutex_unlock(&storage_mutex);
+}
+
+static genie_storage_status_e _genie_storage_cache_write(uint16_t index, uint8_t *p_data, uint16_t data_size)
+{
+    genie_storage_status_e ret = GENIE_STORAGE_SUCCESS;
+    genie_storage_cache_t *p_cache = NULL;
+    uint16_t buff_size = _genie_storage_get_reliable_size(data_size);
+    uint8_t buff[GENIE_STORAGE_CACHE_RECORD_MAX];
+
+    memset(buff, 0, buff_size);
+    memcpy(buff, p_data, data_size);
+
+    aos_mutex_lock(&storage_mutex, AOS_WAIT_FOREVER);
+    p_cache = _genie_storage_cache_find(index);
+    if (p_cache && p_cache->size == buff_size && memcmp(p_cache->data, buff, buff_size) == 0)
+    {
+        //same as cached, nothing new for flash
+        aos_mutex_unlock(&storage_mutex);
+        return GENIE_STORAGE_SUCCESS;
+    }
+
+    if (!p_cache)
+    {
+        p_cache = _genie_storage_cache_alloc(index);
+    }
+
+    if (p_cache)
+    {
+        memcpy(p_cache->data, buff, buff_size);
+        p_cache->size = buff_size;
+        p_cache->dirty = 1;
+        k_delayed_work_submit(&storage_flush_work, GENIE_STORAGE_FLUSH_DELAY);
+    }
+    else
+    {
+        ret = GENIE_STORAGE_WRITE_FAIL;
+    }
+    aos_mutex_unlock(&storage_mutex);
+
+    return ret;
+}
+
+static void _genie_storage_cache_drop(uint16_t index)
+{
+    genie_storage_cache_t *p_cache = NULL;
+
+    aos_mutex_lock(&storage_mutex, AOS_WAIT_FOREVER);
+    p_cache = _genie_storage_cache_find(index);
+    if (p_cache)
+    {
+        memset(p_cache, 0, sizeof(genie_storage_cache_t));
+    }
+    aos_mutex_unlock(&storage_mutex);
+}
+
+genie_storage_status_e genie_storage_flush(void)
+{
+    genie_storage_status_e ret = GENIE_STORAGE_SUCCESS;
+    genie_storage_status_e err = GENIE_STORAGE_SUCCESS;
+    uint8_t i = 0;
+
+    aos_mutex_lock(&storage_mutex, AOS_WAIT_FOREVER);
+    k_delayed_work_cancel(&storage_flush_work);
+    //batch failed as a whole, fall back to one record at a time
+    if (_genie_storage_cache_commit() == GENIE_STORAGE_SUCCESS)
+    {
+        aos_mutex_unlock(&storage_mutex);
+        return GENIE_STORAGE_SUCCESS;
+    }
+
+    for (i = 0; i < CONFIG_GENIE_STORAGE_CACHE_COUNT; i++)
+    {
+        if (storage_cache[i].index != GENIE_STORAGE_INDEX_START && storage_cache[i].dirty)
+        {
+            err = _genie_storage_cache_writeback(&storage_cache[i]);
+            if (ret == GENIE_STORAGE_SUCCESS)
+            {
+                ret = err;
+            }
+        }
+    }
+    aos_mutex_unlock(&storage_mutex);
+
+    return ret;
+}
+
 genie_storage_status_e genie_storage_read_reliable(uint16_t index, uint8_t *p_data, uint16_t data_size)
 {
     genie_storage_status_e ret = GENIE_STORAGE_SUCCESS;
@@ -160,6 +464,11 @@ genie_storage_status_e genie_storage_read_reliable(uint16_t index, uint8_t *p_da
         return GENIE_STORAGE_DATA_INVALID;
     }
 
+    if (_genie_storage_cacheable(index, data_size) && _genie_storage_cache_read(index, p_data, data_size) == GENIE_STORAGE_SUCCESS)
+    {
+        return GENIE_STORAGE_SUCCESS;
+    }
+
     p_buff = hal_malloc(buff_size);
     if (p_buff == NULL)
     {
@@ -184,6 +493,10 @@ genie_storage_status_e genie_storage_read_reliable(uint16_t index, uint8_t *p_da
     {
         _genie_storage_decrypt(p_buff, buff_size);
         memcpy(p_data, p_buff, data_size);
+        if (_genie_storage_cacheable(index, data_size))
+        {
+            _genie_storage_cache_fill(index, p_buff, buff_size);
+        }
     }
     hal_free(p_buff);
 
@@ -202,6 +515,11 @@ genie_storage_status_e genie_storage_write_reliable(uint16_t index, uint8_t *p_d
         return GENIE_STORAGE_DATA_INVALID;
     }
 
+    if (_genie_storage_cacheable(index, data_size))
+    {
+        return _genie_storage_cache_write(index, p_data, data_size);
+    }
+
     p_buff = hal_malloc(buff_size);
     if (p_buff == NULL)
     {
@@ -236,6 +554,7 @@ genie_storage_status_e genie_storage_delete_reliable(uint16_t index)
 {
     char key[10] = {0};
 
+    _genie_storage_cache_drop(index);
     snprintf(key, sizeof(key), "%s_%d", "key", index);
 
     return aos_kv_del(key);
@@ -273,6 +592,9 @@ genie_storage_status_e genie_storage_write_seq(uint32_t *p_seq, bool force_write
         return GENIE_STORAGE_SUCCESS;
     }
 
+    /*seq is never cached, write the pending records first so flash does not hold a newer seq with older keys*/
+    genie_storage_flush();
+
     seq_write = (*p_seq & 0x00FFFFFF) | (GENIE_SEQ_MAGIC_NUMBER << 24);
     ret = aos_kv_set(GENIE_KV_SEQ_KEY, &seq_write, sizeof(uint32_t), 0);
     if (ret != 0)
@@ -322,6 +644,90 @@ genie_storage_status_e genie_storage_delete_seq(void)
     }
 }
 
+genie_storage_status_e genie_storage_rpl_begin(void)
+{
+    if (aos_kv_txn_begin() != 0)
+    {
+        return GENIE_STORAGE_WRITE_FAIL;
+    }
+
+    storage_rpl_txn = 1;
+    return GENIE_STORAGE_SUCCESS;
+}
+
+genie_storage_status_e genie_storage_rpl_commit(void)
+{
+    int ret = -1;
+
+    if (!storage_rpl_txn)
+    {
+        return GENIE_STORAGE_SUCCESS;
+    }
+
+    storage_rpl_txn = 0;
+    ret = aos_kv_txn_commit();
+    if (ret != 0)
+    {
+        GENIE_LOG_ERR("func:%s (%d)failed\n", __func__, ret);
+        return GENIE_STORAGE_WRITE_FAIL;
+    }
+
+    return GENIE_STORAGE_SUCCESS;
+}
+
+genie_storage_status_e genie_storage_write_rpl(uint16_t slot, const struct bt_mesh_rpl *p_rpl)
+{
+    int ret = -1;
+    char key[10] = {0};
+
+    snprintf(key, sizeof(key), "%s_%d", GENIE_KV_RPL_KEY, slot);
+
+    if (p_rpl->src == BT_MESH_ADDR_UNASSIGNED)
+    {
+        if (!storage_rpl_txn || aos_kv_txn_del(key) != 0)
+        {
+            aos_kv_del(key);
+        }
+        return GENIE_STORAGE_SUCCESS;
+    }
+
+    //an entry the batch has no room for is written on its own
+    if (storage_rpl_txn)
+    {
+        ret = aos_kv_txn_set(key, p_rpl, sizeof(struct bt_mesh_rpl));
+    }
+
+    if (ret != 0)
+    {
+        ret = aos_kv_set(key, (void *)p_rpl, sizeof(struct bt_mesh_rpl), 0);
+    }
+
+    if (ret != 0)
+    {
+        GENIE_LOG_ERR("func:%s (%d)failed\n", __func__, ret);
+        return GENIE_STORAGE_WRITE_FAIL;
+    }
+
+    return GENIE_STORAGE_SUCCESS;
+}
+
+genie_storage_status_e genie_storage_read_rpl(uint16_t slot, struct bt_mesh_rpl *p_rpl)
+{
+    int ret = -1;
+    char key[10] = {0};
+    int rpl_len = sizeof(struct bt_mesh_rpl);
+
+    snprintf(key, sizeof(key), "%s_%d", GENIE_KV_RPL_KEY, slot);
+
+    ret = aos_kv_get(key, p_rpl, &rpl_len);
+    if (ret != 0 || rpl_len != sizeof(struct bt_mesh_rpl))
+    {
+        return GENIE_STORAGE_READ_FAIL;
+    }
+
+    return GENIE_STORAGE_SUCCESS;
+}
+
 genie_storage_status_e genie_storage_write_sub(uint16_t *p_sub)
 {
     uint16_t group_addr_crc = 0;
@@ -460,6 +866,11 @@ genie_storage_status_e genie_storage_reset_system(void)
 {
     int ret = 0;
 
+    aos_mutex_lock(&storage_mutex, AOS_WAIT_FOREVER);
+    k_delayed_work_cancel(&storage_flush_work);
+    memset(storage_cache, 0, sizeof(storage_cache));
+    aos_mutex_unlock(&storage_mutex);
+
     ret = aos_kv_del_all(NULL);
     save_switches_param();
     if (ret != 0)
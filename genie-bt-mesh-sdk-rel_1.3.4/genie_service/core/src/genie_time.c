@@ -5,21 +5,41 @@
 #include "genie_mesh_internal.h"
 
 static inline uint8_t is_leap_year(uint16_t year);
+static inline utc_time_t unix2UTC(uint32_t unix_time);
 static genie_time_data_t genie_time_data;
 static genie_time_timer_t genie_time_timer;
-static utc_time_t local_time = {0};
 
 #define GENIE_TIME_LOCK k_sem_take(&genie_time_timer.lock, -1)
 #define GENIE_TIME_UNLOCK k_sem_give(&genie_time_timer.lock)
 
-utc_time_t genie_time_local_time_get()
+/* Wall time is the last pushed UTC plus the uptime elapsed since, nothing
+ * counts seconds while the device sleeps.
+ */
+static int64_t genie_time_unix_ms(void)
 {
-    return local_time;
+    return (int64_t)genie_time_timer.unix_time * 1000 + (k_uptime_get() - genie_time_timer.uptime_base);
 }
 
 uint32_t genie_time_local_unixtime_get()
 {
-    return genie_time_timer.unix_time;
+    if (!genie_time_timer.update)
+    {
+        return 0;
+    }
+
+    return (uint32_t)(genie_time_unix_ms() / 1000);
+}
+
+utc_time_t genie_time_local_time_get()
+{
+    utc_time_t utc = {0};
+
+    if (genie_time_timer.update)
+    {
+        utc = unix2UTC(genie_time_local_unixtime_get() + genie_time_data.timezone * HOUR);
+    }
+
+    return utc;
 }
 
 static int genie_time_time_sync_get(uint16_t *period_time, uint8_t *retry_delay, uint8_t *retry_times)
@@ -120,6 +140,74 @@ static genie_time_t *genie_time_find(uint8_t index)
     return NULL;
 }
 
+static void genie_time_insert(genie_time_t *vendor_timer)
+{
+    genie_time_t *node, *prev = NULL;
+
+    SYS_SLIST_FOR_EACH_CONTAINER(&genie_time_timer.timer_list_active, node, next)
+    {
+        if (node->unixtime_match > vendor_timer->unixtime_match)
+        {
+            break;
+        }
+
+        prev = node;
+    }
+
+    if (prev)
+    {
+        sys_slist_insert(&genie_time_timer.timer_list_active, &prev->next, &vendor_timer->next);
+    }
+    else
+    {
+        sys_slist_prepend(&genie_time_timer.timer_list_active, &vendor_timer->next);
+    }
+}
+
+/* Arm the timer for the first of: the next timer due, the next time sync
+ * (or retry), and a minute boundary at most GENIE_TIME_WAKEUP_MAX ahead.
+ */
+static void genie_time_schedule(void)
+{
+    genie_time_t *head;
+    int64_t now_ms;
+    int64_t wait;
+    uint32_t due;
+
+    if (!genie_time_timer.init || !genie_time_timer.update)
+    {
+        return;
+    }
+
+    now_ms = genie_time_unix_ms();
+    due = now_ms / 1000 + GENIE_TIME_WAKEUP_MAX;
+    due -= due % MINU;
+
+    GENIE_TIME_LOCK;
+    head = SYS_SLIST_PEEK_HEAD_CONTAINER(&genie_time_timer.timer_list_active, head, next);
+    if (head && head->unixtime_match < due)
+    {
+        due = head->unixtime_match;
+    }
+    GENIE_TIME_UNLOCK;
+
+    if (genie_time_timer.unix_time_sync_match && genie_time_timer.unix_time_sync_match < due)
+    {
+        due = genie_time_timer.unix_time_sync_match;
+    }
+
+    wait = (int64_t)due * 1000 - now_ms;
+
+    if (wait <= 0)
+    {
+        k_timer_stop(&genie_time_timer.timer);
+        k_work_submit(&genie_time_timer.work);
+        return;
+    }
+
+    k_timer_start(&genie_time_timer.timer, (uint32_t)wait);
+}
+
 static genie_time_t *genie_time_new()
 {
     genie_time_t *free_timer;
@@ -134,6 +222,8 @@ static int genie_time_periodic_start(uint8_t index, uint32_t periodic_time, uint
 {
     genie_time_t *vendor_timer;
 
+    utc_time_t local_time;
+
     GENIE_LOG_DBG("periodic timer start index %d periodic_time %d schedule %d on_off %d\n",
                   index, periodic_time, schedule, attr_data->para);
 
@@ -183,6 +273,7 @@ static int genie_time_periodic_start(uint8_t index, uint32_t periodic_time, uint
     vendor_timer->attr_data.para = attr_data->para;
     vendor_timer->attr_data.type = attr_data->type;
 
+    local_time = genie_time_local_time_get();
     utc_time_t utc = local_time;
     utc.hour = 0;
     utc.minutes = 0;
@@ -194,10 +285,11 @@ static int genie_time_periodic_start(uint8_t index, uint32_t periodic_time, uint
     GENIE_LOG_DBG("periodic timer unixtime_match %d\n", vendor_timer->unixtime_match);
 
     GENIE_TIME_LOCK;
-    sys_slist_append(&genie_time_timer.timer_list_active, &vendor_timer->next);
+    genie_time_insert(vendor_timer);
     GENIE_TIME_UNLOCK;
 
     genie_time_save();
+    genie_time_schedule();
 
     return 0;
 }
@@ -317,7 +409,7 @@ static int genie_time_start(uint8_t index, uint32_t unix_time, vendor_attr_data_
         //return -GT_E_INDEX;
     }
 
-    if (unix_time <= genie_time_timer.unix_time)
+    if (unix_time <= genie_time_local_unixtime_get())
     {
         return -GT_E_PARAM;
     }
@@ -347,10 +439,11 @@ static int genie_time_start(uint8_t index, uint32_t unix_time, vendor_attr_data_
     vendor_timer->attr_data.para = attr_data->para;
 
     GENIE_TIME_LOCK;
-    sys_slist_append(&genie_time_timer.timer_list_active, &vendor_timer->next);
+    genie_time_insert(vendor_timer);
     GENIE_TIME_UNLOCK;
 
     genie_time_save();
+    genie_time_schedule();
 
     return 0;
 }
@@ -648,6 +741,7 @@ static int genie_time_remove(int8_t index)
     }
 
     genie_time_save();
+    genie_time_schedule();
 
     return ret;
 }
@@ -899,85 +993,6 @@ static inline uint8_t is_leap_year(uint16_t year)
     }
 }
 
-static inline void month_update()
-{
-    local_time.month++;
-
-    if (local_time.month >= 12)
-    {
-        local_time.month = 0;
-        local_time.year++;
-    }
-}
-
-static inline void days_update()
-{
-    uint8_t month_days_list[12] = {
-        31,
-        28,
-        31,
-        30,
-        31,
-        30,
-        31,
-        31,
-        30,
-        31,
-        30,
-        31,
-    };
-
-    local_time.day++;
-
-    if (is_leap_year(local_time.year))
-    {
-        month_days_list[1] = 29;
-    }
-
-    uint8_t month_day = month_days_list[local_time.month];
-
-    if (local_time.day > month_day)
-    {
-        local_time.day = 0;
-        month_update();
-    }
-
-    local_time.weekday = (local_time.weekday + 1) % 7;
-}
-
-static inline void hours_update()
-{
-    local_time.hour++;
-
-    if (local_time.hour == 24)
-    {
-        local_time.hour = 0;
-        days_update();
-    }
-}
-
-static inline void minutes_update()
-{
-    local_time.minutes++;
-
-    if (local_time.minutes == 60)
-    {
-        local_time.minutes = 0;
-        hours_update();
-    }
-}
-
-static inline void seconds_update()
-{
-    local_time.seconds++;
-
-    if (local_time.seconds == 60)
-    {
-        local_time.seconds = 0;
-        minutes_update();
-    }
-}
-
 static inline uint8_t is_weekday_match(uint8_t weekday_now, uint8_t schedule)
 {
     uint8_t weekday_mask = weekday_now ? (uint8_t)(1 << (weekday_now - 1)) : (uint8_t)(1 << 6);
@@ -1033,7 +1048,7 @@ static int genie_time_restore()
     {
         if (genie_time_data.timer_data[i].state != TIMER_INVAILD)
         {
-            sys_slist_append(&genie_time_timer.timer_list_active, &genie_time_data.timer_data[i].next);
+            genie_time_insert(&genie_time_data.timer_data[i]);
         }
         else
         {
@@ -1052,86 +1067,102 @@ static int genie_time_restore()
 #endif
 }
 
-static uint8_t is_genie_time_timeout(genie_time_t *vendor_timer)
+/* Move a periodic timer to its next scheduled local day after now */
+static void genie_time_periodic_next(genie_time_t *vendor_timer, uint32_t now)
 {
-    if (vendor_timer->state == TIMER_INVAILD)
+    utc_time_t utc;
+
+    while (vendor_timer->unixtime_match <= now)
     {
-        return 0;
+        utc = unix2UTC(vendor_timer->unixtime_match + genie_time_data.timezone * HOUR);
+        vendor_timer->unixtime_match += (1 + next_weekday_diff_get(next_weekday(utc.weekday), vendor_timer->schedule)) * DAY;
     }
-
-    return vendor_timer->unixtime_match == genie_time_timer.unix_time;
 }
 
 static void genie_time_do_work(struct k_work *work)
 {
-    genie_time_t *tmp = NULL, *node = NULL;
+    genie_time_t *node = NULL;
+    uint32_t now;
 
-    SYS_SLIST_FOR_EACH_CONTAINER_SAFE(&genie_time_timer.timer_list_active, node, tmp, next)
+    if (!genie_time_timer.update)
     {
-        if (is_genie_time_timeout(node))
-        {
-            if (genie_time_timer.genie_time_event_cb)
-            {
-                genie_time_timer.genie_time_event_cb(GT_TIMEOUT, node->index, &node->attr_data);
-            }
+        return;
+    }
 
-            GENIE_TIME_LOCK;
+    now = genie_time_local_unixtime_get();
 
-            if (!node->periodic)
-            {
-                node->unixtime_match = 0xffffffff;
-                node->state = TIMER_INVAILD;
-                sys_slist_find_and_remove(&genie_time_timer.timer_list_active, &node->next);
-                sys_slist_append(&genie_time_timer.timer_list_idle, &node->next);
-            }
-            else
-            {
-                node->unixtime_match += (1 + next_weekday_diff_get(next_weekday(local_time.weekday), node->schedule)) * DAY;
-            }
+    /* Timers are in deadline order, only the due ones are looked at */
+    for (;;)
+    {
+        GENIE_TIME_LOCK;
+        node = SYS_SLIST_PEEK_HEAD_CONTAINER(&genie_time_timer.timer_list_active, node, next);
 
+        if (!node || node->unixtime_match > now)
+        {
             GENIE_TIME_UNLOCK;
-            genie_time_save();
+            break;
         }
-    }
 
-    if (genie_time_timer.unix_time_sync_match && genie_time_timer.unix_time_sync_match <= genie_time_timer.unix_time)
-    {
-        if (genie_time_timer.genie_time_event_cb)
+        sys_slist_get(&genie_time_timer.timer_list_active);
+        GENIE_TIME_UNLOCK;
+
+        /* Missed while the clock was unknown, e.g. restored after a long
+         * outage: skip it instead of firing a burst of stale actions.
+         */
+        if (now - node->unixtime_match > GENIE_TIME_OVERDUE_MAX)
+        {
+            GENIE_LOG_INFO("skip timer %d overdue %us\n", node->index, now - node->unixtime_match);
+        }
+        else if (genie_time_timer.genie_time_event_cb)
         {
-            int ret = genie_time_timer.genie_time_event_cb(GT_TIMING_SYNC, 0, NULL);
+            genie_time_timer.genie_time_event_cb(GT_TIMEOUT, node->index, &node->attr_data);
+        }
 
-            if (ret)
-            {
-                if (genie_time_timer.unix_time_sync_retry_times > 0)
-                {
-                    genie_time_timer.unix_time_sync_match += genie_time_data.timing_sync_config.retry_delay * MINU;
-                    genie_time_timer.unix_time_sync_retry_times--;
-                    return;
-                }
-            }
+        GENIE_TIME_LOCK;
+
+        if (!node->periodic)
+        {
+            node->unixtime_match = 0xffffffff;
+            node->state = TIMER_INVAILD;
+            sys_slist_append(&genie_time_timer.timer_list_idle, &node->next);
+        }
+        else
+        {
+            genie_time_periodic_next(node, now);
+            genie_time_insert(node);
         }
 
-        genie_time_timer.unix_time_sync_retry_times = genie_time_data.timing_sync_config.retry_times;
-        genie_time_timer.unix_time_sync_match = genie_time_timer.unix_time + genie_time_data.timing_sync_config.period_time * MINU;
+        GENIE_TIME_UNLOCK;
+        genie_time_save();
     }
-}
 
-static void timer_update(void *args)
-{
-    if (!genie_time_timer.update)
+    if (genie_time_timer.unix_time_sync_match && genie_time_timer.unix_time_sync_match <= now)
     {
-        return;
+        int ret = 0;
+
+        if (genie_time_timer.genie_time_event_cb)
+        {
+            ret = genie_time_timer.genie_time_event_cb(GT_TIMING_SYNC, 0, NULL);
+        }
+
+        if (ret && genie_time_timer.unix_time_sync_retry_times > 0)
+        {
+            genie_time_timer.unix_time_sync_match = now + genie_time_data.timing_sync_config.retry_delay * MINU;
+            genie_time_timer.unix_time_sync_retry_times--;
+        }
+        else
+        {
+            genie_time_timer.unix_time_sync_retry_times = genie_time_data.timing_sync_config.retry_times;
+            genie_time_timer.unix_time_sync_match = now + genie_time_data.timing_sync_config.period_time * MINU;
+        }
     }
 
-    genie_time_timer.unix_time += 1;
-    seconds_update();
+    genie_time_schedule();
+}
 
+static void genie_time_timer_cb(void *timer, void *args)
+{
     k_work_submit(&genie_time_timer.work);
-
-    if (genie_time_timer.unix_time % 60 == 0)
-    {
-        GENIE_LOG_DBG("timer_update %d\n", genie_time_timer.unix_time);
-    }
 }
 
 int genie_time_utc_start(uint8_t index, utc_time_t utc_time, vendor_attr_data_t *attr_data)
@@ -1145,12 +1176,19 @@ int genie_time_utc_start(uint8_t index, utc_time_t utc_time, vendor_attr_data_t
     return genie_time_start(index, UTC2unix(&utc_time), attr_data);
 }
 
-void genie_time_local_time_show()
+static void genie_time_utc_show(utc_time_t *utc)
 {
     GENIE_LOG_DBG("%4d/%2d/%2d %2d:%2d:%d weekday %2d %04d\n",
-                  local_time.year, local_time.month + 1, local_time.day,
-                  local_time.hour, local_time.minutes, local_time.seconds,
-                  local_time.weekday, genie_time_data.timezone);
+                  utc->year, utc->month + 1, utc->day,
+                  utc->hour, utc->minutes, utc->seconds,
+                  utc->weekday, genie_time_data.timezone);
+}
+
+void genie_time_local_time_show()
+{
+    utc_time_t local_time = genie_time_local_time_get();
+
+    genie_time_utc_show(&local_time);
 }
 
 static int genie_time_timezone_update(int8_t timezone)
@@ -1186,9 +1224,11 @@ static int genie_time_time_sync_set(uint16_t period_time, uint8_t retry_delay, u
     genie_time_data.timing_sync_config.retry_delay = retry_delay;
     genie_time_data.timing_sync_config.retry_times = retry_times;
 
-    genie_time_timer.unix_time_sync_match = genie_time_timer.unix_time + genie_time_data.timing_sync_config.period_time * MINU;
+    genie_time_timer.unix_time_sync_match = genie_time_local_unixtime_get() + genie_time_data.timing_sync_config.period_time * MINU;
     genie_time_timer.unix_time_sync_retry_times = retry_times;
 
+    genie_time_schedule();
+
     return 0;
 }
 
@@ -1201,15 +1241,10 @@ static int genie_time_local_time_update(uint32_t unix_time)
 
     genie_time_timer.update = 1;
     genie_time_timer.unix_time = unix_time;
-
-    local_time = unix2UTC(unix_time + genie_time_data.timezone * HOUR);
+    genie_time_timer.uptime_base = k_uptime_get();
 
     GENIE_LOG_DBG("unix_time %d\n", unix_time);
-    GENIE_LOG_DBG("localtime update %4d/%2d/%2d %2d:%2d:%d weekday %2d\n",
-                  local_time.year, local_time.month + 1, local_time.day,
-                  local_time.hour, local_time.minutes, local_time.seconds,
-                  local_time.weekday);
-    GENIE_LOG_DBG("unix_time revert %d\n", UTC2unix(&local_time));
+    genie_time_local_time_show();
 
     genie_time_time_sync_set(DEF_SYNC_PERIOD, DEF_SYNC_DELAY, DEF_SYNC_DELAY_RETRY);
 
@@ -1389,24 +1424,23 @@ int genie_time_init(void)
         return 0;
     }
 
-    memset(&genie_time_timer, 0, sizeof(genie_time_timer));
-    memset(&local_time, 0, sizeof(local_time));
+    memset(&genie_time_timer, 0, offsetof(genie_time_timer_t, created));
 
     genie_time_timer.genie_time_event_cb = genie_time_event_callback;
 
     sys_slist_init(&genie_time_timer.timer_list_active);
     sys_slist_init(&genie_time_timer.timer_list_idle);
 
-    k_sem_init(&genie_time_timer.lock, 1, 1);
-
-    k_work_init(&genie_time_timer.work, genie_time_do_work);
-    genie_time_timer.timer.port = GENIE_TIME_HW_TEIMER_ID;
-    genie_time_timer.timer.config.period = GENIE_TIME_HW_TEIMER_PERIOD;
-    genie_time_timer.timer.config.reload_mode = TIMER_RELOAD_AUTO;
-    genie_time_timer.timer.config.cb = timer_update;
-    genie_time_timer.timer.config.arg = NULL;
-    hal_timer_init(&genie_time_timer.timer);
-    hal_timer_start(&genie_time_timer.timer);
+    /* A stop queued by genie_time_finalize may still be pending on the
+     * timer, so the kernel objects are never created twice.
+     */
+    if (!genie_time_timer.created)
+    {
+        k_sem_init(&genie_time_timer.lock, 1, 1);
+        k_work_init(&genie_time_timer.work, genie_time_do_work);
+        k_timer_init(&genie_time_timer.timer, genie_time_timer_cb, NULL);
+        genie_time_timer.created = 1;
+    }
 
     genie_time_timer.init = 1;
 
@@ -1449,19 +1483,12 @@ int genie_time_finalize(void)
         genie_time_stop(i);
     }
 
-    hal_timer_stop(&genie_time_timer.timer);
-    /*
-    ret = hal_timer_finalize(&genie_time_timer.timer);
-
-    if (ret)
-    {
-        printf("timer finalize faild\r\n");
-        return ret;
-    }*/
+    /* Only queues the stop when called from the timer task, so the timer
+     * itself is left out of the reset.
+     */
+    k_timer_stop(&genie_time_timer.timer);
 
-    k_sem_delete(&genie_time_timer.lock);
-    (void)memset(&genie_time_timer, 0, offsetof(genie_time_timer_t, work));
-    memset(&local_time, 0, sizeof(local_time));
+    (void)memset(&genie_time_timer, 0, offsetof(genie_time_timer_t, created));
 
     ret = genie_time_erase();
 
@@ -12,16 +12,165 @@ static struct k_timer scan_off_timer;
 #endif
 
 /**
- * send_list was used to save the unconfirmed vendor messages
- * retransmit_timer was used to control when the vendor messages saved in send_list will be resent
+ * node_pool holds the vendor messages waiting for confirmation,
+ * tx_heap orders them by retransmit deadline and tid_index finds them by tid.
+ * retransmit_timer fires at the nearest deadline.
  * */
-static sys_dlist_t send_list;
+static genie_transport_node_t node_pool[CONFIG_VENDOR_SEND_MSG_MAX];
+static sys_slist_t node_free;
+static genie_transport_node_t *tx_heap[CONFIG_VENDOR_SEND_MSG_MAX];
+static uint8_t tx_heap_count;
+static genie_transport_node_t *tid_index[GENIE_TRANSPORT_TID_INDEX_SIZE];
+static genie_transport_stats_t transport_stats;
 static struct k_timer retransmit_timer;
 static aos_mutex_t transport_mutex;
 
+#define TID_INDEX_HASH(tid) ((tid) & (GENIE_TRANSPORT_TID_INDEX_SIZE - 1))
+
+static void transport_node_get(genie_transport_node_t *p_node)
+{
+    p_node->ref++;
+}
+
+static void transport_node_put(genie_transport_node_t *p_node)
+{
+    if (--p_node->ref == 0)
+    {
+        sys_slist_prepend(&node_free, &p_node->next);
+    }
+}
+
+static void tx_heap_set(uint8_t index, genie_transport_node_t *p_node)
+{
+    tx_heap[index] = p_node;
+    p_node->heap_index = index;
+}
+
+static void tx_heap_up(uint8_t index)
+{
+    genie_transport_node_t *p_node = tx_heap[index];
+    uint8_t parent;
+
+    while (index > 0)
+    {
+        parent = (index - 1) / 2;
+        if (tx_heap[parent]->timeout <= p_node->timeout)
+        {
+            break;
+        }
+
+        tx_heap_set(index, tx_heap[parent]);
+        index = parent;
+    }
+
+    tx_heap_set(index, p_node);
+}
+
+static void tx_heap_down(uint8_t index)
+{
+    genie_transport_node_t *p_node = tx_heap[index];
+    uint8_t child;
+
+    while ((child = index * 2 + 1) < tx_heap_count)
+    {
+        if (child + 1 < tx_heap_count && tx_heap[child + 1]->timeout < tx_heap[child]->timeout)
+        {
+            child++;
+        }
+
+        if (p_node->timeout <= tx_heap[child]->timeout)
+        {
+            break;
+        }
+
+        tx_heap_set(index, tx_heap[child]);
+        index = child;
+    }
+
+    tx_heap_set(index, p_node);
+}
+
+static void tx_heap_push(genie_transport_node_t *p_node)
+{
+    tx_heap_set(tx_heap_count, p_node);
+    tx_heap_up(tx_heap_count++);
+
+    if (tx_heap_count > transport_stats.peak)
+    {
+        transport_stats.peak = tx_heap_count;
+    }
+}
+
+static void tx_heap_remove(genie_transport_node_t *p_node)
+{
+    uint8_t index = p_node->heap_index;
+    genie_transport_node_t *p_last = NULL;
+
+    if (index != --tx_heap_count)
+    {
+        p_last = tx_heap[tx_heap_count];
+        tx_heap_set(index, p_last);
+        tx_heap_up(index);
+        tx_heap_down(p_last->heap_index);
+    }
+}
+
+static void tid_index_add(genie_transport_node_t *p_node)
+{
+    genie_transport_node_t **pp_head = &tid_index[TID_INDEX_HASH(p_node->msg.tid)];
+
+    p_node->tid_next = *pp_head;
+    *pp_head = p_node;
+}
+
+static void tid_index_del(genie_transport_node_t *p_node)
+{
+    genie_transport_node_t **pp_node = &tid_index[TID_INDEX_HASH(p_node->msg.tid)];
+
+    while (*pp_node && *pp_node != p_node)
+    {
+        pp_node = &(*pp_node)->tid_next;
+    }
+
+    if (*pp_node)
+    {
+        *pp_node = p_node->tid_next;
+    }
+}
+
+/** @def transport_node_unlink
+ *
+ *  @brief take the node off the retransmit heap and the tid index, the caller still holds the node
+ *
+ *  @param pointer to the vendor model message node
+ *
+ *  @return N/A
+ */
+static void transport_node_unlink(genie_transport_node_t *p_node)
+{
+    tx_heap_remove(p_node);
+    tid_index_del(p_node);
+}
+
+static void transport_schedule(void)
+{
+    long long delay;
+
+    if (tx_heap_count == 0)
+    {
+        k_timer_stop(&retransmit_timer);
+        BT_DBG("list empty, stop timer");
+        return;
+    }
+
+    delay = tx_heap[0]->timeout - k_uptime_get();
+    k_timer_start(&retransmit_timer, delay > 0 ? (uint32_t)delay : 1);
+    BT_DBG("restart retry timer, timeout:%d", (int)delay);
+}
+
 /** @def genie_transport_msg_node_generate
  *
- *  @brief duplicate genie_transport_model_param_t and save to genie_transport_node_t
+ *  @brief take a node from the pool and copy genie_transport_model_param_t and its payload into it
  *
  *  @param pointer to the vendor model message to be duplicated
  *
@@ -30,24 +179,33 @@ static aos_mutex_t transport_mutex;
 static genie_transport_node_t *genie_transport_msg_node_generate(genie_transport_model_param_t *p_model_msg)
 {
     genie_transport_node_t *p_node = NULL;
+    sys_snode_t *p_free = NULL;
 
     if (p_model_msg->retry > VENDOR_MODEL_MSG_MAX_RETRY_TIMES)
     {
         p_model_msg->retry = VENDOR_MODEL_MSG_MAX_RETRY_TIMES;
     }
 
-    p_node = hal_malloc(sizeof(genie_transport_node_t) + p_model_msg->len);
-    if (!p_node)
+    if (p_model_msg->len > GENIE_TRANSPORT_PAYLOAD_MAX)
+    {
+        BT_ERR("payload too long:%d", p_model_msg->len);
+        return NULL;
+    }
+
+    p_free = sys_slist_get(&node_free);
+    if (!p_free)
     {
-        BT_ERR("malloc for genie_transport_node_t failed");
+        GENIE_LOG_WARN("send list full");
         return NULL;
     }
 
+    p_node = CONTAINER_OF(p_free, genie_transport_node_t, next);
+    p_node->ref = 1;
+    p_node->tid_next = NULL;
+
     memcpy(&p_node->msg, p_model_msg, sizeof(genie_transport_model_param_t));
-    BT_DBG("p_node->msg:%p, data:%p, %p", &p_node->msg, &p_node->msg.data, &p_node->msg.data + 1);
-    p_node->msg.data = (uint8_t *)(&p_node->msg.data + 1);
+    p_node->msg.data = p_node->payload;
     memcpy(p_node->msg.data, p_model_msg->data, p_model_msg->len);
-    BT_DBG("p_model_msg->data:%p, %s", p_model_msg->data, bt_hex(p_model_msg->data, p_model_msg->len));
     BT_DBG("p_node->msg.data:%p, %s", p_node->msg.data, bt_hex(p_node->msg.data, p_node->msg.len));
     p_node->timeout = k_uptime_get() + p_model_msg->retry_period;
 
@@ -56,29 +214,16 @@ static genie_transport_node_t *genie_transport_msg_node_generate(genie_transport
     return p_node;
 }
 
-static genie_transport_model_param_t *genie_transport_find_by_tid(uint8_t tid)
+static genie_transport_node_t *genie_transport_find_by_tid(uint8_t tid)
 {
-    sys_dnode_t *p_node = NULL;
-    genie_transport_model_param_t *p_msg = NULL;
-    genie_transport_node_t *p_msg_node = NULL;
+    genie_transport_node_t *p_node = tid_index[TID_INDEX_HASH(tid)];
 
-    SYS_DLIST_FOR_EACH_NODE(&send_list, p_node)
+    while (p_node && p_node->msg.tid != tid)
     {
-        p_msg_node = CONTAINER_OF(p_node, genie_transport_node_t, node);
-        if (p_msg_node == NULL)
-        {
-            continue;
-        }
-
-        p_msg = &p_msg_node->msg;
-
-        if (p_msg->tid == tid)
-        {
-            return p_msg;
-        }
+        p_node = p_node->tid_next;
     }
 
-    return NULL;
+    return p_node;
 }
 
 #ifdef CONFIG_SCAN_DURATION_AFTER_GENIE_MODEL_SEND
@@ -180,29 +325,22 @@ static int16_t genie_transport_append_mesg(genie_transport_model_param_t *p_mode
 {
     genie_transport_node_t *p_msg_node = NULL;
 
-    BT_DBG("append msg:%p, opid:%x, retry:%d, head:%p, node:%p", p_model_msg, p_model_msg->opid, p_model_msg->retry, &send_list, &p_msg_node->node);
-    if (sys_dlist_node_number(&send_list) >= CONFIG_VENDOR_SEND_MSG_MAX)
-    {
-        GENIE_LOG_WARN("send list full");
-        return -1;
-    }
+    BT_DBG("append msg:%p, opid:%x, retry:%d", p_model_msg, p_model_msg->opid, p_model_msg->retry);
 
     aos_mutex_lock(&transport_mutex, AOS_WAIT_FOREVER);
     p_msg_node = genie_transport_msg_node_generate(p_model_msg);
     if (!p_msg_node)
     {
+        transport_stats.alloc_fail++;
+        aos_mutex_unlock(&transport_mutex);
         return -1;
     }
 
-    sys_dlist_append(&send_list, &p_msg_node->node);
+    tid_index_add(p_msg_node);
+    tx_heap_push(p_msg_node);
+    transport_schedule();
     aos_mutex_unlock(&transport_mutex);
 
-    //Check retry timer, if timer is not started yet, start it
-    if (!k_timer_is_started(&retransmit_timer))
-    {
-        k_timer_start(&retransmit_timer, p_model_msg->retry_period);
-    }
-
     return 0;
 }
 
@@ -259,51 +397,26 @@ uint16_t genie_transport_src_addr_get()
     return last_src_addr;
 }
 
-/** @def transport_msg_node_free
- *
- *  @brief free the vendor model message node struct's memory
- *
- *  @param pointer to the vendor model message node to be freed
- *
- *  @return 0 for success; negative for failure
- */
-static int16_t transport_msg_node_free(genie_transport_node_t *p_node)
-{
-    hal_free(p_node);
-
-    return 0;
-}
-
 static int transport_remove_by_tid(uint8_t tid)
 {
-    sys_dnode_t *p_node = NULL;
-    sys_dnode_t *p_node_safe = NULL;
+    genie_transport_node_t *p_msg_node = NULL;
 
-    if (sys_dlist_is_empty(&send_list))
+    if (tx_heap_count == 0)
     {
         return -1;
     }
 
     aos_mutex_lock(&transport_mutex, AOS_WAIT_FOREVER);
-    SYS_DLIST_FOR_EACH_NODE_SAFE(&send_list, p_node, p_node_safe)
+    p_msg_node = genie_transport_find_by_tid(tid);
+    if (p_msg_node)
     {
-        genie_transport_model_param_t *p_msg = NULL;
-        genie_transport_node_t *p_msg_node = NULL;
-
-        p_msg_node = CONTAINER_OF(p_node, genie_transport_node_t, node);
-        p_msg = &p_msg_node->msg;
-
-        BT_DBG("msg %02x", p_msg->tid);
-        if (p_msg->tid == tid)
-        {
-            sys_dlist_remove(p_node);
-            transport_msg_node_free((genie_transport_node_t *)p_node);
-            return 0;
-        }
+        transport_node_unlink(p_msg_node);
+        transport_node_put(p_msg_node);
+        transport_schedule();
     }
     aos_mutex_unlock(&transport_mutex);
 
-    return -1;
+    return p_msg_node ? 0 : -1;
 }
 
 static uint16_t transport_get_send_timeout(uint16_t payload_len)
@@ -351,10 +464,7 @@ int genie_transport_send_model(genie_transport_model_param_t *p_model_msg)
             break;
         }
 
-        if (genie_transport_find_by_tid(p_model_msg->tid) != NULL)
-        {
-            transport_remove_by_tid(p_model_msg->tid); //remove old
-        }
+        transport_remove_by_tid(p_model_msg->tid); //remove old
 
         if ((p_model_msg->opid != VENDOR_OP_ATTR_STATUS) && (p_model_msg->opid != VENDOR_OP_ATTR_TRANS_MSG))
         {
@@ -367,6 +477,10 @@ int genie_transport_send_model(genie_transport_model_param_t *p_model_msg)
 
         GENIE_LOG_INFO("SendTID(%02X)", p_model_msg->tid);
         r = genie_transport_model_send(p_model_msg); //Send at first time
+        if (r == 0)
+        {
+            transport_stats.sent++;
+        }
     }
     break;
     default:
@@ -442,148 +556,138 @@ uint8_t genie_transport_get_seg_count(uint16_t msg_len)
 
 bool genie_transport_tx_in_progress(void)
 {
-    if (!sys_dlist_is_empty(&send_list))
-    {
-        return true;
-    }
-
-    return false;
+    return tx_heap_count > 0;
 }
 
 /** @def retransmit_timer_cb
  *
  *  @brief timeout handler for the retransmit_timer
  *
- *  @param p_timer - pointer to the timer; args - pointer to send_list
+ *  @param p_timer - pointer to the timer; args - unused
  *
  *  @return N/A
  */
 static void retransmit_timer_cb(void *p_timer, void *args)
 {
-    sys_dlist_t *p_head = (sys_dlist_t *)args;
-    sys_dnode_t *p_node = NULL;
-    sys_dnode_t *p_node_safe = NULL;
-    uint32_t nearest = 0;
     genie_transport_node_t *p_msg_node = NULL;
     genie_transport_model_param_t *p_msg = NULL;
+    long long now = k_uptime_get();
 
-    BT_DBG("retransmit_timer timeout, p_head:%p", p_head);
+    BT_DBG("retransmit_timer timeout");
 
     /**
-     * 1. go through p_head
-     * 2. resend the no responsed messages if timeout happens and refresh timeout value
+     * resend the due messages from the top of the heap and push their deadline back,
+     * drop them once no retry is left
      * */
     aos_mutex_lock(&transport_mutex, AOS_WAIT_FOREVER);
-    SYS_DLIST_FOR_EACH_NODE_SAFE(p_head, p_node, p_node_safe)
+    while (tx_heap_count > 0 && tx_heap[0]->timeout <= now)
     {
-        p_msg_node = CONTAINER_OF(p_node, genie_transport_node_t, node);
-        nearest = p_msg_node->msg.retry_period;
+        p_msg_node = tx_heap[0];
         p_msg = &p_msg_node->msg;
-        BT_DBG("msg:%p, opid:%d, left:%d", p_msg, p_msg->opid, p_msg_node->left_retry);
+        BT_DBG("timeout - msg:%p, opid:%x, left:%d", p_msg, p_msg->opid, p_msg_node->left_retry);
 
-        if (p_msg_node->timeout <= k_uptime_get())
+        if (p_msg_node->left_retry-- == 0)
         {
-            BT_DBG("timeout - msg:%p, opid:%x, left:%d", p_msg, p_msg->opid, p_msg_node->left_retry);
-            if (p_msg_node->left_retry-- == 0)
+            GENIE_LOG_INFO("TID(%02X) timeout", p_msg->tid);
+            transport_stats.timeout++;
+            transport_node_unlink(p_msg_node);
+            if (p_msg->result_cb)
             {
-                GENIE_LOG_INFO("TID(%02X) timeout", p_msg_node->msg.tid);
-                if (p_msg_node->msg.result_cb)
-                {
-                    p_msg_node->msg.result_cb(&p_msg_node->msg, SEND_RESULT_TIMEOUT);
-                }
+                p_msg->result_cb(p_msg, SEND_RESULT_TIMEOUT);
+            }
 /*[Genie begin] add by wenbing.cwb at 2021-04-29*/
 #ifdef CONFIG_BT_MESH_CTRL_RELAY
-                ctrl_relay_open_send();
+            ctrl_relay_open_send();
 #endif
-                /*[Genie end] add by wenbing.cwb at 2021-04-29*/
-                sys_dlist_remove(p_node);
-                transport_msg_node_free((genie_transport_node_t *)p_node);
-                break;
-            }
-            GENIE_LOG_INFO("ReTID(%02X), LR(%d)", p_msg->tid, p_msg_node->left_retry);
-            genie_transport_model_send(p_msg);
-            p_msg_node->timeout = k_uptime_get() + p_msg_node->msg.retry_period;
-        }
-        else
-        {
-            if (nearest > p_msg_node->timeout)
-            {
-                nearest = p_msg_node->timeout;
-            }
+            /*[Genie end] add by wenbing.cwb at 2021-04-29*/
+            transport_node_put(p_msg_node);
+            continue;
         }
-    }
-    aos_mutex_unlock(&transport_mutex);
 
-    /* start new timer */
-    if (!sys_dlist_is_empty(p_head))
-    {
-        k_timer_start(&retransmit_timer, nearest);
-        BT_DBG("restart retry timer, timeout:%d", nearest);
-    }
-    else
-    {
-        k_timer_stop(&retransmit_timer);
-        BT_DBG("list empty, stop timer");
+        GENIE_LOG_INFO("ReTID(%02X), LR(%d)", p_msg->tid, p_msg_node->left_retry);
+        transport_stats.retransmit++;
+        p_msg_node->timeout = now + p_msg->retry_period;
+        tx_heap_down(0);
+
+        //the send path may ack or replace this tid, keep the node until it returns
+        transport_node_get(p_msg_node);
+        genie_transport_model_send(p_msg);
+        transport_node_put(p_msg_node);
     }
 
-    return;
+    transport_schedule();
+    aos_mutex_unlock(&transport_mutex);
 }
 
 /** @def genie_transport_ack
  *
  *  @brief check received vendor message's tid
  *
- *  @param pointer to send_list, tid of the received vendor model message
+ *  @param tid of the received vendor model message
  *
  *  @return 0 for success; negative for failure
  */
 int genie_transport_ack(uint8_t tid)
 {
-    sys_dnode_t *p_node = NULL;
-    sys_dnode_t *p_node_safe = NULL;
+    genie_transport_node_t *p_msg_node = NULL;
+    genie_transport_model_param_t *p_msg = NULL;
 
-    if (sys_dlist_is_empty(&send_list))
+    if (tx_heap_count == 0)
     {
         return 0;
     }
 
-    /**
-     * go through message list and dequeue the vendor model's message and free it if received message
-     * s tid equals this message's tid
-     * */
     BT_DBG("recv %02x", tid);
     aos_mutex_lock(&transport_mutex, AOS_WAIT_FOREVER);
-    SYS_DLIST_FOR_EACH_NODE_SAFE(&send_list, p_node, p_node_safe)
+    p_msg_node = genie_transport_find_by_tid(tid);
+    if (p_msg_node)
     {
-        genie_transport_model_param_t *p_msg = NULL;
-        genie_transport_node_t *p_msg_node = NULL;
-
-        p_msg_node = CONTAINER_OF(p_node, genie_transport_node_t, node);
         p_msg = &p_msg_node->msg;
-
-        BT_DBG("msg %02x", p_msg->tid);
-        if (p_msg->tid == tid)
+        BT_DBG("dequeue msg:%p, opid:%x, retry:%d", p_msg, p_msg->opid, p_msg->retry);
+        transport_stats.acked++;
+        transport_node_unlink(p_msg_node);
+        if (p_msg->result_cb)
         {
-            BT_DBG("dequeue msg:%p, opid:%x, retry:%d", p_msg, p_msg->opid, p_msg->retry);
-            if (p_msg->result_cb)
-            {
-                p_msg->result_cb(p_msg, SEND_RESULT_SUCCESS);
-            }
-
-            sys_dlist_remove(p_node);
-            transport_msg_node_free((genie_transport_node_t *)p_node);
-            break;
+            p_msg->result_cb(p_msg, SEND_RESULT_SUCCESS);
         }
+
+        transport_node_put(p_msg_node);
+        transport_schedule();
     }
     aos_mutex_unlock(&transport_mutex);
 
     return 0;
 }
 
+void genie_transport_stats_get(genie_transport_stats_t *p_stats)
+{
+    aos_mutex_lock(&transport_mutex, AOS_WAIT_FOREVER);
+    memcpy(p_stats, &transport_stats, sizeof(genie_transport_stats_t));
+    aos_mutex_unlock(&transport_mutex);
+}
+
+void genie_transport_stats_reset(void)
+{
+    aos_mutex_lock(&transport_mutex, AOS_WAIT_FOREVER);
+    memset(&transport_stats, 0, sizeof(genie_transport_stats_t));
+    transport_stats.peak = tx_heap_count;
+    aos_mutex_unlock(&transport_mutex);
+}
+
 void genie_transport_init(void)
 {
-    sys_dlist_init(&send_list);
-    k_timer_init(&retransmit_timer, retransmit_timer_cb, &send_list);
+    uint8_t i = 0;
+
+    memset(node_pool, 0, sizeof(node_pool));
+    memset(tid_index, 0, sizeof(tid_index));
+    tx_heap_count = 0;
+    sys_slist_init(&node_free);
+    for (i = 0; i < CONFIG_VENDOR_SEND_MSG_MAX; i++)
+    {
+        sys_slist_append(&node_free, &node_pool[i].next);
+    }
+
+    k_timer_init(&retransmit_timer, retransmit_timer_cb, NULL);
     aos_mutex_new(&transport_mutex);
 
 #ifdef CONFIG_SCAN_DURATION_AFTER_GENIE_MODEL_SEND
@@ -16,7 +16,7 @@ static sig_model_event_e sig_model_event_handle_delay_start(sig_model_element_st
     sig_model_transition_timer_stop(p_elem);
 #endif
 
-    k_timer_start(&p_elem->state.delay_timer, p_elem->state.delay * 5);
+    k_delayed_work_submit(&p_elem->state.delay_work, p_elem->state.delay * 5);
 
     return SIG_MODEL_EVT_NONE;
 }
@@ -56,12 +56,13 @@ static sig_model_event_e sig_model_event_handle_trans_start(sig_model_element_st
     {
         return SIG_MODEL_EVT_TRANS_END;
     }
+    else if (sig_model_transition_start(p_elem) == 0)
+    {
+        //finished on the first step
+        return SIG_MODEL_EVT_TRANS_END;
+    }
     else
     {
-        //start cycle
-        k_timer_start(&p_elem->state.trans_timer, SIG_MODEL_TRANSITION_INTERVAL);
-        BT_DBG("start trans %p", &p_elem->state.trans_timer);
-
         return SIG_MODEL_EVT_NONE;
     }
 }
@@ -5,10 +5,135 @@
 #include "genie_mesh_internal.h"
 
 #ifdef CONFIG_MESH_MODEL_TRANS
+#define DELTA_ACTUAL_MIN 655 //lightness of one PWM duty step
+#define DELTA_TEMP_MIN 192
+
+/* Every running transition is linked on one list and stepped by one work
+ * item, so several elements in transition cost a single wakeup per tick.
+ * Like the delay work and mesh RX, it runs in the BLE task, which is the
+ * only context touching the list.
+ */
+static sys_slist_t trans_list;
+static struct k_delayed_work trans_work;
+static bool trans_work_inited;
+
+static void sig_model_transition_schedule(void)
+{
+    sig_model_element_state_t *p_elem;
+    u32_t cur_time = k_uptime_get();
+    u32_t next = UINT32_MAX;
+    u32_t remain;
+
+    SYS_SLIST_FOR_EACH_CONTAINER(&trans_list, p_elem, state.trans_node)
+    {
+        remain = (s32_t)(p_elem->state.trans_end_time - cur_time) > 0 ? p_elem->state.trans_end_time - cur_time : 0;
+        remain = remain < p_elem->state.trans_tick ? remain : p_elem->state.trans_tick;
+        next = remain < next ? remain : next;
+    }
+
+    if (next == UINT32_MAX)
+    {
+        k_delayed_work_cancel(&trans_work);
+    }
+    else
+    {
+        k_delayed_work_submit(&trans_work, next ? next : 1);
+    }
+}
+
+static void sig_model_transition_work_handler(struct k_work *p_work)
+{
+    sig_model_element_state_t *p_elem, *p_next;
+
+    SYS_SLIST_FOR_EACH_CONTAINER_SAFE(&trans_list, p_elem, p_next, state.trans_node)
+    {
+        sig_model_event(SIG_MODEL_EVT_TRANS_CYCLE, p_elem);
+
+        if (p_elem->state.trans == 0)
+        {
+            sys_slist_find_and_remove(&trans_list, &p_elem->state.trans_node);
+            sig_model_event(SIG_MODEL_EVT_TRANS_END, p_elem);
+        }
+    }
+
+    sig_model_transition_schedule();
+}
+
+#if defined(CONFIG_MESH_MODEL_LIGHTNESS_SRV) || defined(CONFIG_MESH_MODEL_CTL_SRV)
+static u32_t sig_model_transition_steps(u16_t start, u16_t target, u16_t step)
+{
+    return (start > target ? start - target : target - start) / step;
+}
+#endif
+
 void sig_model_transition_timer_stop(sig_model_element_state_t *p_elem)
 {
-    k_timer_stop(&p_elem->state.delay_timer);
-    k_timer_stop(&p_elem->state.trans_timer);
+    k_delayed_work_cancel(&p_elem->state.delay_work);
+
+    if (sys_slist_find_and_remove(&trans_list, &p_elem->state.trans_node))
+    {
+        sig_model_transition_schedule();
+    }
+}
+
+uint8_t sig_model_transition_start(sig_model_element_state_t *p_elem)
+{
+    sig_model_state_t *p_state = &p_elem->state;
+    u32_t cur_time = k_uptime_get();
+    u32_t duration;
+    u32_t steps = 0;
+
+    if (!trans_work_inited)
+    {
+        k_delayed_work_init(&trans_work, sig_model_transition_work_handler);
+        trans_work_inited = true;
+    }
+
+    sys_slist_find_and_remove(&trans_list, &p_state->trans_node);
+
+    //the curve runs from now, so a late start does not jump
+    p_state->trans_start_time = cur_time;
+    duration = p_state->trans_end_time - cur_time;
+    p_state->trans_rate = sig_model_trans_rate(duration);
+
+#ifdef CONFIG_MESH_MODEL_LIGHTNESS_SRV
+    p_state->trans_lightness = p_state->lightness[TYPE_PRESENT];
+    steps = sig_model_transition_steps(p_state->trans_lightness, p_state->lightness[TYPE_TARGET], DELTA_ACTUAL_MIN);
+#endif
+#ifdef CONFIG_MESH_MODEL_CTL_SRV
+    p_state->trans_color_temperature = p_state->color_temperature[TYPE_PRESENT];
+    if (sig_model_transition_steps(p_state->trans_color_temperature, p_state->color_temperature[TYPE_TARGET], DELTA_TEMP_MIN) > steps)
+    {
+        steps = sig_model_transition_steps(p_state->trans_color_temperature, p_state->color_temperature[TYPE_TARGET], DELTA_TEMP_MIN);
+    }
+#endif
+
+    //wake about once per visible step, the eased curves are up to twice as steep
+    if (p_state->trans_ease != SIG_MODEL_TRANS_EASE_LINEAR)
+    {
+        steps *= 2;
+    }
+    p_state->trans_tick = steps ? duration / steps : duration;
+    if (p_state->trans_tick < SIG_MODEL_TRANSITION_INTERVAL)
+    {
+        p_state->trans_tick = SIG_MODEL_TRANSITION_INTERVAL;
+    }
+
+    sys_slist_append(&trans_list, &p_state->trans_node);
+
+    //first step right away, onoff switches on at the start
+    sig_model_event(SIG_MODEL_EVT_TRANS_CYCLE, p_elem);
+    if (p_state->trans == 0)
+    {
+        sys_slist_find_and_remove(&trans_list, &p_state->trans_node);
+        sig_model_transition_schedule();
+        return 0;
+    }
+
+    BT_DBG("start trans %p tick %d", p_elem, p_state->trans_tick);
+    sig_model_transition_schedule();
+
+    return 1;
 }
 
 void sig_model_transition_state_reset(sig_model_element_state_t *p_elem)
@@ -18,174 +143,80 @@ void sig_model_transition_state_reset(sig_model_element_state_t *p_elem)
     p_elem->state.trans_end_time = 0;
 }
 
-#define DELTA_ACTUAL_MIN 655
-#define DELTA_TEMP_MIN 192
-
 uint8_t sig_model_transition_update(sig_model_element_state_t *p_elem)
 {
     uint8_t cycle = 0;
-    uint16_t delta = 0;
     u32_t cur_time = k_uptime_get();
     sig_model_state_t *p_state = &p_elem->state;
+    u32_t progress;
+#if defined(CONFIG_MESH_MODEL_LIGHTNESS_SRV) || defined(CONFIG_MESH_MODEL_CTL_SRV)
+    u32_t level;
+#endif
 
-    //stop cycle when timeout
-    if (cur_time <= p_state->trans_end_time - SIG_MODEL_TRANSITION_INTERVAL)
-    {
+    progress = sig_model_trans_progress(p_state->trans_rate, cur_time - p_state->trans_start_time,
+                                        p_state->trans_end_time - p_state->trans_start_time);
 #if defined(CONFIG_MESH_MODEL_LIGHTNESS_SRV) || defined(CONFIG_MESH_MODEL_CTL_SRV)
-        uint16_t step = (p_state->trans_end_time - cur_time) / SIG_MODEL_TRANSITION_INTERVAL;
+    level = sig_model_trans_ease(progress, p_state->trans_ease);
 #endif
 
 #ifdef CONFIG_MESH_MODEL_GEN_ONOFF_SRV
-        if (p_state->onoff[TYPE_PRESENT] != p_state->onoff[TYPE_TARGET])
-        {
-            p_state->onoff[TYPE_PRESENT] = p_state->onoff[TYPE_TARGET];
-            sig_model_event_set_indicate(SIG_MODEL_INDICATE_GEN_ONOFF);
-        }
+    if (p_state->onoff[TYPE_PRESENT] != p_state->onoff[TYPE_TARGET])
+    {
+        p_state->onoff[TYPE_PRESENT] = p_state->onoff[TYPE_TARGET];
+        sig_model_event_set_indicate(SIG_MODEL_INDICATE_GEN_ONOFF);
+    }
 #endif
 
 #ifdef CONFIG_MESH_MODEL_LIGHTNESS_SRV
-        if (p_state->lightness[TYPE_PRESENT] != p_state->lightness[TYPE_TARGET])
-        {
-            if (p_state->lightness[TYPE_TARGET] > p_state->lightness[TYPE_PRESENT])
-            {
-                delta = (p_state->lightness[TYPE_TARGET] - p_state->lightness[TYPE_PRESENT]) / step;
-                delta = delta > DELTA_ACTUAL_MIN ? delta : DELTA_ACTUAL_MIN;
-                if (LIGHTNESS_MAX_VALUE - p_state->lightness[TYPE_PRESENT] < delta ||
-                    p_state->lightness[TYPE_TARGET] - p_state->lightness[TYPE_PRESENT] < delta)
-                {
-                    p_state->lightness[TYPE_PRESENT] = p_state->lightness[TYPE_TARGET];
-                    sig_model_event_set_indicate(SIG_MODEL_INDICATE_GEN_LIGHTNESS);
-                }
-                else
-                {
-                    p_state->lightness[TYPE_PRESENT] += delta;
-                    if (p_state->lightness[TYPE_PRESENT] == p_state->lightness[TYPE_TARGET])
-                    {
-                        sig_model_event_set_indicate(SIG_MODEL_INDICATE_GEN_LIGHTNESS);
-                    }
-                }
-            }
-            else
-            {
-                delta = (p_state->lightness[TYPE_PRESENT] - p_state->lightness[TYPE_TARGET]) / step;
-                delta = delta > DELTA_ACTUAL_MIN ? delta : DELTA_ACTUAL_MIN;
-                if (p_state->lightness[TYPE_PRESENT] < delta ||
-                    p_state->lightness[TYPE_PRESENT] - delta < p_state->lightness[TYPE_TARGET])
-                {
-                    p_state->lightness[TYPE_PRESENT] = p_state->lightness[TYPE_TARGET];
-                    sig_model_event_set_indicate(SIG_MODEL_INDICATE_GEN_LIGHTNESS);
-                }
-                else
-                {
-                    p_state->lightness[TYPE_PRESENT] -= delta;
-                    if (p_state->lightness[TYPE_PRESENT] == p_state->lightness[TYPE_TARGET])
-                    {
-                        sig_model_event_set_indicate(SIG_MODEL_INDICATE_GEN_LIGHTNESS);
-                    }
-                }
-            }
-            cycle = 1;
-        }
-#endif
-#ifdef CONFIG_MESH_MODEL_CTL_SRV
-        if (p_state->color_temperature[TYPE_PRESENT] != p_state->color_temperature[TYPE_TARGET])
-        {
-            if (p_state->color_temperature[TYPE_TARGET] > p_state->color_temperature[TYPE_PRESENT])
-            {
-                delta = (p_state->color_temperature[TYPE_TARGET] - p_state->color_temperature[TYPE_PRESENT]) / step;
-                delta = delta > DELTA_TEMP_MIN ? delta : DELTA_TEMP_MIN;
-                if (COLOR_TEMPERATURE_MAX - p_state->color_temperature[TYPE_PRESENT] < delta ||
-                    p_state->color_temperature[TYPE_TARGET] - p_state->color_temperature[TYPE_PRESENT] < delta)
-                {
-                    p_state->color_temperature[TYPE_PRESENT] = p_state->color_temperature[TYPE_TARGET];
-                    sig_model_event_set_indicate(SIG_MODEL_INDICATE_GEN_CTL);
-                }
-                else
-                {
-                    p_state->color_temperature[TYPE_PRESENT] += delta;
-                    if (p_state->color_temperature[TYPE_PRESENT] == p_state->color_temperature[TYPE_TARGET])
-                    {
-                        sig_model_event_set_indicate(SIG_MODEL_INDICATE_GEN_CTL);
-                    }
-                }
-                delta += p_state->color_temperature[TYPE_PRESENT];
-                p_state->color_temperature[TYPE_PRESENT] = delta > p_state->color_temperature[TYPE_TARGET] ? p_state->color_temperature[TYPE_TARGET] : delta;
-            }
-            else
-            {
-                delta = (p_state->color_temperature[TYPE_PRESENT] - p_state->color_temperature[TYPE_TARGET]) / step;
-                delta = delta > DELTA_TEMP_MIN ? delta : DELTA_TEMP_MIN;
-                if (p_state->color_temperature[TYPE_PRESENT] < delta + COLOR_TEMPERATURE_MIN ||
-                    p_state->color_temperature[TYPE_PRESENT] - delta < p_state->color_temperature[TYPE_TARGET])
-                {
-                    p_state->color_temperature[TYPE_PRESENT] = p_state->color_temperature[TYPE_TARGET];
-                    sig_model_event_set_indicate(SIG_MODEL_INDICATE_GEN_CTL);
-                }
-                else
-                {
-                    p_state->color_temperature[TYPE_PRESENT] -= delta;
-                    if (p_state->color_temperature[TYPE_PRESENT] == p_state->color_temperature[TYPE_TARGET])
-                    {
-                        sig_model_event_set_indicate(SIG_MODEL_INDICATE_GEN_CTL);
-                    }
-                }
-            }
-            cycle = 1;
-        }
-#endif
+    if (p_state->trans_lightness != p_state->lightness[TYPE_TARGET])
+    {
+        p_state->lightness[TYPE_PRESENT] = sig_model_trans_value(p_state->trans_lightness, p_state->lightness[TYPE_TARGET], level);
+        cycle = 1;
     }
-#if 0
-    printf("next: %d->%d|%02x->%02x|%02x->%02x\n", p_state->onoff[TYPE_PRESENT], p_state->onoff[TYPE_TARGET],
-           p_state->lightness[TYPE_PRESENT], p_state->lightness[TYPE_TARGET], p_state->color_temperature[TYPE_PRESENT], p_state->color_temperature[TYPE_TARGET]);
-#endif
-#ifdef CONFIG_MESH_MODEL_GEN_ONOFF_SRV
-    if (p_state->onoff[TYPE_PRESENT] == p_state->onoff[TYPE_TARGET])
-#endif
-#ifdef CONFIG_MESH_MODEL_LIGHTNESS_SRV
-        if (p_state->lightness[TYPE_PRESENT] == p_state->lightness[TYPE_TARGET])
 #endif
 #ifdef CONFIG_MESH_MODEL_CTL_SRV
-            if (p_state->color_temperature[TYPE_PRESENT] == p_state->color_temperature[TYPE_TARGET])
+    if (p_state->trans_color_temperature != p_state->color_temperature[TYPE_TARGET])
+    {
+        p_state->color_temperature[TYPE_PRESENT] = sig_model_trans_value(p_state->trans_color_temperature, p_state->color_temperature[TYPE_TARGET], level);
+        cycle = 1;
+    }
 #endif
-                cycle = 0;
 
-    //BT_DBG("cycle %d", cycle);
-    if (cycle == 0)
+    if (cycle && progress < SIG_MODEL_TRANS_Q16_ONE)
     {
+        return cycle;
+    }
+
 #ifdef CONFIG_MESH_MODEL_GEN_ONOFF_SRV
 #ifdef CONFIG_MESH_MODEL_LIGHTNESS_SRV
-        if (p_state->lightness[TYPE_TARGET] == 0)
-        {
-            p_state->onoff[TYPE_TARGET] = 0;
-        }
+    if (p_state->lightness[TYPE_TARGET] == 0)
+    {
+        p_state->onoff[TYPE_TARGET] = 0;
+    }
 #endif
-        if (p_state->onoff[TYPE_PRESENT] != p_state->onoff[TYPE_TARGET])
-        {
-            p_state->onoff[TYPE_PRESENT] = p_state->onoff[TYPE_TARGET];
-            sig_model_event_set_indicate(SIG_MODEL_INDICATE_GEN_ONOFF);
-        }
-        //BT_DBG("onoff %d->%d", p_state->onoff[TYPE_PRESENT], p_state->onoff[TYPE_TARGET]);
+    if (p_state->onoff[TYPE_PRESENT] != p_state->onoff[TYPE_TARGET])
+    {
+        p_state->onoff[TYPE_PRESENT] = p_state->onoff[TYPE_TARGET];
+        sig_model_event_set_indicate(SIG_MODEL_INDICATE_GEN_ONOFF);
+    }
 #endif
 #ifdef CONFIG_MESH_MODEL_LIGHTNESS_SRV
-        if (p_state->lightness[TYPE_PRESENT] != p_state->lightness[TYPE_TARGET])
-        {
-            p_state->lightness[TYPE_PRESENT] = p_state->lightness[TYPE_TARGET];
-            sig_model_event_set_indicate(SIG_MODEL_INDICATE_GEN_LIGHTNESS);
-        }
-        //BT_DBG("lightness %02x->%02x", p_state->lightness[TYPE_PRESENT], p_state->lightness[TYPE_TARGET]);
+    if (p_state->trans_lightness != p_state->lightness[TYPE_TARGET])
+    {
+        p_state->lightness[TYPE_PRESENT] = p_state->lightness[TYPE_TARGET];
+        sig_model_event_set_indicate(SIG_MODEL_INDICATE_GEN_LIGHTNESS);
+    }
 #endif
 #ifdef CONFIG_MESH_MODEL_CTL_SRV
-        if (p_state->color_temperature[TYPE_PRESENT] != p_state->color_temperature[TYPE_TARGET])
-        {
-            p_state->color_temperature[TYPE_PRESENT] = p_state->color_temperature[TYPE_TARGET];
-            sig_model_event_set_indicate(SIG_MODEL_INDICATE_GEN_CTL);
-        }
-        //BT_DBG("color_temperature %02x->%02x", p_state->color_temperature[TYPE_PRESENT], p_state->color_temperature[TYPE_TARGET]);
-#endif
-        p_state->trans = 0;
+    if (p_state->trans_color_temperature != p_state->color_temperature[TYPE_TARGET])
+    {
+        p_state->color_temperature[TYPE_PRESENT] = p_state->color_temperature[TYPE_TARGET];
+        sig_model_event_set_indicate(SIG_MODEL_INDICATE_GEN_CTL);
     }
+#endif
+    p_state->trans = 0;
 
-    return cycle;
+    return 0;
 }
 #endif
 
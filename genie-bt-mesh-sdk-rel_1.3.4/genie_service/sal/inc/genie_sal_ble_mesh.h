@@ -12,6 +12,7 @@
 #include <access.h>
 #include <mesh.h>
 #include <prov.h>
+#include <transport.h>
 
 #include <api/mesh.h>
 #endif
@@ -20,6 +20,7 @@ extern "C" {
 #include <k_spin_lock.h>
 #include <k_sys.h>
 #include <k_list.h>
+#include <k_wheel.h>
 #include <k_obj.h>
 #include <k_sched.h>
 #include <k_task.h>
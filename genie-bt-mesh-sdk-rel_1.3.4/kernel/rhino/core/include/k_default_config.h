@@ -74,6 +74,22 @@
 #define RHINO_CONFIG_TIMER                   0
 #endif
 
+/* hierarchical timing wheel for the tick list and the timer queue */
+#ifndef RHINO_CONFIG_TICK_WHEEL
+#define RHINO_CONFIG_TICK_WHEEL              0
+#endif
+
+#if (RHINO_CONFIG_TICK_WHEEL > 0)
+/* slots per level is 1 << BITS, ticks covered is 1 << (BITS * LEVELS) */
+#ifndef RHINO_CONFIG_TICK_WHEEL_BITS
+#define RHINO_CONFIG_TICK_WHEEL_BITS         5
+#endif
+
+#ifndef RHINO_CONFIG_TICK_WHEEL_LEVELS
+#define RHINO_CONFIG_TICK_WHEEL_LEVELS       4
+#endif
+#endif /* RHINO_CONFIG_TICK_WHEEL */
+
 #ifndef RHINO_CONFIG_MM_BLK
 #define RHINO_CONFIG_MM_BLK                  1
 #endif
@@ -101,6 +117,27 @@
 #define RHINO_CONFIG_MM_TLF_BLK_SIZE         8192
 #endif
 
+/* size-class slabs tried before the fix pool, classes are
+   2^MINBIT ... 2^(MINBIT + CLASS_NUM - 1) bytes */
+#ifndef RHINO_CONFIG_MM_SLAB
+#define RHINO_CONFIG_MM_SLAB                 0
+#endif
+
+#if (RHINO_CONFIG_MM_SLAB > 0)
+#ifndef RHINO_CONFIG_MM_SLAB_MINBIT
+#define RHINO_CONFIG_MM_SLAB_MINBIT          4
+#endif
+
+#ifndef RHINO_CONFIG_MM_SLAB_CLASS_NUM
+#define RHINO_CONFIG_MM_SLAB_CLASS_NUM       5
+#endif
+
+/* bytes of heap reserved for each class */
+#ifndef RHINO_CONFIG_MM_SLAB_CLASS_SIZE
+#define RHINO_CONFIG_MM_SLAB_CLASS_SIZE      1024
+#endif
+#endif /* RHINO_CONFIG_MM_SLAB */
+
 #ifndef RHINO_CONFIG_MM_QUICK
 #define RHINO_CONFIG_MM_QUICK                1
 #endif
@@ -281,6 +318,24 @@
 #error "RHINO_CONFIG_MM_BLK should be 1 when RHINO_CONFIG_MM_TLF is enabled."
 #endif
 
+#if (RHINO_CONFIG_TICK_WHEEL >= 1)
+#if ((RHINO_CONFIG_TICK_WHEEL_BITS < 1) || (RHINO_CONFIG_TICK_WHEEL_BITS > 5))
+#error "RHINO_CONFIG_TICK_WHEEL_BITS should be 1 ~ 5."
+#endif
+#if ((RHINO_CONFIG_TICK_WHEEL_LEVELS < 2) || (RHINO_CONFIG_TICK_WHEEL_BITS * RHINO_CONFIG_TICK_WHEEL_LEVELS > 63))
+#error "RHINO_CONFIG_TICK_WHEEL_LEVELS should be >= 2 and BITS * LEVELS <= 63."
+#endif
+#endif
+
+#if ((RHINO_CONFIG_MM_TLF >= 1) && (RHINO_CONFIG_MM_SLAB >= 1))
+#if (RHINO_CONFIG_MM_SLAB_MINBIT < 3)
+#error "RHINO_CONFIG_MM_SLAB_MINBIT must be >= 3."
+#endif
+#if ((RHINO_CONFIG_MM_SLAB_CLASS_SIZE % (1 << (RHINO_CONFIG_MM_SLAB_MINBIT + RHINO_CONFIG_MM_SLAB_CLASS_NUM - 1))) != 0)
+#error "RHINO_CONFIG_MM_SLAB_CLASS_SIZE must be a multiple of the largest slab class."
+#endif
+#endif
+
 #if ((RHINO_CONFIG_KOBJ_DYN_ALLOC >= 1) && (RHINO_CONFIG_MM_TLF == 0))
 #error \
   "RHINO_CONFIG_MM_TLF should be 1 when RHINO_CONFIG_KOBJ_DYN_ALLOC is enabled."
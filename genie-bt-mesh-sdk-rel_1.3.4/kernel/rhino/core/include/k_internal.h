@@ -29,6 +29,9 @@ extern cpu_stack_t  g_idle_task_stack[RHINO_CONFIG_CPU_NUM]
 /* tick attribute */
 extern tick_t  g_tick_count;
 extern klist_t g_tick_head;
+#if (RHINO_CONFIG_TICK_WHEEL > 0)
+extern kwheel_t g_tick_wheel;
+#endif
 
 #if (RHINO_CONFIG_SYSTEM_STATS > 0)
 extern kobj_list_t g_kobj_list;
@@ -36,6 +39,9 @@ extern kobj_list_t g_kobj_list;
 
 #if (RHINO_CONFIG_TIMER > 0)
 extern klist_t          g_timer_head;
+#if (RHINO_CONFIG_TICK_WHEEL > 0)
+extern kwheel_t         g_timer_wheel;
+#endif
 extern sys_time_t       g_timer_count;
 extern ktask_t          g_timer_task;
 extern cpu_stack_t      g_timer_task_stack[RHINO_CONFIG_TIMER_TASK_STACK_SIZE];
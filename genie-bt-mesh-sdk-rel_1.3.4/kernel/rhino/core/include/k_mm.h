@@ -77,6 +77,46 @@
 #define MM_CRITICAL_EXIT(pmmhead) krhino_mutex_unlock(&(pmmhead->mm_mutex))
 #endif
 
+#if (RHINO_CONFIG_MM_SLAB > 0)
+/* slab classes: 2^MM_SLAB_MIN_BIT ... MM_SLAB_MAX_SIZE bytes, every class
+   owns MM_SLAB_CLASS_SIZE bytes of one area carved from the heap */
+#define MM_SLAB_MIN_BIT         RHINO_CONFIG_MM_SLAB_MINBIT
+#define MM_SLAB_CLASS_NUM       RHINO_CONFIG_MM_SLAB_CLASS_NUM
+#define MM_SLAB_CLASS_SIZE      RHINO_CONFIG_MM_SLAB_CLASS_SIZE
+#define MM_SLAB_AREA_SIZE       (MM_SLAB_CLASS_NUM * MM_SLAB_CLASS_SIZE)
+#define MM_SLAB_MAX_SIZE        (1 << (MM_SLAB_MIN_BIT + MM_SLAB_CLASS_NUM - 1))
+/* the smallest class has the most blks */
+#define MM_SLAB_MAX_BLKS        (MM_SLAB_CLASS_SIZE >> MM_SLAB_MIN_BIT)
+
+/* get blk size of a class */
+#define MM_SLAB_BLK_SIZE(cls)   \
+        ((size_t)1 << (MM_SLAB_MIN_BIT + (cls)))
+/* is buf in slab area? */
+#define MM_SLAB_CHECK(mmhead, buf)                                  \
+        ((mmhead)->slab_area != NULL                                \
+        && ((uint8_t *)(buf) >= (mmhead)->slab_area)                \
+        && ((uint8_t *)(buf) <  (mmhead)->slab_area + MM_SLAB_AREA_SIZE))
+/* get class of a slab buf */
+#define MM_SLAB_GET_CLASS(mmhead, buf)  \
+        ((int32_t)(((uint8_t *)(buf) - (mmhead)->slab_area) / MM_SLAB_CLASS_SIZE))
+
+typedef struct
+{
+    size_t blk_whole;
+    size_t blk_avail;
+#if (K_MM_STATISTIC > 0)
+    size_t maxused;
+    /* allocs served, and allocs that found the class full */
+    size_t hit_times;
+    size_t miss_times;
+    /* bytes asked by the served allocs, for internal fragmentation */
+    size_t req_size;
+#endif
+    /* one bit per blk (krhino_bitmap_* order), set when the blk is free */
+    uint32_t free_bitmap[(MM_SLAB_MAX_BLKS + 31) >> 5];
+} k_mm_slab_t;
+#endif
+
 /*struct of memory list ,every memory block include this information*/
 typedef struct free_ptr_struct
 {
@@ -119,6 +159,10 @@ typedef struct
 #if (RHINO_CONFIG_MM_BLK > 0)
     void *fix_pool;
 #endif
+#if (RHINO_CONFIG_MM_SLAB > 0)
+    uint8_t    *slab_area;
+    k_mm_slab_t slab[MM_SLAB_CLASS_NUM];
+#endif
 #if (K_MM_STATISTIC > 0)
     size_t used_size;
     size_t maxused_size;
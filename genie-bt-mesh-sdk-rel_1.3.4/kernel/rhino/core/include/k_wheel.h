@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2015-2017 Alibaba Group Holding Limited
+ */
+
+#ifndef K_WHEEL_H
+#define K_WHEEL_H
+
+#if (RHINO_CONFIG_TICK_WHEEL > 0)
+
+#define KWHEEL_SLOTS  (1u << RHINO_CONFIG_TICK_WHEEL_BITS)
+#define KWHEEL_MASK   (KWHEEL_SLOTS - 1u)
+
+/* returns the absolute expiry tick of a node linked on the wheel */
+typedef tick_t (*kwheel_match_t)(klist_t *node);
+
+typedef struct {
+    /* next tick to be processed */
+    tick_t         cur;
+    kwheel_match_t match;
+    /* bit n set when slot[level][n] is not empty */
+    uint32_t       busy[RHINO_CONFIG_TICK_WHEEL_LEVELS];
+    klist_t        slot[RHINO_CONFIG_TICK_WHEEL_LEVELS][KWHEEL_SLOTS];
+} kwheel_t;
+
+/**
+ * This function will init a timing wheel
+ * @param[in]  wheel  pointer to the wheel
+ * @param[in]  match  getter of the expiry tick of a node
+ * @param[in]  now    current tick
+ * @return  no return
+ */
+void kwheel_init(kwheel_t *wheel, kwheel_match_t match, tick_t now);
+
+/**
+ * This function will link a node on the wheel, O(1)
+ * @param[in]  wheel  pointer to the wheel
+ * @param[in]  node   node to link, its expiry tick is read by the getter
+ * @return  no return
+ */
+void kwheel_insert(kwheel_t *wheel, klist_t *node);
+
+/**
+ * This function will unlink a node from the wheel, O(1)
+ * @param[in]  wheel  pointer to the wheel
+ * @param[in]  node   node linked by kwheel_insert
+ * @return  no return
+ */
+void kwheel_rm(kwheel_t *wheel, klist_t *node);
+
+/**
+ * This function will advance the wheel up to now and return an expired node,
+ * the node stays linked and must be removed by the caller before next call
+ * @param[in]  wheel  pointer to the wheel
+ * @param[in]  now    current tick
+ * @return  the expired node or NULL when nothing is due up to now
+ */
+klist_t *kwheel_expire(kwheel_t *wheel, tick_t now);
+
+/**
+ * This function will get the earliest expiry tick on the wheel
+ * @param[in]   wheel  pointer to the wheel
+ * @param[out]  match  the earliest expiry tick
+ * @return  0 when the wheel is empty, otherwise 1
+ */
+uint8_t kwheel_next(kwheel_t *wheel, tick_t *match);
+
+#endif /* RHINO_CONFIG_TICK_WHEEL */
+
+#endif /* K_WHEEL_H */
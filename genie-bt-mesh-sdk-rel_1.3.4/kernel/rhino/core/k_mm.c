@@ -132,6 +132,99 @@ static void removesize(k_mm_head *mmhead, size_t size)
 #define stats_removesize(mmhead,size)           do{}while(0)
 #endif
 
+#if (RHINO_CONFIG_MM_SLAB > 0)
+/* smallest class whose blk holds size */
+static int32_t size_to_slab(size_t size)
+{
+    size_t cnt;
+
+    cnt = 32 - krhino_clz32(size - 1);
+    if (cnt <= MM_SLAB_MIN_BIT) {
+        return 0;
+    }
+
+    return cnt - MM_SLAB_MIN_BIT;
+}
+
+static void k_mm_slab_init(k_mm_head *mmhead, uint8_t *area)
+{
+    int32_t      cls;
+    int32_t      i;
+    k_mm_slab_t *slab;
+
+    for (cls = 0; cls < MM_SLAB_CLASS_NUM; cls++) {
+        slab = &mmhead->slab[cls];
+        memset(slab, 0, sizeof(k_mm_slab_t));
+
+        slab->blk_whole = MM_SLAB_CLASS_SIZE / MM_SLAB_BLK_SIZE(cls);
+        slab->blk_avail = slab->blk_whole;
+        for (i = 0; i < (int32_t)slab->blk_whole; i++) {
+            krhino_bitmap_set(slab->free_bitmap, i);
+        }
+    }
+
+    mmhead->slab_area = area;
+}
+
+static void *k_mm_slab_alloc(k_mm_head *mmhead, size_t size)
+{
+    int32_t      cls;
+    int32_t      idx;
+    k_mm_slab_t *slab;
+
+    cls  = size_to_slab(size);
+    slab = &mmhead->slab[cls];
+
+    if (slab->blk_avail == 0) {
+#if (K_MM_STATISTIC > 0)
+        slab->miss_times++;
+#endif
+        return NULL;
+    }
+
+    idx = krhino_find_first_bit(slab->free_bitmap);
+    krhino_bitmap_clear(slab->free_bitmap, idx);
+    slab->blk_avail--;
+
+#if (K_MM_STATISTIC > 0)
+    slab->hit_times++;
+    slab->req_size += size;
+    if (slab->blk_whole - slab->blk_avail > slab->maxused) {
+        slab->maxused = slab->blk_whole - slab->blk_avail;
+    }
+#endif
+    stats_addsize(mmhead, MM_SLAB_BLK_SIZE(cls), 0);
+
+    return mmhead->slab_area + cls * MM_SLAB_CLASS_SIZE
+           + ((size_t)idx << (MM_SLAB_MIN_BIT + cls));
+}
+
+static void k_mm_slab_free(k_mm_head *mmhead, void *ptr)
+{
+    int32_t      cls;
+    int32_t      idx;
+    size_t       off;
+    k_mm_slab_t *slab;
+
+    cls  = MM_SLAB_GET_CLASS(mmhead, ptr);
+    off  = (uint8_t *)ptr - mmhead->slab_area - cls * MM_SLAB_CLASS_SIZE;
+    idx  = (int32_t)(off >> (MM_SLAB_MIN_BIT + cls));
+    slab = &mmhead->slab[cls];
+
+    /* not the start of a blk, or the blk is free already */
+    if ((off & (MM_SLAB_BLK_SIZE(cls) - 1)) != 0
+        || (slab->free_bitmap[BITMAP_WORD(idx)] & BITMAP_MASK(idx)) != 0) {
+        k_err_proc(RHINO_SYS_FATAL_ERR);
+        return;
+    }
+
+    krhino_bitmap_set(slab->free_bitmap, idx);
+    slab->blk_avail++;
+
+    stats_removesize(mmhead, MM_SLAB_BLK_SIZE(cls));
+}
+#endif
+
 kstat_t krhino_init_mm_head(k_mm_head **ppmmhead, void *addr, size_t len )
 {
     k_mm_list_t *nextblk;
@@ -142,6 +235,9 @@ kstat_t krhino_init_mm_head(k_mm_head **ppmmhead, void *addr, size_t len )
     mblk_pool_t *mmblk_pool;
     kstat_t      stat;
 #endif
+#if (RHINO_CONFIG_MM_SLAB > 0)
+    uint8_t     *slab_area;
+#endif
 
     NULL_PARA_CHK(ppmmhead);
     NULL_PARA_CHK(addr);
@@ -223,6 +319,22 @@ kstat_t krhino_init_mm_head(k_mm_head **ppmmhead, void *addr, size_t len )
     }
 #endif
 
+#if (RHINO_CONFIG_MM_SLAB > 0)
+    /* only when the heap still keeps MIN_FREE_MEMORY_SIZE for user alloced */
+    slab_area = NULL;
+    if (len >= MIN_FREE_MEMORY_SIZE + RHINO_CONFIG_MM_TLF_BLK_SIZE + MM_SLAB_AREA_SIZE) {
+        /* note: stats_addsize inside */
+        slab_area = k_mm_alloc(pmmhead, MM_SLAB_AREA_SIZE);
+    }
+    if (slab_area) {
+        k_mm_slab_init(pmmhead, slab_area);
+#if (K_MM_STATISTIC > 0)
+        stats_removesize(pmmhead, MM_SLAB_AREA_SIZE);
+        pmmhead->maxused_size = pmmhead->used_size;
+#endif
+    }
+#endif
+
     return RHINO_SUCCESS;
 }
 
@@ -414,6 +526,17 @@ void *k_mm_alloc(k_mm_head *mmhead, size_t size)
 
     MM_CRITICAL_ENTER(mmhead);
 
+#if (RHINO_CONFIG_MM_SLAB > 0)
+    /* size class blk, no split */
+    if (mmhead->slab_area != NULL && size <= MM_SLAB_MAX_SIZE) {
+        retptr = k_mm_slab_alloc(mmhead, size);
+        if (retptr) {
+            MM_CRITICAL_EXIT(mmhead);
+            return retptr;
+        }
+    }
+#endif
+
 #if (RHINO_CONFIG_MM_BLK > 0)
     /* little blk, try to get from mm_pool */
     if (mmhead->fix_pool != NULL) {
@@ -525,6 +648,15 @@ void  k_mm_free(k_mm_head *mmhead, void *ptr)
 
     MM_CRITICAL_ENTER(mmhead);
 
+#if (RHINO_CONFIG_MM_SLAB > 0)
+    /* slab blk, no merge */
+    if (MM_SLAB_CHECK(mmhead, ptr)) {
+        k_mm_slab_free(mmhead, ptr);
+        MM_CRITICAL_EXIT(mmhead);
+        return;
+    }
+#endif
+
 #if (RHINO_CONFIG_MM_BLK > 0)
     /* fix blk, free to mm_pool */
     if (krhino_mblk_check(mmhead->fix_pool, ptr)) {
@@ -619,6 +751,24 @@ void *k_mm_realloc(k_mm_head *mmhead, void *oldmem, size_t new_size)
 
     MM_CRITICAL_ENTER(mmhead);
 
+#if (RHINO_CONFIG_MM_SLAB > 0)
+    /*begin of oldmem in slab case*/
+    if (MM_SLAB_CHECK(mmhead, oldmem)) {
+        old_size = MM_SLAB_BLK_SIZE(MM_SLAB_GET_CLASS(mmhead, oldmem));
+        MM_CRITICAL_EXIT(mmhead);
+        if (new_size <= old_size) {
+            return oldmem;
+        }
+        ptr_aux = k_mm_alloc(mmhead, new_size);
+        if (ptr_aux) {
+            memcpy(ptr_aux, oldmem, old_size);
+            k_mm_free(mmhead, oldmem);
+        }
+        return ptr_aux;
+    }
+    /*end of slab case*/
+#endif
+
 #if (RHINO_CONFIG_MM_BLK > 0)
     /*begin of oldmem in mmblk case*/
     if (krhino_mblk_check(mmhead->fix_pool, oldmem)) {
@@ -753,6 +903,13 @@ void krhino_owner_attach(k_mm_head *mmhead, void *addr, size_t allocator)
     }
 #endif
 
+#if (RHINO_CONFIG_MM_SLAB > 0)
+    /* slab blk has no head for debug info */
+    if (MM_SLAB_CHECK(mmhead, addr)) {
+        return;
+    }
+#endif
+
     MM_CRITICAL_ENTER(mmhead);
 
     blk = MM_GET_THIS_BLK(addr);
@@ -399,6 +399,11 @@ void dump_kmm_statistic_info(k_mm_head *mmhead)
 #if (RHINO_CONFIG_MM_BLK > 0)
     mblk_pool_t *pool;
 #endif
+#if (RHINO_CONFIG_MM_SLAB > 0 && K_MM_STATISTIC > 0)
+    k_mm_slab_t *slab;
+    size_t       blk_size;
+    size_t       served;
+#endif
 
     if (!mmhead) {
         return;
@@ -428,6 +433,24 @@ void dump_kmm_statistic_info(k_mm_head *mmhead)
               pool->blk_whole * RHINO_CONFIG_MM_BLK_SIZE);
     }
 #endif
+#if (RHINO_CONFIG_MM_SLAB > 0 && K_MM_STATISTIC > 0)
+    if (mmhead->slab_area != NULL) {
+        /* hit%: allocs served by the class, waste%: blk bytes not asked for */
+        print("-----------------slab information:-----------------\r\n");
+        print(" blksize | total | used | maxused |   hit    |   miss   | hit%% | waste%%\r\n");
+        for (i = 0; i < MM_SLAB_CLASS_NUM; i++) {
+            slab     = &mmhead->slab[i];
+            blk_size = MM_SLAB_BLK_SIZE(i);
+            served   = slab->hit_times * blk_size;
+            print(" %7d | %5d | %4d | %7d | %8d | %8d | %4d | %6d\r\n",
+                  blk_size, slab->blk_whole, slab->blk_whole - slab->blk_avail,
+                  slab->maxused, slab->hit_times, slab->miss_times,
+                  (slab->hit_times + slab->miss_times) ?
+                  (int)((uint64_t)slab->hit_times * 100 / (slab->hit_times + slab->miss_times)) : 0,
+                  served ? (int)((uint64_t)(served - slab->req_size) * 100 / served) : 0);
+        }
+    }
+#endif
 }
 
 uint32_t dumpsys_mm_info_func(uint32_t len)
@@ -27,6 +27,10 @@ cpu_stack_t  g_idle_task_stack[RHINO_CONFIG_CPU_NUM][RHINO_CONFIG_IDLE_TASK_STAC
 /* tick attribute */
 tick_t       g_tick_count;
 klist_t      g_tick_head;
+#if (RHINO_CONFIG_TICK_WHEEL > 0)
+/* g_tick_head stays empty and only marks tasks linked on the wheel */
+kwheel_t     g_tick_wheel;
+#endif
 
 #if (RHINO_CONFIG_SYSTEM_STATS > 0)
 kobj_list_t  g_kobj_list;
@@ -34,6 +38,9 @@ kobj_list_t  g_kobj_list;
 
 #if (RHINO_CONFIG_TIMER > 0)
 klist_t          g_timer_head;
+#if (RHINO_CONFIG_TICK_WHEEL > 0)
+kwheel_t         g_timer_wheel;
+#endif
 sys_time_t       g_timer_count;
 ktask_t          g_timer_task;
 cpu_stack_t      g_timer_task_stack[RHINO_CONFIG_TIMER_TASK_STACK_SIZE];
@@ -197,6 +197,26 @@ void krhino_intrpt_exit(void)
     RHINO_CPU_INTRPT_ENABLE();
 }
 
+#if (RHINO_CONFIG_TICK_WHEEL > 0)
+tick_t krhino_next_sleep_ticks_get(void)
+{
+    CPSR_ALLOC();
+
+    tick_t match;
+    tick_t ticks;
+
+    RHINO_CRITICAL_ENTER();
+    if (kwheel_next(&g_tick_wheel, &match) == 0u) {
+        RHINO_CRITICAL_EXIT();
+        return RHINO_WAIT_FOREVER;
+    }
+
+    ticks = match > g_tick_count ? match - g_tick_count : 0u;
+    RHINO_CRITICAL_EXIT();
+
+    return ticks;
+}
+#else
 tick_t krhino_next_sleep_ticks_get(void)
 {
     CPSR_ALLOC();
@@ -216,11 +236,12 @@ tick_t krhino_next_sleep_ticks_get(void)
 
     iter  = tick_head->next;
     tcb   = krhino_list_entry(iter, ktask_t, tick_list);
-    ticks = tcb->tick_match - g_tick_count;
+    ticks = tcb->tick_match > g_tick_count ? tcb->tick_match - g_tick_count : 0u;
     RHINO_CRITICAL_EXIT();
 
     return ticks;
 }
+#endif
 
 
 size_t krhino_global_space_get(void)
@@ -232,10 +253,17 @@ size_t krhino_global_space_get(void)
           + sizeof(g_active_task) + sizeof(g_idle_task) + sizeof(g_idle_task_stack)
           + sizeof(g_tick_head) + sizeof(g_tick_count) + sizeof(g_idle_count);
 
+#if (RHINO_CONFIG_TICK_WHEEL > 0)
+    mem += sizeof(g_tick_wheel);
+#endif
+
 #if (RHINO_CONFIG_TIMER > 0)
     mem += sizeof(g_timer_head) + sizeof(g_timer_count)
            + sizeof(g_timer_task) + sizeof(g_timer_task_stack)
            + sizeof(g_timer_queue) + sizeof(timer_queue_cb);
+#if (RHINO_CONFIG_TICK_WHEEL > 0)
+    mem += sizeof(g_timer_wheel);
+#endif
 #endif
 
 #if (RHINO_CONFIG_SYSTEM_STATS > 0)
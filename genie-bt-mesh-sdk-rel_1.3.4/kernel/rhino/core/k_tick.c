@@ -4,11 +4,22 @@
 
 #include <k_api.h>
 
+#if (RHINO_CONFIG_TICK_WHEEL > 0)
+static tick_t tick_wheel_match(klist_t *node)
+{
+    return krhino_list_entry(node, ktask_t, tick_list)->tick_match;
+}
+#endif
+
 void tick_list_init(void)
 {
    klist_init(&g_tick_head);
+#if (RHINO_CONFIG_TICK_WHEEL > 0)
+   kwheel_init(&g_tick_wheel, tick_wheel_match, g_tick_count);
+#endif
 }
 
+#if (RHINO_CONFIG_TICK_WHEEL == 0)
 RHINO_INLINE void tick_list_pri_insert(klist_t *head, ktask_t *task)
 {
     tick_t   val;
@@ -29,6 +40,7 @@ RHINO_INLINE void tick_list_pri_insert(klist_t *head, ktask_t *task)
 
     klist_insert(q, &task->tick_list);
 }
+#endif
 
 void tick_list_insert(ktask_t *task, tick_t time)
 {
@@ -39,7 +51,11 @@ void tick_list_insert(ktask_t *task, tick_t time)
         task->tick_remain = time;
 
         tick_head_ptr = &g_tick_head;
+#if (RHINO_CONFIG_TICK_WHEEL > 0)
+        kwheel_insert(&g_tick_wheel, &task->tick_list);
+#else
         tick_list_pri_insert(tick_head_ptr, task);
+#endif
         task->tick_head = tick_head_ptr;
     }
 }
@@ -49,11 +65,73 @@ void tick_list_rm(ktask_t *task)
     klist_t *tick_head_ptr = task->tick_head;
 
     if (tick_head_ptr != NULL) {
+#if (RHINO_CONFIG_TICK_WHEEL > 0)
+        kwheel_rm(&g_tick_wheel, &task->tick_list);
+#else
         klist_rm(&task->tick_list);
+#endif
         task->tick_head = NULL;
     }
 }
 
+static void tick_task_timeout(ktask_t *p_tcb)
+{
+    switch (p_tcb->task_state) {
+        case K_SLEEP:
+            p_tcb->blk_state  = BLK_FINISH;
+            p_tcb->task_state = K_RDY;
+            tick_list_rm(p_tcb);
+            ready_list_add(&g_ready_queue, p_tcb);
+            break;
+        case K_PEND:
+            tick_list_rm(p_tcb);
+            /* remove task on the block list because task is timeout */
+            klist_rm(&p_tcb->task_list);
+            ready_list_add(&g_ready_queue, p_tcb);
+            p_tcb->blk_state  = BLK_TIMEOUT;
+            p_tcb->task_state = K_RDY;
+            mutex_task_pri_reset(p_tcb);
+            p_tcb->blk_obj    = NULL;
+            break;
+        case K_PEND_SUSPENDED:
+            tick_list_rm(p_tcb);
+            /* remove task on the block list because task is timeout */
+            klist_rm(&p_tcb->task_list);
+            p_tcb->blk_state  = BLK_TIMEOUT;
+            p_tcb->task_state = K_SUSPENDED;
+            mutex_task_pri_reset(p_tcb);
+            p_tcb->blk_obj    = NULL;
+            break;
+        case K_SLEEP_SUSPENDED:
+            p_tcb->task_state = K_SUSPENDED;
+            p_tcb->blk_state  = BLK_FINISH;
+            tick_list_rm(p_tcb);
+            break;
+        default:
+            k_err_proc(RHINO_SYS_FATAL_ERR);
+            break;
+    }
+}
+
+#if (RHINO_CONFIG_TICK_WHEEL > 0)
+void tick_list_update(tick_i_t ticks)
+{
+    CPSR_ALLOC();
+
+    klist_t *iter;
+
+    RHINO_CRITICAL_ENTER();
+
+    g_tick_count += ticks;
+
+    /* every expired task is unlinked by tick_task_timeout */
+    while ((iter = kwheel_expire(&g_tick_wheel, g_tick_count)) != NULL) {
+        tick_task_timeout(krhino_list_entry(iter, ktask_t, tick_list));
+    }
+
+    RHINO_CRITICAL_EXIT();
+}
+#else
 void tick_list_update(tick_i_t ticks)
 {
     CPSR_ALLOC();
@@ -81,42 +159,7 @@ void tick_list_update(tick_i_t ticks)
 
             /* since time list is sorted by remain time, so just campare  the absolute time */
             if (delta <= 0) {
-                switch (p_tcb->task_state) {
-                    case K_SLEEP:
-                        p_tcb->blk_state  = BLK_FINISH;
-                        p_tcb->task_state = K_RDY;
-                        tick_list_rm(p_tcb);
-                        ready_list_add(&g_ready_queue, p_tcb);
-                        break;
-                    case K_PEND:
-                        tick_list_rm(p_tcb);
-                        /* remove task on the block list because task is timeout */
-                        klist_rm(&p_tcb->task_list);
-                        ready_list_add(&g_ready_queue, p_tcb);
-                        p_tcb->blk_state  = BLK_TIMEOUT;
-                        p_tcb->task_state = K_RDY;
-                        mutex_task_pri_reset(p_tcb);
-                        p_tcb->blk_obj    = NULL;
-                        break;
-                    case K_PEND_SUSPENDED:
-                        tick_list_rm(p_tcb);
-                        /* remove task on the block list because task is timeout */
-                        klist_rm(&p_tcb->task_list);
-                        p_tcb->blk_state  = BLK_TIMEOUT;
-                        p_tcb->task_state = K_SUSPENDED;
-                        mutex_task_pri_reset(p_tcb);
-                        p_tcb->blk_obj    = NULL;
-                        break;
-                    case K_SLEEP_SUSPENDED:
-                        p_tcb->task_state = K_SUSPENDED;
-                        p_tcb->blk_state  = BLK_FINISH;
-                        tick_list_rm(p_tcb);
-                        break;
-                    default:
-                        k_err_proc(RHINO_SYS_FATAL_ERR);
-                        break;
-                }
-
+                tick_task_timeout(p_tcb);
                 iter = iter_temp;
             } else {
                 break;
@@ -128,4 +171,4 @@ void tick_list_update(tick_i_t ticks)
 
     RHINO_CRITICAL_EXIT();
 }
-
+#endif
@@ -5,6 +5,19 @@
 #include <k_api.h>
 
 #if (RHINO_CONFIG_TIMER > 0)
+#if (RHINO_CONFIG_TICK_WHEEL > 0)
+static tick_t timer_wheel_match(klist_t *node)
+{
+    return krhino_list_entry(node, ktimer_t, timer_list)->match;
+}
+
+static void timer_list_pri_insert(klist_t *head, ktimer_t *timer)
+{
+    (void)head;
+
+    kwheel_insert(&g_timer_wheel, &timer->timer_list);
+}
+#else
 static void timer_list_pri_insert(klist_t *head, ktimer_t *timer)
 {
     sys_time_t val;
@@ -25,6 +38,7 @@ static void timer_list_pri_insert(klist_t *head, ktimer_t *timer)
 
     klist_insert(q, &timer->timer_list);
 }
+#endif
 
 static void timer_list_rm(ktimer_t *timer)
 {
@@ -32,7 +46,11 @@ static void timer_list_rm(ktimer_t *timer)
 
     head = timer->to_head;
     if (head != NULL) {
+#if (RHINO_CONFIG_TICK_WHEEL > 0)
+        kwheel_rm(&g_timer_wheel, &timer->timer_list);
+#else
         klist_rm(&timer->timer_list);
+#endif
         timer->to_head = NULL;
     }
 }
@@ -226,6 +244,36 @@ kstat_t krhino_timer_arg_change_auto(ktimer_t *timer, void *arg)
     return err;
 }
 
+#if (RHINO_CONFIG_TICK_WHEEL > 0)
+static void timer_cb_proc(void)
+{
+    klist_t  *q;
+    ktimer_t *timer;
+
+    /* the expired timer is unlinked before the next expire call */
+    while ((q = kwheel_expire(&g_timer_wheel, g_timer_count)) != NULL) {
+        timer = krhino_list_entry(q, ktimer_t, timer_list);
+
+        timer->cb(timer, timer->timer_cb_arg);
+        timer_list_rm(timer);
+
+        if (timer->round_ticks > 0u) {
+            timer->remain  =  timer->round_ticks;
+            timer->match   =  g_timer_count + timer->remain;
+            timer->to_head = &g_timer_head;
+            timer_list_pri_insert(&g_timer_head, timer);
+        } else {
+            timer->timer_state = TIMER_DEACTIVE;
+        }
+    }
+}
+
+/* earliest match of the active timers, 0 when none is active */
+static uint8_t timer_next_match(sys_time_t *match)
+{
+    return kwheel_next(&g_timer_wheel, match);
+}
+#else
 static void timer_cb_proc(void)
 {
     klist_t     *q;
@@ -259,6 +307,21 @@ static void timer_cb_proc(void)
     }
 }
 
+static uint8_t timer_next_match(sys_time_t *match)
+{
+    ktimer_t *timer;
+
+    if (is_klist_empty(&g_timer_head)) {
+        return 0u;
+    }
+
+    timer = krhino_list_entry(g_timer_head.next, ktimer_t, timer_list);
+    *match = timer->match;
+
+    return 1u;
+}
+#endif
+
 static void cmd_proc(k_timer_queue_cb *cb, uint8_t cmd)
 {
     ktimer_t *timer;
@@ -376,7 +439,7 @@ static void timer_cmd_proc(k_timer_queue_cb *cb)
 
 static void timer_task(void *pa)
 {
-    ktimer_t         *timer;
+    sys_time_t        match;
     k_timer_queue_cb  cb_msg;
     kstat_t           err;
     sys_time_t        tick_start;
@@ -398,10 +461,9 @@ static void timer_task(void *pa)
 
         timer_cmd_proc(&cb_msg);
 
-        while (!is_klist_empty(&g_timer_head)) {
-            timer = krhino_list_entry(g_timer_head.next, ktimer_t, timer_list);
+        while (timer_next_match(&match) != 0u) {
             tick_start = krhino_sys_tick_get();
-            delta = (int)timer->match - (int)tick_start;
+            delta = (int)match - (int)tick_start;
             if (delta > 0) {
                 err = krhino_buf_queue_recv(&g_timer_queue, (tick_t)delta, &cb_msg, &msg_size);
                 tick_end = krhino_sys_tick_get();
@@ -427,6 +489,9 @@ static void timer_task(void *pa)
 void ktimer_init(void)
 {
     klist_init(&g_timer_head);
+#if (RHINO_CONFIG_TICK_WHEEL > 0)
+    kwheel_init(&g_timer_wheel, timer_wheel_match, g_timer_count);
+#endif
 
     krhino_fix_buf_queue_create(&g_timer_queue, "timer_queue",
                                  timer_queue_cb, sizeof(k_timer_queue_cb), RHINO_CONFIG_TIMER_MSG_NUM);
@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2015-2017 Alibaba Group Holding Limited
+ */
+
+#include <k_api.h>
+
+#if (RHINO_CONFIG_TICK_WHEEL > 0)
+
+#define KWHEEL_LEVELS     RHINO_CONFIG_TICK_WHEEL_LEVELS
+#define KWHEEL_SHIFT(lvl) ((lvl) * RHINO_CONFIG_TICK_WHEEL_BITS)
+#define KWHEEL_IDX(t, lvl) ((uint32_t)((t) >> KWHEEL_SHIFT(lvl)) & KWHEEL_MASK)
+#define KWHEEL_FULL       (0xFFFFFFFFu >> (32u - KWHEEL_SLOTS))
+/* ticks covered by the whole wheel, later nodes are parked on the top level */
+#define KWHEEL_SPAN       ((tick_t)1u << KWHEEL_SHIFT(KWHEEL_LEVELS))
+
+/* rotate the busy bits so that bit 0 is slot start */
+RHINO_INLINE uint32_t wheel_busy_rotate(uint32_t busy, uint32_t start)
+{
+    if (start == 0u) {
+        return busy;
+    }
+
+    return ((busy >> start) | (busy << (KWHEEL_SLOTS - start))) & KWHEEL_FULL;
+}
+
+void kwheel_init(kwheel_t *wheel, kwheel_match_t match, tick_t now)
+{
+    uint32_t lvl;
+    uint32_t idx;
+
+    wheel->cur   = now;
+    wheel->match = match;
+
+    for (lvl = 0u; lvl < KWHEEL_LEVELS; lvl++) {
+        wheel->busy[lvl] = 0u;
+        for (idx = 0u; idx < KWHEEL_SLOTS; idx++) {
+            klist_init(&wheel->slot[lvl][idx]);
+        }
+    }
+}
+
+void kwheel_insert(kwheel_t *wheel, klist_t *node)
+{
+    tick_t   match;
+    tick_t   delta;
+    uint32_t lvl;
+    uint32_t idx;
+
+    match = wheel->match(node);
+
+    /* already due, fire on the next expire */
+    if (match < wheel->cur) {
+        match = wheel->cur;
+    }
+
+    delta = match - wheel->cur;
+    if (delta >= KWHEEL_SPAN) {
+        /* cascaded again with the real match when its slot comes round */
+        delta = KWHEEL_SPAN - 1u;
+        match = wheel->cur + delta;
+    }
+
+    for (lvl = 0u; lvl < KWHEEL_LEVELS - 1u; lvl++) {
+        if (delta < ((tick_t)1u << KWHEEL_SHIFT(lvl + 1u))) {
+            break;
+        }
+    }
+
+    idx = KWHEEL_IDX(match, lvl);
+    klist_insert(&wheel->slot[lvl][idx], node);
+    wheel->busy[lvl] |= (1u << idx);
+}
+
+void kwheel_rm(kwheel_t *wheel, klist_t *node)
+{
+    uint32_t pos;
+
+    /* last node of the slot, next and prev are both the slot head */
+    if (node->next == node->prev) {
+        pos = (uint32_t)(node->next - &wheel->slot[0][0]);
+        wheel->busy[pos >> RHINO_CONFIG_TICK_WHEEL_BITS] &= ~(1u << (pos & KWHEEL_MASK));
+    }
+
+    klist_rm(node);
+}
+
+/* move the upper level slots that start at cur down the wheel */
+static void wheel_cascade(kwheel_t *wheel)
+{
+    klist_t  list;
+    klist_t *head;
+    klist_t *node;
+    uint32_t lvl;
+    uint32_t idx;
+
+    for (lvl = 1u; lvl < KWHEEL_LEVELS; lvl++) {
+        idx = KWHEEL_IDX(wheel->cur, lvl);
+
+        if ((wheel->busy[lvl] & (1u << idx)) != 0u) {
+            head = &wheel->slot[lvl][idx];
+
+            list.next       = head->next;
+            list.prev       = head->prev;
+            list.next->prev = &list;
+            list.prev->next = &list;
+            klist_init(head);
+            wheel->busy[lvl] &= ~(1u << idx);
+
+            while (!is_klist_empty(&list)) {
+                node = list.next;
+                klist_rm(node);
+                kwheel_insert(wheel, node);
+            }
+        }
+
+        if (idx != 0u) {
+            break;
+        }
+    }
+}
+
+static void wheel_advance(kwheel_t *wheel, tick_t cur)
+{
+    wheel->cur = cur;
+
+    if ((cur & KWHEEL_MASK) == 0u) {
+        wheel_cascade(wheel);
+    }
+}
+
+klist_t *kwheel_expire(kwheel_t *wheel, tick_t now)
+{
+    uint32_t idx;
+    uint32_t lvl;
+    uint32_t dist;
+    tick_t   step;
+
+    while (wheel->cur <= now) {
+        idx = KWHEEL_IDX(wheel->cur, 0u);
+
+        if ((wheel->busy[0] & (1u << idx)) != 0u) {
+            return wheel->slot[0][idx].next;
+        }
+
+        /* skip empty ticks, but never step over a cascade point */
+        if (wheel->busy[0] != 0u) {
+            dist = krhino_ctz32(wheel_busy_rotate(wheel->busy[0], idx));
+            step = (idx + dist < KWHEEL_SLOTS) ? dist : (KWHEEL_SLOTS - idx);
+        } else {
+            for (lvl = 1u; lvl < KWHEEL_LEVELS; lvl++) {
+                if (wheel->busy[lvl] != 0u) {
+                    break;
+                }
+            }
+
+            if (lvl == KWHEEL_LEVELS) {
+                wheel->cur = now + 1u;
+                break;
+            }
+
+            step = (((wheel->cur >> KWHEEL_SHIFT(lvl)) + 1u) << KWHEEL_SHIFT(lvl))
+                   - wheel->cur;
+        }
+
+        if (step > now + 1u - wheel->cur) {
+            step = now + 1u - wheel->cur;
+        }
+
+        wheel_advance(wheel, wheel->cur + step);
+    }
+
+    return NULL;
+}
+
+uint8_t kwheel_next(kwheel_t *wheel, tick_t *match)
+{
+    klist_t *head;
+    klist_t *iter;
+    uint32_t lvl;
+    uint32_t idx;
+    uint32_t dist;
+    uint32_t busy;
+    tick_t   base;
+    tick_t   val;
+    tick_t   best  = 0u;
+    uint8_t  found = 0u;
+
+    /* level 0 holds one tick per slot */
+    if (wheel->busy[0] != 0u) {
+        idx   = KWHEEL_IDX(wheel->cur, 0u);
+        best  = wheel->cur + krhino_ctz32(wheel_busy_rotate(wheel->busy[0], idx));
+        found = 1u;
+    }
+
+    /* upper slots are walked in time order, each one starts no earlier than
+       its lower bound so the walk stops once that passes the best match */
+    for (lvl = 1u; lvl < KWHEEL_LEVELS; lvl++) {
+        base = wheel->cur >> KWHEEL_SHIFT(lvl);
+        idx  = (uint32_t)(base + 1u) & KWHEEL_MASK;
+        busy = wheel_busy_rotate(wheel->busy[lvl], idx);
+
+        while (busy != 0u) {
+            dist  = krhino_ctz32(busy);
+            busy &= busy - 1u;
+
+            if ((found != 0u) && (((base + 1u + dist) << KWHEEL_SHIFT(lvl)) >= best)) {
+                break;
+            }
+
+            head = &wheel->slot[lvl][(idx + dist) & KWHEEL_MASK];
+            for (iter = head->next; iter != head; iter = iter->next) {
+                val = wheel->match(iter);
+                if ((found == 0u) || (val < best)) {
+                    best  = val;
+                    found = 1u;
+                }
+            }
+        }
+    }
+
+    *match = best;
+
+    return found;
+}
+
+#endif /* RHINO_CONFIG_TICK_WHEEL */
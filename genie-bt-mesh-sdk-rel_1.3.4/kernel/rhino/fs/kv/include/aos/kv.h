@@ -75,6 +75,52 @@ int aos_kv_del_all(const char *ex_prefix);
  */
 int aos_kv_del_by_prefix(const char *prefix);
 
+/**
+ * Begin a batch of KV changes which reach flash all together or not at all.
+ * Only one batch runs at a time, a second caller waits until the first one
+ * is committed or aborted. The rest of the batch calls must come from the
+ * same task.
+ *
+ * @return  0 on success, negative error on failure.
+ */
+int aos_kv_txn_begin(void);
+
+/**
+ * Add or update a KV pair in the batch, a later change of the same key
+ * replaces this one.
+ *
+ * @param[in]  key    the key of the KV pair.
+ * @param[in]  value  the value of the KV pair.
+ * @param[in]  len    the length of the value.
+ *
+ * @return  0 on success, negative error on failure.
+ */
+int aos_kv_txn_set(const char *key, const void *value, int len);
+
+/**
+ * Delete a KV pair in the batch.
+ *
+ * @param[in]  key  the key of the KV pair to delete.
+ *
+ * @return  0 on success, negative error on failure.
+ */
+int aos_kv_txn_del(const char *key);
+
+/**
+ * Write the batch to flash in one pass and end it. The batch is ended
+ * even if the commit fails, nothing of it is stored then.
+ *
+ * @return  0 on success, negative error on failure.
+ */
+int aos_kv_txn_commit(void);
+
+/**
+ * Drop the batch without storing anything.
+ *
+ * @return  none.
+ */
+void aos_kv_txn_abort(void);
+
 
 #ifdef __cplusplus
 }
@@ -39,6 +39,41 @@
 #define KV_GC_TASK_SIZE CONFIG_AOS_KV_TASK_SIZE
 #endif
 
+/* The number of items GC copies per step before it releases the lock */
+#ifndef CONFIG_AOS_KV_GC_STEP_ITEMS
+#define KV_GC_STEP_ITEMS 4
+#else
+#define KV_GC_STEP_ITEMS CONFIG_AOS_KV_GC_STEP_ITEMS
+#endif
+
+/* GC starts in idle time once the write block has less free space than this */
+#ifndef CONFIG_AOS_KV_GC_IDLE_SPACE
+#define KV_GC_IDLE_SPACE ((1 << BLK_BITS) >> 2)
+#else
+#define KV_GC_IDLE_SPACE CONFIG_AOS_KV_GC_IDLE_SPACE
+#endif
+
+/* The quiet time after the last write before the idle GC runs, in ms */
+#ifndef CONFIG_AOS_KV_GC_IDLE_DELAY
+#define KV_GC_IDLE_DELAY 500
+#else
+#define KV_GC_IDLE_DELAY CONFIG_AOS_KV_GC_IDLE_DELAY
+#endif
+
+/* The largest batch aos_kv_txn_commit writes, staged in RAM until then */
+#ifndef CONFIG_AOS_KV_TXN_MAX_LEN
+#define KV_TXN_MAX_LEN 1024
+#else
+#define KV_TXN_MAX_LEN CONFIG_AOS_KV_TXN_MAX_LEN
+#endif
+
+/* The number of keys tracked by the RAM index, lookups scan flash beyond it */
+#ifndef CONFIG_AOS_KV_INDEX_NUMS
+#define KV_INDEX_NUMS 64
+#else
+#define KV_INDEX_NUMS CONFIG_AOS_KV_INDEX_NUMS
+#endif
+
 #define SUPPORT_KV_LIST_CMD
 
 #endif
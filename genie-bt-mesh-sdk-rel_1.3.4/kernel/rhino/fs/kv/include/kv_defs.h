@@ -159,6 +159,14 @@ typedef struct _item_header_t
 #define KV_GC_RESERVED      1
 #define KV_GC_STACK_SIZE    1024
 
+/**
+ * Batch related defination
+ *
+ * KV_TXN_CRC_CHUNK:    the piece size recovery reads a batch in to check it
+ * 
+ */
+#define KV_TXN_CRC_CHUNK    32
+
 /**
  * Key-value item descriptor defination
  *
@@ -187,6 +195,42 @@ typedef struct _block_info_t {
     uint8_t   state;
 } block_info_t;
 
+/**
+ * RAM index entry of one live key-value item
+ *
+ * hash:    the 16-bit hash of the item key
+ * pos:     the store position of the key-value item
+ * 
+ */
+typedef struct _kv_index_t {
+    uint16_t    hash;
+    kv_size_t   pos;
+} kv_index_t;
+
+/**
+ * Garbage collection statistics
+ *
+ * runs:        numbers of the blocks reclaimed by GC
+ * steps:       numbers of the GC copy steps
+ * moved:       numbers of the items moved out of dirty blocks
+ * waits:       numbers of the writes which had to wait for GC
+ * step_max:    the longest time one step held the lock, in ms
+ * step_total:  the total time the steps held the lock, in ms
+ * erase_max:   the longest block erase, which runs unlocked, in ms
+ * idle:        numbers of the GC runs started ahead of need in idle time
+ * 
+ */
+typedef struct _kv_gc_stats_t {
+    uint32_t    runs;
+    uint32_t    steps;
+    uint32_t    moved;
+    uint32_t    waits;
+    uint32_t    step_max;
+    uint32_t    step_total;
+    uint32_t    erase_max;
+    uint32_t    idle;
+} kv_gc_stats_t;
+
 /**
  * Key-value module management struct
  *
@@ -198,6 +242,17 @@ typedef struct _block_info_t {
  * gc_sem:          semaphore for GC
  * mutex:           mutex for module sync
  * block_info[]:    the array to record the block management info
+ * index_nums:      numbers of the valid entries in index[]
+ * index_full:      the flag to indicate some items are not indexed
+ * index[]:         the RAM index of the live items
+ * gc_src:          the block GC is moving the items out of, BLK_NUMS if none
+ * gc_moved:        numbers of the items moved in the current GC step
+ * gc_need:         the space still needed to move the items of gc_src
+ * gc_stats:        the GC statistics
+ * txn_mutex:       mutex held by the task running a batch
+ * txn_buf:         the batch staged in RAM, header first
+ * txn_len:         the length of the staged records
+ * txn_nums:        numbers of the staged records
  * 
  */
 typedef struct _kv_mgr_t {
@@ -209,6 +264,17 @@ typedef struct _kv_mgr_t {
     kv_sem_t        gc_sem;
     kv_mutex_t      mutex;
     block_info_t    block_info[BLK_NUMS];
+    uint16_t        index_nums;
+    uint8_t         index_full;
+    kv_index_t      index[KV_INDEX_NUMS];
+    uint8_t         gc_src;
+    uint8_t         gc_moved;
+    kv_size_t       gc_need;
+    kv_gc_stats_t   gc_stats;
+    kv_mutex_t      txn_mutex;
+    char           *txn_buf;
+    uint16_t        txn_len;
+    uint8_t         txn_nums;
 } kv_mgr_t;
 
 typedef struct _kv_store_t {
@@ -223,6 +289,21 @@ typedef struct _kv_store_t {
 static const uint8_t BLK_MAGIC_NUM = 'K';
 static const uint8_t ITEM_MAGIC_NUM = 'I';
 
+/**
+ * A batch is stored as a header, its records as normal items and a commit
+ * marker, both header and marker use the item header layout:
+ *
+ * state:       ITEM_STATE_NORMAL until the batch is applied, the marker is
+ *              written as ITEM_STATE_DELETE
+ * crc:         the crc-8 value of the records
+ * key_len:     numbers of the records
+ * val_len:     the length of the records
+ *
+ * Deletes in a batch are records in ITEM_STATE_DELETE without a value,
+ * whose origin_off is the item to delete.
+ */
+static const uint8_t TXN_MAGIC_NUM = 'T';
+
 /**
  * The function to be invoked while polling the used block
  */
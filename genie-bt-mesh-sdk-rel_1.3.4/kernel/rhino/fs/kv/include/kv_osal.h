@@ -161,6 +161,35 @@ int kv_os_task_start(const char *name, void (*fn)(void *), void *arg,
  */
 void kv_os_task_del(void);
 
+/**
+ * @brief Run a function from the low priority work queue once no call
+ *        came in for the delay, each call restarts the delay
+ *
+ * @param[in] fn    the function to run
+ * @param[in] delay the quiet time before it runs, in ms
+ *
+ * @return 0 on success, otherwise is failed or not supported
+ */
+int kv_os_idle_work(void (*fn)(void *), uint32_t delay);
+
+/**
+ * @brief Yield the CPU to the tasks of the same priority
+ * 
+ * @return 0 on success, otherwise is failed
+ *
+ * int kv_os_task_yield(void);
+ */
+#define kv_os_task_yield krhino_task_yield
+
+/**
+ * @brief Get the system time in milliseconds
+ * 
+ * @return the system time
+ *
+ * uint64_t kv_os_time_get(void);
+ */
+#define kv_os_time_get krhino_sys_time_get
+
 /**
  * @brief wrapper of MM allocation
  * 
@@ -34,3 +34,26 @@ void kv_os_task_del(void)
     krhino_task_dyn_del(NULL);
 }
 
+
+int kv_os_idle_work(void (*fn)(void *), uint32_t delay)
+{
+#if (RHINO_CONFIG_WORKQUEUE > 0)
+    static kwork_t work;
+    static uint8_t inited = 0;
+
+    if (!inited)
+    {
+        if (krhino_work_init(&work, fn, NULL, krhino_ms_to_ticks(delay)) != RHINO_SUCCESS)
+        {
+            return -1;
+        }
+        inited = 1;
+    }
+
+    return krhino_work_sched(&work);
+#else
+    (void)fn;
+    (void)delay;
+    return -1;
+#endif
+}
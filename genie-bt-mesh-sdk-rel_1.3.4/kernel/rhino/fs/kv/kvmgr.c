@@ -9,16 +9,17 @@ static kv_mgr_t g_kv_mgr;
 static void kv_gc_task(void *arg);
 
 /**
- * @brief CRC-8: the poly is 0x31 (x^8 + x^5 + x^4 + 1)
+ * @brief CRC-8: the poly is 0x31 (x^8 + x^5 + x^4 + 1), continued over
+ *        one more piece of the data
  *
+ * @param[in] crc       the crc value of the data before the buffer
  * @param[in] buf       the buffer which is need calculate crc
  * @param[in] length    the length of the buffer
  *
  * @return the crc value
  */
-static uint8_t calc_crc8(uint8_t *buf, uint16_t length)
+static uint8_t calc_crc8_update(uint8_t crc, uint8_t *buf, uint16_t length)
 {
-    uint8_t crc = 0x00;
     uint8_t i = 0;
 
     while (length--)
@@ -40,6 +41,19 @@ static uint8_t calc_crc8(uint8_t *buf, uint16_t length)
     return crc;
 }
 
+/**
+ * @brief CRC-8: the poly is 0x31 (x^8 + x^5 + x^4 + 1)
+ *
+ * @param[in] buf       the buffer which is need calculate crc
+ * @param[in] length    the length of the buffer
+ *
+ * @return the crc value
+ */
+static uint8_t calc_crc8(uint8_t *buf, uint16_t length)
+{
+    return calc_crc8_update(0x00, buf, length);
+}
+
 /**
  * @brief Trigger garbage collection process
  *
@@ -53,10 +67,80 @@ static void kv_trigger_gc(void)
     }
 
     g_kv_mgr.gc_waiter = 0;
+    g_kv_mgr.gc_src = BLK_NUMS;
     g_kv_mgr.gc_trigger = 1;
     kv_os_task_start("kv_gc", kv_gc_task, NULL, KV_GC_TASK_SIZE);
 }
 
+/**
+ * @brief Check whether the write block runs low while a dirty block could
+ *        be reclaimed, so GC is worth starting before a write needs it
+ *
+ * @return 1 if GC is due, otherwise 0
+ */
+static int kv_gc_due(void)
+{
+    uint8_t i;
+    uint8_t blk_idx;
+
+    blk_idx = g_kv_mgr.write_pos >> BLK_BITS;
+    if ((g_kv_mgr.gc_trigger != 0) ||
+        (g_kv_mgr.clean_blk_nums > KV_GC_RESERVED) ||
+        (g_kv_mgr.block_info[blk_idx].space >= KV_GC_IDLE_SPACE))
+    {
+        return 0;
+    }
+
+    for (i = 0; i < BLK_NUMS; i++)
+    {
+        if (g_kv_mgr.block_info[i].state == BLK_STATE_DIRTY)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief The idle work, it starts GC once the writes have gone quiet
+ *
+ * @param[in] arg unused
+ *
+ * @return none
+ */
+static void kv_gc_idle(void *arg)
+{
+    (void)arg;
+
+    if (kv_os_mutex_lock(&(g_kv_mgr.mutex), KV_WAIT_FOREVER) != RES_OK)
+    {
+        return;
+    }
+
+    if (g_kv_mgr.inited && kv_gc_due())
+    {
+        g_kv_mgr.gc_stats.idle++;
+        kv_trigger_gc();
+    }
+
+    kv_os_mutex_unlock(&(g_kv_mgr.mutex));
+}
+
+/**
+ * @brief Schedule the idle GC after a write if it is due, called with the
+ *        mutex held, each write pushes it back by KV_GC_IDLE_DELAY
+ *
+ * @return none
+ */
+static void kv_gc_idle_arm(void)
+{
+    if (kv_gc_due())
+    {
+        kv_os_idle_work(kv_gc_idle, KV_GC_IDLE_DELAY);
+    }
+}
+
 /**
  * @brief Free item resource
  * 
@@ -76,6 +160,89 @@ static void kv_item_free(kv_item_t *item)
     }
 }
 
+/**
+ * @brief Calculate the 16-bit index hash of the key (FNV-1a, folded)
+ *
+ * @param[in] key pointer to the key
+ * @param[in] len the length of the key
+ *
+ * @return the hash value
+ */
+static uint16_t kv_index_hash(const char *key, uint8_t len)
+{
+    uint32_t hash = 2166136261u;
+
+    while (len--)
+    {
+        hash ^= (uint8_t)*key++;
+        hash *= 16777619u;
+    }
+
+    return (uint16_t)((hash >> 16) ^ hash);
+}
+
+/**
+ * @brief Find the index entry of the item stored at the position
+ *
+ * @param[in] pos the store position of the item
+ *
+ * @return the index entry or NULL
+ */
+static kv_index_t *kv_index_find(kv_size_t pos)
+{
+    uint16_t i;
+
+    for (i = 0; i < g_kv_mgr.index_nums; i++)
+    {
+        if (g_kv_mgr.index[i].pos == pos)
+        {
+            return &(g_kv_mgr.index[i]);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Add an item to the index, lookups fall back to flash scan once
+ *        the index has overflowed
+ *
+ * @param[in] hash the key hash of the item
+ * @param[in] pos  the store position of the item
+ *
+ * @return none
+ */
+static void kv_index_add(uint16_t hash, kv_size_t pos)
+{
+    if (g_kv_mgr.index_nums >= KV_INDEX_NUMS)
+    {
+        g_kv_mgr.index_full = 1;
+        return;
+    }
+
+    g_kv_mgr.index[g_kv_mgr.index_nums].hash = hash;
+    g_kv_mgr.index[g_kv_mgr.index_nums].pos = pos;
+    g_kv_mgr.index_nums++;
+}
+
+/**
+ * @brief Remove the item stored at the position from the index
+ *
+ * @param[in] pos the store position of the item
+ *
+ * @return none
+ */
+static void kv_index_del(kv_size_t pos)
+{
+    kv_index_t *entry = kv_index_find(pos);
+
+    if (entry)
+    {
+        g_kv_mgr.index_nums--;
+        *entry = g_kv_mgr.index[g_kv_mgr.index_nums];
+    }
+}
+
 /**
  * @brief Set block/item state bit
  * 
@@ -90,13 +257,13 @@ static int kv_state_set(kv_size_t pos, uint8_t state)
 }
 
 /**
- * @brief Format block header
+ * @brief Erase block and write a clean block header
  * 
  * @param[in]  blk_idx the index of the block
  * 
  * @return 0 on success, otherwise will be failed
  */
-static int kv_block_format(uint8_t blk_idx)
+static int kv_block_erase(uint8_t blk_idx)
 {
     block_hdr_t hdr;
     kv_size_t pos = (blk_idx << BLK_BITS);
@@ -118,6 +285,25 @@ static int kv_block_format(uint8_t blk_idx)
         return RES_FLASH_WRITE_ERR;
     }
 
+    return RES_OK;
+}
+
+/**
+ * @brief Format block header
+ * 
+ * @param[in]  blk_idx the index of the block
+ * 
+ * @return 0 on success, otherwise will be failed
+ */
+static int kv_block_format(uint8_t blk_idx)
+{
+    int res;
+
+    if ((res = kv_block_erase(blk_idx)) != RES_OK)
+    {
+        return res;
+    }
+
     g_kv_mgr.block_info[blk_idx].state = BLK_STATE_CLEAN;
     g_kv_mgr.block_info[blk_idx].space = BLK_SIZE - BLK_HDR_SIZE;
     g_kv_mgr.clean_blk_nums++;
@@ -195,6 +381,7 @@ static kv_size_t kv_calc_position(uint16_t len)
 static int kv_item_del(kv_item_t *item, int flag)
 {
     uint8_t i;
+    uint16_t len;
     kv_size_t off;
     item_hdr_t hdr;
     int res = RES_OK;
@@ -204,6 +391,7 @@ static int kv_item_del(kv_item_t *item, int flag)
     if (flag == KV_DELETE_REMOVE)
     {
         off = item->pos;
+        len = KV_ALIGN(ITEM_HDR_SIZE + item->len);
     }
     else if (flag == KV_UPDATE_REMOVE)
     {
@@ -245,6 +433,7 @@ static int kv_item_del(kv_item_t *item, int flag)
 
         kv_os_free(ori_key);
         kv_os_free(new_key);
+        len = KV_ALIGN(ITEM_HDR_SIZE + hdr.key_len + hdr.val_len);
     }
     else
     {
@@ -257,6 +446,11 @@ static int kv_item_del(kv_item_t *item, int flag)
     }
 
     i = off >> BLK_BITS;
+    if ((g_kv_mgr.gc_need > 0) && (i == g_kv_mgr.gc_src))
+    {
+        /* Nothing left to move for this item */
+        g_kv_mgr.gc_need -= len;
+    }
     if (g_kv_mgr.block_info[i].state == BLK_STATE_USED)
     {
         res = kv_state_set((off & BLK_OFF_MASK), BLK_STATE_DIRTY);
@@ -268,6 +462,7 @@ static int kv_item_del(kv_item_t *item, int flag)
         g_kv_mgr.block_info[i].state = BLK_STATE_DIRTY;
     }
 
+    kv_index_del(off);
     return res;
 }
 
@@ -353,12 +548,29 @@ static int __item_find_cb(kv_item_t *item, const char *key)
 }
 
 /**
- * @brief GC callback function when polling the block
+ * @brief GC size callback function when polling the block
  * 
  * @param[in]  item pointer to the key-value pair item
  * @param[in]  key  pointer to the key
  * 
- * @return RES_CONT: continue to polling, otherwise is failed
+ * @return RES_CONT: continue to polling
+ */
+static int __item_gc_size_cb(kv_item_t *item, const char *key)
+{
+    g_kv_mgr.gc_need += KV_ALIGN(ITEM_HDR_SIZE + item->len);
+    return RES_CONT;
+}
+
+/**
+ * @brief GC callback function when polling the block, moves the item and
+ *        deletes the old copy so the next step resumes behind it
+ * 
+ * @param[in]  item pointer to the key-value pair item
+ * @param[in]  key  pointer to the key
+ * 
+ * @return RES_OK: the step budget is used up;
+ *         RES_CONT: continue to polling,
+ *         otherwise is failed
  */
 static int __item_gc_cb(kv_item_t *item, const char *key)
 {
@@ -366,9 +578,17 @@ static int __item_gc_cb(kv_item_t *item, const char *key)
     int res;
     uint8_t idx;
     uint16_t len;
+    kv_size_t pos;
+    kv_index_t *entry;
 
     len = KV_ALIGN(ITEM_HDR_SIZE + item->len);
 
+    pos = kv_calc_position(len);
+    if (pos == 0)
+    {
+        return RES_NO_SPACE;
+    }
+
     p = (char *)kv_os_malloc(len);
     if (!p)
     {
@@ -381,22 +601,67 @@ static int __item_gc_cb(kv_item_t *item, const char *key)
         goto err;
     }
 
-    if (kv_os_partition_write(g_kv_mgr.write_pos, p, len) != RES_OK)
+    if (kv_os_partition_write(pos, p, len) != RES_OK)
     {
         res = RES_FLASH_WRITE_ERR;
         goto err;
     }
 
-    g_kv_mgr.write_pos += len;
+    g_kv_mgr.write_pos = pos + len;
     idx = (g_kv_mgr.write_pos) >> BLK_BITS;
     g_kv_mgr.block_info[idx].space -= len;
-    res = RES_CONT;
+
+    entry = kv_index_find(item->pos);
+    if (entry)
+    {
+        entry->pos = pos;
+    }
+
+    if ((res = kv_item_del(item, KV_DELETE_REMOVE)) != RES_OK)
+    {
+        goto err;
+    }
+
+    g_kv_mgr.gc_stats.moved++;
+    g_kv_mgr.gc_moved++;
+    res = (g_kv_mgr.gc_moved >= KV_GC_STEP_ITEMS) ? RES_OK : RES_CONT;
 
 err:
     kv_os_free(p);
     return res;
 }
 
+/**
+ * @brief Index callback function when polling the block
+ * 
+ * @param[in]  item pointer to the key-value pair item
+ * @param[in]  key  pointer to the key
+ * 
+ * @return RES_CONT: continue to polling, otherwise is failed
+ */
+static int __item_index_cb(kv_item_t *item, const char *key)
+{
+    char *p = (char *)kv_os_malloc(item->hdr.key_len);
+    if (!p)
+    {
+        g_kv_mgr.index_full = 1;
+        return RES_MALLOC_FAILED;
+    }
+
+    if (kv_os_partition_read(item->pos + ITEM_HDR_SIZE, p,
+                             item->hdr.key_len) != RES_OK)
+    {
+        g_kv_mgr.index_full = 1;
+        kv_os_free(p);
+        return RES_FLASH_READ_ERR;
+    }
+
+    kv_index_add(kv_index_hash(p, item->hdr.key_len), item->pos);
+
+    kv_os_free(p);
+    return RES_CONT;
+}
+
 /**
  * @brief Group delete callback function when polling the block
  * 
@@ -432,6 +697,100 @@ static int __item_del_by_prefix_cb(kv_item_t *item, const char *prefix)
     return RES_CONT;
 }
 
+/**
+ * @brief Apply or roll back the records of a batch and mark it done
+ * 
+ * @param[in]  pos   the position of the batch header
+ * @param[in]  end   the end of the records
+ * @param[in]  valid 1 to delete the copies the records replace,
+ *                   0 to delete the records themselves
+ * 
+ * @return 0 on success, otherwise will be failed
+ */
+static int kv_txn_finish(kv_size_t pos, kv_size_t end, int valid)
+{
+    kv_item_t rec;
+    kv_size_t off = pos + ITEM_HDR_SIZE;
+
+    while (off + ITEM_HDR_SIZE <= end)
+    {
+        memset(&rec, 0, sizeof(kv_item_t));
+        if ((kv_os_partition_read(off, &(rec.hdr), ITEM_HDR_SIZE) != RES_OK) ||
+            (rec.hdr.magic != ITEM_MAGIC_NUM))
+        {
+            break;
+        }
+
+        rec.pos = off;
+        rec.len = rec.hdr.key_len + rec.hdr.val_len;
+
+        if (valid)
+        {
+            if (rec.hdr.origin_off != 0)
+            {
+                kv_item_del(&rec, KV_UPDATE_REMOVE);
+            }
+        }
+        else if (rec.hdr.state == ITEM_STATE_NORMAL)
+        {
+            kv_state_set(off, ITEM_STATE_DELETE);
+        }
+
+        off += KV_ALIGN(ITEM_HDR_SIZE + rec.len);
+    }
+
+    return kv_state_set(pos, ITEM_STATE_DELETE);
+}
+
+/**
+ * @brief Finish a batch whose header is still pending, it is applied only
+ *        with an intact commit marker and records, otherwise rolled back
+ * 
+ * @param[in]  pos the position of the batch header
+ * @param[in]  txn pointer to the batch header
+ * @param[in]  end the end of the block
+ * 
+ * @return none
+ */
+static void kv_txn_recover(kv_size_t pos, item_hdr_t *txn, kv_size_t end)
+{
+    uint8_t buf[KV_TXN_CRC_CHUNK];
+    uint8_t crc = 0x00;
+    uint16_t len;
+    int valid = 0;
+    item_hdr_t marker;
+    kv_size_t off = pos + ITEM_HDR_SIZE;
+    kv_size_t cur;
+
+    if ((uint32_t)off + txn->val_len + ITEM_HDR_SIZE <= end)
+    {
+        end = off + txn->val_len;
+        memset(&marker, 0, ITEM_HDR_SIZE);
+        kv_os_partition_read(end, &marker, ITEM_HDR_SIZE);
+        if ((marker.magic == TXN_MAGIC_NUM) && (marker.crc == txn->crc) &&
+            (marker.key_len == txn->key_len) && (marker.val_len == txn->val_len))
+        {
+            /* Read in pieces, recovery must not depend on the heap */
+            for (cur = off; cur < end; cur += len)
+            {
+                len = ((end - cur) > KV_TXN_CRC_CHUNK) ? KV_TXN_CRC_CHUNK : (end - cur);
+                if (kv_os_partition_read(cur, buf, len) != RES_OK)
+                {
+                    break;
+                }
+                crc = calc_crc8_update(crc, buf, len);
+            }
+
+            if ((cur == end) && (crc == txn->crc))
+            {
+                valid = 1;
+            }
+        }
+    }
+
+    kv_txn_finish(pos, end, valid);
+}
+
 /**
  * @brief polling flash block
  * 
@@ -472,6 +831,19 @@ static kv_item_t *kv_item_traverse(item_func func, uint8_t blk_idx,
             return NULL;
         }
 
+        if (hdr->magic == TXN_MAGIC_NUM)
+        {
+            /* Batch header or commit marker, the records follow as items */
+            if (hdr->state != ITEM_STATE_DELETE)
+            {
+                kv_txn_recover(pos, hdr, end);
+            }
+
+            pos += ITEM_HDR_SIZE;
+            kv_item_free(item);
+            continue;
+        }
+
         if (hdr->magic != ITEM_MAGIC_NUM)
         {
             if ((hdr->magic == 0xFF) && (hdr->state == 0xFF))
@@ -482,9 +854,10 @@ static kv_item_t *kv_item_traverse(item_func func, uint8_t blk_idx,
             hdr->val_len = 0xFFFF;
         }
 
+        /* Only the deletes of a batch are stored without a value */
         if ((hdr->val_len > ITEM_MAX_VAL_LEN) ||
-            (hdr->key_len > ITEM_MAX_KEY_LEN) ||
-            (hdr->val_len == 0) || (hdr->key_len == 0))
+            (hdr->key_len > ITEM_MAX_KEY_LEN) || (hdr->key_len == 0) ||
+            ((hdr->val_len == 0) && (hdr->state != ITEM_STATE_DELETE)))
         {
 
             pos += ITEM_HDR_SIZE;
@@ -529,7 +902,14 @@ static kv_item_t *kv_item_traverse(item_func func, uint8_t blk_idx,
         pos += len;
     } while (end > (pos + ITEM_HDR_SIZE));
 
-    if (end > pos)
+    /* The GC block must stay full, or a traverse while the GC task waits
+     * for the lock would let writers back into it.
+     */
+    if ((g_kv_mgr.gc_trigger != 0) && (blk_idx == g_kv_mgr.gc_src))
+    {
+        g_kv_mgr.block_info[blk_idx].space = 0;
+    }
+    else if (end > pos)
     {
         g_kv_mgr.block_info[blk_idx].space = end - pos;
     }
@@ -542,36 +922,119 @@ static kv_item_t *kv_item_traverse(item_func func, uint8_t blk_idx,
 }
 
 /**
- * @brief Get key-value pair item
+ * @brief Rebuild the RAM index from the items in flash
  * 
- * @param[in]  key pointer to the item key
- * 
- * @return key-value item or NULL
+ * @return none
  */
-static kv_item_t *kv_item_get(const char *key)
+static void kv_index_build(void)
 {
     uint8_t i;
-    kv_item_t *item = NULL;
+
+    g_kv_mgr.index_nums = 0;
+    g_kv_mgr.index_full = 0;
 
     for (i = 0; i < BLK_NUMS; i++)
     {
         if (g_kv_mgr.block_info[i].state != BLK_STATE_CLEAN)
         {
-            item = kv_item_traverse(__item_find_cb, i, key);
-            if (item != NULL)
-            {
-                return item;
-            }
+            kv_item_traverse(__item_index_cb, i, NULL);
         }
     }
-
-    return NULL;
 }
 
 /**
- * @brief Store key-value item
+ * @brief Load the key-value pair item stored at the position
  * 
- * @param[in]  key        pointer to the item key
+ * @param[in]  pos the store position of the item
+ * @param[in]  key pointer to the item key
+ * 
+ * @return key-value item or NULL if the item there has another key
+ */
+static kv_item_t *kv_item_load(kv_size_t pos, const char *key)
+{
+    kv_item_t *item;
+    item_hdr_t *hdr;
+
+    item = (kv_item_t *)kv_os_malloc(sizeof(kv_item_t));
+    if (!item)
+    {
+        return NULL;
+    }
+
+    memset(item, 0, sizeof(kv_item_t));
+    hdr = &(item->hdr);
+
+    if ((kv_os_partition_read(pos, hdr, ITEM_HDR_SIZE) != RES_OK) ||
+        (hdr->magic != ITEM_MAGIC_NUM) ||
+        (hdr->state != ITEM_STATE_NORMAL))
+    {
+        kv_item_free(item);
+        return NULL;
+    }
+
+    item->pos = pos;
+    item->len = hdr->key_len + hdr->val_len;
+
+    if (__item_find_cb(item, key) != RES_OK)
+    {
+        kv_item_free(item);
+        return NULL;
+    }
+
+    return item;
+}
+
+/**
+ * @brief Get key-value pair item
+ * 
+ * @param[in]  key pointer to the item key
+ * 
+ * @return key-value item or NULL
+ */
+static kv_item_t *kv_item_get(const char *key)
+{
+    uint8_t i;
+    uint16_t n, hash;
+    kv_item_t *item = NULL;
+
+    hash = kv_index_hash(key, strlen(key));
+    for (n = 0; n < g_kv_mgr.index_nums; n++)
+    {
+        if (g_kv_mgr.index[n].hash == hash)
+        {
+            item = kv_item_load(g_kv_mgr.index[n].pos, key);
+            if (item != NULL)
+            {
+                return item;
+            }
+        }
+    }
+
+    /* Only an overflowed index can miss a stored key */
+    if (!g_kv_mgr.index_full)
+    {
+        return NULL;
+    }
+
+    for (i = 0; i < BLK_NUMS; i++)
+    {
+        if (g_kv_mgr.block_info[i].state != BLK_STATE_CLEAN)
+        {
+            item = kv_item_traverse(__item_find_cb, i, key);
+            if (item != NULL)
+            {
+                return item;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Store key-value item
+ * 
+ * @param[in]  key        pointer to the item key
  * @param[in]  val        pointer to the item value
  * @param[in]  len        the length of the value 
  * @param[in]  origin_off the old item position offset
@@ -586,6 +1049,7 @@ static int kv_item_store(const char *key, const void *val, int len,
     kv_size_t pos;
     item_hdr_t hdr;
     kv_store_t store;
+    kv_index_t *entry;
 
     hdr.magic = ITEM_MAGIC_NUM;
     hdr.state = ITEM_STATE_NORMAL;
@@ -610,7 +1074,8 @@ static int kv_item_store(const char *key, const void *val, int len,
     hdr.crc = calc_crc8((uint8_t *)p, hdr.key_len + hdr.val_len);
     memcpy(store.p, &hdr, ITEM_HDR_SIZE);
 
-    pos = kv_calc_position(store.len);
+    /* Leave room for the items GC still has to move */
+    pos = kv_calc_position(store.len + g_kv_mgr.gc_need);
     if (pos > 0)
     {
         store.res = kv_os_partition_write(pos, store.p, store.len);
@@ -619,6 +1084,17 @@ static int kv_item_store(const char *key, const void *val, int len,
             g_kv_mgr.write_pos = pos + store.len;
             idx = (uint8_t)(g_kv_mgr.write_pos >> BLK_BITS);
             g_kv_mgr.block_info[idx].space -= store.len;
+
+            /* An update takes over the index entry of the old copy */
+            entry = (origin_off != 0) ? kv_index_find(origin_off) : NULL;
+            if (entry)
+            {
+                entry->pos = pos;
+            }
+            else
+            {
+                kv_index_add(kv_index_hash(key, hdr.key_len), pos);
+            }
         }
     }
     else
@@ -777,48 +1253,40 @@ static int kv_init(void)
         }
     }
 
+    kv_index_build();
     return RES_OK;
 }
 
 /**
- * Garbage collection task
+ * @brief Pick the dirty block to reclaim and move the write position to a
+ *        clean block, which takes the moved items and the new writes
  * 
- * @param[in] arg pointer to the argument
- *
- * @return none
+ * @return 0 on success, otherwise there is nothing to collect
  */
-static void kv_gc_task(void *arg)
+static int kv_gc_begin(void)
 {
-    int res;
-    kv_size_t origin_pos;
-    uint8_t i, gc_idx, gc_copy = 0;
-
-    if ((res = kv_os_mutex_lock(&(g_kv_mgr.mutex), KV_WAIT_FOREVER)) != RES_OK)
-    {
-        goto exit;
-    }
+    uint8_t i, dst, origin;
 
-    origin_pos = g_kv_mgr.write_pos;
+    origin = g_kv_mgr.write_pos >> BLK_BITS;
     if (g_kv_mgr.clean_blk_nums == 0)
     {
-        goto exit;
+        return RES_NO_SPACE;
     }
 
-    for (gc_idx = 0; gc_idx < BLK_NUMS; gc_idx++)
+    for (dst = 0; dst < BLK_NUMS; dst++)
     {
-        if (g_kv_mgr.block_info[gc_idx].state == BLK_STATE_CLEAN)
+        if (g_kv_mgr.block_info[dst].state == BLK_STATE_CLEAN)
         {
-            g_kv_mgr.write_pos = (gc_idx << BLK_BITS) + BLK_HDR_SIZE;
             break;
         }
     }
 
-    if (gc_idx == BLK_NUMS)
+    if (dst == BLK_NUMS)
     {
-        goto exit;
+        return RES_NO_SPACE;
     }
 
-    i = (origin_pos >> BLK_BITS) + 1;
+    i = origin + 1;
     while (1)
     {
         if (i == BLK_NUMS)
@@ -828,37 +1296,150 @@ static void kv_gc_task(void *arg)
 
         if (g_kv_mgr.block_info[i].state == BLK_STATE_DIRTY)
         {
-            kv_item_traverse(__item_gc_cb, i, NULL);
+            break;
+        }
 
-            gc_copy = 1;
+        if (i == origin)
+        {
+            return RES_ITEM_NOT_FOUND;
+        }
+        i++;
+    }
 
-            if (kv_block_format(i) != RES_OK)
-            {
-                goto exit;
-            }
+    if (kv_state_set((dst << BLK_BITS), BLK_STATE_USED) != RES_OK)
+    {
+        return RES_FLASH_WRITE_ERR;
+    }
 
-            kv_state_set((g_kv_mgr.write_pos & BLK_OFF_MASK), BLK_STATE_USED);
-            g_kv_mgr.block_info[gc_idx].state = BLK_STATE_USED;
-            g_kv_mgr.clean_blk_nums--;
-            break;
+    g_kv_mgr.block_info[dst].state = BLK_STATE_USED;
+    g_kv_mgr.clean_blk_nums--;
+    g_kv_mgr.write_pos = (dst << BLK_BITS) + BLK_HDR_SIZE;
+
+    g_kv_mgr.gc_src = i;
+    g_kv_mgr.gc_need = 0;
+    kv_item_traverse(__item_gc_size_cb, i, NULL);
+    g_kv_mgr.block_info[i].space = 0;
+
+    return RES_OK;
+}
+
+/**
+ * @brief Move up to KV_GC_STEP_ITEMS items out of the GC block
+ * 
+ * @return RES_OK: the block is empty; RES_CONT: items are left,
+ *         otherwise is failed
+ */
+static int kv_gc_step(void)
+{
+    kv_item_t *item;
+
+    g_kv_mgr.gc_moved = 0;
+    item = kv_item_traverse(__item_gc_cb, g_kv_mgr.gc_src, NULL);
+
+    if (item != NULL)
+    {
+        kv_item_free(item);
+        return RES_CONT;
+    }
+
+    /* An item which could not be moved still needs its space */
+    return (g_kv_mgr.gc_need == 0) ? RES_OK : RES_FLASH_WRITE_ERR;
+}
+
+/**
+ * Garbage collection task
+ * 
+ * The items are moved a few at a time and the lock is released between the
+ * steps, so writers are only held up for one step. The emptied block is
+ * erased without the lock, readers skip it as a clean block meanwhile.
+ * 
+ * @param[in] arg pointer to the argument
+ *
+ * @return none
+ */
+static void kv_gc_task(void *arg)
+{
+    int res;
+    uint8_t blk_idx, waiter;
+    uint32_t pause;
+    sys_time_t start;
+
+    if ((res = kv_os_mutex_lock(&(g_kv_mgr.mutex), KV_WAIT_FOREVER)) != RES_OK)
+    {
+        goto exit;
+    }
+
+    if ((res = kv_gc_begin()) != RES_OK)
+    {
+        goto exit;
+    }
+
+    do
+    {
+        start = kv_os_time_get();
+        res = kv_gc_step();
+        pause = (uint32_t)(kv_os_time_get() - start);
+
+        g_kv_mgr.gc_stats.steps++;
+        g_kv_mgr.gc_stats.step_total += pause;
+        if (pause > g_kv_mgr.gc_stats.step_max)
+        {
+            g_kv_mgr.gc_stats.step_max = pause;
         }
 
-        if (i == (origin_pos >> BLK_BITS))
+        kv_os_mutex_unlock(&(g_kv_mgr.mutex));
+        if (res == RES_CONT)
         {
-            break;
+            kv_os_task_yield();
         }
-        i++;
+        kv_os_mutex_lock(&(g_kv_mgr.mutex), KV_WAIT_FOREVER);
+    } while (res == RES_CONT);
+
+    if (res != RES_OK)
+    {
+        goto exit;
+    }
+
+    blk_idx = g_kv_mgr.gc_src;
+    g_kv_mgr.gc_need = 0;
+    g_kv_mgr.block_info[blk_idx].state = BLK_STATE_CLEAN;
+    kv_os_mutex_unlock(&(g_kv_mgr.mutex));
+
+    start = kv_os_time_get();
+    res = kv_block_erase(blk_idx);
+    pause = (uint32_t)(kv_os_time_get() - start);
+
+    kv_os_mutex_lock(&(g_kv_mgr.mutex), KV_WAIT_FOREVER);
+    if (pause > g_kv_mgr.gc_stats.erase_max)
+    {
+        g_kv_mgr.gc_stats.erase_max = pause;
     }
 
-    if (gc_copy == 0)
+    if (res == RES_OK)
+    {
+        g_kv_mgr.block_info[blk_idx].space = BLK_SIZE - BLK_HDR_SIZE;
+        g_kv_mgr.clean_blk_nums++;
+        g_kv_mgr.gc_stats.runs++;
+
+        if (g_kv_mgr.index_full)
+        {
+            /* Deletes since the overflow may have made room for every key */
+            kv_index_build();
+        }
+    }
+    else
     {
-        g_kv_mgr.write_pos = origin_pos;
+        /* Nothing valid is left in the block, the next GC erases it again */
+        g_kv_mgr.block_info[blk_idx].state = BLK_STATE_DIRTY;
     }
 
 exit:
+    g_kv_mgr.gc_src = BLK_NUMS;
+    g_kv_mgr.gc_need = 0;
     g_kv_mgr.gc_trigger = 0;
+    waiter = g_kv_mgr.gc_waiter;
     kv_os_mutex_unlock(&(g_kv_mgr.mutex));
-    if (g_kv_mgr.gc_waiter > 0)
+    if (waiter > 0)
     {
         kv_os_sem_give_all(&(g_kv_mgr.gc_sem));
     }
@@ -885,6 +1466,10 @@ int aos_kv_del(const char *key)
 
     res = kv_item_del(item, KV_DELETE_REMOVE);
     kv_item_free(item);
+    if (res == RES_OK)
+    {
+        kv_gc_idle_arm();
+    }
     kv_os_mutex_unlock(&(g_kv_mgr.mutex));
     return res;
 }
@@ -900,7 +1485,11 @@ int aos_kv_del_by_prefix(const char *prefix)
 
     for (i = 0; i < BLK_NUMS; i++)
     {
-        kv_item_traverse(__item_del_by_prefix_cb, i, prefix);
+        /* GC marks its source clean before erasing it without the lock */
+        if (g_kv_mgr.block_info[i].state != BLK_STATE_CLEAN)
+        {
+            kv_item_traverse(__item_del_by_prefix_cb, i, prefix);
+        }
     }
 
     kv_os_mutex_unlock(&(g_kv_mgr.mutex));
@@ -950,16 +1539,48 @@ int aos_kv_del_all(const char *ex_prefix)
 
     for (i = 0; i < BLK_NUMS; i++)
     {
-        kv_item_traverse(__item_del_all_cb, i, ex_prefix);
+        /* GC marks its source clean before erasing it without the lock */
+        if (g_kv_mgr.block_info[i].state != BLK_STATE_CLEAN)
+        {
+            kv_item_traverse(__item_del_all_cb, i, ex_prefix);
+        }
     }
 
     kv_os_mutex_unlock(&(g_kv_mgr.mutex));
     return RES_OK;
 }
 
+/**
+ * @brief Wait for GC after a store ran out of space. Writers run alongside GC
+ *        and only wait once out of space. A GC pass frees at most one block,
+ *        so more passes than blocks means the store is full of valid items.
+ * 
+ * @param[in]      res   the result of the store, called with the mutex held
+ * @param[in,out]  waits numbers of the waits of this store
+ * 
+ * @return 1 with the mutex released to retry the store, otherwise 0
+ */
+static int kv_gc_wait(int res, uint8_t *waits)
+{
+    if ((res != RES_NO_SPACE) || (g_kv_mgr.gc_trigger == 0) ||
+        (*waits >= BLK_NUMS))
+    {
+        return 0;
+    }
+
+    (*waits)++;
+    g_kv_mgr.gc_waiter++;
+    g_kv_mgr.gc_stats.waits++;
+    kv_os_mutex_unlock(&(g_kv_mgr.mutex));
+    kv_os_sem_take(&(g_kv_mgr.gc_sem), KV_WAIT_FOREVER);
+
+    return 1;
+}
+
 int aos_kv_set(const char *key, const void *val, int len, int sync)
 {
     int res;
+    uint8_t waits = 0;
     kv_item_t *item;
 
     if (!key || !val || (len <= 0) || (strlen(key) > ITEM_MAX_KEY_LEN) ||
@@ -968,29 +1589,324 @@ int aos_kv_set(const char *key, const void *val, int len, int sync)
         return RES_INVALID_PARAM;
     }
 
-    if (g_kv_mgr.gc_trigger != 0)
+    do
+    {
+        if ((res = kv_os_mutex_lock(&(g_kv_mgr.mutex), KV_WAIT_FOREVER)) != RES_OK)
+        {
+            return RES_MUTEX_ERR;
+        }
+
+        item = kv_item_get(key);
+        if (item != NULL)
+        {
+            res = kv_item_update(item, key, val, len);
+            kv_item_free(item);
+        }
+        else
+        {
+            res = kv_item_store(key, val, len, 0);
+        }
+    } while (kv_gc_wait(res, &waits));
+
+    if (res == RES_OK)
     {
-        g_kv_mgr.gc_waiter++;
-        kv_os_sem_take(&(g_kv_mgr.gc_sem), KV_WAIT_FOREVER);
+        kv_gc_idle_arm();
     }
+    kv_os_mutex_unlock(&(g_kv_mgr.mutex));
+    return res;
+}
 
-    if ((res = kv_os_mutex_lock(&(g_kv_mgr.mutex), KV_WAIT_FOREVER)) != RES_OK)
+/**
+ * @brief Remove the staged record of the key from the batch
+ * 
+ * @param[in]  key pointer to the key
+ * 
+ * @return none
+ */
+static void kv_txn_unstage(const char *key)
+{
+    uint16_t off = 0;
+    uint16_t len;
+    item_hdr_t *hdr;
+    char *body = g_kv_mgr.txn_buf + ITEM_HDR_SIZE;
+    uint8_t key_len = strlen(key);
+
+    while (off < g_kv_mgr.txn_len)
     {
-        return RES_MUTEX_ERR;
+        hdr = (item_hdr_t *)(body + off);
+        len = KV_ALIGN(ITEM_HDR_SIZE + hdr->key_len + hdr->val_len);
+
+        if ((hdr->key_len == key_len) &&
+            (memcmp(body + off + ITEM_HDR_SIZE, key, key_len) == 0))
+        {
+            memmove(body + off, body + off + len, g_kv_mgr.txn_len - off - len);
+            g_kv_mgr.txn_len -= len;
+            g_kv_mgr.txn_nums--;
+            return;
+        }
+
+        off += len;
     }
+}
 
-    item = kv_item_get(key);
-    if (item != NULL)
+/**
+ * @brief Stage a record in the batch
+ * 
+ * @param[in]  key   pointer to the item key
+ * @param[in]  val   pointer to the item value
+ * @param[in]  len   the length of the value
+ * @param[in]  state ITEM_STATE_NORMAL to set, ITEM_STATE_DELETE to delete
+ * 
+ * @return 0 on success, otherwise is failed
+ */
+static int kv_txn_stage(const char *key, const void *val, int len,
+                        uint8_t state)
+{
+    char *p;
+    uint16_t rec_len;
+    item_hdr_t hdr;
+
+    if (!g_kv_mgr.txn_buf)
+    {
+        return RES_INVALID_PARAM;
+    }
+
+    kv_txn_unstage(key);
+
+    hdr.magic = ITEM_MAGIC_NUM;
+    hdr.state = state;
+    hdr.key_len = strlen(key);
+    hdr.val_len = len;
+    hdr.origin_off = 0;
+
+    /* Room is kept for the header and the commit marker */
+    rec_len = KV_ALIGN(ITEM_HDR_SIZE + hdr.key_len + hdr.val_len);
+    if ((g_kv_mgr.txn_nums == 0xFF) ||
+        (g_kv_mgr.txn_len + rec_len + 2 * ITEM_HDR_SIZE > KV_TXN_MAX_LEN))
     {
-        res = kv_item_update(item, key, val, len);
+        return RES_NO_SPACE;
+    }
+
+    p = g_kv_mgr.txn_buf + ITEM_HDR_SIZE + g_kv_mgr.txn_len;
+    memset(p, 0, rec_len);
+    memcpy(p + ITEM_HDR_SIZE, key, hdr.key_len);
+    if (hdr.val_len > 0)
+    {
+        memcpy(p + ITEM_HDR_SIZE + hdr.key_len, val, hdr.val_len);
+    }
+    hdr.crc = calc_crc8((uint8_t *)(p + ITEM_HDR_SIZE), hdr.key_len + hdr.val_len);
+    memcpy(p, &hdr, ITEM_HDR_SIZE);
+
+    g_kv_mgr.txn_len += rec_len;
+    g_kv_mgr.txn_nums++;
+
+    return RES_OK;
+}
+
+/**
+ * @brief Write the staged batch to flash and apply it
+ * 
+ * @return 0 on success, otherwise is failed
+ */
+static int kv_txn_write(void)
+{
+    int res;
+    int drop;
+    uint8_t idx;
+    uint16_t off, len;
+    kv_size_t pos;
+    kv_item_t rec;
+    kv_item_t *item;
+    kv_index_t *entry;
+    item_hdr_t *hdr;
+    item_hdr_t *txn = (item_hdr_t *)g_kv_mgr.txn_buf;
+    char *body = g_kv_mgr.txn_buf + ITEM_HDR_SIZE;
+    char key[ITEM_MAX_KEY_LEN + 1];
+
+    /* Point every record at the copy it replaces, drop the no-ops */
+    off = 0;
+    while (off < g_kv_mgr.txn_len)
+    {
+        hdr = (item_hdr_t *)(body + off);
+        len = KV_ALIGN(ITEM_HDR_SIZE + hdr->key_len + hdr->val_len);
+
+        memcpy(key, body + off + ITEM_HDR_SIZE, hdr->key_len);
+        key[hdr->key_len] = '\0';
+
+        item = kv_item_get(key);
+        if (hdr->state == ITEM_STATE_NORMAL)
+        {
+            drop = item && (item->hdr.val_len == hdr->val_len) &&
+                   !memcmp(item->store + hdr->key_len,
+                           body + off + ITEM_HDR_SIZE + hdr->key_len,
+                           hdr->val_len);
+        }
+        else
+        {
+            drop = (item == NULL);
+        }
+
+        hdr->origin_off = item ? item->pos : 0;
         kv_item_free(item);
+
+        if (drop)
+        {
+            kv_txn_unstage(key);
+            continue;
+        }
+
+        off += len;
     }
-    else
+
+    if (g_kv_mgr.txn_nums == 0)
+    {
+        return RES_OK;
+    }
+
+    memset(txn, 0, ITEM_HDR_SIZE);
+    txn->magic = TXN_MAGIC_NUM;
+    txn->state = ITEM_STATE_NORMAL;
+    txn->crc = calc_crc8((uint8_t *)body, g_kv_mgr.txn_len);
+    txn->key_len = g_kv_mgr.txn_nums;
+    txn->val_len = g_kv_mgr.txn_len;
+
+    hdr = (item_hdr_t *)(body + g_kv_mgr.txn_len);
+    memcpy(hdr, txn, ITEM_HDR_SIZE);
+    hdr->state = ITEM_STATE_DELETE;
+
+    len = g_kv_mgr.txn_len + 2 * ITEM_HDR_SIZE;
+    pos = kv_calc_position(len + g_kv_mgr.gc_need);
+    if (pos == 0)
+    {
+        return RES_NO_SPACE;
+    }
+
+    res = kv_os_partition_write(pos, g_kv_mgr.txn_buf, len);
+
+    g_kv_mgr.write_pos = pos + len;
+    idx = (uint8_t)(g_kv_mgr.write_pos >> BLK_BITS);
+    g_kv_mgr.block_info[idx].space -= len;
+
+    if (res != RES_OK)
     {
-        res = kv_item_store(key, val, len, 0);
+        /* Whatever made it to flash is rolled back */
+        kv_txn_finish(pos, pos + len - ITEM_HDR_SIZE, 0);
+        return RES_FLASH_WRITE_ERR;
     }
 
+    for (off = 0; off < g_kv_mgr.txn_len; off += len)
+    {
+        hdr = (item_hdr_t *)(body + off);
+        len = KV_ALIGN(ITEM_HDR_SIZE + hdr->key_len + hdr->val_len);
+
+        memset(&rec, 0, sizeof(kv_item_t));
+        memcpy(&(rec.hdr), hdr, ITEM_HDR_SIZE);
+        rec.pos = pos + ITEM_HDR_SIZE + off;
+        rec.len = hdr->key_len + hdr->val_len;
+
+        if (hdr->state == ITEM_STATE_NORMAL)
+        {
+            entry = (hdr->origin_off != 0) ? kv_index_find(hdr->origin_off) : NULL;
+            if (entry)
+            {
+                entry->pos = rec.pos;
+            }
+            else
+            {
+                kv_index_add(kv_index_hash(body + off + ITEM_HDR_SIZE,
+                                           hdr->key_len), rec.pos);
+            }
+        }
+
+        if (hdr->origin_off != 0)
+        {
+            kv_item_del(&rec, KV_UPDATE_REMOVE);
+        }
+    }
+
+    return kv_state_set(pos, ITEM_STATE_DELETE);
+}
+
+int aos_kv_txn_begin(void)
+{
+    if (kv_os_mutex_lock(&(g_kv_mgr.txn_mutex), KV_WAIT_FOREVER) != RES_OK)
+    {
+        return RES_MUTEX_ERR;
+    }
+
+    g_kv_mgr.txn_buf = (char *)kv_os_malloc(KV_TXN_MAX_LEN);
+    if (!g_kv_mgr.txn_buf)
+    {
+        kv_os_mutex_unlock(&(g_kv_mgr.txn_mutex));
+        return RES_MALLOC_FAILED;
+    }
+
+    g_kv_mgr.txn_len = 0;
+    g_kv_mgr.txn_nums = 0;
+
+    return RES_OK;
+}
+
+int aos_kv_txn_set(const char *key, const void *val, int len)
+{
+    if (!key || !val || (len <= 0) || (strlen(key) > ITEM_MAX_KEY_LEN) ||
+        (len > ITEM_MAX_VAL_LEN))
+    {
+        return RES_INVALID_PARAM;
+    }
+
+    return kv_txn_stage(key, val, len, ITEM_STATE_NORMAL);
+}
+
+int aos_kv_txn_del(const char *key)
+{
+    if (!key || (strlen(key) > ITEM_MAX_KEY_LEN))
+    {
+        return RES_INVALID_PARAM;
+    }
+
+    return kv_txn_stage(key, NULL, 0, ITEM_STATE_DELETE);
+}
+
+void aos_kv_txn_abort(void)
+{
+    if (!g_kv_mgr.txn_buf)
+    {
+        return;
+    }
+
+    kv_os_free(g_kv_mgr.txn_buf);
+    g_kv_mgr.txn_buf = NULL;
+    kv_os_mutex_unlock(&(g_kv_mgr.txn_mutex));
+}
+
+int aos_kv_txn_commit(void)
+{
+    int res = RES_OK;
+    uint8_t waits = 0;
+
+    if (!g_kv_mgr.txn_buf)
+    {
+        return RES_INVALID_PARAM;
+    }
+
+    do
+    {
+        if (kv_os_mutex_lock(&(g_kv_mgr.mutex), KV_WAIT_FOREVER) != RES_OK)
+        {
+            aos_kv_txn_abort();
+            return RES_MUTEX_ERR;
+        }
+
+        res = kv_txn_write();
+    } while (kv_gc_wait(res, &waits));
+
+    if (res == RES_OK)
+    {
+        kv_gc_idle_arm();
+    }
     kv_os_mutex_unlock(&(g_kv_mgr.mutex));
+    aos_kv_txn_abort();
     return res;
 }
 
@@ -1207,6 +2123,33 @@ static int _kv_getx_cmd(const char *key)
     return 0;
 }
 
+static void _kv_gc_cmd(int reset)
+{
+    kv_gc_stats_t stats;
+
+    if (kv_os_mutex_lock(&(g_kv_mgr.mutex), KV_WAIT_FOREVER) != RES_OK)
+    {
+        return;
+    }
+
+    if (reset)
+    {
+        memset(&(g_kv_mgr.gc_stats), 0, sizeof(kv_gc_stats_t));
+    }
+    memcpy(&stats, &(g_kv_mgr.gc_stats), sizeof(kv_gc_stats_t));
+
+    kv_os_mutex_unlock(&(g_kv_mgr.mutex));
+
+    aos_cli_printf("gc runs:%u idle:%u steps:%u moved:%u waits:%u\r\n",
+                   (unsigned int)stats.runs, (unsigned int)stats.idle,
+                   (unsigned int)stats.steps, (unsigned int)stats.moved,
+                   (unsigned int)stats.waits);
+    aos_cli_printf("gc pause max:%ums avg:%ums, erase max:%ums\r\n",
+                   (unsigned int)stats.step_max,
+                   stats.steps ? (unsigned int)(stats.step_total / stats.steps) : 0,
+                   (unsigned int)stats.erase_max);
+}
+
 static void handle_kv_cmd(char *pwbuf, int blen, int argc, char **argv)
 {
     const char *rtype = argc > 1 ? argv[1] : "";
@@ -1252,16 +2195,25 @@ static void handle_kv_cmd(char *pwbuf, int blen, int argc, char **argv)
     }
     else if (strcmp(rtype, "list") == 0)
     {
+        kv_os_mutex_lock(&(g_kv_mgr.mutex), KV_WAIT_FOREVER);
         for (i = 0; i < BLK_NUMS; i++)
         {
-            kv_item_traverse(__item_print_cb, i, NULL);
+            if (g_kv_mgr.block_info[i].state != BLK_STATE_CLEAN)
+            {
+                kv_item_traverse(__item_print_cb, i, NULL);
+            }
         }
+        kv_os_mutex_unlock(&(g_kv_mgr.mutex));
 #endif
     }
     else if (strcmp(rtype, "clear") == 0)
     {
         aos_kv_del_all(NULL);
     }
+    else if (strcmp(rtype, "gc") == 0)
+    {
+        _kv_gc_cmd((argc > 2) && (strcmp(argv[2], "reset") == 0));
+    }
     else
     {
         aos_cli_printf("\"kv %s\" not support!\r\n", rtype);
@@ -1273,9 +2225,9 @@ static void handle_kv_cmd(char *pwbuf, int blen, int argc, char **argv)
 static struct cli_command kv_cmd = {
     "kv",
 #ifdef SUPPORT_KV_LIST_CMD
-    "kv [set key value | get key | del key | list | clear]",
+    "kv [set key value | get key | del key | list | clear | gc [reset]]",
 #else
-    "kv [set key value | get key | del key | clear]",
+    "kv [set key value | get key | del key | clear | gc [reset]]",
 #endif
     handle_kv_cmd};
 
@@ -1303,6 +2255,11 @@ int aos_kv_init(void)
         return RES_MUTEX_ERR;
     }
 
+    if ((res = kv_os_mutex_create(&(g_kv_mgr.txn_mutex), "KV_TXN")) != RES_OK)
+    {
+        return RES_MUTEX_ERR;
+    }
+
 #ifdef CONFIG_AOS_CLI
     aos_cli_register_command(&kv_cmd);
 #endif
@@ -1334,4 +2291,5 @@ void aos_kv_deinit(void)
     g_kv_mgr.inited = 0;
     kv_os_sem_del(&(g_kv_mgr.gc_sem));
     kv_os_mutex_del(&(g_kv_mgr.mutex));
+    kv_os_mutex_del(&(g_kv_mgr.txn_mutex));
 }
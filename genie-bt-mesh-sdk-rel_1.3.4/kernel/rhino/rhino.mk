@@ -41,6 +41,7 @@ $(NAME)_SOURCES := core/k_err.c          \
                    core/k_sem.c          \
                    core/k_task.c         \
                    core/k_time.c         \
+                   core/k_wheel.c        \
                    uspace/u_task.c       \
                    common/k_fifo.c       \
                    common/k_trace.c      \
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2015-2017 Alibaba Group Holding Limited
+ */
+
+#include <k_api.h>
+#include <test_fw.h>
+#include "mm_test.h"
+
+#define MODULE_NAME "mm_bench"
+
+#if (RHINO_CONFIG_MM_TLF > 0)
+
+#define MM_BENCH_LIVE 16
+#define MM_BENCH_OPS  20000
+
+/* short-lived sizes seen from the BT stack: net_buf user data,
+   transport nodes, kv items */
+static const uint16_t mm_bench_size[] = {
+    8, 12, 16, 20, 24, 28, 36, 44, 60, 76, 100, 128, 160, 200, 256, 400
+};
+
+/* same alloc/free sequence for every run, returns 0 when heap stays sane */
+static uint8_t mm_bench_run(uint8_t slab, sys_time_t *cost, uint32_t *fails)
+{
+    void      *ptr[MM_BENCH_LIVE] = {0};
+    uint16_t   len[MM_BENCH_LIVE] = {0};
+    uint32_t   seed = 1;
+    uint32_t   i;
+    uint32_t   slot;
+    size_t     used;
+    sys_time_t start;
+    kstat_t    ret;
+
+    ret = krhino_init_mm_head(&pmmhead, (void *)mm_pool, MM_POOL_SIZE);
+    MYASSERT(ret == RHINO_SUCCESS);
+
+    if (slab == 0) {
+        mm_slab_bypass(pmmhead);
+    }
+
+    used   = pmmhead->used_size;
+    *fails = 0;
+    start  = krhino_sys_time_get();
+
+    for (i = 0; i < MM_BENCH_OPS; i++) {
+        seed = seed * 1103515245u + 12345u;
+        slot = (seed >> 16) % MM_BENCH_LIVE;
+
+        if (ptr[slot] != NULL) {
+            MYASSERT(((uint8_t *)ptr[slot])[0] == (uint8_t)slot);
+            MYASSERT(((uint8_t *)ptr[slot])[len[slot] - 1] == (uint8_t)slot);
+            k_mm_free(pmmhead, ptr[slot]);
+            ptr[slot] = NULL;
+            continue;
+        }
+
+        len[slot] = mm_bench_size[(seed >> 4) % (sizeof(mm_bench_size) / sizeof(mm_bench_size[0]))];
+        ptr[slot] = k_mm_alloc(pmmhead, len[slot]);
+        if (ptr[slot] == NULL) {
+            (*fails)++;
+            continue;
+        }
+
+        ((uint8_t *)ptr[slot])[0]             = (uint8_t)slot;
+        ((uint8_t *)ptr[slot])[len[slot] - 1] = (uint8_t)slot;
+    }
+
+    *cost = krhino_sys_time_get() - start;
+
+    for (slot = 0; slot < MM_BENCH_LIVE; slot++) {
+        if (ptr[slot] != NULL) {
+            k_mm_free(pmmhead, ptr[slot]);
+        }
+    }
+
+    MYASSERT(pmmhead->used_size == used);
+
+    krhino_deinit_mm_head(pmmhead);
+
+    return 0;
+}
+
+static uint8_t mm_bench_case1(void)
+{
+    sys_time_t cost;
+    uint32_t   fails;
+
+    MYASSERT(mm_bench_run(0, &cost, &fails) == 0);
+    printf("%s: fix pool + tlf %d ops %d ms, %d failed\n", MODULE_NAME,
+           MM_BENCH_OPS, (int)cost, (int)fails);
+
+#if (RHINO_CONFIG_MM_SLAB > 0)
+    MYASSERT(mm_bench_run(1, &cost, &fails) == 0);
+    printf("%s: slab + fix pool + tlf %d ops %d ms, %d failed\n", MODULE_NAME,
+           MM_BENCH_OPS, (int)cost, (int)fails);
+#endif
+
+    return 0;
+}
+
+static const test_func_t mm_func_runner[] = {
+    mm_bench_case1,
+    NULL
+};
+
+void mm_bench_test(void)
+{
+    kstat_t ret;
+
+    task_mm_entry_register(MODULE_NAME, (test_func_t *)mm_func_runner,
+                           sizeof(mm_func_runner) / sizeof(test_func_t));
+
+    ret = krhino_task_dyn_create(&task_mm, MODULE_NAME, 0, TASK_MM_PRI,
+                                 0, TASK_TEST_STACK_SIZE, task_mm_entry, 1);
+    if ((ret != RHINO_SUCCESS) && (ret != RHINO_STOPPED)) {
+        test_case_fail++;
+        PRINT_RESULT(MODULE_NAME, FAIL);
+    }
+}
+
+#endif
@@ -19,6 +19,8 @@ static uint8_t mm_break_case1(void)
     size_t  oldsize;
     ret = krhino_init_mm_head(&pmmhead, (void *)mm_pool, MM_POOL_SIZE);
     MYASSERT(ret == RHINO_SUCCESS);
+    /* checks below are for the fix pool and TLF */
+    mm_slab_bypass(pmmhead);
 
 #if (K_MM_STATISTIC > 0)
 
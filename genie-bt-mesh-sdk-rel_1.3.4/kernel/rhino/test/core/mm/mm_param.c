@@ -38,6 +38,8 @@ static uint8_t mm_param_case2(void)
 
     ret = krhino_init_mm_head(&pmmhead, (void *)mm_pool, MM_POOL_SIZE);
     MYASSERT(ret == RHINO_SUCCESS);
+    /* small blk below must come from the fix pool */
+    mm_slab_bypass(pmmhead);
 
     ptr = k_mm_alloc( NULL, 64);
     MYASSERT(ptr == NULL);
@@ -22,6 +22,7 @@ static const test_case_t mm_case_runner[] = {
     mm_break_test,
     mm_opr_test,
     mm_coopr_test,
+    mm_bench_test,
     NULL
 };
 
@@ -33,6 +34,29 @@ void mm_test(void)
     }
 }
 
+/* hand the slab area back to the TLF heap, the head then behaves as
+   with RHINO_CONFIG_MM_SLAB off */
+void mm_slab_bypass(k_mm_head *mmhead)
+{
+#if (RHINO_CONFIG_MM_SLAB > 0)
+    void *area = mmhead->slab_area;
+
+    if (area == NULL) {
+        return;
+    }
+
+    mmhead->slab_area = NULL;
+    k_mm_free(mmhead, area);
+#if (K_MM_STATISTIC > 0)
+    /* the area was already counted as free while it was a slab */
+    mmhead->used_size += MM_SLAB_AREA_SIZE;
+    mmhead->free_size -= MM_SLAB_AREA_SIZE;
+#endif
+#else
+    (void)mmhead;
+#endif
+}
+
 void task_mm_entry_register(const char *name, test_func_t *runner,
                             uint8_t casenum)
 {
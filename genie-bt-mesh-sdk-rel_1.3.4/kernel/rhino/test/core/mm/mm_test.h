@@ -28,6 +28,8 @@ void mm_param_test(void);
 void mm_break_test(void);
 void mm_opr_test(void);
 void mm_coopr_test(void);
+void mm_bench_test(void);
+void mm_slab_bypass(k_mm_head *mmhead);
 #endif
 #endif /* MM_TEST_H */
 
@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2015-2017 Alibaba Group Holding Limited
+ */
+
+#include <stdio.h>
+#include <k_api.h>
+#include <test_fw.h>
+
+#include "timer_test.h"
+
+#define TIMER_BENCH_PENDING 64
+#define TIMER_BENCH_OPS     20000
+#define TIMER_BENCH_SPAN    5000
+
+typedef struct {
+    klist_t node;
+    tick_t  match;
+} timer_bench_node_t;
+
+static ktask_t            *task_0_test;
+static timer_bench_node_t  bench_node[TIMER_BENCH_PENDING];
+static tick_t              bench_match[TIMER_BENCH_PENDING];
+static klist_t             bench_head;
+static tick_t              bench_now;
+static uint32_t            bench_seed;
+static uint32_t            bench_expired;
+
+#if (RHINO_CONFIG_TICK_WHEEL > 0)
+static kwheel_t            bench_wheel;
+
+static tick_t bench_wheel_match(klist_t *node)
+{
+    return krhino_list_entry(node, timer_bench_node_t, node)->match;
+}
+#endif
+
+static uint32_t bench_rand(void)
+{
+    bench_seed = bench_seed * 1103515245u + 12345u;
+
+    return bench_seed >> 8;
+}
+
+/* expiry only depends on the node and the tick, so both runs end up equal */
+static void bench_rearm(uint32_t i)
+{
+    bench_node[i].match = bench_now + 1u + ((i * 2654435761u + (uint32_t)bench_now) % TIMER_BENCH_SPAN);
+}
+
+/* same walk as the sorted tick list and timer list */
+static void bench_list_insert(timer_bench_node_t *p)
+{
+    klist_t *q;
+
+    for (q = bench_head.next; q != &bench_head; q = q->next) {
+        if ((krhino_list_entry(q, timer_bench_node_t, node)->match - bench_now) > (p->match - bench_now)) {
+            break;
+        }
+    }
+
+    klist_insert(q, &p->node);
+}
+
+static void bench_list_tick(void)
+{
+    timer_bench_node_t *p;
+
+    bench_now++;
+
+    while (!is_klist_empty(&bench_head)) {
+        p = krhino_list_entry(bench_head.next, timer_bench_node_t, node);
+        if (p->match > bench_now) {
+            break;
+        }
+
+        klist_rm(&p->node);
+        bench_rearm(p - bench_node);
+        bench_list_insert(p);
+        bench_expired++;
+    }
+}
+
+static sys_time_t bench_list_run(void)
+{
+    uint32_t   i;
+    uint32_t   op;
+    sys_time_t start;
+
+    bench_seed    = 1;
+    bench_now     = 0;
+    bench_expired = 0;
+    klist_init(&bench_head);
+
+    for (i = 0; i < TIMER_BENCH_PENDING; i++) {
+        bench_node[i].match = bench_now + 1u + bench_rand() % TIMER_BENCH_SPAN;
+        bench_list_insert(&bench_node[i]);
+    }
+
+    start = krhino_sys_time_get();
+
+    for (op = 0; op < TIMER_BENCH_OPS; op++) {
+        i = bench_rand() % TIMER_BENCH_PENDING;
+        klist_rm(&bench_node[i].node);
+        bench_node[i].match = bench_now + 1u + bench_rand() % TIMER_BENCH_SPAN;
+        bench_list_insert(&bench_node[i]);
+
+        if ((op & 7u) == 0u) {
+            bench_list_tick();
+        }
+    }
+
+    return krhino_sys_time_get() - start;
+}
+
+#if (RHINO_CONFIG_TICK_WHEEL > 0)
+static void bench_wheel_tick(void)
+{
+    klist_t  *q;
+    uint32_t  i;
+
+    bench_now++;
+
+    while ((q = kwheel_expire(&bench_wheel, bench_now)) != NULL) {
+        i = krhino_list_entry(q, timer_bench_node_t, node) - bench_node;
+        TIMER_VAL_CHK(bench_node[i].match == bench_now);
+
+        kwheel_rm(&bench_wheel, q);
+        bench_rearm(i);
+        kwheel_insert(&bench_wheel, q);
+        bench_expired++;
+    }
+}
+
+static sys_time_t bench_wheel_run(void)
+{
+    uint32_t   i;
+    uint32_t   op;
+    sys_time_t start;
+
+    bench_seed    = 1;
+    bench_now     = 0;
+    bench_expired = 0;
+    kwheel_init(&bench_wheel, bench_wheel_match, bench_now);
+
+    for (i = 0; i < TIMER_BENCH_PENDING; i++) {
+        bench_node[i].match = bench_now + 1u + bench_rand() % TIMER_BENCH_SPAN;
+        kwheel_insert(&bench_wheel, &bench_node[i].node);
+    }
+
+    start = krhino_sys_time_get();
+
+    for (op = 0; op < TIMER_BENCH_OPS; op++) {
+        i = bench_rand() % TIMER_BENCH_PENDING;
+        kwheel_rm(&bench_wheel, &bench_node[i].node);
+        bench_node[i].match = bench_now + 1u + bench_rand() % TIMER_BENCH_SPAN;
+        kwheel_insert(&bench_wheel, &bench_node[i].node);
+
+        if ((op & 7u) == 0u) {
+            bench_wheel_tick();
+        }
+    }
+
+    return krhino_sys_time_get() - start;
+}
+#endif
+
+static void task_timer0_entry(void *arg)
+{
+    sys_time_t cost;
+    uint32_t   expired;
+    uint32_t   i;
+#if (RHINO_CONFIG_TICK_WHEEL > 0)
+    tick_t     next;
+    tick_t     first;
+#endif
+
+    while (1) {
+        cost    = bench_list_run();
+        expired = bench_expired;
+        printf("timer bench: sorted list %d pending %d ops %d ms\n",
+               TIMER_BENCH_PENDING, TIMER_BENCH_OPS, (int)cost);
+
+        for (i = 0; i < TIMER_BENCH_PENDING; i++) {
+            bench_match[i] = bench_node[i].match;
+        }
+
+#if (RHINO_CONFIG_TICK_WHEEL > 0)
+        cost = bench_wheel_run();
+        printf("timer bench: wheel %d pending %d ops %d ms\n",
+               TIMER_BENCH_PENDING, TIMER_BENCH_OPS, (int)cost);
+
+        /* the wheel fires the same timeouts as the sorted list */
+        TIMER_VAL_CHK(bench_expired == expired);
+
+        first = bench_match[0];
+        for (i = 0; i < TIMER_BENCH_PENDING; i++) {
+            TIMER_VAL_CHK(bench_node[i].match == bench_match[i]);
+            if (bench_match[i] < first) {
+                first = bench_match[i];
+            }
+        }
+
+        /* next expiry used for tickless sleep is the earliest timeout */
+        TIMER_VAL_CHK(kwheel_next(&bench_wheel, &next) == 1u);
+        TIMER_VAL_CHK(next == first);
+#else
+        (void)expired;
+#endif
+
+        test_case_success++;
+        PRINT_RESULT("timer bench", PASS);
+
+        next_test_case_notify();
+        krhino_task_dyn_del(task_0_test);
+    }
+}
+
+kstat_t task_timer_bench_test(void)
+{
+    kstat_t ret;
+
+    ret = krhino_task_dyn_create(&task_0_test, "task_timer0_test", 0, 10,
+                                 0, TASK_TEST_STACK_SIZE, task_timer0_entry, 1);
+    TIMER_VAL_CHK((ret == RHINO_SUCCESS) || (ret == RHINO_STOPPED));
+
+    return 0;
+}
@@ -20,5 +20,8 @@ void timer_test(void)
 
     task_timer_change_test();
     next_test_case_wait();
+
+    task_timer_bench_test();
+    next_test_case_wait();
 }
 
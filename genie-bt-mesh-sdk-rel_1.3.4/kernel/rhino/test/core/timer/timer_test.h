@@ -15,5 +15,6 @@ kstat_t task_timer_create_del_test(void);
 kstat_t task_timer_dyn_create_del_test(void);
 kstat_t task_timer_start_stop_test(void);
 kstat_t task_timer_change_test(void);
+kstat_t task_timer_bench_test(void);
 
 #endif /* TIMER_TEST_H */
@@ -12,6 +12,7 @@ src = Split('''
     core/event/event_param.c 
     core/event/event_reinit.c 
     core/event/event_test.c 
+    core/mm/mm_bench.c 
     core/mm/mm_break.c 
     core/mm/mm_opr.c 
     core/mm/mm_param.c 
@@ -53,6 +54,7 @@ src = Split('''
     core/task_sem/tasksem_test.c 
     core/time/time_opr.c 
     core/time/time_test.c 
+    core/timer/timer_bench.c 
     core/timer/timer_change.c 
     core/timer/timer_create_del.c 
     core/timer/timer_dyn_create_del.c 
@@ -22,6 +22,7 @@ src     = Split('''
                    core/k_sem.c          
                    core/k_task.c         
                    core/k_time.c         
+                   core/k_wheel.c        
                    common/k_fifo.c       
                    common/k_trace.c
                    debug/k_overview.c
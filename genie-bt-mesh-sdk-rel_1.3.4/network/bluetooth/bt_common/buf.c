@@ -73,22 +73,23 @@ static int pool_id(struct net_buf_pool *pool)
 {
     int index;
 
-    for (index = 0; index < (sizeof(net_buf_pool_list) / 4); index++) {
+    for (index = 0; index < ARRAY_SIZE(net_buf_pool_list); index++) {
         if (net_buf_pool_list[index] == pool) {
             break;
         }
     }
 
-    assert(index < (sizeof(net_buf_pool_list) / 4));
+    assert(index < ARRAY_SIZE(net_buf_pool_list));
     return index;
 }
 
 /* Helpers to access the storage array, since we don't have access to its
  * type at this point anymore.
  */
-#define BUF_SIZE(pool) (sizeof(struct net_buf) + \
-			ROUND_UP(pool->buf_size, 4) + \
-			ROUND_UP(pool->user_data_size, 4))
+#define BUF_SIZE(pool) ROUND_UP(sizeof(struct net_buf) + \
+				ROUND_UP(pool->buf_size, sizeof(void *)) + \
+				ROUND_UP(pool->user_data_size, sizeof(void *)), \
+				__alignof__(struct net_buf))
 #define UNINIT_BUF(pool, n) (struct net_buf *)(((u8_t *)(pool->__bufs)) + \
 					       ((n) * BUF_SIZE(pool)))
 
@@ -7,13 +7,11 @@
 #include "misc/util.h"
 #include "work.h"
 
-extern struct k_work_q g_work_queue;
 extern void process_events(struct k_poll_event *ev, int count);
 extern int bt_conn_prepare_events(struct k_poll_event events[]);
 void scheduler_loop(struct k_poll_event *events)
 {
     struct k_work *work;
-    uint32_t now;
     int ev_count;
     int delayed_ms = 0;
 
@@ -21,15 +19,9 @@ void scheduler_loop(struct k_poll_event *events)
         ev_count = 0;
         delayed_ms = K_FOREVER;
 
-        if (k_queue_is_empty(&g_work_queue.queue) == 0) {
-            work = k_queue_first_entry(&g_work_queue.queue);
-            now = k_uptime_get_32();
-
-            delayed_ms = 0;
-            if (now < (work->start_ms + work->timeout)) {
-                delayed_ms = work->start_ms + work->timeout - now;
-            }
-
+        work = k_work_q_first();
+        if (work) {
+            delayed_ms = k_delayed_work_remaining_get((struct k_delayed_work *)work);
             if (delayed_ms == 0) {
                 delayed_ms = 1;
             }
@@ -51,16 +43,9 @@ void scheduler_loop(struct k_poll_event *events)
         k_poll(events, ev_count, delayed_ms);
         process_events(events, ev_count);
 
-        if (k_queue_is_empty(&g_work_queue.queue) == 0) {
-            work = k_queue_first_entry(&g_work_queue.queue);
-            now = k_uptime_get_32();
-
-            if (now >= (work->start_ms + work->timeout)) {
-                k_queue_remove(&g_work_queue.queue, work);
-                if (atomic_test_and_clear_bit(work->flags, K_WORK_STATE_PENDING) && work->handler) {
-                    work->handler(work);
-                }
-            }
+        work = k_work_q_get_expired();
+        if (work && work->handler) {
+            work->handler(work);
         }
     }
 }
@@ -22,8 +22,14 @@ extern "C" {
 #endif
 
 
+#ifdef CONFIG_BT_PORT_POSIX
+/* Host builds link against glibc, which keeps errno per thread here */
+extern int *__errno_location(void);
+#define errno (*__errno_location())
+#else
 extern int *__errno(void);
 #define errno (*__errno())
+#endif
 
 /*
  * POSIX Error codes
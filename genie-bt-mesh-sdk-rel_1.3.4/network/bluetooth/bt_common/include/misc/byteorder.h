@@ -15,6 +15,13 @@
 #include <stddef.h>
 #include <misc/__assert.h>
 
+#ifdef CONFIG_BT_PORT_POSIX
+/* glibc declares __bswap_* functions; get them in before the macros below
+ * so a later libc header does not trip over them.
+ */
+#include <byteswap.h>
+#endif
+
 /* Internal helpers only used by the sys_* APIs further below */
 #define __bswap_16(x) ((u16_t) ((((x) >> 8) & 0xff) | (((x) & 0xff) << 8)))
 #define __bswap_32(x) ((u32_t) ((((x) >> 24) & 0xff) | \
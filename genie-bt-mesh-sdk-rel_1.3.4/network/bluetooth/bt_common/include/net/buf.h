@@ -26,8 +26,11 @@ extern "C" {
  * @{
  */
 
-/* Alignment needed for various parts of the buffer definition */
-#define __net_buf_align __aligned(sizeof(int))
+/* Alignment needed for various parts of the buffer definition. Pointer
+ * sized so that net_buf_simple and the net_buf_simple view inside net_buf
+ * agree on where __buf starts on 64-bit hosts too.
+ */
+#define __net_buf_align __aligned(sizeof(void *))
 
 /** @brief Simple network buffer representation.
  *
@@ -802,7 +805,7 @@ struct net_buf *net_buf_clone(struct net_buf *buf, s32_t timeout);
  */
 static inline void *net_buf_user_data(struct net_buf *buf)
 {
-	return (void *)ROUND_UP((buf->__buf + buf->size), sizeof(int));
+	return (void *)ROUND_UP((buf->__buf + buf->size), sizeof(void *));
 }
 
 /**
@@ -9,7 +9,7 @@
 #include <misc/dlist.h>
 
 struct k_queue {
-#if defined(BOARD_TG7100B)
+#if defined(BOARD_TG7100B) || defined(CONFIG_BT_PORT_POSIX)
     _sem_t sem;
 #endif
     sys_slist_t data_q;
@@ -8,8 +8,16 @@
 #include "zephyr.h"
 #include "queue.h"
 
+struct k_work;
+
+/* Pending work ordered by expiry: a binary min-heap linked through the
+ * work items themselves, so submit and cancel are O(log n) and need no
+ * storage of their own.
+ */
 struct k_work_q {
-    struct k_queue queue;
+    struct k_work *root;
+    uint32_t count;
+    uint32_t seq;
 };
 
 int k_work_q_start();
@@ -17,22 +25,25 @@ int k_work_q_start();
 enum {
     K_WORK_STATE_PENDING,
 };
-struct k_work;
 /* work define*/
 typedef void (*k_work_handler_t)(struct k_work *work);
 
 struct k_work {
-    void *_reserved;
+    struct k_work *parent;
+    struct k_work *left;
+    struct k_work *right;
+    struct k_work_q *queue;
     k_work_handler_t handler;
     atomic_t flags[1];
     uint32_t start_ms;
     uint32_t timeout;
-    int      index;
+    uint32_t seq;
 };
 
 #define _K_WORK_INITIALIZER(work_handler) \
         { \
-        ._reserved = NULL, \
+        .parent = NULL, \
+        .queue = NULL, \
         .handler = work_handler, \
         .flags = { 0 } \
         }
@@ -53,4 +64,12 @@ int k_delayed_work_submit(struct k_delayed_work *work, uint32_t delay);
 int k_delayed_work_cancel(struct k_delayed_work *work);
 s32_t k_delayed_work_remaining_get(struct k_delayed_work *work);
 
+/* For the stack task: the pending work that expires first, NULL if none. */
+struct k_work *k_work_q_first(void);
+
+/* For the stack task: take the first work off the queue if it has
+ * expired. The caller runs its handler.
+ */
+struct k_work *k_work_q_get_expired(void);
+
 #endif /* WORK_H */
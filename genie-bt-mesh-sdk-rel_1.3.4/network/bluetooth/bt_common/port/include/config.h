@@ -450,6 +450,16 @@
 #define CONFIG_BT_MESH_MODEL_GROUP_COUNT 8
 #endif
 
+/* OpCode dispatch index, one entry per OpCode of each model */
+#ifndef CONFIG_BT_MESH_OP_INDEX_SIZE
+#define CONFIG_BT_MESH_OP_INDEX_SIZE 128
+#endif
+
+/* Distinct group and virtual addresses the elements subscribe to */
+#ifndef CONFIG_BT_MESH_GROUP_INDEX_SIZE
+#define CONFIG_BT_MESH_GROUP_INDEX_SIZE (CONFIG_BT_MESH_MODEL_GROUP_COUNT * 2 + 2)
+#endif
+
 #ifndef CONFIG_BT_MESH_APP_KEY_COUNT
 #define CONFIG_BT_MESH_APP_KEY_COUNT 2
 #endif
@@ -487,6 +497,12 @@
 #define CONFIG_BT_MESH_RX_SEG_MSG_COUNT 4
 #endif
 
+/* 12 byte slots shared by all incoming segmented messages */
+#ifndef CONFIG_BT_MESH_RX_SEG_POOL_SIZE
+#define CONFIG_BT_MESH_RX_SEG_POOL_SIZE \
+    (CONFIG_BT_MESH_RX_SEG_MSG_COUNT * ((CONFIG_BT_MESH_RX_SDU_MAX + 11) / 12))
+#endif
+
 #ifndef CONFIG_BT_MESH_ADV_PRIO
 #define CONFIG_BT_MESH_ADV_PRIO         16
 #endif
@@ -14,6 +14,36 @@
 #include <stdint.h>
 #include <string.h>
 
+#ifdef CONFIG_BT_PORT_POSIX
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+
+/*
+ * Host (POSIX) port. Port tasks run one at a time under a single scheduler
+ * lock, which is only dropped while a task blocks, so the stack sees the
+ * same run-to-block behaviour as on a uniprocessor RTOS. Objects are plain
+ * counters and are valid when zero-initialised; a limit of 0 means none.
+ */
+typedef struct
+{
+    unsigned int count;
+    unsigned int limit;
+} _sem_t;
+
+typedef struct
+{
+    pthread_t thread;
+} _task_t;
+
+typedef unsigned char _stack_element_t;
+
+typedef struct
+{
+    pthread_t    owner;
+    unsigned int nested;
+} _mutex_t;
+#else
 #include <k_types.h>
 #include <k_api.h>
 
@@ -22,6 +52,7 @@ typedef ksem_t       _sem_t;
 typedef aos_task_t   _task_t;
 typedef cpu_stack_t  _stack_element_t;
 typedef kmutex_t     _mutex_t;
+#endif
 
 #define _POLL_EVENT sys_dlist_t poll_events
 
@@ -165,12 +196,19 @@ struct k_mutex
     sys_dlist_t poll_events;
 };
 
+#ifndef CONFIG_BT_PORT_POSIX
 #include <k_api.h>
+#endif
 
 typedef void (*k_timer_handler_t)(void *timer, void *args);
 typedef struct k_timer
 {
+#ifdef CONFIG_BT_PORT_POSIX
+    sys_dnode_t       node;
+    int64_t           expiry;
+#else
     ktimer_t          timer;
+#endif
     k_timer_handler_t handler;
     void *            args;
     uint32_t          timeout;
@@ -334,4 +372,66 @@ void k_mutex_init(struct k_mutex *mutex);
 int k_mutex_lock(struct k_mutex *mutex, s32_t timeout);
 void k_mutex_unlock(struct k_mutex *mutex);
 
+#ifdef CONFIG_BT_PORT_POSIX
+/**
+ * @brief Start the host port and attach the calling thread to it.
+ *
+ * Must be called once, from the thread that goes on to initialise the
+ * stack, before any other k_* routine. The caller then runs as a port task:
+ * it holds the scheduler lock until it blocks in a k_* call.
+ *
+ * @return N/A
+ */
+void k_os_init(void);
+
+/**
+ * @brief Enter the port from a thread it did not create.
+ *
+ * Used by I/O threads that block in the host OS (sockets, stdin) and only
+ * need the port while handing data to the stack, like an ISR would.
+ *
+ * @return N/A
+ */
+void k_os_enter(void);
+
+/**
+ * @brief Leave the port after k_os_enter().
+ *
+ * @return N/A
+ */
+void k_os_exit(void);
+
+/**
+ * @brief Idle hook of the virtual clock.
+ *
+ * Called with no port task runnable. May hand data to the stack (which
+ * wakes the tasks waiting for it) and returns the new uptime, which must
+ * not go backwards.
+ *
+ * @param deadline Earliest uptime a task waits for, -1 if none.
+ *
+ * @return Uptime to resume at, in milliseconds.
+ */
+typedef int64_t (*k_os_idle_t)(int64_t deadline);
+
+/**
+ * @brief Run the port on a virtual clock.
+ *
+ * Call before k_os_init(). Uptime then starts at 0 and only advances
+ * through @p idle, and port tasks are switched in a fixed order, so a run
+ * replays exactly given the same inputs. k_os_enter() is not available
+ * in this mode.
+ *
+ * @param idle Called whenever every port task is blocked.
+ *
+ * @return N/A
+ */
+void k_os_set_virtual_clock(k_os_idle_t idle);
+
+int _sem_init(_sem_t *sem, unsigned int initial_count, unsigned int limit);
+int _sem_take(_sem_t *sem, s32_t timeout);
+void _sem_give(_sem_t *sem);
+void _sem_delete(_sem_t *sem);
+#endif
+
 #endif /* KPORT_H */
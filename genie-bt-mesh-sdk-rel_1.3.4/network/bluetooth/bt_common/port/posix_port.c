@@ -0,0 +1,722 @@
+/*
+ * Copyright (C) 2015-2019 Alibaba Group Holding Limited
+ */
+
+#include <zephyr.h>
+#include <misc/util.h>
+#include <misc/dlist.h>
+
+#define BT_DBG_ENABLED IS_ENABLED(CONFIG_BT_DEBUG_CORE)
+
+#include <common/log.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Host port of the kport.h API on top of pthreads and CLOCK_MONOTONIC.
+ *
+ * Every port task (threads made by k_thread_create(), the timer task and the
+ * thread that called k_os_init()) runs while holding g_sched_lock, and every
+ * wait in this file is a wait on g_sched_cond under that lock. At most one
+ * task executes stack code at a time and a task is only switched out where
+ * it would block on the target, so irq_lock() has nothing left to exclude.
+ * Any state change a waiter may care about broadcasts g_sched_cond and each
+ * waiter re-checks its own condition; with the handful of tasks in the
+ * stack that is cheaper than a wait queue per object.
+ *
+ * On the virtual clock (k_os_set_virtual_clock()) the lock is still held by
+ * whichever task runs, but only g_current may run: every task has its own
+ * condition, blocked tasks queue on g_wait_list in the order they blocked
+ * and runnable ones on g_run_queue. The switch order then depends only on
+ * what the tasks do, never on the host scheduler, and time only moves when
+ * nothing is runnable.
+ */
+static pthread_mutex_t g_sched_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  g_sched_cond;
+static pthread_once_t  g_port_once = PTHREAD_ONCE_INIT;
+static struct timespec g_boot_time;
+
+static pthread_t   g_timer_thread;
+static sys_dlist_t g_timer_list = SYS_DLIST_STATIC_INIT(&g_timer_list);
+
+struct port_task
+{
+    sys_dnode_t    node;
+    pthread_cond_t cond;
+    int64_t        deadline;
+    bool           expired;
+};
+
+static k_os_idle_t       g_idle;
+static int64_t           g_virtual_now;
+static struct port_task *g_current;
+static sys_dlist_t       g_run_queue = SYS_DLIST_STATIC_INIT(&g_run_queue);
+static sys_dlist_t       g_wait_list = SYS_DLIST_STATIC_INIT(&g_wait_list);
+static __thread struct port_task *g_self;
+
+struct thread_start
+{
+    k_thread_entry_t  entry;
+    void *            arg;
+    struct port_task *task;
+};
+
+static void port_deadline(struct timespec *ts, int64_t uptime_ms)
+{
+    ts->tv_sec = g_boot_time.tv_sec + uptime_ms / MSEC_PER_SEC;
+    ts->tv_nsec = g_boot_time.tv_nsec + (uptime_ms % MSEC_PER_SEC) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L)
+    {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static struct port_task *vclock_task_new(void)
+{
+    struct port_task *task;
+
+    task = calloc(1, sizeof(*task));
+    if (task)
+    {
+        pthread_cond_init(&task->cond, NULL);
+    }
+
+    return task;
+}
+
+/* Make waiters runnable, in the order they blocked: all of them, or only
+ * those whose deadline has been reached.
+ */
+static void vclock_release(bool all)
+{
+    sys_dnode_t *node, *next;
+    struct port_task *task;
+
+    SYS_DLIST_FOR_EACH_NODE_SAFE(&g_wait_list, node, next)
+    {
+        task = (struct port_task *)node;
+        task->expired = task->deadline >= 0 && task->deadline <= g_virtual_now;
+        if (all || task->expired)
+        {
+            sys_dlist_remove(node);
+            sys_dlist_append(&g_run_queue, node);
+        }
+    }
+}
+
+static int64_t vclock_next_deadline(void)
+{
+    struct port_task *task;
+    int64_t deadline = -1;
+
+    SYS_DLIST_FOR_EACH_CONTAINER(&g_wait_list, task, node)
+    {
+        if (task->deadline >= 0 && (deadline < 0 || task->deadline < deadline))
+        {
+            deadline = task->deadline;
+        }
+    }
+
+    return deadline;
+}
+
+/* Hand the CPU to the next runnable task, letting the idle hook move the
+ * clock while there is none.
+ */
+static void vclock_dispatch(void)
+{
+    sys_dnode_t *next;
+    int64_t now;
+
+    while ((next = sys_dlist_get(&g_run_queue)) == NULL)
+    {
+        vclock_release(false);
+        if (!sys_dlist_is_empty(&g_run_queue))
+        {
+            continue;
+        }
+
+        now = g_idle(vclock_next_deadline());
+        if (now > g_virtual_now)
+        {
+            g_virtual_now = now;
+        }
+        vclock_release(false);
+    }
+
+    g_current = (struct port_task *)next;
+    pthread_cond_signal(&g_current->cond);
+}
+
+static void vclock_resume(struct port_task *self)
+{
+    while (g_current != self)
+    {
+        pthread_cond_wait(&self->cond, &g_sched_lock);
+    }
+}
+
+/* Wait until woken or until uptime reaches deadline_ms. A negative
+ * deadline waits forever. Returns non-zero once the deadline has passed.
+ * (The stack's errno.h numbers ETIMEDOUT differently from the host libc,
+ * so the pthread result is not passed through.)
+ */
+static int port_wait(int64_t deadline_ms)
+{
+    struct timespec ts;
+
+    if (g_idle)
+    {
+        g_self->deadline = deadline_ms;
+        g_self->expired = false;
+        sys_dlist_append(&g_wait_list, &g_self->node);
+        vclock_dispatch();
+        vclock_resume(g_self);
+        return g_self->expired;
+    }
+
+    if (deadline_ms < 0)
+    {
+        pthread_cond_wait(&g_sched_cond, &g_sched_lock);
+        return 0;
+    }
+
+    port_deadline(&ts, deadline_ms);
+    return pthread_cond_timedwait(&g_sched_cond, &g_sched_lock, &ts) != 0;
+}
+
+static void port_wake(void)
+{
+    if (g_idle)
+    {
+        vclock_release(true);
+        return;
+    }
+
+    pthread_cond_broadcast(&g_sched_cond);
+}
+
+static int64_t port_deadline_of(s32_t timeout)
+{
+    if (timeout == K_FOREVER)
+    {
+        return -1;
+    }
+
+    return k_uptime_get() + timeout;
+}
+
+static void timer_unlink(k_timer_t *timer)
+{
+    if (timer->node.next)
+    {
+        sys_dlist_remove(&timer->node);
+        timer->node.next = NULL;
+        timer->node.prev = NULL;
+    }
+}
+
+static int timer_expires_after(sys_dnode_t *node, void *data)
+{
+    return ((k_timer_t *)node)->expiry > *(int64_t *)data;
+}
+
+static void timer_task(void *arg, void *p2, void *p3)
+{
+    k_timer_t *timer;
+    int64_t now;
+
+    while (1)
+    {
+        timer = (k_timer_t *)sys_dlist_peek_head(&g_timer_list);
+        if (!timer)
+        {
+            port_wait(-1);
+            continue;
+        }
+
+        now = k_uptime_get();
+        if (timer->expiry > now)
+        {
+            port_wait(timer->expiry);
+            continue;
+        }
+
+        /* One-shot, like the Rhino port: timeout stays set until the
+         * owner stops or restarts the timer.
+         */
+        timer_unlink(timer);
+        if (timer->handler)
+        {
+            timer->handler(timer, timer->args);
+        }
+    }
+}
+
+static void *thread_trampoline(void *arg)
+{
+    struct thread_start start = *(struct thread_start *)arg;
+
+    free(arg);
+
+    pthread_mutex_lock(&g_sched_lock);
+    if (start.task)
+    {
+        g_self = start.task;
+        vclock_resume(g_self);
+    }
+
+    start.entry(start.arg, NULL, NULL);
+
+    if (start.task)
+    {
+        vclock_dispatch();
+    }
+    pthread_mutex_unlock(&g_sched_lock);
+
+    return NULL;
+}
+
+/* Start a port task. On the virtual clock it queues behind the tasks that
+ * are already runnable and first runs when its turn comes.
+ */
+static int port_spawn(pthread_t *thread, k_thread_entry_t entry, void *arg)
+{
+    struct thread_start *start;
+    struct port_task *task = NULL;
+    int ret;
+
+    start = calloc(1, sizeof(*start));
+    if (start == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    if (g_idle)
+    {
+        task = vclock_task_new();
+        if (task == NULL)
+        {
+            free(start);
+            return -ENOMEM;
+        }
+    }
+
+    start->entry = entry;
+    start->arg = arg;
+    start->task = task;
+
+    /* The new thread owns and frees start, only task is used below */
+    ret = pthread_create(thread, NULL, thread_trampoline, start);
+    if (ret)
+    {
+        free(task);
+        free(start);
+        return -ret;
+    }
+
+    if (task)
+    {
+        sys_dlist_append(&g_run_queue, &task->node);
+    }
+
+    pthread_detach(*thread);
+    return 0;
+}
+
+static void port_init(void)
+{
+    pthread_condattr_t attr;
+
+    clock_gettime(CLOCK_MONOTONIC, &g_boot_time);
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&g_sched_cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+void k_os_init(void)
+{
+    pthread_once(&g_port_once, port_init);
+    k_os_enter();
+
+    if (g_idle)
+    {
+        g_self = vclock_task_new();
+        if (g_self == NULL)
+        {
+            SYS_LOG_FAT("create main task fail\n");
+            abort();
+        }
+        g_current = g_self;
+    }
+
+    if (port_spawn(&g_timer_thread, timer_task, NULL))
+    {
+        SYS_LOG_FAT("create timer task fail\n");
+        abort();
+    }
+}
+
+void k_os_set_virtual_clock(k_os_idle_t idle)
+{
+    g_idle = idle;
+}
+
+void k_os_enter(void)
+{
+    pthread_mutex_lock(&g_sched_lock);
+}
+
+void k_os_exit(void)
+{
+    pthread_mutex_unlock(&g_sched_lock);
+}
+
+int _sem_init(_sem_t *sem, unsigned int initial_count, unsigned int limit)
+{
+    sem->count = initial_count;
+    sem->limit = limit;
+    return 0;
+}
+
+int _sem_take(_sem_t *sem, s32_t timeout)
+{
+    int64_t deadline;
+
+    if (!sem->count && timeout == K_NO_WAIT)
+    {
+        return -EBUSY;
+    }
+
+    deadline = port_deadline_of(timeout);
+    while (!sem->count)
+    {
+        if (port_wait(deadline) && !sem->count)
+        {
+            return -EAGAIN;
+        }
+    }
+
+    sem->count--;
+    return 0;
+}
+
+void _sem_give(_sem_t *sem)
+{
+    if (!sem->limit || sem->count < sem->limit)
+    {
+        sem->count++;
+    }
+    port_wake();
+}
+
+void _sem_delete(_sem_t *sem)
+{
+    sem->count = 0;
+}
+
+int k_sem_init(struct k_sem *sem, unsigned int initial_count,
+               unsigned int limit)
+{
+    if (NULL == sem)
+    {
+        BT_ERR("sem is NULL\n");
+        return -EINVAL;
+    }
+
+    sys_dlist_init(&sem->poll_events);
+    return _sem_init(&sem->sem, initial_count, limit);
+}
+
+int k_sem_take(struct k_sem *sem, uint32_t timeout)
+{
+    return _sem_take(&sem->sem, (s32_t)timeout);
+}
+
+int k_sem_give(struct k_sem *sem)
+{
+    if (NULL == sem)
+    {
+        BT_ERR("sem is NULL\n");
+        return -EINVAL;
+    }
+
+    _sem_give(&sem->sem);
+    return 0;
+}
+
+int k_sem_delete(struct k_sem *sem)
+{
+    if (NULL == sem)
+    {
+        BT_ERR("sem is NULL\n");
+        return -EINVAL;
+    }
+
+    _sem_delete(&sem->sem);
+    return 0;
+}
+
+unsigned int k_sem_count_get(struct k_sem *sem)
+{
+    return sem->sem.count;
+}
+
+void k_mutex_init(struct k_mutex *mutex)
+{
+    if (NULL == mutex)
+    {
+        BT_ERR("mutex is NULL\n");
+        return;
+    }
+
+    mutex->mutex.nested = 0;
+    sys_dlist_init(&mutex->poll_events);
+}
+
+int k_mutex_lock(struct k_mutex *mutex, s32_t timeout)
+{
+    pthread_t self = pthread_self();
+    int64_t deadline;
+
+    if (mutex->mutex.nested && pthread_equal(mutex->mutex.owner, self))
+    {
+        mutex->mutex.nested++;
+        return 0;
+    }
+
+    deadline = port_deadline_of(timeout);
+    while (mutex->mutex.nested)
+    {
+        if (timeout == K_NO_WAIT)
+        {
+            return -EBUSY;
+        }
+
+        if (port_wait(deadline) && mutex->mutex.nested)
+        {
+            return -EAGAIN;
+        }
+    }
+
+    mutex->mutex.owner = self;
+    mutex->mutex.nested = 1;
+    return 0;
+}
+
+void k_mutex_unlock(struct k_mutex *mutex)
+{
+    if (NULL == mutex)
+    {
+        BT_ERR("mutex is NULL\n");
+        return;
+    }
+
+    if (!mutex->mutex.nested ||
+        !pthread_equal(mutex->mutex.owner, pthread_self()))
+    {
+        BT_ERR("mutex not owned\n");
+        return;
+    }
+
+    if (--mutex->mutex.nested == 0)
+    {
+        port_wake();
+    }
+}
+
+int64_t k_uptime_get()
+{
+    struct timespec now;
+
+    if (g_idle)
+    {
+        return g_virtual_now;
+    }
+
+    pthread_once(&g_port_once, port_init);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (int64_t)(now.tv_sec - g_boot_time.tv_sec) * MSEC_PER_SEC +
+           (now.tv_nsec - g_boot_time.tv_nsec) / 1000000L;
+}
+
+u32_t k_uptime_get_32()
+{
+    return (u32_t)k_uptime_get();
+}
+
+int k_thread_create(struct k_thread *new_thread, k_thread_stack_t *stack,
+                    size_t stack_size, k_thread_entry_t entry, void *p1,
+                    void *p2, void *p3, int prio, u32_t options, s32_t delay)
+{
+    int ret;
+
+    /* As on Rhino, p1 names the task and p2 is the entry argument. The
+     * static stack is left unused: the host thread brings its own.
+     */
+    ret = port_spawn(&new_thread->task.thread, entry, p2);
+    if (ret)
+    {
+        SYS_LOG_ERR("create ble task fail\n");
+    }
+
+    return ret;
+}
+
+int k_yield(void)
+{
+    if (g_idle)
+    {
+        sys_dlist_append(&g_run_queue, &g_self->node);
+        vclock_dispatch();
+        vclock_resume(g_self);
+        return 0;
+    }
+
+    k_os_exit();
+    sched_yield();
+    k_os_enter();
+    return 0;
+}
+
+unsigned int irq_lock(void)
+{
+    return 0;
+}
+
+void irq_unlock(unsigned int key)
+{
+}
+
+void _SysFatalErrorHandler(unsigned int reason, const void *pEsf){};
+
+void k_timer_init(k_timer_t *timer, k_timer_handler_t handle, void *args)
+{
+    ASSERT(timer, "timer is NULL");
+    BT_DBG("timer %p,handle %p,args %p", timer, handle, args);
+    timer->handler = handle;
+    timer->args = args;
+    timer->timeout = 0;
+    timer->expiry = 0;
+    timer->node.next = NULL;
+    timer->node.prev = NULL;
+}
+
+void k_timer_start(k_timer_t *timer, uint32_t timeout)
+{
+    ASSERT(timer, "timer is NULL");
+    BT_DBG("timer %p,timeout %u", timer, timeout);
+
+    k_timer_stop(timer);
+
+    timer->timeout = timeout;
+    timer->start_ms = k_uptime_get_32();
+    timer->expiry = k_uptime_get() + timeout;
+
+    sys_dlist_insert_at(&g_timer_list, &timer->node, timer_expires_after,
+                        &timer->expiry);
+    if (sys_dlist_peek_head(&g_timer_list) == &timer->node)
+    {
+        port_wake();
+    }
+}
+
+void k_timer_stop(k_timer_t *timer)
+{
+    ASSERT(timer, "timer is NULL");
+    /**
+ * Timer may be reused, so its timeout value
+ * should be cleared when stopped.
+ */
+    if (!timer->timeout)
+        return;
+
+    BT_DBG("timer %p", timer);
+    timer_unlink(timer);
+
+    timer->timeout = 0;
+}
+
+bool k_timer_is_started(k_timer_t *timer)
+{
+    ASSERT(timer, "timer is NULL");
+
+    return timer->timeout ? true : false;
+}
+
+void k_sleep(s32_t duration)
+{
+    int64_t deadline;
+
+    if (duration <= 0)
+    {
+        k_yield();
+        return;
+    }
+
+    deadline = k_uptime_get() + duration;
+    while (!port_wait(deadline))
+    {
+    }
+}
+
+long long k_now_ms()
+{
+    return k_uptime_get();
+}
+
+unsigned int find_msb_set(u32_t data)
+{
+    return data ? 32 - __builtin_clz(data) : 0;
+}
+
+unsigned int find_lsb_set(u32_t data)
+{
+    return data ? __builtin_ctz(data) + 1 : 0;
+}
+
+void *hal_malloc(u32_t size)
+{
+    return malloc(size);
+}
+
+void hal_free(void *data)
+{
+    free(data);
+}
+
+/* AOS kernel and log symbols the stack logs through. Weak, so a host build
+ * that also links utility/log keeps that one.
+ */
+__attribute__((weak)) unsigned int aos_log_level = AOS_LL_V_DEBUG | AOS_LL_V_INFO |
+                                                   AOS_LL_V_WARN | AOS_LL_V_ERROR |
+                                                   AOS_LL_V_FATAL;
+
+__attribute__((weak)) int csp_printf(const char *fmt, ...)
+{
+    va_list args;
+    int ret;
+
+    va_start(args, fmt);
+    ret = vprintf(fmt, args);
+    va_end(args);
+    fflush(stdout);
+
+    return ret;
+}
+
+__attribute__((weak)) long long aos_now_ms(void)
+{
+    return k_uptime_get();
+}
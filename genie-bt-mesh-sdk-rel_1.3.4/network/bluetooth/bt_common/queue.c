@@ -15,6 +15,8 @@ void k_queue_init(struct k_queue *queue)
     if (stat) {
         printf("buf queue exhausted\n");
     }
+#elif defined(CONFIG_BT_PORT_POSIX)
+    _sem_init(&queue->sem, 0, 1);
 #endif
     sys_slist_init(&queue->data_q);
     sys_dlist_init(&queue->poll_events);
@@ -29,6 +31,8 @@ void k_queue_cancel_wait(struct k_queue *queue)
 {
 #if defined(BOARD_TG7100B)
     krhino_sem_give(&queue->sem);
+#elif defined(CONFIG_BT_PORT_POSIX)
+    _sem_give(&queue->sem);
 #endif
     handle_poll_events(queue, K_POLL_STATE_NOT_READY);
 }
@@ -45,6 +49,8 @@ static void queue_insert(struct k_queue *queue, void *prev, void *data)
 #if defined(BOARD_TG7100B)
     irq_unlock(key);
     krhino_sem_give(&queue->sem);
+#elif defined(CONFIG_BT_PORT_POSIX)
+    _sem_give(&queue->sem);
 #endif
     handle_poll_events(queue, K_POLL_STATE_DATA_AVAILABLE);
 }
@@ -69,6 +75,8 @@ void k_queue_append_list(struct k_queue *queue, void *head, void *tail)
     sys_slist_append_list(&queue->data_q, head, tail);
 #if defined(BOARD_TG7100B)
     krhino_sem_give(&queue->sem);
+#elif defined(CONFIG_BT_PORT_POSIX)
+    _sem_give(&queue->sem);
 #endif
     handle_poll_events(queue, K_POLL_STATE_DATA_AVAILABLE);
 }
@@ -103,6 +111,12 @@ void *k_queue_get(struct k_queue *queue, s32_t timeout)
     msg = sys_slist_get(&queue->data_q);
     irq_unlock(key);
     return msg;
+#elif defined(CONFIG_BT_PORT_POSIX)
+    if (sys_slist_is_empty(&queue->data_q) && timeout != K_NO_WAIT &&
+        _sem_take(&queue->sem, timeout)) {
+        return NULL;
+    }
+    return sys_slist_get(&queue->data_q);
 #else
     return sys_slist_get(&queue->data_q);
 #endif
@@ -9,28 +9,157 @@
 struct k_work_q g_work_queue;
 
 extern void event_callback(uint8_t event_type);
-static void k_work_submit_to_queue(struct k_work_q *work_q, struct k_work *work)
+
+/* Expiry order. Times are 32-bit ms that wrap, so compare by signed
+ * difference; work submitted at the same expiry keeps submit order.
+ */
+static bool work_before(const struct k_work *a, const struct k_work *b)
 {
-    sys_snode_t *node = NULL;
-    struct k_work *delayed_work = NULL;
-    struct k_work *prev_delayed_work = NULL;
-    //uint32_t now = k_uptime_get_32();
+    int32_t diff = (int32_t)((a->start_ms + a->timeout) -
+                             (b->start_ms + b->timeout));
 
-    if (!atomic_test_and_set_bit(work->flags, K_WORK_STATE_PENDING)) {
-        SYS_SLIST_FOR_EACH_NODE(&g_work_queue.queue.data_q, node) {
-            delayed_work = (struct k_work *)node;
-            if ((work->timeout + work->start_ms) < (delayed_work->start_ms + delayed_work->timeout)) {
-                break;
-            }
-            prev_delayed_work = delayed_work;
+    if (diff) {
+        return diff < 0;
+    }
+
+    return (int32_t)(a->seq - b->seq) < 0;
+}
+
+static struct k_work **heap_link(struct k_work_q *work_q, struct k_work *work)
+{
+    if (!work->parent) {
+        return &work_q->root;
+    }
+
+    return work->parent->left == work ? &work->parent->left :
+                                        &work->parent->right;
+}
+
+/* Link to heap position pos (1-based, level order): the bits of pos
+ * below the top one spell the path from the root.
+ */
+static struct k_work **heap_slot(struct k_work_q *work_q, uint32_t pos,
+                                 struct k_work **parent)
+{
+    struct k_work **link = &work_q->root;
+    int bit = find_msb_set(pos) - 2;
+
+    *parent = NULL;
+    for (; bit >= 0; bit--) {
+        *parent = *link;
+        link = (pos >> bit) & 1 ? &(*link)->right : &(*link)->left;
+    }
+
+    return link;
+}
+
+/* Swap a work with its parent. */
+static void heap_swap_up(struct k_work_q *work_q, struct k_work *work)
+{
+    struct k_work *parent = work->parent;
+    struct k_work **link = heap_link(work_q, parent);
+    struct k_work *left = work->left;
+    struct k_work *right = work->right;
+    struct k_work *sibling;
+
+    *link = work;
+    work->parent = parent->parent;
+    if (parent->left == work) {
+        sibling = parent->right;
+        work->left = parent;
+        work->right = sibling;
+    } else {
+        sibling = parent->left;
+        work->left = sibling;
+        work->right = parent;
+    }
+
+    if (sibling) {
+        sibling->parent = work;
+    }
+
+    parent->parent = work;
+    parent->left = left;
+    parent->right = right;
+    if (left) {
+        left->parent = parent;
+    }
+    if (right) {
+        right->parent = parent;
+    }
+}
+
+static void heap_sift(struct k_work_q *work_q, struct k_work *work)
+{
+    struct k_work *child;
+
+    while (work->parent && work_before(work, work->parent)) {
+        heap_swap_up(work_q, work);
+    }
+
+    while ((child = work->left) != NULL) {
+        if (work->right && work_before(work->right, child)) {
+            child = work->right;
+        }
+
+        if (!work_before(child, work)) {
+            break;
         }
 
-        delayed_work = k_queue_first_entry(&g_work_queue.queue);
-        sys_slist_insert(&g_work_queue.queue.data_q,
-                         (sys_snode_t *)prev_delayed_work, (sys_snode_t *)work);
+        heap_swap_up(work_q, child);
+    }
+}
+
+static void heap_insert(struct k_work_q *work_q, struct k_work *work)
+{
+    struct k_work **link;
 
-        if (delayed_work &&
-            work->start_ms + work->timeout < delayed_work->start_ms + delayed_work->timeout) {
+    link = heap_slot(work_q, ++work_q->count, &work->parent);
+    *link = work;
+    work->queue = work_q;
+    work->left = NULL;
+    work->right = NULL;
+    heap_sift(work_q, work);
+}
+
+/* Move the last work into the hole and restore the order from there. */
+static void heap_remove(struct k_work_q *work_q, struct k_work *work)
+{
+    struct k_work *parent;
+    struct k_work **link;
+    struct k_work *last;
+
+    work->queue = NULL;
+    link = heap_slot(work_q, work_q->count--, &parent);
+    last = *link;
+    *link = NULL;
+    if (last == work) {
+        return;
+    }
+
+    last->parent = work->parent;
+    last->left = work->left;
+    last->right = work->right;
+    *heap_link(work_q, work) = last;
+    if (last->left) {
+        last->left->parent = last;
+    }
+    if (last->right) {
+        last->right->parent = last;
+    }
+
+    heap_sift(work_q, last);
+}
+
+static void k_work_submit_to_queue(struct k_work_q *work_q, struct k_work *work)
+{
+    struct k_work *first = work_q->root;
+
+    if (!atomic_test_and_set_bit(work->flags, K_WORK_STATE_PENDING)) {
+        work->seq = work_q->seq++;
+        heap_insert(work_q, work);
+
+        if (first && work_before(work, first)) {
             event_callback(K_POLL_TYPE_EARLIER_WORK);
         }
         /*[Genie begin] add by lgy at 2020-09-09*/
@@ -45,18 +174,62 @@ static void k_work_submit_to_queue(struct k_work_q *work_q, struct k_work *work)
 
 static void k_work_rm_from_queue(struct k_work_q *work_q, struct k_work *work)
 {
-    k_queue_remove(&work_q->queue, work);
+    if (atomic_test_and_clear_bit(work->flags, K_WORK_STATE_PENDING)) {
+        heap_remove(work_q, work);
+    }
 }
 
 int k_work_q_start(void)
 {
-    k_queue_init(&g_work_queue.queue);
+    struct k_work *work;
+
+    /* A restart drops the pending works, they can be submitted again. */
+    while ((work = g_work_queue.root) != NULL) {
+        atomic_clear_bit(work->flags, K_WORK_STATE_PENDING);
+        heap_remove(&g_work_queue, work);
+    }
     return 0;
 }
 
+struct k_work *k_work_q_first(void)
+{
+    return g_work_queue.root;
+}
+
+struct k_work *k_work_q_get_expired(void)
+{
+    struct k_work *work;
+    int key = irq_lock();
+
+    work = g_work_queue.root;
+    if (work && k_delayed_work_remaining_get((struct k_delayed_work *)work)) {
+        work = NULL;
+    }
+
+    if (work) {
+        k_work_rm_from_queue(&g_work_queue, work);
+    }
+
+    irq_unlock(key);
+    return work;
+}
+
 int k_work_init(struct k_work *work, k_work_handler_t handler)
 {
+    int key = irq_lock();
+
+    /* Re-initialising pending work drops it, as it never runs anyway. A
+     * first-use work may carry a stale pending bit, so it must also be
+     * linked to the queue, which only the heap sets and clears.
+     */
+    if (work->queue == &g_work_queue &&
+        atomic_test_bit(work->flags, K_WORK_STATE_PENDING)) {
+        k_work_rm_from_queue(&g_work_queue, work);
+    }
     atomic_clear_bit(work->flags, K_WORK_STATE_PENDING);
+    work->queue = NULL;
+    irq_unlock(key);
+
     work->handler = handler;
     work->start_ms = 0;
     work->timeout = 0;
@@ -94,9 +267,8 @@ int k_delayed_work_submit(struct k_delayed_work *work, uint32_t delay)
 int k_delayed_work_cancel(struct k_delayed_work *work)
 {
     int key = irq_lock();
-	work->work.timeout = 0;
-    atomic_clear_bit(work->work.flags, K_WORK_STATE_PENDING);
     k_work_rm_from_queue(&g_work_queue, (struct k_work *)work);
+	work->work.timeout = 0;
     irq_unlock(key);
     return 0;
 }
@@ -24,6 +24,34 @@ struct bt_mesh_model *bt_mesh_model_find(struct bt_mesh_elem *elem,
 
 u16_t *bt_mesh_model_find_group(struct bt_mesh_model *mod, u16_t addr);
 
+/* Keep the group address index in step with model subscriptions: update
+ * after one address was added to or removed from a model, rebuild after
+ * whole subscription lists were rewritten.
+ */
+void bt_mesh_elem_group_update(u16_t addr);
+void bt_mesh_elem_group_rebuild(void);
+
+/* Group and virtual destinations turned away by the node wide
+ * subscription filter, and access PDUs the transport layer dropped before
+ * application decryption because nothing on this node takes them.
+ */
+struct bt_mesh_sub_stats
+{
+	u16_t addrs;		/* Group and virtual addresses subscribed */
+	u32_t lookups;		/* Group and virtual destinations looked up */
+	u32_t filtered;		/* Rejected by the filter alone */
+	u32_t false_pos;	/* Passed the filter but not subscribed */
+	u32_t skip_group;	/* PDUs to other groups not decrypted */
+	u32_t skip_unicast; /* PDUs to other nodes not decrypted */
+	u32_t skip_octets;	/* Upper transport octets of those */
+};
+
+void bt_mesh_sub_skipped(u16_t dst, u16_t len);
+
+void bt_mesh_sub_stats_get(struct bt_mesh_sub_stats *stats);
+
+void bt_mesh_sub_stats_reset(void);
+
 bool bt_mesh_fixed_group_match(u16_t addr);
 
 void bt_mesh_model_foreach(void (*func)(struct bt_mesh_model *mod,
@@ -43,6 +71,12 @@ const struct bt_mesh_comp *bt_mesh_comp_get(void);
 
 void bt_mesh_model_recv(struct bt_mesh_net_rx *rx, struct net_buf_simple *buf);
 
+/* Number of models on dst taking opcode with app_idx, found through the
+ * OpCode index or the linear walk of the composition.
+ */
+int bt_mesh_model_op_match(u16_t dst, u16_t app_idx, u32_t opcode,
+						   bool linear);
+
 int bt_mesh_comp_register(const struct bt_mesh_comp *comp);
 
 u16_t bt_mesh_model_get_appkey_id(struct bt_mesh_elem *elem,  struct bt_mesh_model *p_model);
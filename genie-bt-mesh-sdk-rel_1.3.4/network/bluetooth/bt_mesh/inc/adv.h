@@ -11,8 +11,8 @@
 /* Maximum advertising data payload for a single data type */
 #define BT_MESH_ADV_DATA_SIZE 29
 
-/* The user data is a pointer (4 bytes) to struct bt_mesh_adv */
-#define BT_MESH_ADV_USER_DATA_SIZE 4
+/* The user data is a pointer to struct bt_mesh_adv */
+#define BT_MESH_ADV_USER_DATA_SIZE sizeof(struct bt_mesh_adv *)
 
 #define BT_MESH_ADV(buf) (*(struct bt_mesh_adv **)net_buf_user_data(buf))
 
@@ -24,6 +24,17 @@ enum bt_mesh_adv_type
     BT_MESH_ADV_URI,
 };
 
+/* Priority classes of the adv thread, most urgent first */
+enum bt_mesh_adv_prio
+{
+    BT_MESH_ADV_PRIO_CTL,    /* Transport control, friend queue, provisioning */
+    BT_MESH_ADV_PRIO_LOCAL,  /* Locally originated network PDUs */
+    BT_MESH_ADV_PRIO_BEACON,
+    BT_MESH_ADV_PRIO_RELAY,  /* PDUs relayed from the advertising bearer */
+
+    BT_MESH_ADV_PRIO_COUNT,
+};
+
 typedef void (*bt_mesh_adv_func_t)(struct net_buf *buf, u16_t duration,
                                    int err, void *user_data);
 
@@ -35,11 +46,18 @@ struct bt_mesh_adv
     u8_t type : 2;
     u8_t busy : 1;
     u8_t count : 3;
-    u8_t padding : 2;
+    u8_t prio : 2;
 #ifdef GENIE_ULTRA_PROV
     u8_t tiny_adv;
 #endif
     u16_t adv_int;
+
+    /* Transmit plan of the adv thread: transmissions still to go and
+     * when the next one is due.
+     */
+    u8_t xmit_left;
+    u32_t xmit_due;
+
     union
     {
         /* Address, used e.g. for Friend Queue messages */
@@ -78,6 +96,31 @@ void bt_mesh_adv_send(struct net_buf *buf, const struct bt_mesh_send_cb *cb,
 
 void bt_mesh_adv_update(void);
 
+#define BT_MESH_ADV_DEPTH_HIST 6
+#define BT_MESH_ADV_LATENCY_HIST 11
+
+/* Adv scheduler counters of one priority class */
+struct bt_mesh_adv_stats
+{
+    u32_t queued;   /* PDUs taken into the transmit plan */
+    u32_t sent;     /* PDUs that went out all their transmissions */
+    u32_t late;     /* Transmissions that started past the class deadline */
+    u32_t dropped;  /* Stale PDUs dropped */
+    u32_t rejected; /* PDUs refused on admission */
+    u16_t depth;    /* PDUs in the plan now */
+    u16_t depth_max;
+    /* Class depth seen on admission: 0, 1, 2-3, 4-7, 8-15, 16+ */
+    u32_t depth_hist[BT_MESH_ADV_DEPTH_HIST];
+    /* ms from bt_mesh_adv_send() to the first transmission: 0, 1, 2-3,
+     * 4-7, ..., 256-511, 512+
+     */
+    u32_t latency_hist[BT_MESH_ADV_LATENCY_HIST];
+};
+
+void bt_mesh_adv_stats_get(struct bt_mesh_adv_stats stats[BT_MESH_ADV_PRIO_COUNT]);
+
+void bt_mesh_adv_stats_reset(void);
+
 void bt_mesh_adv_init(void);
 
 int bt_mesh_scan_enable(void);
@@ -43,5 +43,37 @@ int bt_mesh_friend_sub_add(struct bt_mesh_net_rx *rx,
 int bt_mesh_friend_sub_rem(struct bt_mesh_net_rx *rx,
 						   struct net_buf_simple *buf);
 
+/* Friend Queue counters, summed over the LPNs */
+struct bt_mesh_friend_stats
+{
+	u32_t queued[BT_MESH_FRIEND_LANE_COUNT]; /* PDUs put on each lane */
+	u32_t sent;         /* PDUs taken off the queue for an LPN */
+	u32_t evict_budget; /* Oldest PDUs dropped to keep an LPN in budget */
+	u32_t evict_pool;   /* Oldest PDUs dropped for a free buffer */
+	u32_t alloc_failed; /* PDUs lost with nothing left to drop */
+	u32_t ack_purged;   /* Acks replaced by a newer one */
+	u32_t seg_no_ctx;   /* Segments dropped for lack of a context */
+	u32_t seg_cleared;  /* Incomplete segmented messages cleared */
+};
+
+/* Friend Queue occupancy of one LPN */
+struct bt_mesh_friend_queue
+{
+	u16_t lpn;
+	u16_t size[BT_MESH_FRIEND_LANE_COUNT]; /* PDUs on each lane */
+	u16_t bytes; /* Octets on all lanes */
+	u16_t peak;  /* Most octets since the friendship began */
+	u16_t seg;   /* Segment contexts in use */
+};
+
+void bt_mesh_friend_stats_get(struct bt_mesh_friend_stats *stats);
+
+void bt_mesh_friend_stats_reset(void);
+
+/* Fills queue[] (CONFIG_BT_MESH_FRIEND_LPN_COUNT entries) for every
+ * friendship, returns how many there are.
+ */
+int bt_mesh_friend_queue_get(struct bt_mesh_friend_queue *queue);
+
 int bt_mesh_friend_init(void);
 #endif
\ No newline at end of file
@@ -21,6 +21,11 @@
 #define CONFIG_BT_MESH_FRIEND_QUEUE_SIZE 16
 #endif
 
+/* Octets of Network PDUs (29 at most each) one LPN may hold queued */
+#ifndef CONFIG_BT_MESH_FRIEND_QUEUE_BYTES
+#define CONFIG_BT_MESH_FRIEND_QUEUE_BYTES (CONFIG_BT_MESH_FRIEND_QUEUE_SIZE * 29)
+#endif
+
 #ifndef CONFIG_BT_MESH_FRIEND_SUB_LIST_SIZE
 #define CONFIG_BT_MESH_FRIEND_SUB_LIST_SIZE 3
 #endif
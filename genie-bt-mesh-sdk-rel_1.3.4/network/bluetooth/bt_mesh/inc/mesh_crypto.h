@@ -125,20 +125,28 @@ static inline int bt_mesh_prov_salt(const u8_t conf_salt[16],
 }
 
 int bt_mesh_net_obfuscate(u8_t *pdu, u32_t iv_index,
-						  const u8_t privacy_key[16]);
+						  const struct bt_mesh_aes_key *privacy_key);
 
-int bt_mesh_net_encrypt(const u8_t key[16], struct net_buf_simple *buf,
+int bt_mesh_net_encrypt(const struct bt_mesh_aes_key *key,
+						struct net_buf_simple *buf,
 						u32_t iv_index, bool proxy);
 
-int bt_mesh_net_decrypt(const u8_t key[16], struct net_buf_simple *buf,
+/* buf holds the deobfuscated header and gets the decrypted payload. The
+ * encrypted payload and MIC are read from payload, which may either be
+ * &buf->data[7] or the received PDU.
+ */
+int bt_mesh_net_decrypt(const struct bt_mesh_aes_key *key,
+						struct net_buf_simple *buf, const u8_t *payload,
 						u32_t iv_index, bool proxy);
 
-int bt_mesh_app_encrypt(const u8_t key[16], bool dev_key, u8_t aszmic,
-						struct net_buf_simple *buf, const u8_t *ad,
-						u16_t src, u16_t dst, u32_t seq_num, u32_t iv_index);
+int bt_mesh_app_encrypt(const struct bt_mesh_aes_key *key, bool dev_key,
+						u8_t aszmic, struct net_buf_simple *buf,
+						const u8_t *ad, u16_t src, u16_t dst, u32_t seq_num,
+						u32_t iv_index);
 
-int bt_mesh_app_decrypt(const u8_t key[16], bool dev_key, u8_t aszmic,
-						struct net_buf_simple *buf, struct net_buf_simple *out,
+int bt_mesh_app_decrypt(const struct bt_mesh_aes_key *key, bool dev_key,
+						u8_t aszmic, struct net_buf_simple *buf,
+						struct net_buf_simple *out,
 						const u8_t *ad, u16_t src, u16_t dst, u32_t seq_num,
 						u32_t iv_index);
 
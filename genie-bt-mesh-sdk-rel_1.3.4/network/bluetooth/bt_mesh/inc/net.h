@@ -8,6 +8,7 @@
 #ifndef __NET_H
 #define __NET_H
 #include "mesh_config.h"
+#include <port/mesh_hal_sec.h>
 
 #define BT_MESH_NET_FLAG_KR BIT(0)
 #define BT_MESH_NET_FLAG_IVU BIT(1)
@@ -31,6 +32,7 @@ struct bt_mesh_app_key
 	{
 		u8_t id;
 		u8_t val[16];
+		struct bt_mesh_aes_key sched; /* Expanded AppKey */
 	} keys[2];
 };
 
@@ -69,6 +71,9 @@ struct bt_mesh_subnet
 #endif
 		u8_t privacy[16]; /* PrivacyKey */
 		u8_t beacon[16];  /* BeaconKey */
+
+		struct bt_mesh_aes_key enc_sched;	  /* Expanded EncKey */
+		struct bt_mesh_aes_key privacy_sched; /* Expanded PrivacyKey */
 	} keys[2];
 };
 
@@ -87,6 +92,16 @@ struct bt_mesh_rpl
 #define FRIEND_SUB_LIST_SIZE 0
 #endif
 
+/* Lanes of the Friend Queue, handed to the LPN in this order */
+enum bt_mesh_friend_lane
+{
+	BT_MESH_FRIEND_LANE_CTL,  /* Friend Updates */
+	BT_MESH_FRIEND_LANE_ACK,  /* Segment Acknowledgments */
+	BT_MESH_FRIEND_LANE_DATA, /* Everything else */
+
+	BT_MESH_FRIEND_LANE_COUNT,
+};
+
 struct bt_mesh_friend
 {
 	u16_t lpn;
@@ -111,12 +126,18 @@ struct bt_mesh_friend
 	struct bt_mesh_friend_seg
 	{
 		sys_slist_t queue;
+		/* Message being collected, valid while queue isn't empty */
+		u16_t src;
+		u64_t seq_auth;
 	} seg[FRIEND_SEG_RX];
 
 	struct net_buf *last;
 
-	sys_slist_t queue;
+	sys_slist_t queue[BT_MESH_FRIEND_LANE_COUNT];
+	u16_t lane_size[BT_MESH_FRIEND_LANE_COUNT];
 	u32_t queue_size;
+	u16_t queue_bytes; /* Network PDU octets on all lanes */
+	u16_t queue_peak;  /* Most octets queued since the friendship began */
 
 	/* Friend Clear Procedure */
 	struct
@@ -227,6 +248,7 @@ struct bt_mesh_net
 	struct k_delayed_work ivu_complete;
 
 	u8_t dev_key[16];
+	struct bt_mesh_aes_key dev_key_sched; /* Expanded DevKey */
 
 	struct bt_mesh_app_key app_keys[CONFIG_BT_MESH_APP_KEY_COUNT];
 
@@ -325,6 +347,29 @@ void bt_mesh_net_recv(struct net_buf_simple *data, s8_t rssi,
 
 void bt_mesh_net_init(void);
 
+/* Network message cache and duplicate filter counters */
+struct bt_mesh_net_cache_stats
+{
+	u32_t hit;	 /* Lookups that found the key already cached */
+	u32_t miss;	 /* Lookups that added a new key */
+	u32_t evict; /* Keys dropped to make room for a new one */
+};
+
+void bt_mesh_net_cache_stats_get(struct bt_mesh_net_cache_stats *msg,
+								 struct bt_mesh_net_cache_stats *dup);
+
+/* Network layer decryption counters */
+struct bt_mesh_net_decrypt_stats
+{
+	u32_t pdus;			/* PDUs that went through credential lookup */
+	u32_t no_match;		/* PDUs no credential could decrypt */
+	u32_t dup;			/* PDUs dropped by the Network Message Cache */
+	u32_t cand_fail;	/* Candidate credentials that failed to decrypt */
+	u32_t fail_hist[4]; /* PDUs by failed candidates: 0, 1, 2, 3+ */
+};
+
+void bt_mesh_net_decrypt_stats_get(struct bt_mesh_net_decrypt_stats *stats);
+
 bool bt_mesh_net_is_rx(void);
 
 /* Friendship Credential Management */
@@ -341,11 +386,15 @@ struct friend_cred
 		u8_t nid;		  /* NID */
 		u8_t enc[16];	  /* EncKey */
 		u8_t privacy[16]; /* PrivacyKey */
+
+		struct bt_mesh_aes_key enc_sched;	  /* Expanded EncKey */
+		struct bt_mesh_aes_key privacy_sched; /* Expanded PrivacyKey */
 	} cred[2];
 };
 
 int friend_cred_get(struct bt_mesh_subnet *sub, u16_t addr, u8_t *nid,
-					const u8_t **enc, const u8_t **priv);
+					const struct bt_mesh_aes_key **enc,
+					const struct bt_mesh_aes_key **priv);
 int friend_cred_set(struct friend_cred *cred, u8_t idx, const u8_t net_key[16]);
 void friend_cred_refresh(u16_t net_idx);
 int friend_cred_update(struct bt_mesh_subnet *sub);
@@ -57,6 +57,21 @@ int bt_mesh_adv_start(const struct bt_mesh_le_adv_param *param,
  */
 int bt_mesh_adv_stop(void);
 
+/** @typedef bt_mesh_le_adv_sent_cb_t
+ *  @brief Callback type for reporting a finished advertising event.
+ *
+ *  A function of this type is given to the bt_mesh_adv_sent_cb_set()
+ *  function and will be called each time the advertising data set by
+ *  bt_mesh_adv_start() has been put on air. It may run from timer context.
+ */
+typedef void bt_mesh_le_adv_sent_cb_t(void);
+
+/** @brief Set the advertising event callback
+ *
+ *  @param cb Callback for finished advertising events, NULL to clear it.
+ */
+void bt_mesh_adv_sent_cb_set(bt_mesh_le_adv_sent_cb_t *cb);
+
 /** @brief Start multi advertising instant
  *
  *  Set advertisement data, scan response data, advertisement parameters
@@ -238,9 +238,11 @@ void k_timer_stop(k_timer_t *timer);
 void k_sleep(s32_t duration);
 long long k_now_ms();
 
+#ifndef CONFIG_BT_PORT_POSIX
 int k_event_create(kevent_t *event, const name_t *name, uint32_t flag);
 int k_event_delete(kevent_t *event);
 int k_event_get(kevent_t *event, uint32_t flags, uint32_t *actl_flags, int32_t ticks);
 void k_event_set(kevent_t *event, uint32_t flags);
+#endif
 
 #endif /* _MESH_HAL_OS_H_ */
@@ -61,6 +61,42 @@ int bt_mesh_aes_encrypt(const uint8_t key[16], const uint8_t plaintext[16],
 int bt_mesh_aes_decrypt(const uint8_t key[16], const uint8_t enc_data[16],
                         uint8_t dec_data[16]);
 
+/*  @brief Expanded AES-128 encryption key
+ *
+ *  Keys that encrypt many blocks (network, application and friendship
+ *  keys) are expanded once when they are installed so that the per
+ *  block cost is only the cipher rounds. The contents are owned by the
+ *  port; clearing the structure with memset() wipes the key.
+ */
+struct bt_mesh_aes_key
+{
+        unsigned int words[44];
+};
+
+/** @brief Expand an AES-128 encryption key
+ *
+ *  @param ctx Expanded key to initialize
+ *  @param key AES key
+ *
+ *  @return 0 on sucess, otherwise negative number
+ */
+int bt_mesh_aes_key_set(struct bt_mesh_aes_key *ctx, const uint8_t key[16]);
+
+/** @brief AES-128 ECB with an expanded key
+ *
+ *  Same as bt_mesh_aes_encrypt() but takes a key prepared with
+ *  bt_mesh_aes_key_set().
+ *
+ *  @param ctx Expanded AES key
+ *  @param plaintext The data before encryption
+ *  @param enc_data The data after encryption, may alias plaintext
+ *
+ *  @return 0 on sucess, otherwise negative number
+ */
+int bt_mesh_aes_key_encrypt(const struct bt_mesh_aes_key *ctx,
+                            const uint8_t plaintext[16],
+                            uint8_t enc_data[16]);
+
 /** @brief AES-CMAC
  *
  * Function used to do the AES-CMAC calculation.
@@ -114,4 +114,66 @@ int bt_mesh_trans_recv(struct net_buf_simple *buf, struct bt_mesh_net_rx *rx);
 void bt_mesh_trans_init(void);
 
 void bt_mesh_rpl_clear(void);
+
+/* Storage for the RPL. begin and commit are optional and bracket the
+ * store calls of one pass, so they can be written together; a non-zero
+ * return from either keeps the slots pending for the next pass.
+ */
+struct bt_mesh_rpl_store_cb
+{
+	int (*begin)(void);
+	void (*store)(u16_t slot, const struct bt_mesh_rpl *rpl);
+	int (*commit)(void);
+};
+
+/* Hand every RPL slot changed since the last call to the store callback.
+ * Slots with a zero source address have been cleared.
+ */
+void bt_mesh_rpl_store_pending(const struct bt_mesh_rpl_store_cb *cb);
+
+void bt_mesh_rpl_restore(u16_t slot, const struct bt_mesh_rpl *rpl);
+
+#define BT_MESH_SEG_LATENCY_HIST 14
+
+/* Segmented message counters */
+struct bt_mesh_seg_stats
+{
+	u16_t pool_size;	 /* RX segment slots */
+	u16_t pool_used;	 /* Slots reserved by RX contexts now */
+	u16_t pool_peak;	 /* Most slots reserved at once */
+	u32_t pool_rejected; /* RX sessions refused for lack of slots */
+	u32_t rx_complete;	 /* SDUs reassembled */
+	u32_t rx_canceled;	 /* RX sessions timed out, too large or superseded */
+	u32_t rx_dup_acked;	 /* Late segments acked from the completion cache */
+	u32_t rx_latency_max;
+	/* ms from the first to the last segment of complete SDUs: 0, 1, 2-3,
+	 * 4-7, ..., 4096-8191, 8192+
+	 */
+	u32_t rx_latency_hist[BT_MESH_SEG_LATENCY_HIST];
+	u32_t tx_retransmit;  /* Segments sent again */
+	u32_t tx_timeouts;	  /* Retransmit timer expiries */
+	u32_t tx_ack_resends; /* Resends of segments a block ack missed */
+};
+
+/* Above the TX context count, so an estimate pinned by every TX context
+ * still leaves one to recycle.
+ */
+#define BT_MESH_SEG_RTT_COUNT (CONFIG_BT_MESH_TX_SEG_MSG_COUNT + 2)
+
+/* Round trip estimate of one destination, in ms */
+struct bt_mesh_seg_rtt
+{
+	u16_t addr;
+	u16_t srtt;
+	u16_t rttvar;
+	u16_t rto;
+	u32_t samples;
+};
+
+void bt_mesh_seg_stats_get(struct bt_mesh_seg_stats *stats);
+
+/* Fills in destinations with at least one sample, returns how many */
+int bt_mesh_seg_rtt_get(struct bt_mesh_seg_rtt rtt[BT_MESH_SEG_RTT_COUNT]);
+
+void bt_mesh_seg_stats_reset(void);
 #endif
\ No newline at end of file
@@ -91,6 +91,7 @@ struct
     uint8_t flag;
     adv_scan_schd_state_en cur_st;
     struct adv_scan_data_t param;
+    bt_mesh_le_adv_sent_cb_t *adv_sent_cb;
 } adv_scan_schd = {0};
 
 static int adv_scan_schd_idle_enter(adv_scan_schd_state_en st)
@@ -293,6 +294,7 @@ void adv_scan_timer(void *timer, void *arg)
     } next_state = ADV;
     static int adv_time = 0;
     uint32_t next_time = 0;
+    bt_mesh_le_adv_sent_cb_t *adv_sent_cb = NULL;
 
     k_mutex_lock(&adv_scan_schd.mutex, 5000);
     if (adv_scan_schd.flag == FLAG_RESTART)
@@ -344,6 +346,11 @@ void adv_scan_timer(void *timer, void *arg)
         {
             BT_ERR("adv stop err %d\n", ret);
         }
+        else
+        {
+            /* The adv window is over, report the event once unlocked */
+            adv_sent_cb = adv_scan_schd.adv_sent_cb;
+        }
 
         /* Here, we define the adv window of each package in adv duration (120ms or xmit related time)*/
         if (adv_scan_schd.param.adv_param.options & BT_LE_ADV_OPT_CONNECTABLE)
@@ -371,6 +378,11 @@ void adv_scan_timer(void *timer, void *arg)
     k_timer_start(&adv_scan_schd.timer, krhino_ms_to_ticks(next_time));
 
     k_mutex_unlock(&adv_scan_schd.mutex);
+
+    if (adv_sent_cb)
+    {
+        adv_sent_cb();
+    }
 }
 
 int bt_mesh_adv_scan_schd_init()
@@ -461,6 +473,11 @@ int bt_mesh_adv_stop(void)
     return 0;
 }
 
+void bt_mesh_adv_sent_cb_set(bt_mesh_le_adv_sent_cb_t *cb)
+{
+    adv_scan_schd.adv_sent_cb = cb;
+}
+
 int bt_mesh_scan_start(const struct bt_mesh_le_scan_param *param, bt_mesh_le_scan_cb_t cb)
 {
     k_mutex_lock(&adv_scan_schd.mutex, K_FOREVER);
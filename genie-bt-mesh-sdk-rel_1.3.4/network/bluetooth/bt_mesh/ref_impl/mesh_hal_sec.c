@@ -4,6 +4,7 @@
 
 #include <errno.h>
 #include <stddef.h>
+#include <string.h>
 #include <bluetooth.h>
 #include <port/mesh_hal_sec.h>
 
@@ -46,6 +47,44 @@ int bt_mesh_aes_decrypt(const uint8_t key[16], const uint8_t enc_data[16],
 #endif
 }
 
+BUILD_ASSERT(sizeof(struct bt_mesh_aes_key) ==
+             sizeof(struct tc_aes_key_sched_struct));
+
+int bt_mesh_aes_key_set(struct bt_mesh_aes_key *ctx, const uint8_t key[16])
+{
+#if BOARD_TC825X
+    /* The hardware engine expands the key itself, just keep it */
+    memcpy(ctx->words, key, 16);
+    return 0;
+#else
+    if (tc_aes128_set_encrypt_key((TCAesKeySched_t)ctx->words,
+                                  key) == TC_CRYPTO_FAIL)
+    {
+        return -EINVAL;
+    }
+
+    return 0;
+#endif
+}
+
+int bt_mesh_aes_key_encrypt(const struct bt_mesh_aes_key *ctx,
+                            const uint8_t plaintext[16],
+                            uint8_t enc_data[16])
+{
+#if BOARD_TC825X
+    return bt_mesh_aes_encrypt((const uint8_t *)ctx->words, plaintext,
+                               enc_data);
+#else
+    if (tc_aes_encrypt(enc_data, plaintext,
+                       (TCAesKeySched_t)ctx->words) == TC_CRYPTO_FAIL)
+    {
+        return -EINVAL;
+    }
+
+    return 0;
+#endif
+}
+
 int bt_mesh_aes_cmac(const uint8_t key[16], struct bt_mesh_sg *sg,
                      size_t sg_len, uint8_t mac[16])
 {
@@ -100,6 +139,18 @@ int bt_mesh_aes_encrypt(const uint8_t key[16], const uint8_t plaintext[16],
     return 0;
 }
 
+int bt_mesh_aes_key_set(struct bt_mesh_aes_key *ctx, const uint8_t key[16])
+{
+    return 0;
+}
+
+int bt_mesh_aes_key_encrypt(const struct bt_mesh_aes_key *ctx,
+                            const uint8_t plaintext[16],
+                            uint8_t enc_data[16])
+{
+    return 0;
+}
+
 int bt_mesh_aes_cmac(const uint8_t key[16], struct bt_mesh_sg *sg,
                      size_t sg_len, uint8_t mac[16])
 {
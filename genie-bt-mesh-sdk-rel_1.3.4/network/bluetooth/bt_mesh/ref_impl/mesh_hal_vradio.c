@@ -0,0 +1,667 @@
+/*
+ * Copyright (C) 2015-2019 Alibaba Group Holding Limited
+ */
+
+#include <port/mesh_hal_ble.h>
+#include <errno.h>
+#define BT_DBG_ENABLED IS_ENABLED(CONFIG_BT_DEBUG_CORE)
+
+#include <common/log.h>
+
+#include <conn.h>
+#include <gatt.h>
+#include <bluetooth.h>
+#include <buf.h>
+#include <crypto.h>
+#include <ecc.h>
+#include <misc/byteorder.h>
+#include "hci_core.h"
+
+#include <tinycrypt/constants.h>
+#include <tinycrypt/aes.h>
+#include <tinycrypt/ecc.h>
+#include <tinycrypt/ecc_dh.h>
+#include <tinycrypt/ecc_platform_specific.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "mesh_hal_vradio.h"
+
+/*
+ * Host stand-in for the controller and for the parts of bt_host that the
+ * mesh stack and mesh_hal_sec.c use. The stack task runs the same
+ * scheduler_loop() as hci_core.c; its only poll event is the queue of
+ * received PDUs, which bt_mesh_vradio_input() fills.
+ */
+
+#define VRADIO_HDR_LEN BT_MESH_VRADIO_HDR_LEN
+#define VRADIO_AD_MAX (BT_MESH_VRADIO_PDU_MAX - BT_MESH_VRADIO_HDR_LEN)
+#define VRADIO_EVENT_RX 0
+
+/* Shortest advertising interval the virtual controller will repeat at */
+#define VRADIO_ADV_INT_MIN 20 //ms
+
+/* Upper bound of the random advDelay added to every advertising event, so
+ * that nodes repeating at the same interval drift apart as on air.
+ */
+#define VRADIO_ADV_DELAY_MAX 10 //ms
+
+struct vradio_rx
+{
+    sys_snode_t node;
+    bt_mesh_addr_le_t addr;
+    int8_t rssi;
+    uint8_t adv_type;
+    uint8_t len;
+    uint8_t data[VRADIO_AD_MAX];
+};
+
+static struct
+{
+    const struct bt_mesh_vradio_bearer *bearer;
+    bt_mesh_addr_le_t addr;
+
+    uint8_t pdu[BT_MESH_VRADIO_PDU_MAX];
+    size_t pdu_len;
+    uint32_t adv_int;
+    k_timer_t adv_timer;
+    bt_mesh_le_adv_sent_cb_t *adv_sent_cb;
+
+    bt_mesh_le_scan_cb_t *scan_cb;
+    struct k_fifo rx_queue;
+    sys_slist_t rx_free;
+    struct vradio_rx rx_pool[CONFIG_BT_MESH_VRADIO_RX_COUNT];
+
+    struct bt_mesh_vradio_stats stats;
+    struct k_thread task;
+} vradio;
+
+/* The UDP multicast bearer */
+static struct
+{
+    int sock;
+    struct sockaddr_in group;
+    pthread_t rx_thread;
+} udp;
+
+/* buf.c indexes the HCI buffer pools of bt_host; nothing allocates from
+ * them on the virtual radio.
+ */
+NET_BUF_POOL_DEFINE(hci_cmd_pool, 1, 1, BT_BUF_USER_DATA_MIN, NULL);
+NET_BUF_POOL_DEFINE(hci_rx_pool, 1, 1, BT_BUF_USER_DATA_MIN, NULL);
+NET_BUF_POOL_DEFINE(acl_tx_pool, 1, 1, BT_BUF_USER_DATA_MIN, NULL);
+
+struct bt_dev bt_dev;
+
+/* Key generation completes from the stack task, like the HCI LE P-256
+ * events it replaces.
+ */
+static struct
+{
+    bool valid;
+    uint8_t pk[64];
+    uint8_t sk[32];
+    uint8_t remote_pk[64];
+    struct bt_pub_key_cb *pub_key_cb;
+    bt_dh_key_cb_t dh_key_cb;
+    struct k_work work;
+} ecc;
+
+static void ecc_work(struct k_work *work);
+
+static void vradio_send(void)
+{
+    if (vradio.bearer->send(vradio.pdu, vradio.pdu_len))
+    {
+        BT_WARN("vradio tx failed");
+        return;
+    }
+
+    vradio.stats.tx++;
+}
+
+static uint32_t vradio_adv_delay(void)
+{
+    uint8_t delay;
+
+    bt_rand(&delay, sizeof(delay));
+    return delay % (VRADIO_ADV_DELAY_MAX + 1);
+}
+
+static void vradio_adv_timer(void *timer, void *arg)
+{
+    vradio_send();
+    k_timer_start(&vradio.adv_timer, vradio.adv_int + vradio_adv_delay());
+
+    if (vradio.adv_sent_cb)
+    {
+        vradio.adv_sent_cb();
+    }
+}
+
+void bt_mesh_vradio_input(const uint8_t *pdu, size_t len, int8_t rssi)
+{
+    struct vradio_rx *rx;
+
+    if (len < VRADIO_HDR_LEN || len > BT_MESH_VRADIO_PDU_MAX ||
+        !memcmp(pdu, vradio.addr.a.val, sizeof(vradio.addr.a.val)) ||
+        !vradio.scan_cb)
+    {
+        return;
+    }
+
+    rx = (struct vradio_rx *)sys_slist_get(&vradio.rx_free);
+    if (rx == NULL)
+    {
+        vradio.stats.rx_drop++;
+        return;
+    }
+
+    memcpy(rx->addr.a.val, pdu, sizeof(rx->addr.a.val));
+    rx->addr.type = pdu[6];
+    rx->adv_type = pdu[7];
+    rx->rssi = rssi;
+    rx->len = len - VRADIO_HDR_LEN;
+    memcpy(rx->data, &pdu[VRADIO_HDR_LEN], rx->len);
+    k_fifo_put(&vradio.rx_queue, rx);
+    vradio.stats.rx++;
+}
+
+static int udp_send(const uint8_t *pdu, size_t len)
+{
+    if (sendto(udp.sock, pdu, len, 0, (struct sockaddr *)&udp.group,
+               sizeof(udp.group)) < 0)
+    {
+        return -errno;
+    }
+
+    return 0;
+}
+
+static const struct bt_mesh_vradio_bearer udp_bearer = {
+    .send = udp_send,
+};
+
+static void *udp_rx_thread(void *arg)
+{
+    uint8_t pdu[BT_MESH_VRADIO_PDU_MAX];
+    ssize_t len;
+
+    while (1)
+    {
+        len = recv(udp.sock, pdu, sizeof(pdu), 0);
+        if (len < 0)
+        {
+            continue;
+        }
+
+        k_os_enter();
+        bt_mesh_vradio_input(pdu, len, CONFIG_BT_MESH_VRADIO_RSSI);
+        k_os_exit();
+    }
+
+    return NULL;
+}
+
+int has_tx_sem(struct k_poll_event *event)
+{
+    return 1;
+}
+
+void process_events(struct k_poll_event *ev, int count)
+{
+    struct net_buf_simple *buf = NET_BUF_SIMPLE(VRADIO_AD_MAX);
+    struct vradio_rx *rx;
+
+    for (; count; ev++, count--)
+    {
+        if (ev->state != K_POLL_STATE_FIFO_DATA_AVAILABLE ||
+            ev->tag != VRADIO_EVENT_RX)
+        {
+            continue;
+        }
+
+        while ((rx = k_fifo_get(&vradio.rx_queue, K_NO_WAIT)) != NULL)
+        {
+            /* Scanning may have stopped while the PDU was queued. */
+            if (vradio.scan_cb)
+            {
+                net_buf_simple_init(buf, 0);
+                net_buf_simple_add_mem(buf, rx->data, rx->len);
+                vradio.scan_cb(&rx->addr, rx->rssi, rx->adv_type, buf);
+            }
+            sys_slist_append(&vradio.rx_free, &rx->node);
+        }
+    }
+}
+
+extern void scheduler_loop(struct k_poll_event *events);
+static void vradio_task(void *p1, void *p2, void *p3)
+{
+    static struct k_poll_event events[] = {
+        K_POLL_EVENT_STATIC_INITIALIZER(K_POLL_TYPE_FIFO_DATA_AVAILABLE,
+                                        K_POLL_MODE_NOTIFY_ONLY,
+                                        &vradio.rx_queue, VRADIO_EVENT_RX),
+    };
+
+    scheduler_loop(events);
+}
+
+static int vradio_ecc_rng(uint8_t *dest, unsigned int size)
+{
+    return !bt_rand(dest, size);
+}
+
+int bt_mesh_vradio_attach(const struct bt_mesh_vradio_bearer *bearer)
+{
+    int i;
+
+    if (bearer == NULL || bearer->send == NULL)
+    {
+        return -EINVAL;
+    }
+
+    vradio.bearer = bearer;
+    if (bearer->rand)
+    {
+        uECC_set_rng(vradio_ecc_rng);
+    }
+
+    /* Random static address: two top bits set. */
+    bt_rand(vradio.addr.a.val, sizeof(vradio.addr.a.val));
+    vradio.addr.a.val[5] |= 0xc0;
+    vradio.addr.type = BT_ADDR_LE_RANDOM;
+    bt_dev.id_addr.type = BT_ADDR_LE_RANDOM;
+    memcpy(bt_dev.id_addr.a.val, vradio.addr.a.val, 6);
+
+    k_work_q_start();
+    k_work_init(&ecc.work, ecc_work);
+    k_timer_init(&vradio.adv_timer, vradio_adv_timer, NULL);
+    k_fifo_init(&vradio.rx_queue);
+    sys_slist_init(&vradio.rx_free);
+    for (i = 0; i < ARRAY_SIZE(vradio.rx_pool); i++)
+    {
+        sys_slist_append(&vradio.rx_free, &vradio.rx_pool[i].node);
+    }
+
+    BT_INFO("vradio addr %s", bt_hex(vradio.addr.a.val, 6));
+
+    return k_thread_create(&vradio.task, NULL, 0, vradio_task, "ble", NULL,
+                           NULL, 0, 0, K_NO_WAIT);
+}
+
+int bt_mesh_vradio_init(const char *group, uint16_t port)
+{
+    struct sockaddr_in local;
+    struct ip_mreq mreq;
+    int one = 1;
+    int err;
+
+    memset(&udp.group, 0, sizeof(udp.group));
+    udp.group.sin_family = AF_INET;
+    udp.group.sin_port = htons(port ? port : CONFIG_BT_MESH_VRADIO_PORT);
+    if (inet_pton(AF_INET, group ? group : CONFIG_BT_MESH_VRADIO_GROUP,
+                  &udp.group.sin_addr) != 1)
+    {
+        return -EINVAL;
+    }
+
+    udp.sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (udp.sock < 0)
+    {
+        return -errno;
+    }
+
+    /* Several nodes on one host share the port. */
+    setsockopt(udp.sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(udp.sock, IPPROTO_IP, IP_MULTICAST_LOOP, &one, sizeof(one));
+
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_port = udp.group.sin_port;
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(udp.sock, (struct sockaddr *)&local, sizeof(local)))
+    {
+        goto fail;
+    }
+
+    mreq.imr_multiaddr = udp.group.sin_addr;
+    mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (setsockopt(udp.sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq,
+                   sizeof(mreq)))
+    {
+        goto fail;
+    }
+
+    err = bt_mesh_vradio_attach(&udp_bearer);
+    if (err)
+    {
+        close(udp.sock);
+        return err;
+    }
+
+    /* The thread only gets into the port once the caller blocks, by which
+     * time the radio is attached.
+     */
+    if (pthread_create(&udp.rx_thread, NULL, udp_rx_thread, NULL))
+    {
+        errno = EAGAIN;
+        goto fail;
+    }
+
+    BT_INFO("vradio %s:%u", group ? group : CONFIG_BT_MESH_VRADIO_GROUP,
+            ntohs(udp.group.sin_port));
+    return 0;
+
+fail:
+    err = -errno;
+    close(udp.sock);
+    return err;
+}
+
+void bt_mesh_vradio_stats_get(struct bt_mesh_vradio_stats *stats)
+{
+    *stats = vradio.stats;
+}
+
+int bt_mesh_adv_scan_schd_init()
+{
+    return 0;
+}
+
+static int set_ad_data(uint8_t *data, const struct bt_mesh_data *ad,
+                       size_t ad_len)
+{
+    int i;
+    int set_len = 0;
+
+    for (i = 0; i < ad_len; i++)
+    {
+        if (set_len + ad[i].data_len + 2 > VRADIO_AD_MAX)
+        {
+            return -EINVAL;
+        }
+
+        data[set_len++] = ad[i].data_len + 1;
+        data[set_len++] = ad[i].type;
+        memcpy(&data[set_len], ad[i].data, ad[i].data_len);
+        set_len += ad[i].data_len;
+    }
+
+    return set_len;
+}
+
+int bt_mesh_adv_start(const struct bt_mesh_le_adv_param *param,
+                      const struct bt_mesh_data *ad, size_t ad_len,
+                      const struct bt_mesh_data *sd, size_t sd_len)
+{
+    int len;
+
+    if (param == NULL)
+    {
+        return -EINVAL;
+    }
+
+    len = set_ad_data(&vradio.pdu[VRADIO_HDR_LEN], ad, ad_len);
+    if (len < 0)
+    {
+        return len;
+    }
+
+    k_timer_stop(&vradio.adv_timer);
+
+    memcpy(vradio.pdu, vradio.addr.a.val, 6);
+    vradio.pdu[6] = vradio.addr.type;
+    vradio.pdu[7] = (param->options & BT_MESH_LE_ADV_OPT_CONNECTABLE) ?
+                        BT_MESH_LE_ADV_IND : BT_MESH_LE_ADV_NONCONN_IND;
+    vradio.pdu_len = VRADIO_HDR_LEN + len;
+
+    /* Interval is in 0.625 ms units; repeat until stopped like a
+     * controller would. Every event, the first one included, is pushed
+     * back by advDelay.
+     */
+    vradio.adv_int = max(VRADIO_ADV_INT_MIN, param->interval_min * 5 / 8);
+
+    k_timer_start(&vradio.adv_timer, vradio_adv_delay());
+    return 0;
+}
+
+int bt_mesh_adv_stop(void)
+{
+    k_timer_stop(&vradio.adv_timer);
+    return 0;
+}
+
+void bt_mesh_adv_sent_cb_set(bt_mesh_le_adv_sent_cb_t *cb)
+{
+    vradio.adv_sent_cb = cb;
+}
+
+int bt_mesh_scan_start(const struct bt_mesh_le_scan_param *param, bt_mesh_le_scan_cb_t cb)
+{
+    vradio.scan_cb = cb;
+    return 0;
+}
+
+int bt_mesh_scan_stop(void)
+{
+    vradio.scan_cb = NULL;
+    return 0;
+}
+
+int bt_mesh_multi_adv_start(const struct bt_mesh_le_adv_param *param,
+                            const struct bt_mesh_data *ad, size_t ad_len,
+                            const struct bt_mesh_data *sd, size_t sd_len, int *instant_id)
+{
+    return -ENOTSUP;
+}
+
+int bt_mesh_multi_adv_stop(int instant_id)
+{
+    return -ENOTSUP;
+}
+
+/* The virtual radio has no connections: PB-GATT and the proxy bearer
+ * register fine but never see a link.
+ */
+void bt_mesh_conn_cb_register(struct bt_mesh_conn_cb *cb)
+{
+}
+
+bt_mesh_conn_t bt_mesh_conn_ref(bt_mesh_conn_t conn)
+{
+    return conn;
+}
+
+void bt_mesh_conn_unref(bt_mesh_conn_t conn)
+{
+}
+
+int bt_mesh_conn_disconnect(bt_mesh_conn_t conn, uint8_t reason)
+{
+    return -ENOTCONN;
+}
+
+int bt_mesh_gatt_service_register(struct bt_mesh_gatt_service *svc)
+{
+    return 0;
+}
+
+int bt_mesh_gatt_service_unregister(struct bt_mesh_gatt_service *svc)
+{
+    return 0;
+}
+
+int bt_mesh_gatt_notify(bt_mesh_conn_t conn, const struct bt_mesh_gatt_attr *attr,
+                        const void *data, uint16_t len)
+{
+    return -ENOTCONN;
+}
+
+int bt_mesh_gatt_attr_read(bt_mesh_conn_t conn, const struct bt_mesh_gatt_attr *attr,
+                           void *buf, uint16_t buf_len, uint16_t offset,
+                           const void *value, uint16_t value_len)
+{
+    return -ENOTCONN;
+}
+
+uint16_t bt_mesh_gatt_get_mtu(bt_mesh_conn_t conn)
+{
+    return 23;
+}
+
+int bt_mesh_gatt_attr_read_service(bt_mesh_conn_t conn,
+                                   const struct bt_mesh_gatt_attr *attr,
+                                   void *buf, uint16_t len, uint16_t offset)
+{
+    return -ENOTCONN;
+}
+
+int bt_mesh_gatt_attr_read_chrc(bt_mesh_conn_t conn,
+                                const struct bt_mesh_gatt_attr *attr, void *buf,
+                                uint16_t len, uint16_t offset)
+{
+    return -ENOTCONN;
+}
+
+int bt_rand(void *buf, size_t len)
+{
+    if (vradio.bearer && vradio.bearer->rand)
+    {
+        return vradio.bearer->rand(buf, len);
+    }
+
+    return default_CSPRNG(buf, len) ? 0 : -EIO;
+}
+
+int bt_encrypt_be(const u8_t key[16], const u8_t plaintext[16],
+                  u8_t enc_data[16])
+{
+    struct tc_aes_key_sched_struct s;
+
+    if (tc_aes128_set_encrypt_key(&s, key) == TC_CRYPTO_FAIL ||
+        tc_aes_encrypt(enc_data, plaintext, &s) == TC_CRYPTO_FAIL)
+    {
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+int bt_decrypt_be(const u8_t key[16], const u8_t enc_data[16], u8_t dec_data[16])
+{
+    struct tc_aes_key_sched_struct s;
+
+    if (tc_aes128_set_decrypt_key(&s, key) == TC_CRYPTO_FAIL ||
+        tc_aes_decrypt(dec_data, enc_data, &s) == TC_CRYPTO_FAIL)
+    {
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+/* Keys cross this API little endian, as in the HCI LE P-256 events;
+ * tinycrypt works big endian.
+ */
+static void ecc_pub_key_done(void)
+{
+    struct bt_pub_key_cb *cb = ecc.pub_key_cb;
+    uint8_t pk[64];
+
+    ecc.pub_key_cb = NULL;
+    if (!ecc.valid)
+    {
+        ecc.valid = uECC_make_key(ecc.pk, ecc.sk, uECC_secp256r1());
+    }
+
+    if (!ecc.valid)
+    {
+        cb->func(NULL);
+        return;
+    }
+
+    sys_memcpy_swap(pk, ecc.pk, 32);
+    sys_memcpy_swap(&pk[32], &ecc.pk[32], 32);
+    cb->func(pk);
+}
+
+static void ecc_dh_key_done(void)
+{
+    bt_dh_key_cb_t cb = ecc.dh_key_cb;
+    uint8_t pk[64];
+    uint8_t dhkey[32];
+
+    ecc.dh_key_cb = NULL;
+    sys_memcpy_swap(pk, ecc.remote_pk, 32);
+    sys_memcpy_swap(&pk[32], &ecc.remote_pk[32], 32);
+    if (uECC_valid_public_key(pk, uECC_secp256r1()) ||
+        uECC_shared_secret(pk, ecc.sk, dhkey, uECC_secp256r1()) != TC_CRYPTO_SUCCESS)
+    {
+        cb(NULL);
+        return;
+    }
+
+    sys_mem_swap(dhkey, sizeof(dhkey));
+    cb(dhkey);
+}
+
+static void ecc_work(struct k_work *work)
+{
+    if (ecc.pub_key_cb)
+    {
+        ecc_pub_key_done();
+    }
+
+    if (ecc.dh_key_cb)
+    {
+        ecc_dh_key_done();
+    }
+}
+
+int bt_pub_key_gen(struct bt_pub_key_cb *cb)
+{
+    if (ecc.pub_key_cb)
+    {
+        return -EBUSY;
+    }
+
+    ecc.pub_key_cb = cb;
+    k_work_submit(&ecc.work);
+    return 0;
+}
+
+const u8_t *bt_pub_key_get(void)
+{
+    static uint8_t pk[64];
+
+    if (!ecc.valid)
+    {
+        return NULL;
+    }
+
+    sys_memcpy_swap(pk, ecc.pk, 32);
+    sys_memcpy_swap(&pk[32], &ecc.pk[32], 32);
+    return pk;
+}
+
+int bt_dh_key_gen(const u8_t remote_pk[64], bt_dh_key_cb_t cb)
+{
+    if (!ecc.valid)
+    {
+        return -EADDRNOTAVAIL;
+    }
+
+    if (ecc.dh_key_cb)
+    {
+        return -EBUSY;
+    }
+
+    memcpy(ecc.remote_pk, remote_pk, sizeof(ecc.remote_pk));
+    ecc.dh_key_cb = cb;
+    k_work_submit(&ecc.work);
+    return 0;
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2015-2019 Alibaba Group Holding Limited
+ */
+
+#ifndef _MESH_HAL_VRADIO_H_
+#define _MESH_HAL_VRADIO_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Virtual radio for host builds (CONFIG_BT_PORT_POSIX).
+ *
+ * The virtual controller hands every advertising PDU to a bearer and takes
+ * received PDUs back through bt_mesh_vradio_input(). A PDU is:
+ *
+ *   | addr (6) | addr type (1) | adv type (1) | AD structures (<= 31) |
+ *
+ * The default bearer (bt_mesh_vradio_init()) carries PDUs as UDP
+ * datagrams on a multicast group, so every node process on the same host
+ * (or LAN segment) that joined the group hears every other node's
+ * advertising, like on a shared channel. A simulator attaches its own
+ * bearer instead and models the medium itself.
+ */
+
+#define BT_MESH_VRADIO_HDR_LEN 8
+#define BT_MESH_VRADIO_PDU_MAX (BT_MESH_VRADIO_HDR_LEN + 31)
+
+#ifndef CONFIG_BT_MESH_VRADIO_GROUP
+#define CONFIG_BT_MESH_VRADIO_GROUP "239.255.77.77"
+#endif
+
+#ifndef CONFIG_BT_MESH_VRADIO_PORT
+#define CONFIG_BT_MESH_VRADIO_PORT 47077
+#endif
+
+/* RSSI reported for every PDU received on the UDP bearer */
+#ifndef CONFIG_BT_MESH_VRADIO_RSSI
+#define CONFIG_BT_MESH_VRADIO_RSSI (-50)
+#endif
+
+/* Received PDUs waiting for the stack task; more are dropped. */
+#ifndef CONFIG_BT_MESH_VRADIO_RX_COUNT
+#define CONFIG_BT_MESH_VRADIO_RX_COUNT 32
+#endif
+
+struct bt_mesh_vradio_stats
+{
+    uint32_t tx;
+    uint32_t rx;
+    uint32_t rx_drop;
+};
+
+struct bt_mesh_vradio_bearer
+{
+    /** Put one PDU on the medium. Called from port tasks. */
+    int (*send)(const uint8_t *pdu, size_t len);
+
+    /** Random source for the address, keys and advertising delay; NULL
+     *  for the host CSPRNG.
+     */
+    int (*rand)(void *buf, size_t len);
+};
+
+/**
+ * @brief Bring up the virtual radio on a bearer and start the stack task.
+ *
+ * Replaces bt_enable() on host builds: picks a random static identity
+ * address and starts the task that runs the bt_common scheduler loop.
+ * Call after k_os_init() and before bt_mesh_init().
+ *
+ * @param bearer Bearer the PDUs go out on; must stay valid.
+ *
+ * @return 0 on success, negative errno otherwise.
+ */
+int bt_mesh_vradio_attach(const struct bt_mesh_vradio_bearer *bearer);
+
+/**
+ * @brief Hand a received PDU to the virtual controller.
+ *
+ * Call from a port task, or between k_os_enter() and k_os_exit(). PDUs
+ * sent from this node's own address are ignored, and PDUs are dropped
+ * while scanning is off or CONFIG_BT_MESH_VRADIO_RX_COUNT are queued.
+ *
+ * @param pdu  PDU as laid out above.
+ * @param len  PDU length.
+ * @param rssi RSSI to report to the stack.
+ *
+ * @return N/A
+ */
+void bt_mesh_vradio_input(const uint8_t *pdu, size_t len, int8_t rssi);
+
+/**
+ * @brief Bring up the virtual radio on the UDP multicast bearer.
+ *
+ * Joins the multicast group, then does bt_mesh_vradio_attach() and starts
+ * a thread that feeds received datagrams to bt_mesh_vradio_input().
+ *
+ * @param group Multicast group, NULL for CONFIG_BT_MESH_VRADIO_GROUP.
+ * @param port  UDP port, 0 for CONFIG_BT_MESH_VRADIO_PORT.
+ *
+ * @return 0 on success, negative errno otherwise.
+ */
+int bt_mesh_vradio_init(const char *group, uint16_t port);
+
+/**
+ * @brief Get the virtual radio counters.
+ *
+ * @param stats Filled with the counters since the radio was attached.
+ *
+ * @return N/A
+ */
+void bt_mesh_vradio_stats_get(struct bt_mesh_vradio_stats *stats);
+
+#endif /* _MESH_HAL_VRADIO_H_ */
@@ -30,6 +30,46 @@
 static const struct bt_mesh_comp *dev_comp;
 static u16_t dev_primary_addr;
 
+/* Element sets are kept as bitmaps, so the indexes below only serve
+ * compositions of up to 32 elements.
+ */
+#define ACCESS_INDEX_ELEM_MAX 32
+
+/* Every (element, model, op) of the composition, sorted by opcode. Entries
+ * of one opcode keep composition order, so the first model of an element
+ * still wins as with the linear walk.
+ */
+static struct op_entry
+{
+    u32_t opcode;
+    u8_t elem;
+    u8_t mod;
+    u8_t op;
+    u8_t vnd;
+} op_index[CONFIG_BT_MESH_OP_INDEX_SIZE];
+
+static u16_t op_index_count;
+static bool op_index_valid;
+
+/* Group and virtual addresses mapped to the elements subscribed to them */
+static struct elem_group
+{
+    u16_t addr;
+    u32_t elems;
+} elem_groups[CONFIG_BT_MESH_GROUP_INDEX_SIZE];
+
+static u8_t elem_group_count;
+static bool elem_groups_valid;
+
+/* Node wide filter in front of elem_groups: one bit per hash of every
+ * subscribed address, so most traffic for groups nobody here listens to
+ * is turned away without searching the map.
+ */
+#define SUB_FILTER_BITS 256
+
+static u32_t sub_filter[SUB_FILTER_BITS / 32];
+static struct bt_mesh_sub_stats sub_stats;
+
 static const struct
 {
     const u16_t id;
@@ -293,6 +333,98 @@ static void mod_init(struct bt_mesh_model *mod, struct bt_mesh_elem *elem,
     }
 }
 
+static struct bt_mesh_model *op_entry_model(const struct op_entry *entry)
+{
+    struct bt_mesh_elem *elem = &dev_comp->elem[entry->elem];
+
+    if (entry->vnd)
+    {
+        return &elem->vnd_models[entry->mod];
+    }
+
+    return &elem->models[entry->mod];
+}
+
+static bool op_index_add(u8_t elem, u8_t vnd, struct bt_mesh_model *models,
+                         u8_t count)
+{
+    const struct bt_mesh_model_op *op;
+    u16_t i, j;
+
+    for (i = 0; i < count; i++)
+    {
+        for (op = models[i].op; op->func; op++)
+        {
+            /* SIG OpCodes are only looked up in SIG models and vendor
+             * OpCodes in vendor models, see bt_mesh_model_recv().
+             */
+            if ((op->opcode >= 0x10000) != vnd)
+            {
+                continue;
+            }
+
+            if (op_index_count == ARRAY_SIZE(op_index) ||
+                op - models[i].op > 0xff)
+            {
+                return false;
+            }
+
+            /* Insertion sort, stable so equal OpCodes keep
+             * composition order.
+             */
+            for (j = op_index_count; j > 0; j--)
+            {
+                if (op_index[j - 1].opcode <= op->opcode)
+                {
+                    break;
+                }
+
+                op_index[j] = op_index[j - 1];
+            }
+
+            op_index[j].opcode = op->opcode;
+            op_index[j].elem = elem;
+            op_index[j].mod = i;
+            op_index[j].op = op - models[i].op;
+            op_index[j].vnd = vnd;
+            op_index_count++;
+        }
+    }
+
+    return true;
+}
+
+static void op_index_build(void)
+{
+    int i;
+
+    op_index_count = 0;
+    op_index_valid = false;
+
+    if (dev_comp->elem_count > ACCESS_INDEX_ELEM_MAX)
+    {
+        BT_WARN("%zu elements, no OpCode index", dev_comp->elem_count);
+        return;
+    }
+
+    for (i = 0; i < dev_comp->elem_count; i++)
+    {
+        struct bt_mesh_elem *elem = &dev_comp->elem[i];
+
+        if (!op_index_add(i, 0, elem->models, elem->model_count) ||
+            !op_index_add(i, 1, elem->vnd_models, elem->vnd_model_count))
+        {
+            BT_WARN("OpCode index full, using linear lookup");
+            op_index_count = 0;
+            return;
+        }
+    }
+
+    op_index_valid = true;
+
+    BT_DBG("%u OpCodes indexed", op_index_count);
+}
+
 int bt_mesh_comp_register(const struct bt_mesh_comp *comp)
 {
     /* There must be at least one element */
@@ -305,6 +437,9 @@ int bt_mesh_comp_register(const struct bt_mesh_comp *comp)
 
     bt_mesh_model_foreach(mod_init, NULL);
 
+    op_index_build();
+    bt_mesh_elem_group_rebuild();
+
     return 0;
 }
 
@@ -398,10 +533,219 @@ static struct bt_mesh_model *bt_mesh_elem_find_group(struct bt_mesh_elem *elem,
     return NULL;
 }
 
+/* Elements subscribed to a group or virtual address, from the models */
+static u32_t group_elems(u16_t addr)
+{
+    u32_t elems = 0;
+    int i;
+
+    for (i = 0; i < dev_comp->elem_count; i++)
+    {
+        if (bt_mesh_elem_find_group(&dev_comp->elem[i], addr))
+        {
+            elems |= BIT(i);
+        }
+    }
+
+    return elems;
+}
+
+static u8_t sub_filter_hash(u16_t addr)
+{
+    return (u16_t)(addr * 0x9e37U) >> 8;
+}
+
+static void sub_filter_add(u16_t addr)
+{
+    u8_t bit = sub_filter_hash(addr);
+
+    sub_filter[bit / 32] |= BIT(bit % 32);
+}
+
+static bool sub_filter_test(u16_t addr)
+{
+    u8_t bit = sub_filter_hash(addr);
+
+    return sub_filter[bit / 32] & BIT(bit % 32);
+}
+
+/* Bits cannot be taken out one by one, so removals redo the whole set */
+static void sub_filter_build(void)
+{
+    int i;
+
+    memset(sub_filter, 0, sizeof(sub_filter));
+
+    for (i = 0; i < elem_group_count; i++)
+    {
+        sub_filter_add(elem_groups[i].addr);
+    }
+}
+
+static struct elem_group *elem_group_find(u16_t addr)
+{
+    int i;
+
+    for (i = 0; i < elem_group_count; i++)
+    {
+        if (elem_groups[i].addr == addr)
+        {
+            return &elem_groups[i];
+        }
+    }
+
+    return NULL;
+}
+
+void bt_mesh_elem_group_update(u16_t addr)
+{
+    struct elem_group *group;
+    u32_t elems;
+
+    if (!elem_groups_valid ||
+        (!BT_MESH_ADDR_IS_GROUP(addr) && !BT_MESH_ADDR_IS_VIRTUAL(addr)))
+    {
+        return;
+    }
+
+    elems = group_elems(addr);
+    group = elem_group_find(addr);
+
+    if (!elems)
+    {
+        if (group)
+        {
+            *group = elem_groups[--elem_group_count];
+            sub_filter_build();
+        }
+
+        return;
+    }
+
+    if (!group)
+    {
+        if (elem_group_count == ARRAY_SIZE(elem_groups))
+        {
+            BT_WARN("Group index full, using linear lookup");
+            elem_groups_valid = false;
+            return;
+        }
+
+        group = &elem_groups[elem_group_count++];
+        group->addr = addr;
+        sub_filter_add(addr);
+    }
+
+    group->elems = elems;
+}
+
+static void elem_group_add(u16_t addr)
+{
+    if (!elem_group_find(addr))
+    {
+        bt_mesh_elem_group_update(addr);
+    }
+}
+
+void bt_mesh_elem_group_rebuild(void)
+{
+    int i, j, k;
+
+    elem_group_count = 0;
+    elem_groups_valid = (dev_comp->elem_count <= ACCESS_INDEX_ELEM_MAX);
+    memset(sub_filter, 0, sizeof(sub_filter));
+
+    for (i = 0; i < dev_comp->elem_count && elem_groups_valid; i++)
+    {
+        struct bt_mesh_elem *elem = &dev_comp->elem[i];
+
+        /* Matched by every model, see bt_mesh_model_find_group() */
+        elem_group_add(elem->grop_addr);
+        elem_group_add(BT_MESH_ADDR_GENIE_ALL_NODES);
+
+        for (j = 0; j < elem->model_count; j++)
+        {
+            for (k = 0; k < ARRAY_SIZE(elem->models[j].groups); k++)
+            {
+                elem_group_add(elem->models[j].groups[k]);
+            }
+        }
+
+        for (j = 0; j < elem->vnd_model_count; j++)
+        {
+            for (k = 0; k < ARRAY_SIZE(elem->vnd_models[j].groups); k++)
+            {
+                elem_group_add(elem->vnd_models[j].groups[k]);
+            }
+        }
+    }
+
+    BT_DBG("%u group addresses indexed", elem_group_count);
+}
+
+/* Elements a message to dst is for */
+static u32_t dst_elems(u16_t dst)
+{
+    struct elem_group *group;
+    u16_t i;
+
+    if (BT_MESH_ADDR_IS_UNICAST(dst))
+    {
+        /* Element addresses are consecutive from the primary one */
+        i = dst - dev_comp->elem[0].addr;
+        if (i < dev_comp->elem_count && dev_comp->elem[i].addr == dst)
+        {
+            return BIT(i);
+        }
+
+        return 0;
+    }
+
+    if (BT_MESH_ADDR_IS_GROUP(dst) || BT_MESH_ADDR_IS_VIRTUAL(dst))
+    {
+        if (!elem_groups_valid)
+        {
+            return group_elems(dst);
+        }
+
+        if (!sub_filter_test(dst))
+        {
+            sub_stats.filtered++;
+            return 0;
+        }
+
+        group = elem_group_find(dst);
+        if (!group)
+        {
+            sub_stats.false_pos++;
+            return 0;
+        }
+
+        return group->elems;
+    }
+
+    return bt_mesh_fixed_group_match(dst) ? BIT(0) : 0;
+}
+
 struct bt_mesh_elem *bt_mesh_elem_find(u16_t addr)
 {
+    u32_t elems;
     int i;
 
+    if (dev_comp->elem_count <= ACCESS_INDEX_ELEM_MAX &&
+        (BT_MESH_ADDR_IS_UNICAST(addr) || BT_MESH_ADDR_IS_GROUP(addr) ||
+         BT_MESH_ADDR_IS_VIRTUAL(addr)))
+    {
+        if (!BT_MESH_ADDR_IS_UNICAST(addr))
+        {
+            sub_stats.lookups++;
+        }
+
+        elems = dst_elems(addr);
+
+        return elems ? &dev_comp->elem[find_lsb_set(elems) - 1] : NULL;
+    }
+
     for (i = 0; i < dev_comp->elem_count; i++)
     {
         struct bt_mesh_elem *elem = &dev_comp->elem[i];
@@ -423,6 +767,31 @@ struct bt_mesh_elem *bt_mesh_elem_find(u16_t addr)
     return NULL;
 }
 
+void bt_mesh_sub_skipped(u16_t dst, u16_t len)
+{
+    if (BT_MESH_ADDR_IS_UNICAST(dst))
+    {
+        sub_stats.skip_unicast++;
+    }
+    else
+    {
+        sub_stats.skip_group++;
+    }
+
+    sub_stats.skip_octets += len;
+}
+
+void bt_mesh_sub_stats_get(struct bt_mesh_sub_stats *stats)
+{
+    *stats = sub_stats;
+    stats->addrs = elem_group_count;
+}
+
+void bt_mesh_sub_stats_reset(void)
+{
+    memset(&sub_stats, 0, sizeof(sub_stats));
+}
+
 u8_t bt_mesh_elem_count(void)
 {
     return dev_comp->elem_count;
@@ -566,57 +935,104 @@ bool bt_mesh_fixed_group_match(u16_t addr)
     }
 }
 
-void bt_mesh_model_recv(struct bt_mesh_net_rx *rx, struct net_buf_simple *buf)
+typedef void (*op_match_func_t)(struct bt_mesh_model *model,
+                                const struct bt_mesh_model_op *op,
+                                void *user_data);
+
+/* First index entry of opcode, or op_index_count if there is none */
+static u16_t op_index_find(u32_t opcode)
 {
-    struct bt_mesh_model *models, *model;
-    const struct bt_mesh_model_op *op;
-    u32_t opcode;
-    u8_t count;
-    int i;
+    u16_t lo = 0, hi = op_index_count, mid;
 
-    BT_DBG("app_idx 0x%04x src 0x%04x dst 0x%04x", rx->ctx.app_idx,
-           rx->ctx.addr, rx->dst);
-    BT_DBG("len %u: %s", buf->len, bt_hex(buf->data, buf->len));
+    while (lo < hi)
+    {
+        mid = (lo + hi) / 2;
 
-    if (get_opcode(buf, &opcode) < 0)
+        if (op_index[mid].opcode < opcode)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+static int op_index_match(u16_t dst, u16_t app_idx, u32_t opcode,
+                          op_match_func_t func, void *user_data)
+{
+    struct bt_mesh_model *model;
+    int last = -1, count = 0;
+    u32_t elems;
+    u16_t i;
+
+    elems = dst_elems(dst);
+    if (!elems)
     {
-        BT_WARN("Unable to decode OpCode");
-        return;
+        return 0;
     }
 
-    BT_DBG("OpCode 0x%08x", opcode);
+    for (i = op_index_find(opcode); i < op_index_count; i++)
+    {
+        const struct op_entry *entry = &op_index[i];
 
-#ifdef MESH_DEBUG_RX
-    SYS_LOG_INF("RX Info");
-    MESH_MSG_RX("RSSI: %d", rx->rssi);
-    MESH_MSG_RX("TTL: %d AppIdx: 0x%04x", rx->ctx.recv_ttl, rx->ctx.app_idx);
-    MESH_MSG_RX("SRC: 0x%02X", rx->ctx.addr);
-    MESH_MSG_RX("DST: 0x%02X", rx->dst);
-    MESH_MSG_RX("OPCODE: 0x%04X", opcode);
-    MESH_MSG_RX("Payload size: %d", buf->len);
-    MESH_MSG_RX_BUFF(buf->data, buf->len);
-#endif
+        if (entry->opcode != opcode)
+        {
+            break;
+        }
+
+        /* Only the first model of an element bound to the key */
+        if (entry->elem == last || !(elems & BIT(entry->elem)))
+        {
+            continue;
+        }
+
+        model = op_entry_model(entry);
+        if (!model_has_key(model, app_idx))
+        {
+            continue;
+        }
+
+        last = entry->elem;
+        func(model, &model->op[entry->op], user_data);
+        count++;
+    }
+
+    return count;
+}
+
+static int op_scan_match(u16_t dst, u16_t app_idx, u32_t opcode,
+                         op_match_func_t func, void *user_data)
+{
+    struct bt_mesh_model *models, *model;
+    const struct bt_mesh_model_op *op;
+    int count = 0;
+    u8_t num;
+    int i;
 
     for (i = 0; i < dev_comp->elem_count; i++)
     {
         struct bt_mesh_elem *elem = &dev_comp->elem[i];
 
-        if (BT_MESH_ADDR_IS_UNICAST(rx->dst))
+        if (BT_MESH_ADDR_IS_UNICAST(dst))
         {
-            if (elem->addr != rx->dst)
+            if (elem->addr != dst)
             {
                 continue;
             }
         }
-        else if (BT_MESH_ADDR_IS_GROUP(rx->dst) ||
-                 BT_MESH_ADDR_IS_VIRTUAL(rx->dst))
+        else if (BT_MESH_ADDR_IS_GROUP(dst) ||
+                 BT_MESH_ADDR_IS_VIRTUAL(dst))
         {
-            if (!bt_mesh_elem_find_group(elem, rx->dst))
+            if (!bt_mesh_elem_find_group(elem, dst))
             {
                 continue;
             }
         }
-        else if (i != 0 || !bt_mesh_fixed_group_match(rx->dst))
+        else if (i != 0 || !bt_mesh_fixed_group_match(dst))
         {
             continue;
         }
@@ -628,39 +1044,109 @@ void bt_mesh_model_recv(struct bt_mesh_net_rx *rx, struct net_buf_simple *buf)
         if (opcode < 0x10000)
         {
             models = elem->models;
-            count = elem->model_count;
+            num = elem->model_count;
         }
         else
         {
             models = elem->vnd_models;
-            count = elem->vnd_model_count;
+            num = elem->vnd_model_count;
         }
 
-        op = find_op(models, count, rx->ctx.app_idx, opcode, &model);
+        op = find_op(models, num, app_idx, opcode, &model);
         if (op)
         {
-            struct net_buf_simple_state state;
-
-            if (buf->len < op->min_len)
-            {
-                BT_ERR("Too short message for OpCode 0x%08x",
-                       opcode);
-                continue;
-            }
-
-            /* The callback will likely parse the buffer, so
-             * store the parsing state in case multiple models
-             * receive the message.
-             */
-            net_buf_simple_save(buf, &state);
-            op->func(model, &rx->ctx, buf);
-            net_buf_simple_restore(buf, &state);
+            func(model, op, user_data);
+            count++;
         }
         else
         {
             BT_DBG("No OpCode 0x%08x for elem %d", opcode, i);
         }
     }
+
+    return count;
+}
+
+static int op_match(u16_t dst, u16_t app_idx, u32_t opcode, bool linear,
+                    op_match_func_t func, void *user_data)
+{
+    if (linear || !op_index_valid)
+    {
+        return op_scan_match(dst, app_idx, opcode, func, user_data);
+    }
+
+    return op_index_match(dst, app_idx, opcode, func, user_data);
+}
+
+static void op_match_count(struct bt_mesh_model *model,
+                           const struct bt_mesh_model_op *op, void *user_data)
+{
+}
+
+int bt_mesh_model_op_match(u16_t dst, u16_t app_idx, u32_t opcode, bool linear)
+{
+    return op_match(dst, app_idx, opcode, linear, op_match_count, NULL);
+}
+
+struct op_recv
+{
+    struct bt_mesh_net_rx *rx;
+    struct net_buf_simple *buf;
+};
+
+static void op_recv(struct bt_mesh_model *model,
+                    const struct bt_mesh_model_op *op, void *user_data)
+{
+    struct op_recv *recv = user_data;
+    struct net_buf_simple_state state;
+
+    if (recv->buf->len < op->min_len)
+    {
+        BT_ERR("Too short message for OpCode 0x%08x", op->opcode);
+        return;
+    }
+
+    /* The callback will likely parse the buffer, so
+     * store the parsing state in case multiple models
+     * receive the message.
+     */
+    net_buf_simple_save(recv->buf, &state);
+    op->func(model, &recv->rx->ctx, recv->buf);
+    net_buf_simple_restore(recv->buf, &state);
+}
+
+void bt_mesh_model_recv(struct bt_mesh_net_rx *rx, struct net_buf_simple *buf)
+{
+    struct op_recv recv = {rx, buf};
+    u32_t opcode;
+
+    BT_DBG("app_idx 0x%04x src 0x%04x dst 0x%04x", rx->ctx.app_idx,
+           rx->ctx.addr, rx->dst);
+    BT_DBG("len %u: %s", buf->len, bt_hex(buf->data, buf->len));
+
+    if (get_opcode(buf, &opcode) < 0)
+    {
+        BT_WARN("Unable to decode OpCode");
+        return;
+    }
+
+    BT_DBG("OpCode 0x%08x", opcode);
+
+#ifdef MESH_DEBUG_RX
+    SYS_LOG_INF("RX Info");
+    MESH_MSG_RX("RSSI: %d", rx->rssi);
+    MESH_MSG_RX("TTL: %d AppIdx: 0x%04x", rx->ctx.recv_ttl, rx->ctx.app_idx);
+    MESH_MSG_RX("SRC: 0x%02X", rx->ctx.addr);
+    MESH_MSG_RX("DST: 0x%02X", rx->dst);
+    MESH_MSG_RX("OPCODE: 0x%04X", opcode);
+    MESH_MSG_RX("Payload size: %d", buf->len);
+    MESH_MSG_RX_BUFF(buf->data, buf->len);
+#endif
+
+    if (!op_match(rx->dst, rx->ctx.app_idx, opcode, false, op_recv, &recv))
+    {
+        BT_DBG("No OpCode 0x%08x for dst 0x%04x", opcode, rx->dst);
+    }
 }
 
 void bt_mesh_model_msg_init(struct net_buf_simple *msg, u32_t opcode)
@@ -7,6 +7,7 @@
  */
 
 #include <zephyr.h>
+#include <errno.h>
 #include <misc/stack.h>
 #include <misc/util.h>
 
@@ -48,9 +49,8 @@
 #define ADV_INT_DEFAULT K_MSEC(100)
 #define ADV_INT_FAST K_MSEC(20)
 
-#ifndef GENIE_DEFAULT_DURATION
-#define GENIE_DEFAULT_DURATION 125
-#endif
+/* Largest advDelay a controller adds in front of an advertising event */
+#define ADV_DELAY_MAX K_MSEC(10)
 
 /* TinyCrypt PRNG consumes a lot of stack space, so we need to have
  * an increased call stack whenever it's used.
@@ -81,8 +81,42 @@ static const bt_addr_le_t *dev_addr;
 #ifdef CONFIG_BT_MESH_MULTIADV
 static struct mesh_multi_adv g_mesh_multi_adv;
 static struct k_delayed_work g_mesh_adv_timer;
+#else
+/* Transmit plan: PDUs waiting for their next transmission, one list per
+ * priority class, each ordered by due time. One PDU at a time is on air,
+ * until the HAL reports its advertising event or the event is overdue.
+ */
+static struct
+{
+    sys_slist_t list[BT_MESH_ADV_PRIO_COUNT];
+    struct net_buf *cur;
+    u32_t deadline;
+    bool adv_on;
+    atomic_t sent;
+    atomic_t relays;
+} adv_plan;
+
+/* How late a transmission of each class may start. Relayed PDUs past it
+ * are dropped, the flood has moved on by then; the other classes are only
+ * counted as late, their senders wait for the send callbacks.
+ */
+static const u16_t adv_deadline[BT_MESH_ADV_PRIO_COUNT] = {
+    [BT_MESH_ADV_PRIO_CTL] = K_MSEC(50),
+    [BT_MESH_ADV_PRIO_LOCAL] = K_MSEC(200),
+    [BT_MESH_ADV_PRIO_BEACON] = K_MSEC(1000),
+    [BT_MESH_ADV_PRIO_RELAY] = K_MSEC(200),
+};
+
+/* Relayed PDUs the scheduler holds at most, so that a relay storm leaves
+ * adv buffers for the node's own traffic.
+ */
+#ifndef ADV_RELAY_MAX
+#define ADV_RELAY_MAX (CONFIG_BT_MESH_ADV_BUF_COUNT / 2)
+#endif
 #endif
 
+static struct bt_mesh_adv_stats adv_stats[BT_MESH_ADV_PRIO_COUNT];
+
 static struct bt_mesh_adv *adv_alloc(int id)
 {
     return &adv_pool[id];
@@ -107,32 +141,148 @@ static inline void adv_send_end(int err, const struct bt_mesh_send_cb *cb,
     }
 }
 
-static inline void adv_send(struct net_buf *buf)
+#ifndef CONFIG_BT_MESH_MULTIADV
+static u16_t adv_interval(struct net_buf *buf)
 {
     s32_t adv_int_min = ((bt_dev.hci_version >= BT_HCI_VERSION_5_0) ? ADV_INT_FAST : ADV_INT_DEFAULT);
+
+    /* do not check ADV interval */
+#ifdef CONFIG_ADV_MIN_INTERVAL
+    adv_int_min = CONFIG_ADV_MIN_INTERVAL;
+#endif
+
+    return max(adv_int_min, BT_MESH_ADV(buf)->adv_int);
+}
+
+/* Histogram slot of v: 0, 1, 2-3, 4-7, ... with the last slot open */
+static inline int adv_hist_slot(u32_t v, int slots)
+{
+    return min(find_msb_set(v), slots - 1);
+}
+
+static void adv_plan_insert(struct net_buf *buf)
+{
+    sys_slist_t *list = &adv_plan.list[BT_MESH_ADV(buf)->prio];
+    u32_t due = BT_MESH_ADV(buf)->xmit_due;
+    sys_snode_t *prev = NULL;
+    struct net_buf *next;
+
+    /* Equal due times keep their arrival order */
+    SYS_SLIST_FOR_EACH_CONTAINER(list, next, node)
+    {
+        if ((s32_t)(BT_MESH_ADV(next)->xmit_due - due) > 0)
+        {
+            break;
+        }
+
+        prev = &next->node;
+    }
+
+    sys_slist_insert(list, prev, &buf->node);
+}
+
+static void adv_plan_add(struct net_buf *buf)
+{
+    struct bt_mesh_adv_stats *stats = &adv_stats[BT_MESH_ADV(buf)->prio];
+
+    /* busy == 0 means this was canceled */
+    if (!BT_MESH_ADV(buf)->busy)
+    {
+        if (BT_MESH_ADV(buf)->prio == BT_MESH_ADV_PRIO_RELAY)
+        {
+            atomic_dec(&adv_plan.relays);
+        }
+
+        // unref it even if it is canceled.
+        net_buf_unref(buf);
+        return;
+    }
+
+    stats->queued++;
+    stats->depth_hist[adv_hist_slot(stats->depth, BT_MESH_ADV_DEPTH_HIST)]++;
+    stats->depth++;
+    stats->depth_max = max(stats->depth_max, stats->depth);
+
+    /* busy stays set until the last transmission, so nobody rewrites
+     * the data while it is still planned. The first transmission is due
+     * from when the PDU was sent.
+     */
+    BT_MESH_ADV(buf)->xmit_left = BT_MESH_ADV(buf)->count + 1;
+    adv_plan_insert(buf);
+}
+
+static void adv_plan_remove(struct net_buf *buf, int err)
+{
+    struct bt_mesh_adv_stats *stats = &adv_stats[BT_MESH_ADV(buf)->prio];
     const struct bt_mesh_send_cb *cb = BT_MESH_ADV(buf)->cb;
     void *cb_data = BT_MESH_ADV(buf)->cb_data;
+    bool canceled = !BT_MESH_ADV(buf)->busy;
+
+    stats->depth--;
+    if (BT_MESH_ADV(buf)->prio == BT_MESH_ADV_PRIO_RELAY)
+    {
+        atomic_dec(&adv_plan.relays);
+    }
+
+    if (!err && !canceled)
+    {
+        stats->sent++;
+    }
+
+    BT_MESH_ADV(buf)->busy = 0;
+
+    /* The list node shares its storage with the fragment pointer */
+    buf->frags = NULL;
+    net_buf_unref(buf);
+
+    if (!canceled)
+    {
+        adv_send_end(err, cb, cb_data);
+    }
+}
+
+static void adv_plan_start(struct net_buf *buf, u32_t now)
+{
+    struct bt_mesh_adv_stats *stats = &adv_stats[BT_MESH_ADV(buf)->prio];
+    const struct bt_mesh_send_cb *cb = BT_MESH_ADV(buf)->cb;
+    void *cb_data = BT_MESH_ADV(buf)->cb_data;
+    bool first = (BT_MESH_ADV(buf)->xmit_left == BT_MESH_ADV(buf)->count + 1);
+    u32_t late = now - BT_MESH_ADV(buf)->xmit_due;
+    u16_t adv_int = adv_interval(buf);
     struct bt_mesh_le_adv_param param;
-    u16_t duration, adv_int;
     struct bt_mesh_data ad;
+    u16_t duration;
     int err;
 
-    /* do not check ADV interval */
-#ifdef CONFIG_ADV_MIN_INTERVAL
-    adv_int_min = CONFIG_ADV_MIN_INTERVAL;
-#endif
+    if (!BT_MESH_ADV(buf)->busy)
+    {
+        adv_plan_remove(buf, 0);
+        return;
+    }
 
-    adv_int = max(adv_int_min, BT_MESH_ADV(buf)->adv_int);
+    if (late > adv_deadline[BT_MESH_ADV(buf)->prio])
+    {
+        stats->late++;
 
-    /*[Genie begin]*/
-    //duration = (BT_MESH_ADV(buf)->count + 1) * (adv_int + 10);
-    duration = GENIE_DEFAULT_DURATION;
-    /*[Genie end]*/
+        if (BT_MESH_ADV(buf)->prio == BT_MESH_ADV_PRIO_RELAY)
+        {
+            BT_DBG("Dropping relayed PDU %u ms late", late);
+            stats->dropped++;
+            adv_plan_remove(buf, -ETIMEDOUT);
+            return;
+        }
+    }
+
+    if (first)
+    {
+        stats->latency_hist[adv_hist_slot(late, BT_MESH_ADV_LATENCY_HIST)]++;
+    }
 
     BT_DBG("type %u len %u: %s", BT_MESH_ADV(buf)->type,
            buf->len, bt_hex(buf->data, buf->len));
-    BT_DBG("count %u interval %ums, %ums, %ums duration %ums",
-           BT_MESH_ADV(buf)->count + 1, adv_int, adv_int, BT_MESH_ADV(buf)->adv_int, duration);
+    BT_DBG("transmission %u/%u interval %ums",
+           BT_MESH_ADV(buf)->count + 2 - BT_MESH_ADV(buf)->xmit_left,
+           BT_MESH_ADV(buf)->count + 1, adv_int);
 
 #ifdef GENIE_ULTRA_PROV
     if (BT_MESH_ADV(buf)->tiny_adv == 1)
@@ -154,22 +304,59 @@ static inline void adv_send(struct net_buf *buf)
     param.interval_max = param.interval_min;
     param.own_addr = NULL;
 
+    /* Back-to-back PDUs only swap the advertising data, the advertiser
+     * is not stopped in between.
+     */
+    atomic_clear(&adv_plan.sent);
     err = bt_mesh_adv_start(&param, &ad, 1, NULL, 0);
-    net_buf_unref(buf);
-    adv_send_start(duration, err, cb, cb_data);
+
+    if (first)
+    {
+        duration = (BT_MESH_ADV(buf)->count + 1) * (adv_int + ADV_DELAY_MAX);
+        adv_send_start(duration, err, cb, cb_data);
+    }
+
     if (err)
     {
         BT_ERR("Advertising failed: err %d", err);
-        goto exit;
+        adv_plan_remove(buf, err);
+        return;
     }
 
-    BT_DBG("Advertising started. Sleeping %u ms", duration);
+    adv_plan.adv_on = true;
+    adv_plan.cur = buf;
+    adv_plan.deadline = now + adv_int + ADV_DELAY_MAX;
+    BT_MESH_ADV(buf)->xmit_due = now + adv_int;
+}
+
+static void adv_plan_sent(void)
+{
+    struct net_buf *buf = adv_plan.cur;
 
-    k_sleep(duration);
+    adv_plan.cur = NULL;
+
+    if (--BT_MESH_ADV(buf)->xmit_left && BT_MESH_ADV(buf)->busy)
+    {
+        adv_plan_insert(buf);
+    }
+    else
+    {
+        adv_plan_remove(buf, 0);
+    }
+}
+
+static void adv_plan_stop(void)
+{
+    int err;
+
+    if (!adv_plan.adv_on)
+    {
+        return;
+    }
+
+    adv_plan.adv_on = false;
 
-exit:
     err = bt_mesh_adv_stop();
-    adv_send_end(err, cb, cb_data);
     if (err)
     {
         BT_ERR("Stopping advertising failed: err %d", err);
@@ -179,6 +366,88 @@ exit:
     BT_DBG("Advertising stopped");
 }
 
+static bool adv_plan_pending(void)
+{
+    int prio;
+
+    if (adv_plan.cur)
+    {
+        return true;
+    }
+
+    for (prio = 0; prio < BT_MESH_ADV_PRIO_COUNT; prio++)
+    {
+        if (!sys_slist_is_empty(&adv_plan.list[prio]))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Move the plan on, returns how long the adv thread may wait for new PDUs */
+static s32_t adv_plan_next(void)
+{
+    u32_t now = k_uptime_get_32();
+    s32_t wait, next = K_NO_WAIT;
+    struct net_buf *buf;
+    int prio;
+
+    if (adv_plan.cur)
+    {
+        wait = adv_plan.deadline - now;
+        if (!atomic_cas(&adv_plan.sent, 1, 0) && wait > 0)
+        {
+            return wait;
+        }
+
+        adv_plan_sent();
+    }
+
+    /* The most urgent class with a PDU due goes first */
+    for (prio = 0; prio < BT_MESH_ADV_PRIO_COUNT; prio++)
+    {
+        sys_slist_t *list = &adv_plan.list[prio];
+
+        while (!sys_slist_is_empty(list))
+        {
+            buf = SYS_SLIST_PEEK_HEAD_CONTAINER(list, buf, node);
+
+            wait = BT_MESH_ADV(buf)->xmit_due - now;
+            if (wait > 0)
+            {
+                if (next == K_NO_WAIT || wait < next)
+                {
+                    next = wait;
+                }
+                break;
+            }
+
+            sys_slist_get_not_empty(list);
+            adv_plan_start(buf, now);
+            if (adv_plan.cur)
+            {
+                return adv_plan.deadline - now;
+            }
+        }
+    }
+
+    /* Nothing due: keep the last PDU from going out again meanwhile */
+    adv_plan_stop();
+    return next;
+}
+
+static void adv_sent(void)
+{
+    if (adv_plan.cur)
+    {
+        atomic_set(&adv_plan.sent, 1);
+        k_fifo_cancel_wait(&adv_queue);
+    }
+}
+#endif
+
 #ifdef CONFIG_BT_MESH_MULTIADV
 static inline int adv_send_multi(struct net_buf *buf)
 {
@@ -332,7 +601,11 @@ static void adv_thread(void *p1, void *p2, void *p3)
 #else
         struct net_buf *buf;
 
-        if (IS_ENABLED(CONFIG_BT_MESH_GATT_PROXY) && bt_mesh_gatt_is_user_enabled())
+        if (adv_plan_pending())
+        {
+            buf = net_buf_get(&adv_queue, adv_plan_next());
+        }
+        else if (IS_ENABLED(CONFIG_BT_MESH_GATT_PROXY) && bt_mesh_gatt_is_user_enabled())
         {
 #if defined(BOARD_TG7100B)
             buf = net_buf_get(&adv_queue, NOCONN_ADV_DATA_TIEMOUT);
@@ -380,17 +653,7 @@ static void adv_thread(void *p1, void *p2, void *p3)
             continue;
         }
 
-        /* busy == 0 means this was canceled */
-        if (BT_MESH_ADV(buf)->busy)
-        {
-            BT_MESH_ADV(buf)->busy = 0;
-            adv_send(buf);
-        }
-        else
-        {
-            // unref it even if it is canceled.
-            net_buf_unref(buf);
-        }
+        adv_plan_add(buf);
 #endif
 
         STACK_ANALYZE("adv stack", adv_thread_stack);
@@ -445,6 +708,20 @@ struct net_buf *bt_mesh_adv_create_from_pool(struct net_buf_pool *pool,
     adv->count = xmit_count;
     adv->adv_int = xmit_int;
 
+    /* Relaying, transport control and the Friend Queue reclassify */
+    switch (type)
+    {
+    case BT_MESH_ADV_PROV:
+        adv->prio = BT_MESH_ADV_PRIO_CTL;
+        break;
+    case BT_MESH_ADV_DATA:
+        adv->prio = BT_MESH_ADV_PRIO_LOCAL;
+        break;
+    default:
+        adv->prio = BT_MESH_ADV_PRIO_BEACON;
+        break;
+    }
+
     return buf;
 }
 
@@ -461,9 +738,22 @@ void bt_mesh_adv_send(struct net_buf *buf, const struct bt_mesh_send_cb *cb,
     BT_DBG("type 0x%02x len %u: %s", BT_MESH_ADV(buf)->type, buf->len,
            bt_hex(buf->data, buf->len));
 
+#ifndef CONFIG_BT_MESH_MULTIADV
+    /* Relays come without callbacks, refusing one is just not relaying */
+    if (BT_MESH_ADV(buf)->prio == BT_MESH_ADV_PRIO_RELAY &&
+        atomic_inc(&adv_plan.relays) >= ADV_RELAY_MAX)
+    {
+        atomic_dec(&adv_plan.relays);
+        adv_stats[BT_MESH_ADV_PRIO_RELAY].rejected++;
+        BT_DBG("Relay PDUs at limit, rejecting");
+        return;
+    }
+#endif
+
     BT_MESH_ADV(buf)->cb = cb;
     BT_MESH_ADV(buf)->cb_data = cb_data;
     BT_MESH_ADV(buf)->busy = 1;
+    BT_MESH_ADV(buf)->xmit_due = k_uptime_get_32();
 
     net_buf_put(&adv_queue, net_buf_ref(buf));
 #ifdef CONFIG_BT_MESH_MULTIADV
@@ -475,6 +765,26 @@ void bt_mesh_adv_send(struct net_buf *buf, const struct bt_mesh_send_cb *cb,
 #endif
 }
 
+void bt_mesh_adv_stats_get(struct bt_mesh_adv_stats stats[BT_MESH_ADV_PRIO_COUNT])
+{
+    memcpy(stats, adv_stats, sizeof(adv_stats));
+}
+
+void bt_mesh_adv_stats_reset(void)
+{
+    int prio;
+
+    /* Depth is state rather than a counter */
+    for (prio = 0; prio < BT_MESH_ADV_PRIO_COUNT; prio++)
+    {
+        u16_t depth = adv_stats[prio].depth;
+
+        memset(&adv_stats[prio], 0, sizeof(adv_stats[prio]));
+        adv_stats[prio].depth = depth;
+        adv_stats[prio].depth_max = depth;
+    }
+}
+
 const bt_addr_le_t *bt_mesh_pba_get_addr(void)
 {
     return dev_addr;
@@ -559,6 +869,17 @@ void bt_mesh_adv_init(void)
 #if defined(BOARD_TG7100B)
     bt_mesh_adv_scan_schd_init();
 #endif
+#ifndef CONFIG_BT_MESH_MULTIADV
+    {
+        int prio;
+
+        for (prio = 0; prio < BT_MESH_ADV_PRIO_COUNT; prio++)
+        {
+            sys_slist_init(&adv_plan.list[prio]);
+        }
+    }
+    bt_mesh_adv_sent_cb_set(adv_sent);
+#endif
 
     k_thread_create(&adv_thread_data, adv_thread_stack,
                     K_THREAD_STACK_SIZEOF(adv_thread_stack), adv_thread,
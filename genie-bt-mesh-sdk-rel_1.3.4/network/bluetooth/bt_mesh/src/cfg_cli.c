@@ -522,7 +522,7 @@ static void cli_ctrl_relay_status(struct bt_mesh_model *model,
 
 	if (cli->op_pending == 0)
 	{
-		aos_msleep(1000);
+		k_sleep(1000);
 	}
 
 	if (cli->op_pending != OP_CTRL_RELAY_CONF_STATUS)
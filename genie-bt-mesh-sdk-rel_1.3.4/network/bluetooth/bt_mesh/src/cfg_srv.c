@@ -516,7 +516,8 @@ static u8_t app_key_set(u16_t net_idx, u16_t app_idx, const u8_t val[16],
         keys = &key->keys[0];
     }
 
-    if (bt_mesh_app_id(val, &keys->id))
+    if (bt_mesh_app_id(val, &keys->id) ||
+        bt_mesh_aes_key_set(&keys->sched, val))
     {
         if (update)
         {
@@ -572,6 +573,8 @@ static s8_t genie_mesh_setup(u16_t key_app_idx)
         }
     }
 
+    bt_mesh_elem_group_rebuild();
+
     return 0;
 }
 
@@ -1520,6 +1523,8 @@ static void _elem_sub_bind(struct bt_mesh_elem *p_elem)
         p_mod = bt_mesh_model_find_vnd(p_elem, p_elem->vnd_models[i].vnd.company, p_elem->vnd_models[i].vnd.id);
         memcpy(p_mod->groups, g_sub_list, sizeof(g_sub_list));
     }
+
+    bt_mesh_elem_group_rebuild();
 }
 /*[Genie end]*/
 
@@ -1591,6 +1596,7 @@ static void mod_sub_add(struct bt_mesh_model *model,
         if (mod->groups[i] == BT_MESH_ADDR_UNASSIGNED)
         {
             mod->groups[i] = sub_addr;
+            bt_mesh_elem_group_update(sub_addr);
             break;
         }
     }
@@ -1613,7 +1619,7 @@ static void mod_sub_add(struct bt_mesh_model *model,
 
 send_status:
 #ifdef CONFIG_GENIE_MESH_GLP
-    aos_msleep(1300);
+    k_sleep(1300);
 #endif
     send_mod_sub_status(model, ctx, status, elem_addr, sub_addr,
                         mod_id, vnd);
@@ -1696,13 +1702,14 @@ static void mod_sub_del(struct bt_mesh_model *model,
     if (match)
     {
         *match = BT_MESH_ADDR_UNASSIGNED;
+        bt_mesh_elem_group_update(sub_addr);
     }
 #endif
     /*[Genie begin]*/
 
 send_status:
 #ifdef CONFIG_GENIE_MESH_GLP
-    aos_msleep(1300);
+    k_sleep(1300);
 #endif
 
     send_mod_sub_status(model, ctx, status, elem_addr, sub_addr,
@@ -1765,6 +1772,7 @@ static void mod_sub_overwrite(struct bt_mesh_model *model,
     if (ARRAY_SIZE(mod->groups) > 0)
     {
         mod->groups[0] = sub_addr;
+        bt_mesh_elem_group_rebuild();
         status = STATUS_SUCCESS;
 
         if (IS_ENABLED(CONFIG_BT_MESH_LOW_POWER))
@@ -1822,6 +1830,7 @@ static void mod_sub_del_all(struct bt_mesh_model *model,
 
     /* Clear all subscriptions (0x0000 is the unassigned address) */
     memset(mod->groups, 0, sizeof(mod->groups));
+    bt_mesh_elem_group_rebuild();
 
     status = STATUS_SUCCESS;
 
@@ -2005,6 +2014,7 @@ static void mod_sub_va_add(struct bt_mesh_model *model,
         if (mod->groups[i] == BT_MESH_ADDR_UNASSIGNED)
         {
             mod->groups[i] = sub_addr;
+            bt_mesh_elem_group_update(sub_addr);
             break;
         }
     }
@@ -2078,6 +2088,7 @@ static void mod_sub_va_del(struct bt_mesh_model *model,
     if (match)
     {
         *match = BT_MESH_ADDR_UNASSIGNED;
+        bt_mesh_elem_group_update(sub_addr);
         status = STATUS_SUCCESS;
     }
     else
@@ -2152,6 +2163,8 @@ static void mod_sub_va_overwrite(struct bt_mesh_model *model,
         status = STATUS_INSUFF_RESOURCES;
     }
 
+    bt_mesh_elem_group_rebuild();
+
 send_status:
     send_mod_sub_status(model, ctx, status, elem_addr, sub_addr,
                         mod_id, vnd);
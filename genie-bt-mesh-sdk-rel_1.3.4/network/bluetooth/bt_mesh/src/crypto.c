@@ -192,46 +192,81 @@ int bt_mesh_id128(const u8_t n[16], const char *s, u8_t out[16])
 	return bt_mesh_k1(n, 16, salt, id128, out);
 }
 
-static int bt_mesh_ccm_decrypt(const u8_t key[16], u8_t nonce[13],
-							   const u8_t *enc_msg, size_t msg_len,
-							   const u8_t *aad, size_t aad_len,
-							   u8_t *out_msg, size_t mic_size)
+/* Single pass AES-CCM with a 2 byte length field (Mesh Profile 3.8.2).
+ * For every 16 byte block the counter keystream and the CBC-MAC step
+ * are done together, byte by byte, so the output may overlap the input
+ * and data can be fed in pieces of any size.
+ */
+struct bt_mesh_ccm
+{
+	const struct bt_mesh_aes_key *key;
+	u8_t ctr[16]; /* Counter block A_i of the current block */
+	u8_t mac[16]; /* CBC-MAC state X_i */
+	u8_t ks[16];  /* Keystream of the current block */
+	u8_t off;	  /* Bytes consumed of the current block */
+	u8_t mic_size;
+};
+
+static int ccm_mac(struct bt_mesh_ccm *ccm, const u8_t *data, size_t len)
 {
-	u8_t msg[16], pmsg[16], cmic[16], cmsg[16], Xn[16], mic[16];
-	u16_t last_blk, blk_cnt;
-	size_t i, j;
 	int err;
 
-	if (msg_len < 1 || aad_len >= 0xff00)
+	while (len--)
 	{
-		return -EINVAL;
+		ccm->mac[ccm->off++] ^= *data++;
+		if (ccm->off == 16)
+		{
+			err = bt_mesh_aes_key_encrypt(ccm->key, ccm->mac, ccm->mac);
+			if (err)
+			{
+				return err;
+			}
+
+			ccm->off = 0;
+		}
 	}
 
-	/* C_mic = e(AppKey, 0x01 || nonce || 0x0000) */
-	pmsg[0] = 0x01;
-	memcpy(pmsg + 1, nonce, 13);
-	sys_put_be16(0x0000, pmsg + 14);
+	return 0;
+}
 
-	err = bt_mesh_aes_encrypt(key, pmsg, cmic);
-	if (err)
+static int ccm_mac_flush(struct bt_mesh_ccm *ccm)
+{
+	if (!ccm->off)
 	{
-		return err;
+		return 0;
 	}
 
-	/* X_0 = e(AppKey, 0x09 || nonce || length) */
-	if (mic_size == sizeof(u64_t))
-	{
-		pmsg[0] = 0x19 | (aad_len ? 0x40 : 0x00);
-	}
-	else
+	/* Remaining bytes are implicitly zero padded */
+	ccm->off = 0;
+
+	return bt_mesh_aes_key_encrypt(ccm->key, ccm->mac, ccm->mac);
+}
+
+static int bt_mesh_ccm_init(struct bt_mesh_ccm *ccm,
+							const struct bt_mesh_aes_key *key,
+							const u8_t nonce[13], size_t msg_len,
+							const u8_t *aad, size_t aad_len, size_t mic_size)
+{
+	u8_t len[2];
+	int err;
+
+	/* Unsupported AAD size */
+	if (aad_len >= 0xff00)
 	{
-		pmsg[0] = 0x09 | (aad_len ? 0x40 : 0x00);
+		return -EINVAL;
 	}
 
-	memcpy(pmsg + 1, nonce, 13);
-	sys_put_be16(msg_len, pmsg + 14);
+	ccm->key = key;
+	ccm->mic_size = mic_size;
+	ccm->off = 0;
 
-	err = bt_mesh_aes_encrypt(key, pmsg, Xn);
+	/* X_0 = e(Key, B_0), B_0 = flags || nonce || length */
+	ccm->mac[0] = (((mic_size - 2) / 2) << 3) | (aad_len ? 0x40 : 0x00) |
+				  0x01;
+	memcpy(ccm->mac + 1, nonce, 13);
+	sys_put_be16(msg_len, ccm->mac + 14);
+
+	err = bt_mesh_aes_key_encrypt(key, ccm->mac, ccm->mac);
 	if (err)
 	{
 		return err;
@@ -240,332 +275,168 @@ static int bt_mesh_ccm_decrypt(const u8_t key[16], u8_t nonce[13],
 	/* If AAD is being used to authenticate, include it here */
 	if (aad_len)
 	{
-		sys_put_be16(aad_len, pmsg);
+		sys_put_be16(aad_len, len);
 
-		for (i = 0; i < sizeof(u16_t); i++)
+		err = ccm_mac(ccm, len, sizeof(len));
+		if (!err)
 		{
-			pmsg[i] = Xn[i] ^ pmsg[i];
+			err = ccm_mac(ccm, aad, aad_len);
 		}
 
-		j = 0;
-		aad_len += sizeof(u16_t);
-		while (aad_len > 16)
+		if (!err)
 		{
-			do
-			{
-				pmsg[i] = Xn[i] ^ aad[j];
-				i++, j++;
-			} while (i < 16);
-
-			aad_len -= 16;
-			i = 0;
-
-			err = bt_mesh_aes_encrypt(key, pmsg, Xn);
-			if (err)
-			{
-				return err;
-			}
+			err = ccm_mac_flush(ccm);
 		}
 
-		for (i = 0; i < aad_len; i++, j++)
-		{
-			pmsg[i] = Xn[i] ^ aad[j];
-		}
-
-		for (i = aad_len; i < 16; i++)
-		{
-			pmsg[i] = Xn[i];
-		}
-
-		err = bt_mesh_aes_encrypt(key, pmsg, Xn);
 		if (err)
 		{
 			return err;
 		}
 	}
 
-	last_blk = msg_len % 16;
-	blk_cnt = (msg_len + 15) / 16;
-	if (!last_blk)
-	{
-		last_blk = 16;
-	}
+	/* A_0 = 0x01 || nonce || 0x0000, A_0 itself only protects the MIC */
+	ccm->ctr[0] = 0x01;
+	memcpy(ccm->ctr + 1, nonce, 13);
+	sys_put_be16(0x0000, ccm->ctr + 14);
+
+	return 0;
+}
+
+static int bt_mesh_ccm_update(struct bt_mesh_ccm *ccm, const u8_t *in,
+							  u8_t *out, size_t len, bool decrypt)
+{
+	u8_t in_byte, out_byte;
+	int err;
 
-	for (j = 0; j < blk_cnt; j++)
+	while (len--)
 	{
-		if (j + 1 == blk_cnt)
+		/* C_i = e(Key, A_i) for i = 1, 2, ... */
+		if (!ccm->off)
 		{
-			/* C_1 = e(AppKey, 0x01 || nonce || 0x0001) */
-			pmsg[0] = 0x01;
-			memcpy(pmsg + 1, nonce, 13);
-			sys_put_be16(j + 1, pmsg + 14);
+			sys_put_be16(sys_get_be16(ccm->ctr + 14) + 1, ccm->ctr + 14);
 
-			err = bt_mesh_aes_encrypt(key, pmsg, cmsg);
+			err = bt_mesh_aes_key_encrypt(ccm->key, ccm->ctr, ccm->ks);
 			if (err)
 			{
 				return err;
 			}
+		}
 
-			/* Encrypted = Payload[0-15] ^ C_1 */
-			for (i = 0; i < last_blk; i++)
-			{
-				msg[i] = enc_msg[(j * 16) + i] ^ cmsg[i];
-			}
-
-			memcpy(out_msg + (j * 16), msg, last_blk);
-
-			/* X_1 = e(AppKey, X_0 ^ Payload[0-15]) */
-			for (i = 0; i < last_blk; i++)
-			{
-				pmsg[i] = Xn[i] ^ msg[i];
-			}
-
-			for (i = last_blk; i < 16; i++)
-			{
-				pmsg[i] = Xn[i] ^ 0x00;
-			}
+		/* Read before writing, out may point at in */
+		in_byte = *in++;
+		out_byte = in_byte ^ ccm->ks[ccm->off];
+		*out++ = out_byte;
 
-			err = bt_mesh_aes_encrypt(key, pmsg, Xn);
+		/* X_i = e(Key, X_i-1 ^ Payload_i) */
+		ccm->mac[ccm->off++] ^= decrypt ? out_byte : in_byte;
+		if (ccm->off == 16)
+		{
+			err = bt_mesh_aes_key_encrypt(ccm->key, ccm->mac, ccm->mac);
 			if (err)
 			{
 				return err;
 			}
 
-			/* MIC = C_mic ^ X_1 */
-			for (i = 0; i < sizeof(mic); i++)
-			{
-				mic[i] = cmic[i] ^ Xn[i];
-			}
+			ccm->off = 0;
 		}
-		else
-		{
-			/* C_1 = e(AppKey, 0x01 || nonce || 0x0001) */
-			pmsg[0] = 0x01;
-			memcpy(pmsg + 1, nonce, 13);
-			sys_put_be16(j + 1, pmsg + 14);
+	}
 
-			err = bt_mesh_aes_encrypt(key, pmsg, cmsg);
-			if (err)
-			{
-				return err;
-			}
+	return 0;
+}
 
-			/* Encrypted = Payload[0-15] ^ C_1 */
-			for (i = 0; i < 16; i++)
-			{
-				msg[i] = enc_msg[(j * 16) + i] ^ cmsg[i];
-			}
+static int bt_mesh_ccm_final(struct bt_mesh_ccm *ccm, u8_t *mic)
+{
+	int err, i;
 
-			memcpy(out_msg + (j * 16), msg, 16);
+	err = ccm_mac_flush(ccm);
+	if (err)
+	{
+		return err;
+	}
 
-			/* X_1 = e(AppKey, X_0 ^ Payload[0-15]) */
-			for (i = 0; i < 16; i++)
-			{
-				pmsg[i] = Xn[i] ^ msg[i];
-			}
+	/* MIC = C_mic ^ X_n, C_mic = e(Key, A_0) */
+	sys_put_be16(0x0000, ccm->ctr + 14);
 
-			err = bt_mesh_aes_encrypt(key, pmsg, Xn);
-			if (err)
-			{
-				return err;
-			}
-		}
+	err = bt_mesh_aes_key_encrypt(ccm->key, ccm->ctr, ccm->ks);
+	if (err)
+	{
+		return err;
 	}
 
-	if (memcmp(mic, enc_msg + msg_len, mic_size))
+	for (i = 0; i < ccm->mic_size; i++)
 	{
-		return -EBADMSG;
+		mic[i] = ccm->mac[i] ^ ccm->ks[i];
 	}
 
 	return 0;
 }
 
-static int bt_mesh_ccm_encrypt(const u8_t key[16], u8_t nonce[13],
-							   const u8_t *msg, size_t msg_len,
+static int bt_mesh_ccm_decrypt(const struct bt_mesh_aes_key *key,
+							   const u8_t nonce[13],
+							   const u8_t *enc_msg, size_t msg_len,
 							   const u8_t *aad, size_t aad_len,
 							   u8_t *out_msg, size_t mic_size)
 {
-	u8_t pmsg[16], cmic[16], cmsg[16], mic[16], Xn[16];
-	u16_t blk_cnt, last_blk;
-	size_t i, j;
+	struct bt_mesh_ccm ccm;
+	u8_t mic[16];
 	int err;
 
-	BT_DBG("key %s", bt_hex(key, 16));
-	BT_DBG("nonce %s", bt_hex(nonce, 13));
-	BT_DBG("msg (len %zu) %s", msg_len, bt_hex(msg, msg_len));
-	BT_DBG("aad_len %zu mic_size %zu", aad_len, mic_size);
-
-	/* Unsupported AAD size */
-	if (aad_len >= 0xff00)
+	if (msg_len < 1)
 	{
 		return -EINVAL;
 	}
 
-	/* C_mic = e(AppKey, 0x01 || nonce || 0x0000) */
-	pmsg[0] = 0x01;
-	memcpy(pmsg + 1, nonce, 13);
-	sys_put_be16(0x0000, pmsg + 14);
-
-	err = bt_mesh_aes_encrypt(key, pmsg, cmic);
-	if (err)
+	err = bt_mesh_ccm_init(&ccm, key, nonce, msg_len, aad, aad_len,
+						   mic_size);
+	if (!err)
 	{
-		return err;
+		err = bt_mesh_ccm_update(&ccm, enc_msg, out_msg, msg_len, true);
 	}
 
-	/* X_0 = e(AppKey, 0x09 || nonce || length) */
-	if (mic_size == sizeof(u64_t))
-	{
-		pmsg[0] = 0x19 | (aad_len ? 0x40 : 0x00);
-	}
-	else
+	if (!err)
 	{
-		pmsg[0] = 0x09 | (aad_len ? 0x40 : 0x00);
+		err = bt_mesh_ccm_final(&ccm, mic);
 	}
 
-	memcpy(pmsg + 1, nonce, 13);
-	sys_put_be16(msg_len, pmsg + 14);
-
-	err = bt_mesh_aes_encrypt(key, pmsg, Xn);
 	if (err)
 	{
 		return err;
 	}
 
-	/* If AAD is being used to authenticate, include it here */
-	if (aad_len)
+	if (memcmp(mic, enc_msg + msg_len, mic_size))
 	{
-		sys_put_be16(aad_len, pmsg);
-
-		for (i = 0; i < sizeof(u16_t); i++)
-		{
-			pmsg[i] = Xn[i] ^ pmsg[i];
-		}
-
-		j = 0;
-		aad_len += sizeof(u16_t);
-		while (aad_len > 16)
-		{
-			do
-			{
-				pmsg[i] = Xn[i] ^ aad[j];
-				i++, j++;
-			} while (i < 16);
-
-			aad_len -= 16;
-			i = 0;
-
-			err = bt_mesh_aes_encrypt(key, pmsg, Xn);
-			if (err)
-			{
-				return err;
-			}
-		}
+		return -EBADMSG;
+	}
 
-		for (i = 0; i < aad_len; i++, j++)
-		{
-			pmsg[i] = Xn[i] ^ aad[j];
-		}
+	return 0;
+}
 
-		for (i = aad_len; i < 16; i++)
-		{
-			pmsg[i] = Xn[i];
-		}
+static int bt_mesh_ccm_encrypt(const struct bt_mesh_aes_key *key,
+							   const u8_t nonce[13],
+							   const u8_t *msg, size_t msg_len,
+							   const u8_t *aad, size_t aad_len,
+							   u8_t *out_msg, size_t mic_size)
+{
+	struct bt_mesh_ccm ccm;
+	int err;
 
-		err = bt_mesh_aes_encrypt(key, pmsg, Xn);
-		if (err)
-		{
-			return err;
-		}
-	}
+	BT_DBG("nonce %s", bt_hex(nonce, 13));
+	BT_DBG("msg (len %zu) %s", msg_len, bt_hex(msg, msg_len));
+	BT_DBG("aad_len %zu mic_size %zu", aad_len, mic_size);
 
-	last_blk = msg_len % 16;
-	blk_cnt = (msg_len + 15) / 16;
-	if (!last_blk)
+	err = bt_mesh_ccm_init(&ccm, key, nonce, msg_len, aad, aad_len,
+						   mic_size);
+	if (!err)
 	{
-		last_blk = 16;
+		err = bt_mesh_ccm_update(&ccm, msg, out_msg, msg_len, false);
 	}
 
-	for (j = 0; j < blk_cnt; j++)
+	if (!err)
 	{
-		if (j + 1 == blk_cnt)
-		{
-			/* X_1 = e(AppKey, X_0 ^ Payload[0-15]) */
-			for (i = 0; i < last_blk; i++)
-			{
-				pmsg[i] = Xn[i] ^ msg[(j * 16) + i];
-			}
-			for (i = last_blk; i < 16; i++)
-			{
-				pmsg[i] = Xn[i] ^ 0x00;
-			}
-
-			err = bt_mesh_aes_encrypt(key, pmsg, Xn);
-			if (err)
-			{
-				return err;
-			}
-
-			/* MIC = C_mic ^ X_1 */
-			for (i = 0; i < sizeof(mic); i++)
-			{
-				mic[i] = cmic[i] ^ Xn[i];
-			}
-
-			/* C_1 = e(AppKey, 0x01 || nonce || 0x0001) */
-			pmsg[0] = 0x01;
-			memcpy(pmsg + 1, nonce, 13);
-			sys_put_be16(j + 1, pmsg + 14);
-
-			err = bt_mesh_aes_encrypt(key, pmsg, cmsg);
-			if (err)
-			{
-				return err;
-			}
-
-			/* Encrypted = Payload[0-15] ^ C_1 */
-			for (i = 0; i < last_blk; i++)
-			{
-				out_msg[(j * 16) + i] =
-					msg[(j * 16) + i] ^ cmsg[i];
-			}
-		}
-		else
-		{
-			/* X_1 = e(AppKey, X_0 ^ Payload[0-15]) */
-			for (i = 0; i < 16; i++)
-			{
-				pmsg[i] = Xn[i] ^ msg[(j * 16) + i];
-			}
-
-			err = bt_mesh_aes_encrypt(key, pmsg, Xn);
-			if (err)
-			{
-				return err;
-			}
-
-			/* C_1 = e(AppKey, 0x01 || nonce || 0x0001) */
-			pmsg[0] = 0x01;
-			memcpy(pmsg + 1, nonce, 13);
-			sys_put_be16(j + 1, pmsg + 14);
-
-			err = bt_mesh_aes_encrypt(key, pmsg, cmsg);
-			if (err)
-			{
-				return err;
-			}
-
-			/* Encrypted = Payload[0-15] ^ C_N */
-			for (i = 0; i < 16; i++)
-			{
-				out_msg[(j * 16) + i] =
-					msg[(j * 16) + i] ^ cmsg[i];
-			}
-		}
+		err = bt_mesh_ccm_final(&ccm, out_msg + msg_len);
 	}
 
-	memcpy(out_msg + msg_len, mic, mic_size);
-
-	return 0;
+	return err;
 }
 
 #if defined(CONFIG_BT_MESH_GATT_PROXY)
@@ -623,7 +494,7 @@ static void create_net_nonce(u8_t nonce[13], const u8_t *pdu,
 }
 
 int bt_mesh_net_obfuscate(u8_t *pdu, u32_t iv_index,
-						  const u8_t privacy_key[16])
+						  const struct bt_mesh_aes_key *privacy_key)
 {
 	u8_t priv_rand[16] = {
 		0x00,
@@ -635,14 +506,14 @@ int bt_mesh_net_obfuscate(u8_t *pdu, u32_t iv_index,
 	u8_t tmp[16];
 	int err, i;
 
-	BT_DBG("IVIndex %u, PrivacyKey %s", iv_index, bt_hex(privacy_key, 16));
+	BT_DBG("IVIndex %u", iv_index);
 
 	sys_put_be32(iv_index, &priv_rand[5]);
 	memcpy(&priv_rand[9], &pdu[7], 7);
 
 	BT_DBG("PrivacyRandom %s", bt_hex(priv_rand, 16));
 
-	err = bt_mesh_aes_encrypt(privacy_key, priv_rand, tmp);
+	err = bt_mesh_aes_key_encrypt(privacy_key, priv_rand, tmp);
 	if (err)
 	{
 		return err;
@@ -656,15 +527,15 @@ int bt_mesh_net_obfuscate(u8_t *pdu, u32_t iv_index,
 	return 0;
 }
 
-int bt_mesh_net_encrypt(const u8_t key[16], struct net_buf_simple *buf,
+int bt_mesh_net_encrypt(const struct bt_mesh_aes_key *key,
+						struct net_buf_simple *buf,
 						u32_t iv_index, bool proxy)
 {
 	u8_t mic_len = NET_MIC_LEN(buf->data);
 	u8_t nonce[13];
 	int err;
 
-	BT_DBG("IVIndex %u EncKey %s mic_len %u", iv_index, bt_hex(key, 16),
-		   mic_len);
+	BT_DBG("IVIndex %u mic_len %u", iv_index, mic_len);
 	BT_DBG("PDU (len %u) %s", buf->len, bt_hex(buf->data, buf->len));
 
 #if defined(CONFIG_BT_MESH_GATT_PROXY)
@@ -692,15 +563,15 @@ int bt_mesh_net_encrypt(const u8_t key[16], struct net_buf_simple *buf,
 	return err;
 }
 
-int bt_mesh_net_decrypt(const u8_t key[16], struct net_buf_simple *buf,
+int bt_mesh_net_decrypt(const struct bt_mesh_aes_key *key,
+						struct net_buf_simple *buf, const u8_t *payload,
 						u32_t iv_index, bool proxy)
 {
 	u8_t mic_len = NET_MIC_LEN(buf->data);
 	u8_t nonce[13];
 
 	BT_DBG("PDU (%u bytes) %s", buf->len, bt_hex(buf->data, buf->len));
-	BT_DBG("iv_index %u, key %s mic_len %u", iv_index, bt_hex(key, 16),
-		   mic_len);
+	BT_DBG("iv_index %u mic_len %u", iv_index, mic_len);
 
 #if defined(CONFIG_BT_MESH_GATT_PROXY)
 	if (proxy)
@@ -719,7 +590,7 @@ int bt_mesh_net_decrypt(const u8_t key[16], struct net_buf_simple *buf,
 
 	buf->len -= mic_len;
 
-	return bt_mesh_ccm_decrypt(key, nonce, &buf->data[7], buf->len - 7,
+	return bt_mesh_ccm_decrypt(key, nonce, payload, buf->len - 7,
 							   NULL, 0, &buf->data[7], mic_len);
 }
 
@@ -744,14 +615,14 @@ static void create_app_nonce(u8_t nonce[13], bool dev_key, u8_t aszmic,
 	sys_put_be32(iv_index, &nonce[9]);
 }
 
-int bt_mesh_app_encrypt(const u8_t key[16], bool dev_key, u8_t aszmic,
-						struct net_buf_simple *buf, const u8_t *ad,
-						u16_t src, u16_t dst, u32_t seq_num, u32_t iv_index)
+int bt_mesh_app_encrypt(const struct bt_mesh_aes_key *key, bool dev_key,
+						u8_t aszmic, struct net_buf_simple *buf,
+						const u8_t *ad, u16_t src, u16_t dst, u32_t seq_num,
+						u32_t iv_index)
 {
 	u8_t nonce[13];
 	int err;
 
-	BT_DBG("AppKey %s", bt_hex(key, 16));
 	BT_DBG("dev_key %u src 0x%04x dst 0x%04x", dev_key, src, dst);
 	BT_DBG("seq_num 0x%08x iv_index 0x%08x", seq_num, iv_index);
 	BT_DBG("Clear: %s", bt_hex(buf->data, buf->len));
@@ -771,8 +642,9 @@ int bt_mesh_app_encrypt(const u8_t key[16], bool dev_key, u8_t aszmic,
 	return err;
 }
 
-int bt_mesh_app_decrypt(const u8_t key[16], bool dev_key, u8_t aszmic,
-						struct net_buf_simple *buf, struct net_buf_simple *out,
+int bt_mesh_app_decrypt(const struct bt_mesh_aes_key *key, bool dev_key,
+						u8_t aszmic, struct net_buf_simple *buf,
+						struct net_buf_simple *out,
 						const u8_t *ad, u16_t src, u16_t dst, u32_t seq_num,
 						u32_t iv_index)
 {
@@ -783,7 +655,6 @@ int bt_mesh_app_decrypt(const u8_t key[16], bool dev_key, u8_t aszmic,
 
 	create_app_nonce(nonce, dev_key, aszmic, src, dst, seq_num, iv_index);
 
-	BT_DBG("AppKey %s", bt_hex(key, 16));
 	BT_DBG("Nonce  %s", bt_hex(nonce, 13));
 
 	err = bt_mesh_ccm_decrypt(key, nonce, buf->data, buf->len, ad,
@@ -917,7 +788,18 @@ int bt_mesh_prov_conf(const u8_t conf_key[16], const u8_t rand[16],
 int bt_mesh_prov_decrypt(const u8_t key[16], u8_t nonce[13],
 						 const u8_t data[25 + 8], u8_t out[25])
 {
-	return bt_mesh_ccm_decrypt(key, nonce, data, 25, NULL, 0, out, 8);
+	struct bt_mesh_aes_key sched;
+	int err;
+
+	err = bt_mesh_aes_key_set(&sched, key);
+	if (!err)
+	{
+		err = bt_mesh_ccm_decrypt(&sched, nonce, data, 25, NULL, 0, out, 8);
+	}
+
+	memset(&sched, 0, sizeof(sched));
+
+	return err;
 }
 
 int bt_mesh_beacon_auth(const u8_t beacon_key[16], u8_t flags,
@@ -63,32 +63,118 @@ static struct friend_adv
 	u64_t seq_auth;
 } adv_pool[FRIEND_BUF_COUNT];
 
+static struct bt_mesh_friend_stats frnd_stats;
+
 static struct bt_mesh_adv *adv_alloc(int id)
 {
 	return &adv_pool[id].adv;
 }
 
-static void discard_buffer(void)
+static void lane_put(struct bt_mesh_friend *frnd,
+					 enum bt_mesh_friend_lane lane, struct net_buf *buf)
+{
+	net_buf_slist_put(&frnd->queue[lane], buf);
+	frnd->lane_size[lane]++;
+	frnd->queue_size++;
+	frnd->queue_bytes += buf->len;
+
+	if (frnd->queue_bytes > frnd->queue_peak)
+	{
+		frnd->queue_peak = frnd->queue_bytes;
+	}
+
+	frnd_stats.queued[lane]++;
+}
+
+static struct net_buf *lane_get(struct bt_mesh_friend *frnd,
+								enum bt_mesh_friend_lane lane)
+{
+	struct net_buf *buf;
+
+	buf = net_buf_slist_get(&frnd->queue[lane]);
+	if (buf)
+	{
+		frnd->lane_size[lane]--;
+		frnd->queue_size--;
+		frnd->queue_bytes -= buf->len;
+	}
+
+	return buf;
+}
+
+/* Next PDU for the LPN: control first, then acks, then data */
+static struct net_buf *queue_get(struct bt_mesh_friend *frnd)
+{
+	struct net_buf *buf = NULL;
+	int lane;
+
+	for (lane = 0; lane < BT_MESH_FRIEND_LANE_COUNT && !buf; lane++)
+	{
+		buf = lane_get(frnd, lane);
+	}
+
+	return buf;
+}
+
+/* Oldest PDU to give up: data first, a Friend Update last */
+static struct net_buf *queue_evict(struct bt_mesh_friend *frnd)
+{
+	struct net_buf *buf = NULL;
+	int lane;
+
+	for (lane = BT_MESH_FRIEND_LANE_COUNT - 1; lane >= 0 && !buf; lane--)
+	{
+		buf = lane_get(frnd, lane);
+	}
+
+	return buf;
+}
+
+/* Keep the LPN within the queue size it was offered and its octet
+ * budget, dropping its oldest PDUs to make room for len more octets.
+ */
+static void queue_make_room(struct bt_mesh_friend *frnd, u16_t len)
+{
+	struct net_buf *buf;
+
+	while (frnd->queue_size >= CONFIG_BT_MESH_FRIEND_QUEUE_SIZE ||
+		   (frnd->queue_size &&
+			frnd->queue_bytes + len > CONFIG_BT_MESH_FRIEND_QUEUE_BYTES))
+	{
+		buf = queue_evict(frnd);
+		BT_WARN("Discarding buffer %p for LPN 0x%04x", buf, frnd->lpn);
+		net_buf_unref(buf);
+		frnd_stats.evict_budget++;
+	}
+}
+
+static bool discard_buffer(void)
 {
 	struct bt_mesh_friend *frnd = &bt_mesh.frnd[0];
 	struct net_buf *buf;
 	int i;
 
-	/* Find the Friend context with the most queued buffers */
+	/* Find the Friend context with the most queued octets */
 	for (i = 1; i < ARRAY_SIZE(bt_mesh.frnd); i++)
 	{
-		if (bt_mesh.frnd[i].queue_size > frnd->queue_size)
+		if (bt_mesh.frnd[i].queue_bytes > frnd->queue_bytes)
 		{
 			frnd = &bt_mesh.frnd[i];
 		}
 	}
 
-	buf = net_buf_slist_get(&frnd->queue);
-	__ASSERT_NO_MSG(buf != NULL);
+	/* The rest of the pool sits in segment contexts and last PDUs */
+	buf = queue_evict(frnd);
+	if (!buf)
+	{
+		return false;
+	}
+
 	BT_WARN("Discarding buffer %p for LPN 0x%04x", buf, frnd->lpn);
 	net_buf_unref(buf);
-	/* should reduce queue size when discard buffer*/
-	frnd->queue_size--;
+	frnd_stats.evict_pool++;
+
+	return true;
 }
 
 static struct net_buf *friend_buf_alloc(u16_t src)
@@ -105,12 +191,16 @@ static struct net_buf *friend_buf_alloc(u16_t src)
 										   BT_MESH_TRANSMIT_COUNT(xmit),
 										   BT_MESH_TRANSMIT_INT(xmit),
 										   K_NO_WAIT);
-		if (!buf)
+		if (!buf && !discard_buffer())
 		{
-			discard_buffer();
+			BT_WARN("Out of Friend Queue buffers");
+			frnd_stats.alloc_failed++;
+			return NULL;
 		}
 	} while (!buf);
 
+	/* Poll responses have to make the LPN's receive window */
+	BT_MESH_ADV(buf)->prio = BT_MESH_ADV_PRIO_CTL;
 	BT_MESH_ADV(buf)->addr = src;
 	FRIEND_ADV(buf)->seq_auth = TRANS_SEQ_AUTH_NVAL;
 
@@ -171,6 +261,7 @@ static s32_t recv_delay(struct bt_mesh_friend *frnd)
 
 static void friend_clear(struct bt_mesh_friend *frnd)
 {
+	struct net_buf *buf;
 	int i;
 
 	BT_DBG("LPN 0x%04x", frnd->lpn);
@@ -191,9 +282,9 @@ static void friend_clear(struct bt_mesh_friend *frnd)
 		frnd->last = NULL;
 	}
 
-	while (!sys_slist_is_empty(&frnd->queue))
+	while ((buf = queue_get(frnd)) != NULL)
 	{
-		net_buf_unref(net_buf_slist_get(&frnd->queue));
+		net_buf_unref(buf);
 	}
 
 	for (i = 0; i < ARRAY_SIZE(frnd->seg); i++)
@@ -210,7 +301,7 @@ static void friend_clear(struct bt_mesh_friend *frnd)
 	frnd->established = 0;
 	frnd->pending_buf = 0;
 	frnd->fsn = 0;
-	frnd->queue_size = 0;
+	frnd->queue_peak = 0;
 	frnd->pending_req = 0;
 	memset(frnd->sub_list, 0, sizeof(frnd->sub_list));
 }
@@ -351,7 +442,7 @@ static struct net_buf *create_friend_pdu(struct bt_mesh_friend *frnd,
 										 struct net_buf_simple *sdu)
 {
 	struct bt_mesh_subnet *sub;
-	const u8_t *enc, *priv;
+	const struct bt_mesh_aes_key *enc, *priv;
 	struct net_buf *buf;
 	u8_t nid;
 
@@ -359,12 +450,16 @@ static struct net_buf *create_friend_pdu(struct bt_mesh_friend *frnd,
 	__ASSERT_NO_MSG(sub != NULL);
 
 	buf = friend_buf_alloc(info->src);
+	if (!buf)
+	{
+		return NULL;
+	}
 
 	/* Friend Offer needs master security credentials */
 	if (info->ctl && TRANS_CTL_OP(sdu->data) == TRANS_CTL_OP_FRIEND_OFFER)
 	{
-		enc = sub->keys[sub->kr_flag].enc;
-		priv = sub->keys[sub->kr_flag].privacy;
+		enc = &sub->keys[sub->kr_flag].enc_sched;
+		priv = &sub->keys[sub->kr_flag].privacy_sched;
 		nid = sub->keys[sub->kr_flag].nid;
 	}
 	else
@@ -579,10 +674,11 @@ int bt_mesh_friend_sub_rem(struct bt_mesh_net_rx *rx,
 	return 0;
 }
 
-static void enqueue_buf(struct bt_mesh_friend *frnd, struct net_buf *buf)
+static void enqueue_buf(struct bt_mesh_friend *frnd,
+						enum bt_mesh_friend_lane lane, struct net_buf *buf)
 {
-	net_buf_slist_put(&frnd->queue, buf);
-	frnd->queue_size++;
+	queue_make_room(frnd, buf->len);
+	lane_put(frnd, lane, buf);
 }
 
 static void enqueue_update(struct bt_mesh_friend *frnd, u8_t md)
@@ -597,7 +693,7 @@ static void enqueue_update(struct bt_mesh_friend *frnd, u8_t md)
 	}
 
 	frnd->sec_update = 0;
-	enqueue_buf(frnd, buf);
+	enqueue_buf(frnd, BT_MESH_FRIEND_LANE_CTL, buf);
 }
 
 int bt_mesh_friend_poll(struct bt_mesh_net_rx *rx, struct net_buf_simple *buf)
@@ -657,7 +753,7 @@ int bt_mesh_friend_poll(struct bt_mesh_net_rx *rx, struct net_buf_simple *buf)
 
 		frnd->fsn = msg->fsn;
 
-		if (sys_slist_is_empty(&frnd->queue))
+		if (!frnd->queue_size)
 		{
 			enqueue_update(frnd, 0);
 			BT_DBG("Enqueued Friend Update to empty queue");
@@ -979,29 +1075,50 @@ init_friend:
 	return 0;
 }
 
+/* Segment contexts are keyed by source and SeqAuth and probed from a
+ * slot picked by the source, so the context of a message being
+ * collected is normally the first one looked at.
+ */
 static struct bt_mesh_friend_seg *get_seg(struct bt_mesh_friend *frnd,
-										  u16_t src, u64_t *seq_auth)
+										  u16_t src, u64_t *seq_auth,
+										  bool alloc)
 {
 	struct bt_mesh_friend_seg *unassigned = NULL;
-	int i;
+	int i, slot = src % ARRAY_SIZE(frnd->seg);
 
 	for (i = 0; i < ARRAY_SIZE(frnd->seg); i++)
 	{
-		struct bt_mesh_friend_seg *seg = &frnd->seg[i];
-		struct net_buf *buf = (void *)sys_slist_peek_head(&seg->queue);
+		struct bt_mesh_friend_seg *seg = &frnd->seg[slot];
 
-		if (buf && BT_MESH_ADV(buf)->addr == src &&
-			FRIEND_ADV(buf)->seq_auth == *seq_auth)
+		if (++slot == ARRAY_SIZE(frnd->seg))
 		{
-			return seg;
+			slot = 0;
 		}
 
-		if (!unassigned && !buf)
+		if (sys_slist_is_empty(&seg->queue))
 		{
-			unassigned = seg;
+			if (!unassigned)
+			{
+				unassigned = seg;
+			}
+
+			continue;
+		}
+
+		if (seg->src == src && seg->seq_auth == *seq_auth)
+		{
+			return seg;
 		}
 	}
 
+	if (!alloc || !unassigned)
+	{
+		return NULL;
+	}
+
+	unassigned->src = src;
+	unassigned->seq_auth = *seq_auth;
+
 	return unassigned;
 }
 
@@ -1014,6 +1131,8 @@ static void enqueue_friend_pdu(struct bt_mesh_friend *frnd,
 
 	BT_DBG("type %u", type);
 
+	adv = FRIEND_ADV(buf);
+
 	if (type == BT_MESH_FRIEND_PDU_SINGLE)
 	{
 		if (frnd->sec_update)
@@ -1021,17 +1140,26 @@ static void enqueue_friend_pdu(struct bt_mesh_friend *frnd,
 			enqueue_update(frnd, 1);
 		}
 
-		enqueue_buf(frnd, buf);
+		/* Acks are the only single PDUs with a valid SeqAuth */
+		if (adv->seq_auth != TRANS_SEQ_AUTH_NVAL)
+		{
+			enqueue_buf(frnd, BT_MESH_FRIEND_LANE_ACK, buf);
+		}
+		else
+		{
+			enqueue_buf(frnd, BT_MESH_FRIEND_LANE_DATA, buf);
+		}
+
 		return;
 	}
 
-	adv = FRIEND_ADV(buf);
-	seg = get_seg(frnd, BT_MESH_ADV(buf)->addr, &adv->seq_auth);
+	seg = get_seg(frnd, BT_MESH_ADV(buf)->addr, &adv->seq_auth, true);
 	if (!seg)
 	{
 		BT_ERR("No free friend segment RX contexts for 0x%04x",
 			   BT_MESH_ADV(buf)->addr);
 		net_buf_unref(buf);
+		frnd_stats.seg_no_ctx++;
 		return;
 	}
 
@@ -1048,13 +1176,11 @@ static void enqueue_friend_pdu(struct bt_mesh_friend *frnd,
 		 * (otherwise we can't easily detect them there), so clear
 		 * the SeqAuth information from the segments before merging.
 		 */
-		SYS_SLIST_FOR_EACH_CONTAINER(&seg->queue, buf, node)
+		while ((buf = net_buf_slist_get(&seg->queue)) != NULL)
 		{
 			FRIEND_ADV(buf)->seq_auth = TRANS_SEQ_AUTH_NVAL;
-			frnd->queue_size++;
+			enqueue_buf(frnd, BT_MESH_FRIEND_LANE_DATA, buf);
 		}
-
-		sys_slist_merge_slist(&frnd->queue, &seg->queue);
 	}
 }
 
@@ -1131,7 +1257,7 @@ static void friend_timeout(struct k_work *work)
 		return;
 	}
 
-	frnd->last = net_buf_slist_get(&frnd->queue);
+	frnd->last = queue_get(frnd);
 	if (!frnd->last)
 	{
 		BT_WARN("Friendship not established with 0x%04x", frnd->lpn);
@@ -1141,7 +1267,7 @@ static void friend_timeout(struct k_work *work)
 
 	BT_DBG("Sending buf %p from Friend Queue of LPN 0x%04x",
 		   frnd->last, frnd->lpn);
-	frnd->queue_size--;
+	frnd_stats.sent++;
 
 send_last:
 	frnd->pending_req = 0;
@@ -1162,7 +1288,10 @@ int bt_mesh_friend_init(void)
 
 		frnd->net_idx = BT_MESH_KEY_UNUSED;
 
-		sys_slist_init(&frnd->queue);
+		for (j = 0; j < ARRAY_SIZE(frnd->queue); j++)
+		{
+			sys_slist_init(&frnd->queue[j]);
+		}
 
 		k_delayed_work_init(&frnd->timer, friend_timeout);
 		k_delayed_work_init(&frnd->clear.timer, clear_timeout);
@@ -1179,11 +1308,13 @@ int bt_mesh_friend_init(void)
 static void friend_purge_old_ack(struct bt_mesh_friend *frnd, u64_t *seq_auth,
 								 u16_t src)
 {
+	sys_slist_t *acks = &frnd->queue[BT_MESH_FRIEND_LANE_ACK];
 	sys_snode_t *cur, *prev = NULL;
 
 	BT_DBG("SeqAuth %llx src 0x%04x", *seq_auth, src);
 
-	for (cur = sys_slist_peek_head(&frnd->queue);
+	/* Acks have a lane of their own, so the data backlog isn't walked */
+	for (cur = sys_slist_peek_head(acks);
 		 cur != NULL; prev = cur, cur = sys_slist_peek_next(cur))
 	{
 		struct net_buf *buf = (void *)cur;
@@ -1193,12 +1324,15 @@ static void friend_purge_old_ack(struct bt_mesh_friend *frnd, u64_t *seq_auth,
 		{
 			BT_DBG("Removing old ack from Friend Queue");
 
-			sys_slist_remove(&frnd->queue, prev, cur);
+			sys_slist_remove(acks, prev, cur);
+			frnd->lane_size[BT_MESH_FRIEND_LANE_ACK]--;
 			frnd->queue_size--;
+			frnd->queue_bytes -= buf->len;
 			/* Make sure old slist entry state doesn't remain */
 			buf->frags = NULL;
 
 			net_buf_unref(buf);
+			frnd_stats.ack_purged++;
 			break;
 		}
 	}
@@ -1427,42 +1561,69 @@ void bt_mesh_friend_clear_incomplete(struct bt_mesh_subnet *sub, u16_t src,
 	for (i = 0; i < ARRAY_SIZE(bt_mesh.frnd); i++)
 	{
 		struct bt_mesh_friend *frnd = &bt_mesh.frnd[i];
-		int j;
+		struct bt_mesh_friend_seg *seg;
 
 		if (!friend_lpn_matches(frnd, sub->net_idx, dst))
 		{
 			continue;
 		}
 
-		for (j = 0; j < ARRAY_SIZE(frnd->seg); j++)
+		seg = get_seg(frnd, src, seq_auth, false);
+		if (!seg)
 		{
-			struct bt_mesh_friend_seg *seg = &frnd->seg[j];
-			struct net_buf *buf;
+			continue;
+		}
 
-			buf = (void *)sys_slist_peek_head(&seg->queue);
-			if (!buf)
-			{
-				continue;
-			}
+		BT_WARN("Clearing incomplete segments for 0x%04x", src);
 
-			if (BT_MESH_ADV(buf)->addr != src)
-			{
-				continue;
-			}
+		while (!sys_slist_is_empty(&seg->queue))
+		{
+			net_buf_unref(net_buf_slist_get(&seg->queue));
+		}
 
-			if (FRIEND_ADV(buf)->seq_auth != *seq_auth)
-			{
-				continue;
-			}
+		frnd_stats.seg_cleared++;
+	}
+}
 
-			BT_WARN("Clearing incomplete segments for 0x%04x", src);
+void bt_mesh_friend_stats_get(struct bt_mesh_friend_stats *stats)
+{
+	*stats = frnd_stats;
+}
 
-			while (!sys_slist_is_empty(&seg->queue))
-			{
-				net_buf_unref(net_buf_slist_get(&seg->queue));
-			}
+void bt_mesh_friend_stats_reset(void)
+{
+	memset(&frnd_stats, 0, sizeof(frnd_stats));
+}
+
+int bt_mesh_friend_queue_get(struct bt_mesh_friend_queue *queue)
+{
+	int i, j, count = 0;
+
+	for (i = 0; i < ARRAY_SIZE(bt_mesh.frnd); i++)
+	{
+		struct bt_mesh_friend *frnd = &bt_mesh.frnd[i];
+		struct bt_mesh_friend_queue *q = &queue[count];
+
+		if (!frnd->valid)
+		{
+			continue;
 		}
+
+		q->lpn = frnd->lpn;
+		memcpy(q->size, frnd->lane_size, sizeof(q->size));
+		q->bytes = frnd->queue_bytes;
+		q->peak = frnd->queue_peak;
+		q->seg = 0;
+
+		for (j = 0; j < ARRAY_SIZE(frnd->seg); j++)
+		{
+			q->seg += !sys_slist_is_empty(&frnd->seg[j].queue);
+		}
+
+		count++;
 	}
+
+	return count;
 }
 
 #endif
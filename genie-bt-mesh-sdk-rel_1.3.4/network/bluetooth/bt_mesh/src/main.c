@@ -114,6 +114,7 @@ int bt_mesh_provision(const u8_t net_key[16], u16_t net_idx,
     }
 
     memcpy(bt_mesh.dev_key, dev_key, 16);
+    bt_mesh_aes_key_set(&bt_mesh.dev_key_sched, dev_key);
 
     bt_mesh_setup(seq, addr);
 
@@ -167,8 +168,9 @@ void bt_mesh_reset(void)
     }
 
     memset(bt_mesh.dev_key, 0, sizeof(bt_mesh.dev_key));
+    memset(&bt_mesh.dev_key_sched, 0, sizeof(bt_mesh.dev_key_sched));
 
-    memset(bt_mesh.rpl, 0, sizeof(bt_mesh.rpl));
+    bt_mesh_rpl_clear();
 
     provisioned = false;
     suspended = false;
@@ -196,8 +198,14 @@ void bt_mesh_gatt_user_enable(void)
     gatt_user_en = true;
     if (mesh_inited)
     {
-        bt_mesh_proxy_prov_enable();
-        bt_mesh_proxy_gatt_enable();
+        if (IS_ENABLED(CONFIG_BT_MESH_PB_GATT))
+        {
+            bt_mesh_proxy_prov_enable();
+        }
+        if (IS_ENABLED(CONFIG_BT_MESH_GATT_PROXY))
+        {
+            bt_mesh_proxy_gatt_enable();
+        }
         bt_mesh_adv_update();
 
         BT_WARN("gatt user enable\n");
@@ -213,8 +221,14 @@ void bt_mesh_gatt_user_disable()
     gatt_user_en = false;
     if (mesh_inited)
     {
-        bt_mesh_proxy_prov_disable();
-        bt_mesh_proxy_gatt_disable();
+        if (IS_ENABLED(CONFIG_BT_MESH_PB_GATT))
+        {
+            bt_mesh_proxy_prov_disable();
+        }
+        if (IS_ENABLED(CONFIG_BT_MESH_GATT_PROXY))
+        {
+            bt_mesh_proxy_gatt_disable();
+        }
         bt_mesh_adv_update();
         BT_WARN("gatt user disable\n");
     }
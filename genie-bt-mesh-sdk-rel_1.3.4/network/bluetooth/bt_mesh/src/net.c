@@ -77,8 +77,72 @@
 static struct friend_cred friend_cred[FRIEND_CRED_COUNT];
 #endif
 
-static u64_t msg_cache[CONFIG_BT_MESH_MSG_CACHE_SIZE];
-static u16_t msg_cache_next;
+/* Every network credential a PDU may be encrypted with gets a fixed
+ * handle: old/new keys of each subnet first, then old/new keys of each
+ * friendship credential. The NID index chains the handles by the NID
+ * they were last installed with, so that the receive path only tries
+ * credentials whose NID matches the PDU. Entries can go stale (e.g. a
+ * deleted subnet), so candidates are still validated before use.
+ */
+#define NET_CRED_SUB_COUNT (CONFIG_BT_MESH_SUBNET_COUNT * 2)
+#define NET_CRED_COUNT (NET_CRED_SUB_COUNT + FRIEND_CRED_COUNT * 2)
+#define NET_CRED_NONE 0xff
+#define NET_NID_COUNT 128
+
+BUILD_ASSERT(NET_CRED_COUNT < NET_CRED_NONE);
+
+static struct
+{
+    u8_t head[NET_NID_COUNT];
+    u8_t next[NET_CRED_COUNT];
+    u8_t nid[NET_CRED_COUNT]; /* Bucket the handle is linked in */
+} nid_index = {
+    .head = {[0 ...(NET_NID_COUNT - 1)] = NET_CRED_NONE},
+    .nid = {[0 ...(NET_CRED_COUNT - 1)] = NET_CRED_NONE},
+};
+
+static struct bt_mesh_net_decrypt_stats decrypt_stats;
+
+/* Number of hash bits used to index a cache of n entries. The index
+ * table is kept at least twice the size of the ring so that linear
+ * probe sequences stay short.
+ */
+#define NET_CACHE_INDEX_BITS(n) ((n) <= 8 ? 4 : (n) <= 16 ? 5 :         \
+                                 (n) <= 32 ? 6 : (n) <= 64 ? 7 :        \
+                                 (n) <= 128 ? 8 : (n) <= 256 ? 9 :      \
+                                 (n) <= 512 ? 10 : (n) <= 1024 ? 11 :   \
+                                 (n) <= 2048 ? 12 : (n) <= 4096 ? 13 :  \
+                                 (n) <= 8192 ? 14 : (n) <= 16384 ? 15 : \
+                                 (n) <= 32768 ? 16 : 17)
+
+#define MSG_CACHE_INDEX_BITS NET_CACHE_INDEX_BITS(CONFIG_BT_MESH_MSG_CACHE_SIZE)
+#define MSG_CACHE_INDEX_SIZE BIT(MSG_CACHE_INDEX_BITS)
+
+/* Fixed size FIFO of recently seen keys with an open-addressed hash
+ * index on top of it. The ring keeps the original overwrite-oldest
+ * semantics while the index gives lookups that do not depend on the
+ * ring size. Index entries hold the ring position + 1, 0 means empty.
+ */
+struct net_cache
+{
+    u64_t *ring;
+    u16_t *index;
+    u16_t size;
+    u16_t next;
+    u16_t count;
+    u8_t bits;
+    struct bt_mesh_net_cache_stats stats;
+};
+
+static u64_t msg_cache_ring[CONFIG_BT_MESH_MSG_CACHE_SIZE];
+static u16_t msg_cache_index[MSG_CACHE_INDEX_SIZE];
+
+static struct net_cache msg_cache = {
+    .ring = msg_cache_ring,
+    .index = msg_cache_index,
+    .size = CONFIG_BT_MESH_MSG_CACHE_SIZE,
+    .bits = MSG_CACHE_INDEX_BITS,
+};
 
 /* Singleton network context (the implementation only supports one) */
 struct bt_mesh_net bt_mesh = {
@@ -94,31 +158,136 @@ struct bt_mesh_net bt_mesh = {
 
 u16_t g_sub_list[CONFIG_BT_MESH_MODEL_GROUP_COUNT];
 
-static u32_t dup_cache[CONFIG_BT_MESH_MSG_CACHE_SIZE];
-static int dup_cache_next;
+static u64_t dup_cache_ring[CONFIG_BT_MESH_MSG_CACHE_SIZE];
+static u16_t dup_cache_index[MSG_CACHE_INDEX_SIZE];
 
-static bool check_dup(struct net_buf_simple *data)
+static struct net_cache dup_cache = {
+    .ring = dup_cache_ring,
+    .index = dup_cache_index,
+    .size = CONFIG_BT_MESH_MSG_CACHE_SIZE,
+    .bits = MSG_CACHE_INDEX_BITS,
+};
+
+static inline u32_t net_cache_slot(const struct net_cache *cache, u64_t key)
 {
-    const u8_t *tail = net_buf_simple_tail(data);
-    u32_t val;
-    int i;
+    u32_t hash = (u32_t)key ^ (u32_t)(key >> 32);
 
-    val = sys_get_be32(tail - 4) ^ sys_get_be32(tail - 8);
+    /* Fibonacci hashing, the upper bits are the best mixed ones */
+    return (hash * 0x9e3779b1) >> (32 - cache->bits);
+}
+
+static bool net_cache_find(const struct net_cache *cache, u64_t key)
+{
+    u32_t mask = BIT(cache->bits) - 1;
+    u32_t slot;
 
-    for (i = 0; i < ARRAY_SIZE(dup_cache); i++)
+    for (slot = net_cache_slot(cache, key); cache->index[slot];
+         slot = (slot + 1) & mask)
     {
-        if (dup_cache[i] == val)
+        if (cache->ring[cache->index[slot] - 1] == key)
         {
             return true;
         }
     }
 
-    dup_cache[dup_cache_next++] = val;
-    dup_cache_next %= ARRAY_SIZE(dup_cache);
+    return false;
+}
+
+static void net_cache_index_add(struct net_cache *cache, u16_t pos)
+{
+    u32_t mask = BIT(cache->bits) - 1;
+    u32_t slot;
+
+    for (slot = net_cache_slot(cache, cache->ring[pos]); cache->index[slot];
+         slot = (slot + 1) & mask)
+    {
+    }
+
+    cache->index[slot] = pos + 1;
+}
+
+static void net_cache_index_del(struct net_cache *cache, u16_t pos)
+{
+    u32_t mask = BIT(cache->bits) - 1;
+    u32_t hole, slot, home;
+
+    for (hole = net_cache_slot(cache, cache->ring[pos]);
+         cache->index[hole] != pos + 1; hole = (hole + 1) & mask)
+    {
+        if (!cache->index[hole])
+        {
+            return;
+        }
+    }
+
+    /* Backward shift deletion: pull up any following entry whose
+     * home slot does not lie cyclically in (hole, slot], so that no
+     * probe sequence is broken by the new hole.
+     */
+    for (slot = (hole + 1) & mask; cache->index[slot];
+         slot = (slot + 1) & mask)
+    {
+        home = net_cache_slot(cache, cache->ring[cache->index[slot] - 1]);
+
+        if (((slot - home) & mask) >= ((slot - hole) & mask))
+        {
+            cache->index[hole] = cache->index[slot];
+            hole = slot;
+        }
+    }
+
+    cache->index[hole] = 0;
+}
+
+/* Returns true if the key was already cached, otherwise adds it,
+ * overwriting the oldest entry once the ring is full.
+ */
+static bool net_cache_check(struct net_cache *cache, u64_t key)
+{
+    if (net_cache_find(cache, key))
+    {
+        cache->stats.hit++;
+        return true;
+    }
+
+    cache->stats.miss++;
+
+    if (cache->count == cache->size)
+    {
+        net_cache_index_del(cache, cache->next);
+        cache->stats.evict++;
+    }
+    else
+    {
+        cache->count++;
+    }
+
+    cache->ring[cache->next] = key;
+    net_cache_index_add(cache, cache->next);
+
+    cache->next = (cache->next + 1) % cache->size;
 
     return false;
 }
 
+static void net_cache_reset(struct net_cache *cache)
+{
+    memset(cache->ring, 0, cache->size * sizeof(cache->ring[0]));
+    memset(cache->index, 0, BIT(cache->bits) * sizeof(cache->index[0]));
+    cache->next = 0;
+    cache->count = 0;
+}
+
+static bool check_dup(struct net_buf_simple *data)
+{
+    const u8_t *tail = net_buf_simple_tail(data);
+    u32_t val;
+
+    val = sys_get_be32(tail - 4) ^ sys_get_be32(tail - 8);
+
+    return net_cache_check(&dup_cache, val);
+}
+
 static u64_t msg_hash(struct bt_mesh_net_rx *rx, struct net_buf_simple *pdu)
 {
     u32_t hash1, hash2;
@@ -135,22 +304,80 @@ static u64_t msg_hash(struct bt_mesh_net_rx *rx, struct net_buf_simple *pdu)
 static bool msg_cache_match(struct bt_mesh_net_rx *rx,
                             struct net_buf_simple *pdu)
 {
-    u64_t hash = msg_hash(rx, pdu);
-    u16_t i;
+    return net_cache_check(&msg_cache, msg_hash(rx, pdu));
+}
+
+void bt_mesh_net_cache_stats_get(struct bt_mesh_net_cache_stats *msg,
+                                 struct bt_mesh_net_cache_stats *dup)
+{
+    if (msg)
+    {
+        *msg = msg_cache.stats;
+    }
+
+    if (dup)
+    {
+        *dup = dup_cache.stats;
+    }
+}
+
+static void nid_index_del(u8_t cred)
+{
+    u8_t *prev;
+
+    if (nid_index.nid[cred] == NET_CRED_NONE)
+    {
+        return;
+    }
+
+    for (prev = &nid_index.head[nid_index.nid[cred]]; *prev != cred;
+         prev = &nid_index.next[*prev])
+    {
+    }
+
+    *prev = nid_index.next[cred];
+    nid_index.nid[cred] = NET_CRED_NONE;
+}
+
+static void nid_index_set(u8_t cred, u8_t nid)
+{
+    nid &= 0x7f;
+
+    if (nid_index.nid[cred] == nid)
+    {
+        return;
+    }
+
+    nid_index_del(cred);
+
+    nid_index.next[cred] = nid_index.head[nid];
+    nid_index.head[nid] = cred;
+    nid_index.nid[cred] = nid;
+}
+
+static void nid_index_subnet_keys(const struct bt_mesh_subnet_keys *keys)
+{
+    int i;
 
-    for (i = 0; i < ARRAY_SIZE(msg_cache); i++)
+    for (i = 0; i < ARRAY_SIZE(bt_mesh.sub); i++)
     {
-        if (msg_cache[i] == hash)
+        if (keys == &bt_mesh.sub[i].keys[0])
         {
-            return true;
+            nid_index_set(i * 2, keys->nid);
+            return;
         }
-    }
 
-    /* Add to the cache */
-    msg_cache[msg_cache_next++] = hash;
-    msg_cache_next %= ARRAY_SIZE(msg_cache);
+        if (keys == &bt_mesh.sub[i].keys[1])
+        {
+            nid_index_set(i * 2 + 1, keys->nid);
+            return;
+        }
+    }
+}
 
-    return false;
+void bt_mesh_net_decrypt_stats_get(struct bt_mesh_net_decrypt_stats *stats)
+{
+    *stats = decrypt_stats;
 }
 
 struct bt_mesh_subnet *bt_mesh_subnet_get(u16_t net_idx)
@@ -187,10 +414,24 @@ int bt_mesh_net_keys_create(struct bt_mesh_subnet_keys *keys,
         return err;
     }
 
+    err = bt_mesh_aes_key_set(&keys->enc_sched, keys->enc);
+    if (!err)
+    {
+        err = bt_mesh_aes_key_set(&keys->privacy_sched, keys->privacy);
+    }
+
+    if (err)
+    {
+        BT_ERR("Unable to expand EncKey & PrivacyKey");
+        return err;
+    }
+
     memcpy(keys->net, key, 16);
 
     keys->nid = nid;
 
+    nid_index_subnet_keys(keys);
+
     BT_DBG("NID 0x%02x EncKey %s", keys->nid, bt_hex(keys->enc, 16));
     BT_DBG("PrivacyKey %s", bt_hex(keys->privacy, 16));
 
@@ -268,6 +509,23 @@ int friend_cred_set(struct friend_cred *cred, u8_t idx, const u8_t net_key[16])
         return err;
     }
 
+    err = bt_mesh_aes_key_set(&cred->cred[idx].enc_sched,
+                              cred->cred[idx].enc);
+    if (!err)
+    {
+        err = bt_mesh_aes_key_set(&cred->cred[idx].privacy_sched,
+                                  cred->cred[idx].privacy);
+    }
+
+    if (err)
+    {
+        BT_ERR("Unable to expand EncKey & PrivacyKey");
+        return err;
+    }
+
+    nid_index_set(NET_CRED_SUB_COUNT + (cred - friend_cred) * 2 + idx,
+                  cred->cred[idx].nid);
+
     BT_DBG("Friend NID 0x%02x EncKey %s", cred->cred[idx].nid,
            bt_hex(cred->cred[idx].enc, 16));
     BT_DBG("Friend PrivacyKey %s", bt_hex(cred->cred[idx].privacy, 16));
@@ -288,6 +546,7 @@ void friend_cred_refresh(u16_t net_idx)
         {
             memcpy(&cred->cred[0], &cred->cred[1],
                    sizeof(cred->cred[0]));
+            nid_index_set(NET_CRED_SUB_COUNT + i * 2, cred->cred[0].nid);
         }
     }
 }
@@ -370,6 +629,9 @@ struct friend_cred *friend_cred_create(struct bt_mesh_subnet *sub, u16_t addr,
 
 void friend_cred_clear(struct friend_cred *cred)
 {
+    nid_index_del(NET_CRED_SUB_COUNT + (cred - friend_cred) * 2);
+    nid_index_del(NET_CRED_SUB_COUNT + (cred - friend_cred) * 2 + 1);
+
     cred->net_idx = BT_MESH_KEY_UNUSED;
     cred->addr = BT_MESH_ADDR_UNASSIGNED;
     cred->lpn_counter = 0;
@@ -396,7 +658,8 @@ int friend_cred_del(u16_t net_idx, u16_t addr)
 }
 
 int friend_cred_get(struct bt_mesh_subnet *sub, u16_t addr, u8_t *nid,
-                    const u8_t **enc, const u8_t **priv)
+                    const struct bt_mesh_aes_key **enc,
+                    const struct bt_mesh_aes_key **priv)
 {
     int i;
 
@@ -423,12 +686,12 @@ int friend_cred_get(struct bt_mesh_subnet *sub, u16_t addr, u8_t *nid,
 
         if (enc)
         {
-            *enc = cred->cred[sub->kr_flag].enc;
+            *enc = &cred->cred[sub->kr_flag].enc_sched;
         }
 
         if (priv)
         {
-            *priv = cred->cred[sub->kr_flag].privacy;
+            *priv = &cred->cred[sub->kr_flag].privacy_sched;
         }
 
         return 0;
@@ -438,7 +701,8 @@ int friend_cred_get(struct bt_mesh_subnet *sub, u16_t addr, u8_t *nid,
 }
 #else
 int friend_cred_get(struct bt_mesh_subnet *sub, u16_t addr, u8_t *nid,
-                    const u8_t **enc, const u8_t **priv)
+                    const struct bt_mesh_aes_key **enc,
+                    const struct bt_mesh_aes_key **priv)
 {
     return -ENOENT;
 }
@@ -500,8 +764,7 @@ int bt_mesh_net_create(u16_t idx, u8_t flags, const u8_t key[16],
         return -EALREADY;
     }
 
-    memset(msg_cache, 0, sizeof(msg_cache));
-    msg_cache_next = 0;
+    net_cache_reset(&msg_cache);
 
     sub = &bt_mesh.sub[0];
 
@@ -557,6 +820,7 @@ void bt_mesh_net_revoke_keys(struct bt_mesh_subnet *sub)
     BT_DBG("idx 0x%04x", sub->net_idx);
 
     memcpy(&sub->keys[0], &sub->keys[1], sizeof(sub->keys[0]));
+    nid_index_subnet_keys(&sub->keys[0]);
 
     for (i = 0; i < ARRAY_SIZE(bt_mesh.app_keys); i++)
     {
@@ -624,31 +888,6 @@ bool bt_mesh_kr_update(struct bt_mesh_subnet *sub, u8_t new_kr, bool new_key)
     return false;
 }
 
-void bt_mesh_rpl_reset(void)
-{
-    int i;
-
-    /* Discard "old old" IV Index entries from RPL and flag
-     * any other ones (which are valid) as old.
-     */
-    for (i = 0; i < ARRAY_SIZE(bt_mesh.rpl); i++)
-    {
-        struct bt_mesh_rpl *rpl = &bt_mesh.rpl[i];
-
-        if (rpl->src)
-        {
-            if (rpl->old_iv)
-            {
-                memset(rpl, 0, sizeof(*rpl));
-            }
-            else
-            {
-                rpl->old_iv = true;
-            }
-        }
-    }
-}
-
 #if defined(CONFIG_BT_MESH_IV_UPDATE_TEST)
 void bt_mesh_iv_update_test(bool enable)
 {
@@ -736,7 +975,7 @@ bool bt_mesh_net_iv_update(u32_t iv_index, bool iv_update)
         if (iv_index > bt_mesh.iv_index + 1)
         {
             BT_WARN("Performing IV Index Recovery");
-            memset(bt_mesh.rpl, 0, sizeof(bt_mesh.rpl));
+            bt_mesh_rpl_clear();
             bt_mesh.iv_index = iv_index;
             bt_mesh.seq = 0;
             goto do_update;
@@ -745,7 +984,7 @@ bool bt_mesh_net_iv_update(u32_t iv_index, bool iv_update)
         if (iv_index == bt_mesh.iv_index + 1 && !iv_update)
         {
             BT_WARN("Performing IV Index Recovery");
-            memset(bt_mesh.rpl, 0, sizeof(bt_mesh.rpl));
+            bt_mesh_rpl_clear();
             bt_mesh.iv_index = iv_index;
             bt_mesh.seq = 0;
             goto do_update;
@@ -824,14 +1063,14 @@ int bt_mesh_net_resend(struct bt_mesh_subnet *sub, struct net_buf *buf,
                        bool new_key, const struct bt_mesh_send_cb *cb,
                        void *cb_data)
 {
-    const u8_t *enc, *priv;
+    const struct bt_mesh_aes_key *enc, *priv;
     int err;
 
     BT_DBG("net_idx 0x%04x new_key %u len %u", sub->net_idx, new_key,
            buf->len);
 
-    enc = sub->keys[new_key].enc;
-    priv = sub->keys[new_key].privacy;
+    enc = &sub->keys[new_key].enc_sched;
+    priv = &sub->keys[new_key].privacy_sched;
 
     err = bt_mesh_net_obfuscate(buf->data, BT_MESH_NET_IVI_TX, priv);
     if (err)
@@ -840,7 +1079,8 @@ int bt_mesh_net_resend(struct bt_mesh_subnet *sub, struct net_buf *buf,
         return err;
     }
 
-    err = bt_mesh_net_decrypt(enc, &buf->b, BT_MESH_NET_IVI_TX, false);
+    err = bt_mesh_net_decrypt(enc, &buf->b, &buf->data[7],
+                              BT_MESH_NET_IVI_TX, false);
     if (err)
     {
         BT_ERR("decrypt failed (err %d)", err);
@@ -897,7 +1137,7 @@ int bt_mesh_net_encode(struct bt_mesh_net_tx *tx, struct net_buf_simple *buf,
 {
     const bool ctl = (tx->ctx->app_idx == BT_MESH_KEY_UNUSED);
     u8_t nid;
-    const u8_t *enc, *priv;
+    const struct bt_mesh_aes_key *enc, *priv;
     u8_t *seq;
     int err;
 
@@ -944,16 +1184,16 @@ int bt_mesh_net_encode(struct bt_mesh_net_tx *tx, struct net_buf_simple *buf,
             tx->friend_cred = 0;
 
             nid = tx->sub->keys[tx->sub->kr_flag].nid;
-            enc = tx->sub->keys[tx->sub->kr_flag].enc;
-            priv = tx->sub->keys[tx->sub->kr_flag].privacy;
+            enc = &tx->sub->keys[tx->sub->kr_flag].enc_sched;
+            priv = &tx->sub->keys[tx->sub->kr_flag].privacy_sched;
         }
     }
     else
     {
         tx->friend_cred = 0;
         nid = tx->sub->keys[tx->sub->kr_flag].nid;
-        enc = tx->sub->keys[tx->sub->kr_flag].enc;
-        priv = tx->sub->keys[tx->sub->kr_flag].privacy;
+        enc = &tx->sub->keys[tx->sub->kr_flag].enc_sched;
+        priv = &tx->sub->keys[tx->sub->kr_flag].privacy_sched;
     }
 
     net_buf_simple_push_u8(buf, (nid | (BT_MESH_NET_IVI_TX & 1) << 7));
@@ -1110,8 +1350,9 @@ struct bt_mesh_subnet *bt_mesh_subnet_find(const u8_t net_id[8], u8_t flags,
     return NULL;
 }
 
-static int net_decrypt(struct bt_mesh_subnet *sub, const u8_t *enc,
-                       const u8_t *priv, const u8_t *data,
+static int net_decrypt(struct bt_mesh_subnet *sub,
+                       const struct bt_mesh_aes_key *enc,
+                       const struct bt_mesh_aes_key *priv, const u8_t *data,
                        size_t data_len, struct bt_mesh_net_rx *rx,
                        struct net_buf_simple *buf)
 {
@@ -1120,8 +1361,12 @@ static int net_decrypt(struct bt_mesh_subnet *sub, const u8_t *enc,
 
     rx->old_iv = (IVI(data) != (bt_mesh.iv_index & 0x01));
 
+    /* Only the header and the Privacy Random taken from the start of
+     * the encrypted part are copied. The payload is decrypted straight
+     * from the received PDU into buf.
+     */
     net_buf_simple_init(buf, 0);
-    memcpy(net_buf_simple_add(buf, data_len), data, data_len);
+    memcpy(net_buf_simple_add(buf, data_len), data, 14);
 
     if (bt_mesh_net_obfuscate(buf->data, BT_MESH_NET_IVI_RX(rx), priv))
     {
@@ -1146,103 +1391,128 @@ static int net_decrypt(struct bt_mesh_subnet *sub, const u8_t *enc,
     if (IS_ENABLED(CONFIG_BT_MESH_GATT_PROXY) &&
         rx->net_if == BT_MESH_NET_IF_PROXY_CFG)
     {
-        return bt_mesh_net_decrypt(enc, buf, BT_MESH_NET_IVI_RX(rx),
-                                   true);
+        return bt_mesh_net_decrypt(enc, buf, &data[7],
+                                   BT_MESH_NET_IVI_RX(rx), true);
     }
 
-    return bt_mesh_net_decrypt(enc, buf, BT_MESH_NET_IVI_RX(rx), false);
+    return bt_mesh_net_decrypt(enc, buf, &data[7], BT_MESH_NET_IVI_RX(rx),
+                               false);
 }
 
-#if (defined(CONFIG_BT_MESH_LOW_POWER) || \
-     defined(CONFIG_BT_MESH_FRIEND))
-static int friend_decrypt(struct bt_mesh_subnet *sub, const u8_t *data,
-                          size_t data_len, struct bt_mesh_net_rx *rx,
-                          struct net_buf_simple *buf)
+/* Resolve a NID index handle to its keys, provided the credential is
+ * currently usable for receiving.
+ */
+static bool net_cred_get(u8_t cred, u8_t nid, struct bt_mesh_subnet **sub,
+                         const struct bt_mesh_aes_key **enc,
+                         const struct bt_mesh_aes_key **priv,
+                         bool *new_key, bool *frnd)
 {
-    int i;
-
-    BT_DBG("NID 0x%02x net_idx 0x%04x", NID(data), sub->net_idx);
+    *new_key = (cred & 1);
 
-    for (i = 0; i < ARRAY_SIZE(friend_cred); i++)
+    if (cred < NET_CRED_SUB_COUNT)
     {
-        struct friend_cred *cred = &friend_cred[i];
+        struct bt_mesh_subnet_keys *keys;
 
-        if (cred->net_idx != sub->net_idx)
-        {
-            continue;
-        }
+        *sub = &bt_mesh.sub[cred / 2];
+        keys = &(*sub)->keys[*new_key];
 
-        if (NID(data) == cred->cred[0].nid &&
-            !net_decrypt(sub, cred->cred[0].enc, cred->cred[0].privacy,
-                         data, data_len, rx, buf))
+        if ((*sub)->net_idx == BT_MESH_KEY_UNUSED || keys->nid != nid)
         {
-            return 0;
+            return false;
         }
 
-        if (sub->kr_phase == BT_MESH_KR_NORMAL)
+        *enc = &keys->enc_sched;
+        *priv = &keys->privacy_sched;
+        *frnd = false;
+    }
+    else
+    {
+#if FRIEND_CRED_COUNT > 0
+        struct friend_cred *fc = &friend_cred[(cred - NET_CRED_SUB_COUNT) / 2];
+
+        if (fc->addr == BT_MESH_ADDR_UNASSIGNED ||
+            fc->cred[*new_key].nid != nid)
         {
-            continue;
+            return false;
         }
 
-        if (NID(data) == cred->cred[1].nid &&
-            !net_decrypt(sub, cred->cred[1].enc, cred->cred[1].privacy,
-                         data, data_len, rx, buf))
+        *sub = bt_mesh_subnet_get(fc->net_idx);
+        if (!*sub || (*sub)->net_idx == BT_MESH_KEY_UNUSED)
         {
-            rx->new_key = 1;
-            return 0;
+            return false;
         }
+
+        *enc = &fc->cred[*new_key].enc_sched;
+        *priv = &fc->cred[*new_key].privacy_sched;
+        *frnd = true;
+#else
+        return false;
+#endif
     }
 
-    return -ENOENT;
+    /* The new key is only in use during Key Refresh */
+    return !(*new_key && (*sub)->kr_phase == BT_MESH_KR_NORMAL);
 }
-#endif
 
 static bool net_find_and_decrypt(const u8_t *data, size_t data_len,
                                  struct bt_mesh_net_rx *rx,
                                  struct net_buf_simple *buf)
 {
-    struct bt_mesh_subnet *sub = NULL;
-    int i;
-    u32_t array_size = 0;
+    struct bt_mesh_subnet *sub;
+    const struct bt_mesh_aes_key *enc, *priv;
+    bool new_key, frnd;
+    u8_t cred, fails = 0;
+    int err = -ENOENT;
 
     BT_DBG("%s", __func__);
 
-    array_size = ARRAY_SIZE(bt_mesh.sub);
+    decrypt_stats.pdus++;
 
-    for (i = 0; i < array_size; i++)
+    for (cred = nid_index.head[NID(data)]; cred != NET_CRED_NONE;
+         cred = nid_index.next[cred])
     {
-        sub = &bt_mesh.sub[i];
-        if (sub->net_idx == BT_MESH_KEY_UNUSED)
+        if (!net_cred_get(cred, NID(data), &sub, &enc, &priv, &new_key,
+                          &frnd))
         {
             continue;
         }
 
-        if (NID(data) == sub->keys[0].nid &&
-            !net_decrypt(sub, sub->keys[0].enc, sub->keys[0].privacy,
-                         data, data_len, rx, buf))
+        err = net_decrypt(sub, enc, priv, data, data_len, rx, buf);
+        if (!err)
         {
+            rx->new_key = new_key;
+            rx->friend_cred = frnd;
             rx->ctx.net_idx = sub->net_idx;
             rx->sub = sub;
-            return true;
+            break;
         }
 
-        if (sub->kr_phase == BT_MESH_KR_NORMAL)
+        if (err == -EALREADY)
         {
-            continue;
+            /* Known PDU, the credential did match */
+            decrypt_stats.dup++;
+            break;
         }
 
-        if (NID(data) == sub->keys[1].nid &&
-            !net_decrypt(sub, sub->keys[1].enc, sub->keys[1].privacy,
-                         data, data_len, rx, buf))
-        {
-            rx->new_key = 1;
-            rx->ctx.net_idx = sub->net_idx;
-            rx->sub = sub;
-            return true;
-        }
+        decrypt_stats.cand_fail++;
+        fails++;
     }
 
-    return false;
+    fails = min(fails, ARRAY_SIZE(decrypt_stats.fail_hist) - 1);
+    decrypt_stats.fail_hist[fails]++;
+
+    if (err == -EALREADY)
+    {
+        return false;
+    }
+
+    if (cred == NET_CRED_NONE)
+    {
+        decrypt_stats.no_match++;
+        return false;
+    }
+
+    return true;
 }
 
 /* Relaying from advertising to the advertising bearer should only happen
@@ -1268,7 +1538,7 @@ static bool relay_to_adv(enum bt_mesh_net_if net_if)
 static void bt_mesh_net_relay(struct net_buf_simple *sbuf,
                               struct bt_mesh_net_rx *rx)
 {
-    const u8_t *enc, *priv;
+    const struct bt_mesh_aes_key *enc, *priv;
     struct net_buf *buf;
     u8_t nid, transmit;
 
@@ -1329,6 +1599,14 @@ static void bt_mesh_net_relay(struct net_buf_simple *sbuf,
         return;
     }
 
+    /* Local and proxied traffic keeps its class, adv-adv relaying goes
+     * last and may be dropped once stale.
+     */
+    if (rx->net_if == BT_MESH_NET_IF_ADV)
+    {
+        BT_MESH_ADV(buf)->prio = BT_MESH_ADV_PRIO_RELAY;
+    }
+
     /* Only decrement TTL for non-locally originated packets */
     if (rx->net_if != BT_MESH_NET_IF_LOCAL)
     {
@@ -1339,8 +1617,8 @@ static void bt_mesh_net_relay(struct net_buf_simple *sbuf,
 
     net_buf_add_mem(buf, sbuf->data, sbuf->len);
 
-    enc = rx->sub->keys[rx->sub->kr_flag].enc;
-    priv = rx->sub->keys[rx->sub->kr_flag].privacy;
+    enc = &rx->sub->keys[rx->sub->kr_flag].enc_sched;
+    priv = &rx->sub->keys[rx->sub->kr_flag].privacy_sched;
     nid = rx->sub->keys[rx->sub->kr_flag].nid;
 
     BT_DBG("Relaying packet. TTL is now %u", TTL(buf->data));
@@ -24,7 +24,10 @@
 #include "mesh.h"
 #include "net.h"
 #include "transport.h"
+#include "adv.h"
+#include "access.h"
 #include "foundation.h"
+#include "friend.h"
 #include "ais_ota.h"
 #include "common/log.h"
 
@@ -1023,6 +1026,351 @@ static int cmd_rpl_clear(int argc, char *argv[])
 	bt_mesh_rpl_clear();
 	return 0;
 }
+
+static int cmd_net_cache(int argc, char *argv[])
+{
+	struct bt_mesh_net_cache_stats msg, dup;
+
+	bt_mesh_net_cache_stats_get(&msg, &dup);
+
+	printk("Msg cache (size %u): hit %u miss %u evict %u\n",
+		   CONFIG_BT_MESH_MSG_CACHE_SIZE, msg.hit, msg.miss, msg.evict);
+	printk("Dup cache (size %u): hit %u miss %u evict %u\n",
+		   CONFIG_BT_MESH_MSG_CACHE_SIZE, dup.hit, dup.miss, dup.evict);
+
+	return 0;
+}
+
+static int cmd_net_decrypt(int argc, char *argv[])
+{
+	struct bt_mesh_net_decrypt_stats stats;
+
+	bt_mesh_net_decrypt_stats_get(&stats);
+
+	printk("PDUs %u, no match %u, duplicates %u, failed candidates %u\n",
+		   stats.pdus, stats.no_match, stats.dup, stats.cand_fail);
+	printk("Failed candidates per PDU: 0: %u 1: %u 2: %u 3+: %u\n",
+		   stats.fail_hist[0], stats.fail_hist[1], stats.fail_hist[2],
+		   stats.fail_hist[3]);
+
+	return 0;
+}
+
+static void stats_hist_print(const char *name, const u32_t *hist, int slots)
+{
+	int i;
+
+	printk("  %s", name);
+	for (i = 0; i < slots; i++)
+	{
+		if (i < 2)
+		{
+			printk(" %d: %u", i, hist[i]);
+		}
+		else if (i < slots - 1)
+		{
+			printk(" %u-%u: %u", 1U << (i - 1), (1U << i) - 1, hist[i]);
+		}
+		else
+		{
+			printk(" %u+: %u", 1U << (i - 1), hist[i]);
+		}
+	}
+	printk("\n");
+}
+
+static int cmd_adv_stats(int argc, char *argv[])
+{
+	static const char *const prio_name[BT_MESH_ADV_PRIO_COUNT] = {
+		"ctl", "local", "beacon", "relay"};
+	struct bt_mesh_adv_stats stats[BT_MESH_ADV_PRIO_COUNT];
+	int prio;
+
+	if (argc > 1)
+	{
+		if (strcmp(argv[1], "reset"))
+		{
+			return -EINVAL;
+		}
+
+		bt_mesh_adv_stats_reset();
+		return 0;
+	}
+
+	bt_mesh_adv_stats_get(stats);
+
+	for (prio = 0; prio < BT_MESH_ADV_PRIO_COUNT; prio++)
+	{
+		printk("%s: queued %u sent %u late %u dropped %u rejected %u "
+			   "depth %u max %u\n", prio_name[prio], stats[prio].queued,
+			   stats[prio].sent, stats[prio].late, stats[prio].dropped,
+			   stats[prio].rejected, stats[prio].depth, stats[prio].depth_max);
+		stats_hist_print("depth", stats[prio].depth_hist,
+					   BT_MESH_ADV_DEPTH_HIST);
+		stats_hist_print("latency ms", stats[prio].latency_hist,
+					   BT_MESH_ADV_LATENCY_HIST);
+	}
+
+	return 0;
+}
+
+static int cmd_seg_stats(int argc, char *argv[])
+{
+	struct bt_mesh_seg_rtt rtt[BT_MESH_SEG_RTT_COUNT];
+	struct bt_mesh_seg_stats stats;
+	int i, count;
+
+	if (argc > 1)
+	{
+		if (strcmp(argv[1], "reset"))
+		{
+			return -EINVAL;
+		}
+
+		bt_mesh_seg_stats_reset();
+		return 0;
+	}
+
+	bt_mesh_seg_stats_get(&stats);
+
+	printk("rx pool: %u slots, used %u peak %u rejected %u\n",
+		   stats.pool_size, stats.pool_used, stats.pool_peak,
+		   stats.pool_rejected);
+	printk("rx: complete %u canceled %u dup acked %u latency max %u ms\n",
+		   stats.rx_complete, stats.rx_canceled, stats.rx_dup_acked,
+		   stats.rx_latency_max);
+	stats_hist_print("latency ms", stats.rx_latency_hist,
+					 BT_MESH_SEG_LATENCY_HIST);
+	printk("tx: retransmitted %u timeouts %u ack resends %u\n",
+		   stats.tx_retransmit, stats.tx_timeouts, stats.tx_ack_resends);
+
+	count = bt_mesh_seg_rtt_get(rtt);
+	for (i = 0; i < count; i++)
+	{
+		printk("  rtt 0x%04x: srtt %u rttvar %u rto %u ms, %u samples\n",
+			   rtt[i].addr, rtt[i].srtt, rtt[i].rttvar, rtt[i].rto,
+			   rtt[i].samples);
+	}
+
+	return 0;
+}
+
+static int cmd_sub_stats(int argc, char *argv[])
+{
+	struct bt_mesh_sub_stats stats;
+
+	if (argc > 1)
+	{
+		if (strcmp(argv[1], "reset"))
+		{
+			return -EINVAL;
+		}
+
+		bt_mesh_sub_stats_reset();
+		return 0;
+	}
+
+	bt_mesh_sub_stats_get(&stats);
+
+	printk("filter: %u addresses, %u lookups, %u filtered, "
+		   "%u false positives\n", stats.addrs, stats.lookups,
+		   stats.filtered, stats.false_pos);
+	printk("not decrypted: %u group, %u unicast PDUs, %u octets\n",
+		   stats.skip_group, stats.skip_unicast, stats.skip_octets);
+
+	return 0;
+}
+
+#if defined(CONFIG_BT_MESH_FRIEND)
+static int cmd_frnd_stats(int argc, char *argv[])
+{
+	struct bt_mesh_friend_queue queue[CONFIG_BT_MESH_FRIEND_LPN_COUNT];
+	struct bt_mesh_friend_stats stats;
+	int i, count;
+
+	if (argc > 1)
+	{
+		if (strcmp(argv[1], "reset"))
+		{
+			return -EINVAL;
+		}
+
+		bt_mesh_friend_stats_reset();
+		return 0;
+	}
+
+	bt_mesh_friend_stats_get(&stats);
+
+	printk("queued: ctl %u ack %u data %u, sent %u\n",
+		   stats.queued[BT_MESH_FRIEND_LANE_CTL],
+		   stats.queued[BT_MESH_FRIEND_LANE_ACK],
+		   stats.queued[BT_MESH_FRIEND_LANE_DATA], stats.sent);
+	printk("dropped: budget %u pool %u no buffer %u, acks replaced %u\n",
+		   stats.evict_budget, stats.evict_pool, stats.alloc_failed,
+		   stats.ack_purged);
+	printk("segments: no context %u, incomplete cleared %u\n",
+		   stats.seg_no_ctx, stats.seg_cleared);
+
+	count = bt_mesh_friend_queue_get(queue);
+	for (i = 0; i < count; i++)
+	{
+		printk("  lpn 0x%04x: ctl %u ack %u data %u, %u/%u octets peak %u, "
+			   "%u seg contexts\n", queue[i].lpn,
+			   queue[i].size[BT_MESH_FRIEND_LANE_CTL],
+			   queue[i].size[BT_MESH_FRIEND_LANE_ACK],
+			   queue[i].size[BT_MESH_FRIEND_LANE_DATA], queue[i].bytes,
+			   CONFIG_BT_MESH_FRIEND_QUEUE_BYTES, queue[i].peak,
+			   queue[i].seg);
+	}
+
+	return 0;
+}
+#endif
+
+/* Compares AES-128 block throughput when the key is expanded for every
+ * block (raw key API) against a key schedule prepared once, which is
+ * what the network and transport layers use.
+ */
+static int cmd_crypto_bench(int argc, char *argv[])
+{
+	static const u8_t key[16] = {
+		0x7d, 0xd7, 0x36, 0x4c, 0xd8, 0x42, 0xad, 0x18,
+		0xc1, 0x7c, 0x2b, 0x82, 0x0c, 0x84, 0xc3, 0xd6};
+	struct bt_mesh_aes_key sched;
+	u32_t blocks = 1000;
+	u32_t start, raw_ms, sched_ms;
+	u8_t blk[16] = {0};
+	u32_t i;
+
+	if (argc > 1)
+	{
+		blocks = strtoul(argv[1], NULL, 0);
+		if (!blocks)
+		{
+			return -EINVAL;
+		}
+	}
+
+	start = k_uptime_get_32();
+	for (i = 0; i < blocks; i++)
+	{
+		bt_mesh_aes_encrypt(key, blk, blk);
+	}
+	raw_ms = k_uptime_get_32() - start;
+
+	start = k_uptime_get_32();
+	bt_mesh_aes_key_set(&sched, key);
+	for (i = 0; i < blocks; i++)
+	{
+		bt_mesh_aes_key_encrypt(&sched, blk, blk);
+	}
+	sched_ms = k_uptime_get_32() - start;
+
+	printk("%u blocks: raw key %u ms (%u blocks/s), expanded key %u ms "
+		   "(%u blocks/s)\n",
+		   blocks, raw_ms, raw_ms ? (u32_t)((u64_t)blocks * 1000 / raw_ms) : 0,
+		   sched_ms,
+		   sched_ms ? (u32_t)((u64_t)blocks * 1000 / sched_ms) : 0);
+
+	return 0;
+}
+
+/* Look up every OpCode of the composition, sent to its element and to the
+ * Genie all nodes group with the first key bound to its model.
+ */
+static u32_t access_bench_round(const struct bt_mesh_comp *comp, bool linear,
+								u32_t *mismatch)
+{
+	const struct bt_mesh_model_op *op;
+	struct bt_mesh_model *model;
+	u16_t dst[2];
+	u32_t lookups = 0;
+	int i, j, k;
+	int count;
+
+	for (i = 0; i < comp->elem_count; i++)
+	{
+		struct bt_mesh_elem *elem = &comp->elem[i];
+
+		dst[0] = elem->addr;
+		dst[1] = BT_MESH_ADDR_GENIE_ALL_NODES;
+
+		for (j = 0; j < elem->model_count + elem->vnd_model_count; j++)
+		{
+			if (j < elem->model_count)
+			{
+				model = &elem->models[j];
+			}
+			else
+			{
+				model = &elem->vnd_models[j - elem->model_count];
+			}
+
+			for (op = model->op; op->func; op++)
+			{
+				for (k = 0; k < ARRAY_SIZE(dst); k++)
+				{
+					count = bt_mesh_model_op_match(dst[k], model->keys[0],
+												   op->opcode, linear);
+					if (mismatch &&
+						count != bt_mesh_model_op_match(dst[k], model->keys[0],
+														op->opcode, !linear))
+					{
+						(*mismatch)++;
+					}
+
+					lookups++;
+				}
+			}
+		}
+	}
+
+	return lookups;
+}
+
+static int cmd_access_bench(int argc, char *argv[])
+{
+	const struct bt_mesh_comp *comp = bt_mesh_comp_get();
+	u32_t rounds = 100, lookups = 0, mismatch = 0;
+	u32_t start, index_ms, linear_ms;
+	u32_t i;
+
+	if (!comp)
+	{
+		return -EINVAL;
+	}
+
+	if (argc > 1)
+	{
+		rounds = strtoul(argv[1], NULL, 0);
+		if (!rounds)
+		{
+			return -EINVAL;
+		}
+	}
+
+	access_bench_round(comp, false, &mismatch);
+
+	start = k_uptime_get_32();
+	for (i = 0; i < rounds; i++)
+	{
+		lookups = access_bench_round(comp, false, NULL);
+	}
+	index_ms = k_uptime_get_32() - start;
+
+	start = k_uptime_get_32();
+	for (i = 0; i < rounds; i++)
+	{
+		access_bench_round(comp, true, NULL);
+	}
+	linear_ms = k_uptime_get_32() - start;
+
+	printk("%u x %u lookups: index %u ms, linear %u ms, %u mismatches\n",
+		   rounds, lookups, index_ms, linear_ms, mismatch);
+
+	return 0;
+}
+
 #ifdef CONFIG_BT_MESH_CFG_CLI
 
 static int cmd_get_comp(int argc, char *argv[])
@@ -3453,6 +3801,17 @@ static const struct mesh_shell_cmd mesh_commands[] = {
 	{"net-pressure-test", cmd_net_pressure_test, "<dst> <window(s)> <pkt-per-window> <test duration(s)> [cnt]"},
 #endif
 
+	{"net-cache", cmd_net_cache, NULL},
+	{"net-decrypt", cmd_net_decrypt, NULL},
+	{"crypto-bench", cmd_crypto_bench, "[blocks]"},
+	{"access-bench", cmd_access_bench, "[rounds]"},
+	{"adv-stats", cmd_adv_stats, "[reset]"},
+	{"seg-stats", cmd_seg_stats, "[reset]"},
+	{"sub-stats", cmd_sub_stats, "[reset]"},
+#if defined(CONFIG_BT_MESH_FRIEND)
+	{"frnd-stats", cmd_frnd_stats, "[reset]"},
+#endif
+
 	{NULL, NULL, NULL}};
 
 struct mesh_shell_cmd *bt_mesh_get_shell_cmd_list()
@@ -48,15 +48,31 @@
 
 #define SEQ_AUTH(iv_index, seq) (((u64_t)iv_index) << 24 | (u64_t)seq)
 
-/* Retransmit timeout after which to retransmit unacked segments */
+/* Retransmit timeout after which to retransmit unacked segments, until
+ * the destination has an RTT estimate
+ */
 #define SEG_RETRANSMIT_TIMEOUT K_MSEC(400)
 
+/* Bounds of the adaptive retransmit timeout, backoff included. The spec
+ * floor grows by SEG_RTO_PER_HOP for each hop of the TTL and wins over
+ * SEG_RTO_MAX.
+ */
+#define SEG_RTO_MIN K_MSEC(200)
+#define SEG_RTO_PER_HOP K_MSEC(50)
+#define SEG_RTO_MAX K_MSEC(3200)
+
 /* Number of retransmit attempts (after the initial transmit) per segment */
 #define SEG_RETRANSMIT_ATTEMPTS 1
 
 /* How long to wait for available buffers before giving up */
 #define BUF_TIMEOUT K_NO_WAIT
 
+/* Sessions are found through small hash tables, each bucket heads a
+ * chain of context indices linked through the contexts' hnext fields.
+ */
+#define SEG_HASH_BITS 4
+#define SEG_HASH_NONE 0xff
+
 static struct seg_tx
 {
 	struct bt_mesh_subnet *sub;
@@ -66,11 +82,60 @@ static struct seg_tx
 	u8_t seg_n : 5,	 /* Last segment index */
 		new_key : 1; /* New/old key */
 	u8_t nack_count; /* Number of unacked segs */
+	u8_t hnext;
+	u8_t ttl;
+	u8_t backoff : 3,	   /* Timeouts without an ack in between */
+		resent : 1,		   /* Segments went out more than once */
+		round_acked : 1;   /* Latest round already drove a resend */
+	u32_t round_end;	   /* When the latest segment went out */
+	struct bt_mesh_seg_rtt *rtt; /* Pinned until the context is reset */
 	const struct bt_mesh_send_cb *cb;
 	void *cb_data;
 	struct k_delayed_work retransmit; /* Retransmit timer */
 } seg_tx[CONFIG_BT_MESH_TX_SEG_MSG_COUNT];
 
+/* Round trip estimates, from the last segment going out to the block ack
+ * that answers it, per destination.
+ */
+static struct bt_mesh_seg_rtt seg_rtt[BT_MESH_SEG_RTT_COUNT];
+static u8_t seg_rtt_next;
+
+/* Keyed by SeqZero alone: a Friend may ack on behalf of the destination */
+static u8_t seg_tx_hash[1 << SEG_HASH_BITS] = {
+	[0 ...((1 << SEG_HASH_BITS) - 1)] = SEG_HASH_NONE,
+};
+
+/* Received segments wait in a pool shared by all RX contexts, so RAM
+ * goes with the segments in flight rather than contexts times the
+ * largest SDU. A context reserves a slot for each of its segments when
+ * it is allocated and can therefore always complete.
+ */
+#define SEG_SLOT_NONE 0xff
+#define SEG_SLOT_LEN 12
+
+BUILD_ASSERT(CONFIG_BT_MESH_RX_SEG_POOL_SIZE < SEG_SLOT_NONE);
+
+static struct seg_slot
+{
+	u8_t data[SEG_SLOT_LEN];
+	u8_t seg_o;
+	u8_t next;
+} seg_slot[CONFIG_BT_MESH_RX_SEG_POOL_SIZE];
+
+static struct
+{
+	u8_t free;		  /* Head of the free slot list */
+	u16_t unreserved; /* Slots no context has reserved */
+} seg_pool;
+
+enum seg_rx_state
+{
+	SEG_RX_NONE,		/* Nothing known about the session */
+	SEG_RX_IN_PROGRESS, /* A context is collecting its segments */
+	SEG_RX_COMPLETE,	/* SDU received, late segments get acked */
+	SEG_RX_REJECTED,	/* Canceled or superseded, segments are ignored */
+};
+
 static struct seg_rx
 {
 	struct bt_mesh_subnet *sub;
@@ -81,17 +146,50 @@ static struct seg_rx
 		obo : 1;
 	u8_t hdr;
 	u8_t ttl;
+	u8_t slots; /* Received segments, newest first */
+	u8_t hnext;
 	u16_t src;
 	u16_t dst;
+	u16_t len; /* SDU length, known once the last segment is in */
 	u32_t block;
+	u32_t start; /* First segment */
 	u32_t last;
 	struct k_delayed_work ack;
+} seg_rx[CONFIG_BT_MESH_RX_SEG_MSG_COUNT];
+
+/* Keyed by source and destination, which have one session at a time */
+static u8_t seg_rx_hash[1 << SEG_HASH_BITS] = {
+	[0 ...((1 << SEG_HASH_BITS) - 1)] = SEG_HASH_NONE,
+};
+
+/* Sessions that ended lately. Late segments of a complete SDU are still
+ * acked and those of a canceled one ignored, without holding a context.
+ */
+#define SEG_RX_DONE_COUNT (2 * CONFIG_BT_MESH_RX_SEG_MSG_COUNT)
+
+static struct seg_rx_done
+{
+	u32_t seq_auth; /* Low 8 bits of the IV Index and the sequence */
+	u16_t src;
+	u16_t dst;
+	u8_t seg_n : 5,
+		obo : 1,
+		state : 2;
+} seg_rx_done[SEG_RX_DONE_COUNT];
+
+static u8_t seg_rx_done_next;
+
+static struct bt_mesh_seg_stats seg_stats;
+
+/* Complete SDUs are put together here for the upper layers. Segments are
+ * only received from the network RX path, one at a time.
+ */
+static struct
+{
 	struct net_buf_simple buf;
-	u8_t buf_data[CONFIG_BT_MESH_RX_SDU_MAX];
-} seg_rx[CONFIG_BT_MESH_RX_SEG_MSG_COUNT] = {
-	[0 ...(CONFIG_BT_MESH_RX_SEG_MSG_COUNT - 1)] = {
-		.buf.size = CONFIG_BT_MESH_RX_SDU_MAX,
-	},
+	u8_t data[CONFIG_BT_MESH_RX_SDU_MAX] __net_buf_align;
+} seg_sdu = {
+	.buf.size = CONFIG_BT_MESH_RX_SDU_MAX,
 };
 
 static u16_t hb_sub_dst = BT_MESH_ADDR_UNASSIGNED;
@@ -163,14 +261,127 @@ bool bt_mesh_tx_in_progress(void)
 	return false;
 }
 
+static inline u8_t seg_hash(u16_t a, u16_t b)
+{
+	return (u16_t)((a ^ (b << 3)) * 40503U) >> (16 - SEG_HASH_BITS);
+}
+
+static bool seg_rtt_in_use(const struct bt_mesh_seg_rtt *rtt)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(seg_tx); i++)
+	{
+		if (seg_tx[i].rtt == rtt)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static struct bt_mesh_seg_rtt *seg_rtt_get(u16_t addr)
+{
+	struct bt_mesh_seg_rtt *rtt;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(seg_rtt); i++)
+	{
+		if (seg_rtt[i].addr == addr)
+		{
+			return &seg_rtt[i];
+		}
+	}
+
+	/* There are more estimates than TX contexts, so one is always free */
+	do
+	{
+		rtt = &seg_rtt[seg_rtt_next];
+		seg_rtt_next = (seg_rtt_next + 1) % ARRAY_SIZE(seg_rtt);
+	} while (seg_rtt_in_use(rtt));
+
+	memset(rtt, 0, sizeof(*rtt));
+	rtt->addr = addr;
+
+	return rtt;
+}
+
+/* Smoothed RTT and variation as in RFC 6298, in ms */
+static void seg_rtt_update(struct bt_mesh_seg_rtt *rtt, u32_t sample)
+{
+	u16_t r = min(sample, 0xffff);
+
+	if (!rtt->samples)
+	{
+		rtt->srtt = r;
+		rtt->rttvar = r / 2;
+	}
+	else
+	{
+		u16_t err = r > rtt->srtt ? r - rtt->srtt : rtt->srtt - r;
+
+		rtt->rttvar = (3 * rtt->rttvar + err) / 4;
+		rtt->srtt = (7 * rtt->srtt + r) / 8;
+	}
+
+	rtt->samples++;
+}
+
+static s32_t seg_rtt_rto(const struct bt_mesh_seg_rtt *rtt)
+{
+	if (!rtt->samples)
+	{
+		return SEG_RETRANSMIT_TIMEOUT;
+	}
+
+	return max(SEG_RTO_MIN, min(rtt->srtt + 4 * rtt->rttvar, SEG_RTO_MAX));
+}
+
+static s32_t seg_tx_rto(struct seg_tx *tx)
+{
+	return max(SEG_RTO_MIN + SEG_RTO_PER_HOP * tx->ttl,
+			   min(seg_rtt_rto(tx->rtt) << tx->backoff, SEG_RTO_MAX));
+}
+
+static u8_t *seg_tx_bucket(u16_t seq_zero)
+{
+	return &seg_tx_hash[seg_hash(seq_zero, 0)];
+}
+
+static void seg_tx_link(struct seg_tx *tx)
+{
+	u8_t *head = seg_tx_bucket(tx->seq_auth & 0x1fff);
+
+	tx->hnext = *head;
+	*head = tx - seg_tx;
+}
+
+static void seg_tx_unlink(struct seg_tx *tx)
+{
+	u8_t *i;
+
+	for (i = seg_tx_bucket(tx->seq_auth & 0x1fff); *i != SEG_HASH_NONE;
+		 i = &seg_tx[*i].hnext)
+	{
+		if (&seg_tx[*i] == tx)
+		{
+			*i = tx->hnext;
+			return;
+		}
+	}
+}
+
 static void seg_tx_reset(struct seg_tx *tx)
 {
 	int i;
 
 	k_delayed_work_cancel(&tx->retransmit);
+	seg_tx_unlink(tx);
 
 	tx->cb = NULL;
 	tx->cb_data = NULL;
+	tx->rtt = NULL;
 	tx->seq_auth = 0;
 	tx->sub = NULL;
 	tx->dst = BT_MESH_ADDR_UNASSIGNED;
@@ -238,7 +449,10 @@ static void seg_sent(int err, void *user_data)
 	}
 	else
 	{
-		k_delayed_work_submit(&tx->retransmit, SEG_RETRANSMIT_TIMEOUT);
+		/* The timer runs from the last segment of a round */
+		tx->round_end = k_uptime_get_32();
+		tx->round_acked = 0;
+		k_delayed_work_submit(&tx->retransmit, seg_tx_rto(tx));
 	}
 	/*[Genie end]*/
 }
@@ -252,6 +466,21 @@ static const struct bt_mesh_send_cb seg_sent_cb = {
 	.end = seg_sent,
 };
 
+static bool seg_tx_on_air(struct seg_tx *tx)
+{
+	int i;
+
+	for (i = 0; i <= tx->seg_n; i++)
+	{
+		if (tx->seg[i] && BT_MESH_ADV(tx->seg[i])->busy)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
 static void seg_tx_send_unacked(struct seg_tx *tx)
 {
 	int i, err;
@@ -280,6 +509,9 @@ static void seg_tx_send_unacked(struct seg_tx *tx)
 
 		BT_DBG("resending %u/%u", i, tx->seg_n);
 
+		tx->resent = 1;
+		seg_stats.tx_retransmit++;
+
 		err = bt_mesh_net_resend(tx->sub, seg, tx->new_key,
 								 &seg_sent_cb, tx);
 		if (err)
@@ -295,6 +527,13 @@ static void seg_retransmit(struct k_work *work)
 {
 	struct seg_tx *tx = CONTAINER_OF(work, struct seg_tx, retransmit);
 
+	/* No ack within the timeout: back off until the next one */
+	if (seg_tx_rto(tx) < SEG_RTO_MAX)
+	{
+		tx->backoff++;
+	}
+
+	seg_stats.tx_timeouts++;
 	seg_tx_send_unacked(tx);
 }
 
@@ -351,6 +590,16 @@ static int send_seg(struct bt_mesh_net_tx *net_tx, struct net_buf_simple *sdu,
 	tx->seg_n = (sdu->len - 1) / 12;
 	tx->nack_count = tx->seg_n + 1;
 	tx->seq_auth = SEQ_AUTH(BT_MESH_NET_IVI_TX, bt_mesh.seq);
+	seg_tx_link(tx);
+	tx->rtt = seg_rtt_get(tx->dst);
+	tx->ttl = net_tx->ctx->send_ttl;
+	if (tx->ttl == BT_MESH_TTL_DEFAULT)
+	{
+		tx->ttl = bt_mesh_default_ttl_get();
+	}
+	tx->backoff = 0;
+	tx->resent = 0;
+	tx->round_acked = 0;
 	tx->sub = net_tx->sub;
 	tx->new_key = net_tx->sub->kr_flag;
 	tx->cb = cb;
@@ -475,13 +724,14 @@ void bt_mesh_app_key_set_manual(u16_t net_idx, u16_t app_idx, uint8_t key_val[16
 	key->updated = false;
 	key->keys[0].id = aid;
 	memcpy(key->keys[0].val, key_val, 16);
+	bt_mesh_aes_key_set(&key->keys[0].sched, key_val);
 }
 #endif
 
 int bt_mesh_trans_send(struct bt_mesh_net_tx *tx, struct net_buf_simple *msg,
 					   const struct bt_mesh_send_cb *cb, void *cb_data)
 {
-	const u8_t *key;
+	const struct bt_mesh_aes_key *key;
 	u8_t *ad;
 	int err;
 
@@ -502,7 +752,7 @@ int bt_mesh_trans_send(struct bt_mesh_net_tx *tx, struct net_buf_simple *msg,
 
 	if (tx->ctx->app_idx == BT_MESH_KEY_DEV)
 	{
-		key = bt_mesh.dev_key;
+		key = &bt_mesh.dev_key_sched;
 		tx->aid = 0;
 	}
 	else
@@ -517,12 +767,12 @@ int bt_mesh_trans_send(struct bt_mesh_net_tx *tx, struct net_buf_simple *msg,
 		if (tx->sub->kr_phase == BT_MESH_KR_PHASE_2 &&
 			app_key->updated)
 		{
-			key = app_key->keys[1].val;
+			key = &app_key->keys[1].sched;
 			tx->aid = app_key->keys[1].id;
 		}
 		else
 		{
-			key = app_key->keys[0].val;
+			key = &app_key->keys[0].sched;
 			tx->aid = app_key->keys[0].id;
 		}
 	}
@@ -589,64 +839,335 @@ int bt_mesh_trans_resend(struct bt_mesh_net_tx *tx, struct net_buf_simple *msg,
 	return err;
 }
 
+/* Replay Protection List index. The entries themselves live in
+ * bt_mesh.rpl[], this keeps the used slots sorted by source address for
+ * binary search lookups plus an LRU list used to pick the entry to drop
+ * once the list is full. Slots which changed since they were last
+ * persisted are flagged in rpl_dirty.
+ */
+#define RPL_NONE 0xffff
+
+/* Longest time an RPL change waits before it is stored */
+#define RPL_STORE_TIMEOUT K_SECONDS(5)
+
+static struct
+{
+	u16_t sorted[CONFIG_BT_MESH_CRPL];
+	u16_t count;
+	u16_t prev[CONFIG_BT_MESH_CRPL];
+	u16_t next[CONFIG_BT_MESH_CRPL];
+	u16_t head; /* Most recently used */
+	u16_t tail; /* Least recently used */
+	bool stale;
+} rpl_idx = {
+	.head = RPL_NONE,
+	.tail = RPL_NONE,
+	.stale = true,
+};
+
+static ATOMIC_DEFINE(rpl_dirty, CONFIG_BT_MESH_CRPL);
+static struct k_delayed_work rpl_store;
+
+static void rpl_lru_unlink(u16_t slot)
+{
+	u16_t prev = rpl_idx.prev[slot];
+	u16_t next = rpl_idx.next[slot];
+
+	if (prev != RPL_NONE)
+	{
+		rpl_idx.next[prev] = next;
+	}
+	else
+	{
+		rpl_idx.head = next;
+	}
+
+	if (next != RPL_NONE)
+	{
+		rpl_idx.prev[next] = prev;
+	}
+	else
+	{
+		rpl_idx.tail = prev;
+	}
+}
+
+static void rpl_lru_push(u16_t slot)
+{
+	rpl_idx.prev[slot] = RPL_NONE;
+	rpl_idx.next[slot] = rpl_idx.head;
+
+	if (rpl_idx.head != RPL_NONE)
+	{
+		rpl_idx.prev[rpl_idx.head] = slot;
+	}
+	else
+	{
+		rpl_idx.tail = slot;
+	}
+
+	rpl_idx.head = slot;
+}
+
+/* Returns the position of src in the sorted index, or the position it
+ * would have to be inserted at if it is not there.
+ */
+static u16_t rpl_search(u16_t src, bool *found)
+{
+	u16_t lo = 0, hi = rpl_idx.count;
+
+	while (lo < hi)
+	{
+		u16_t mid = lo + (hi - lo) / 2;
+		u16_t mid_src = bt_mesh.rpl[rpl_idx.sorted[mid]].src;
+
+		if (mid_src == src)
+		{
+			*found = true;
+			return mid;
+		}
+
+		if (mid_src < src)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	*found = false;
+	return lo;
+}
+
+static void rpl_index_rebuild(void)
+{
+	u16_t i, pos;
+	bool found;
+
+	rpl_idx.count = 0;
+	rpl_idx.head = RPL_NONE;
+	rpl_idx.tail = RPL_NONE;
+
+	for (i = 0; i < ARRAY_SIZE(bt_mesh.rpl); i++)
+	{
+		if (!bt_mesh.rpl[i].src)
+		{
+			continue;
+		}
+
+		pos = rpl_search(bt_mesh.rpl[i].src, &found);
+		if (found)
+		{
+			/* Duplicate source, keep the first entry only */
+			memset(&bt_mesh.rpl[i], 0, sizeof(bt_mesh.rpl[i]));
+			atomic_set_bit(rpl_dirty, i);
+			continue;
+		}
+
+		memmove(&rpl_idx.sorted[pos + 1], &rpl_idx.sorted[pos],
+				(rpl_idx.count - pos) * sizeof(rpl_idx.sorted[0]));
+		rpl_idx.sorted[pos] = i;
+		rpl_idx.count++;
+
+		rpl_lru_push(i);
+	}
+
+	rpl_idx.stale = false;
+}
+
+static void rpl_mark_dirty(u16_t slot)
+{
+	atomic_set_bit(rpl_dirty, slot);
+
+	/* Do not push an armed store back, steady traffic would starve it */
+	if (!atomic_test_bit(rpl_store.work.flags, K_WORK_STATE_PENDING))
+	{
+		k_delayed_work_submit(&rpl_store, RPL_STORE_TIMEOUT);
+	}
+}
+
+static void rpl_update(u16_t slot, struct bt_mesh_net_rx *rx)
+{
+	struct bt_mesh_rpl *rpl = &bt_mesh.rpl[slot];
+
+	rpl->src = rx->ctx.addr;
+	rpl->seq = rx->seq;
+	rpl->old_iv = rx->old_iv;
+
+	rpl_mark_dirty(slot);
+}
+
 static bool is_replay(struct bt_mesh_net_rx *rx)
 {
-	static uint8_t index = 0;
-	int i = 0;
-	struct bt_mesh_rpl *rpl = NULL;
+	struct bt_mesh_rpl *rpl;
+	u16_t pos, slot;
+	bool found;
+
+	if (rpl_idx.stale)
+	{
+		rpl_index_rebuild();
+	}
+
+	pos = rpl_search(rx->ctx.addr, &found);
+	if (found)
+	{
+		slot = rpl_idx.sorted[pos];
+		rpl = &bt_mesh.rpl[slot];
+
+		if (rx->old_iv && !rpl->old_iv)
+		{
+			return true;
+		}
+
+		if ((rx->old_iv || !rpl->old_iv) && rpl->seq >= rx->seq)
+		{
+			return true;
+		}
+
+		rpl_update(slot, rx);
+
+		rpl_lru_unlink(slot);
+		rpl_lru_push(slot);
+
+		return false;
+	}
+
+	if (rpl_idx.count < ARRAY_SIZE(bt_mesh.rpl))
+	{
+		/* Unused slots are the ones with no source address */
+		for (slot = 0; bt_mesh.rpl[slot].src; slot++)
+		{
+		}
+	}
+	else
+	{
+		u16_t old_pos;
+		bool old_found;
+
+		/* Replace the least recently used source */
+		slot = rpl_idx.tail;
+
+		BT_WARN("RPL is full, replacing src 0x%04x",
+				bt_mesh.rpl[slot].src);
+
+		old_pos = rpl_search(bt_mesh.rpl[slot].src, &old_found);
+		memmove(&rpl_idx.sorted[old_pos], &rpl_idx.sorted[old_pos + 1],
+				(rpl_idx.count - old_pos - 1) * sizeof(rpl_idx.sorted[0]));
+		rpl_idx.count--;
+
+		rpl_lru_unlink(slot);
+
+		if (old_pos < pos)
+		{
+			pos--;
+		}
+	}
+
+	memmove(&rpl_idx.sorted[pos + 1], &rpl_idx.sorted[pos],
+			(rpl_idx.count - pos) * sizeof(rpl_idx.sorted[0]));
+	rpl_idx.sorted[pos] = slot;
+	rpl_idx.count++;
+
+	rpl_lru_push(slot);
+	rpl_update(slot, rx);
+
+	return false;
+}
+
+static void rpl_store_timeout(struct k_work *work)
+{
+	genie_event(GENIE_EVT_SDK_RPL_UPDATE, NULL);
+}
+
+void bt_mesh_rpl_store_pending(const struct bt_mesh_rpl_store_cb *cb)
+{
+	ATOMIC_DEFINE(stored, CONFIG_BT_MESH_CRPL);
+	u16_t i;
 
 	for (i = 0; i < ARRAY_SIZE(bt_mesh.rpl); i++)
 	{
-		rpl = &bt_mesh.rpl[i];
-		/* Empty slot */
-		if (!rpl->src)
+		if (atomic_test_bit(rpl_dirty, i))
+		{
+			break;
+		}
+	}
+
+	if (i == ARRAY_SIZE(bt_mesh.rpl))
+	{
+		return;
+	}
+
+	if (cb->begin && cb->begin())
+	{
+		k_delayed_work_submit(&rpl_store, RPL_STORE_TIMEOUT);
+		return;
+	}
+
+	memset(stored, 0, sizeof(stored));
+	for (; i < ARRAY_SIZE(bt_mesh.rpl); i++)
+	{
+		if (atomic_test_and_clear_bit(rpl_dirty, i))
 		{
-			rpl->src = rx->ctx.addr;
-			rpl->seq = rx->seq;
-			rpl->old_iv = rx->old_iv;
-			return false;
+			atomic_set_bit(stored, i);
+			cb->store(i, &bt_mesh.rpl[i]);
 		}
+	}
 
-		/* Existing slot for given address */
-		if (rpl->src == rx->ctx.addr)
+	if (cb->commit && cb->commit())
+	{
+		/* Nothing was stored, try again with whatever changed since */
+		for (i = 0; i < ARRAY_SIZE(bt_mesh.rpl); i++)
 		{
-			if (rx->old_iv && !rpl->old_iv)
+			if (atomic_test_bit(stored, i))
 			{
-				return true;
+				atomic_set_bit(rpl_dirty, i);
 			}
+		}
+
+		k_delayed_work_submit(&rpl_store, RPL_STORE_TIMEOUT);
+	}
+}
+
+void bt_mesh_rpl_restore(u16_t slot, const struct bt_mesh_rpl *rpl)
+{
+	if (slot >= ARRAY_SIZE(bt_mesh.rpl))
+	{
+		return;
+	}
+
+	memcpy(&bt_mesh.rpl[slot], rpl, sizeof(*rpl));
+	rpl_idx.stale = true;
+}
+
+void bt_mesh_rpl_reset(void)
+{
+	int i;
+
+	/* Discard "old old" IV Index entries from RPL and flag
+	 * any other ones (which are valid) as old.
+	 */
+	for (i = 0; i < ARRAY_SIZE(bt_mesh.rpl); i++)
+	{
+		struct bt_mesh_rpl *rpl = &bt_mesh.rpl[i];
 
-			if ((!rx->old_iv && rpl->old_iv) ||
-				rpl->seq < rx->seq)
+		if (rpl->src)
+		{
+			if (rpl->old_iv)
 			{
-				rpl->seq = rx->seq;
-				rpl->old_iv = rx->old_iv;
-				return false;
+				memset(rpl, 0, sizeof(*rpl));
 			}
 			else
 			{
-				return true;
+				rpl->old_iv = true;
 			}
+
+			rpl_mark_dirty(i);
 		}
 	}
 
-	/*
-[genie begin] changed by lgy at 2020-12-09
-overlap rpl when it is full
-*/
-	BT_WARN("RPL is full:%d", index);
-
-	rpl = &bt_mesh.rpl[index];
-	rpl->src = rx->ctx.addr;
-	rpl->seq = rx->seq;
-	rpl->old_iv = rx->old_iv;
-
-	index++;
-	index = index % CONFIG_BT_MESH_CRPL;
-
-	return false;
-	/*
-[genie end] changed by lgy at 2020-12-09
-*/
+	rpl_idx.stale = true;
 }
 
 static int sdu_recv(struct bt_mesh_net_rx *rx, u8_t hdr, u8_t aszmic,
@@ -687,18 +1208,9 @@ static int sdu_recv(struct bt_mesh_net_rx *rx, u8_t hdr, u8_t aszmic,
 
 	if (!AKF(&hdr))
 	{
-		u8_t *dev_key = NULL;
 		net_buf_simple_init(sdu, 0);
 
-		dev_key = bt_mesh.dev_key;
-
-		if (!dev_key)
-		{
-			BT_DBG("%s: get NULL dev_key", __func__);
-			return -EINVAL;
-		}
-
-		err = bt_mesh_app_decrypt(dev_key, true, aszmic, buf,
+		err = bt_mesh_app_decrypt(&bt_mesh.dev_key_sched, true, aszmic, buf,
 								  sdu, ad, rx->ctx.addr, rx->dst,
 								  rx->seq, BT_MESH_NET_IVI_RX(rx));
 		if (err)
@@ -747,7 +1259,7 @@ static int sdu_recv(struct bt_mesh_net_rx *rx, u8_t hdr, u8_t aszmic,
 		}
 
 		net_buf_simple_init(sdu, 0);
-		err = bt_mesh_app_decrypt(keys->val, false, aszmic, buf,
+		err = bt_mesh_app_decrypt(&keys->sched, false, aszmic, buf,
 								  sdu, ad, rx->ctx.addr, rx->dst,
 								  rx->seq, BT_MESH_NET_IVI_RX(rx));
 		if (err)
@@ -770,9 +1282,9 @@ static int sdu_recv(struct bt_mesh_net_rx *rx, u8_t hdr, u8_t aszmic,
 static struct seg_tx *seg_tx_lookup(u16_t seq_zero, u8_t obo, u16_t addr)
 {
 	struct seg_tx *tx;
-	int i;
+	u8_t i;
 
-	for (i = 0; i < ARRAY_SIZE(seg_tx); i++)
+	for (i = *seg_tx_bucket(seq_zero); i != SEG_HASH_NONE; i = tx->hnext)
 	{
 		tx = &seg_tx[i];
 
@@ -890,7 +1402,13 @@ static int trans_ack(struct bt_mesh_net_rx *rx, u8_t hdr,
 		return -EINVAL;
 	}
 
-	k_delayed_work_cancel(&tx->retransmit);
+	/* Only acks for rounds nothing was resent in tell which round they
+	 * answer (Karn's algorithm).
+	 */
+	if (!tx->resent && !tx->round_acked && !seg_tx_on_air(tx))
+	{
+		seg_rtt_update(tx->rtt, k_uptime_get_32() - tx->round_end);
+	}
 
 	while ((bit = find_lsb_set(ack)))
 	{
@@ -905,16 +1423,29 @@ static int trans_ack(struct bt_mesh_net_rx *rx, u8_t hdr,
 		ack &= ~MESH_BIT(bit - 1);
 	}
 
-	if (tx->nack_count)
-	{
-		seg_tx_send_unacked(tx);
-	}
-	else
+	tx->backoff = 0;
+
+	if (!tx->nack_count)
 	{
 		BT_DBG("SDU TX complete");
 		seg_tx_complete(tx, 0);
+		return 0;
 	}
 
+	/* Resend what the block ack misses once per round. Acks that cross
+	 * segments still on air, or repeat one already acted on, leave it
+	 * to the retransmit timer.
+	 */
+	if (tx->round_acked || seg_tx_on_air(tx))
+	{
+		return 0;
+	}
+
+	tx->round_acked = 1;
+	k_delayed_work_cancel(&tx->retransmit);
+	seg_stats.tx_ack_resends++;
+	seg_tx_send_unacked(tx);
+
 	return 0;
 }
 
@@ -1070,6 +1601,7 @@ static int trans_unseg(struct net_buf_simple *buf, struct bt_mesh_net_rx *rx,
 		/* SDUs must match a local element or an LPN of this Friend. */
 		if (!rx->local_match && !rx->friend_match)
 		{
+			bt_mesh_sub_skipped(rx->dst, buf->len);
 			return 0;
 		}
 
@@ -1114,6 +1646,9 @@ int bt_mesh_ctl_send(struct bt_mesh_net_tx *tx, u8_t ctl_op, void *data,
 		return -ENOBUFS;
 	}
 
+	/* Acks, polls and friendship messages have timing windows */
+	BT_MESH_ADV(buf)->prio = BT_MESH_ADV_PRIO_CTL;
+
 	net_buf_reserve(buf, BT_MESH_NET_HDR_LEN);
 
 	net_buf_add_u8(buf, TRANS_CTL_HDR(ctl_op, 0));
@@ -1200,6 +1735,138 @@ static int send_ack(struct bt_mesh_subnet *sub, u16_t src, u16_t dst,
 							NULL, NULL, NULL);
 }
 
+static inline u8_t seg_len(bool ctl)
+{
+	if (ctl)
+	{
+		return 8;
+	}
+	else
+	{
+		return 12;
+	}
+}
+
+static void seg_pool_init(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(seg_slot); i++)
+	{
+		seg_slot[i].next = i + 1 < ARRAY_SIZE(seg_slot) ? i + 1 : SEG_SLOT_NONE;
+	}
+
+	seg_pool.free = 0;
+	seg_pool.unreserved = ARRAY_SIZE(seg_slot);
+}
+
+static bool seg_pool_reserve(u8_t seg_n)
+{
+	u16_t used;
+
+	if (seg_pool.unreserved < seg_n + 1)
+	{
+		seg_stats.pool_rejected++;
+		return false;
+	}
+
+	seg_pool.unreserved -= seg_n + 1;
+
+	used = ARRAY_SIZE(seg_slot) - seg_pool.unreserved;
+	seg_stats.pool_peak = max(seg_stats.pool_peak, used);
+
+	return true;
+}
+
+static void seg_pool_release(struct seg_rx *rx)
+{
+	u8_t i, next;
+
+	for (i = rx->slots; i != SEG_SLOT_NONE; i = next)
+	{
+		next = seg_slot[i].next;
+		seg_slot[i].next = seg_pool.free;
+		seg_pool.free = i;
+	}
+
+	rx->slots = SEG_SLOT_NONE;
+	seg_pool.unreserved += rx->seg_n + 1;
+}
+
+static void seg_rx_store(struct seg_rx *rx, u8_t seg_o,
+						 struct net_buf_simple *buf)
+{
+	/* Never empty: the context reserved a slot for each segment */
+	u8_t i = seg_pool.free;
+
+	seg_pool.free = seg_slot[i].next;
+
+	memcpy(seg_slot[i].data, buf->data, buf->len);
+	seg_slot[i].seg_o = seg_o;
+	seg_slot[i].next = rx->slots;
+	rx->slots = i;
+}
+
+/* Give back the segment stored last */
+static void seg_rx_unstore(struct seg_rx *rx)
+{
+	u8_t i = rx->slots;
+
+	rx->slots = seg_slot[i].next;
+	seg_slot[i].next = seg_pool.free;
+	seg_pool.free = i;
+}
+
+static struct net_buf_simple *seg_rx_assemble(struct seg_rx *rx)
+{
+	u8_t len = seg_len(rx->ctl);
+	u8_t i;
+
+	net_buf_simple_init(&seg_sdu.buf, 0);
+	seg_sdu.buf.len = rx->len;
+
+	/* Location in the SDU follows from seg_o and rx->ctl, only the
+	 * last segment can be short.
+	 */
+	for (i = rx->slots; i != SEG_SLOT_NONE; i = seg_slot[i].next)
+	{
+		u16_t off = seg_slot[i].seg_o * len;
+
+		memcpy(seg_sdu.buf.data + off, seg_slot[i].data,
+			   min(len, rx->len - off));
+	}
+
+	return &seg_sdu.buf;
+}
+
+static u8_t *seg_rx_bucket(u16_t src, u16_t dst)
+{
+	return &seg_rx_hash[seg_hash(src, dst)];
+}
+
+static void seg_rx_link(struct seg_rx *rx)
+{
+	u8_t *head = seg_rx_bucket(rx->src, rx->dst);
+
+	rx->hnext = *head;
+	*head = rx - seg_rx;
+}
+
+static void seg_rx_unlink(struct seg_rx *rx)
+{
+	u8_t *i;
+
+	for (i = seg_rx_bucket(rx->src, rx->dst); *i != SEG_HASH_NONE;
+		 i = &seg_rx[*i].hnext)
+	{
+		if (&seg_rx[*i] == rx)
+		{
+			*i = rx->hnext;
+			return;
+		}
+	}
+}
+
 static void seg_rx_reset(struct seg_rx *rx)
 {
 	BT_DBG("rx %p", rx);
@@ -1214,14 +1881,45 @@ static void seg_rx_reset(struct seg_rx *rx)
 										&rx->seq_auth);
 	}
 
-	/* We don't reset rx->net and rx->seq_auth here since we need to
-	 * be able to send an ack if we receive a segment after we've
-	 * already received the full SDU.
-	 */
+	if (rx->in_use)
+	{
+		seg_pool_release(rx);
+		seg_rx_unlink(rx);
+	}
 
 	rx->in_use = 0;
 }
 
+/* Free the context, remembering how the session ended */
+static void seg_rx_end(struct seg_rx *rx, enum seg_rx_state state)
+{
+	struct seg_rx_done *done = &seg_rx_done[seg_rx_done_next];
+	u32_t time = k_uptime_get_32() - rx->start;
+
+	seg_rx_done_next = (seg_rx_done_next + 1) % ARRAY_SIZE(seg_rx_done);
+
+	done->seq_auth = rx->seq_auth;
+	done->src = rx->src;
+	done->dst = rx->dst;
+	done->seg_n = rx->seg_n;
+	done->obo = rx->obo;
+	done->state = state;
+
+	if (state == SEG_RX_COMPLETE)
+	{
+		seg_stats.rx_complete++;
+		seg_stats.rx_latency_max = max(seg_stats.rx_latency_max, time);
+		seg_stats.rx_latency_hist[min(find_msb_set(time),
+									  BT_MESH_SEG_LATENCY_HIST - 1)]++;
+	}
+	else
+	{
+		seg_stats.rx_canceled++;
+	}
+
+	seg_rx_reset(rx);
+}
+
 static void seg_ack(struct k_work *work)
 {
 	struct seg_rx *rx = CONTAINER_OF(work, struct seg_rx, ack);
@@ -1233,7 +1931,7 @@ static void seg_ack(struct k_work *work)
 		BT_WARN("Incomplete timer expired");
 		send_ack(rx->sub, rx->dst, rx->src, rx->ttl,
 				 &rx->seq_auth, 0, rx->obo);
-		seg_rx_reset(rx);
+		seg_rx_end(rx, SEG_RX_REJECTED);
 		return;
 	}
 
@@ -1243,58 +1941,73 @@ static void seg_ack(struct k_work *work)
 	k_delayed_work_submit(&rx->ack, ack_timeout(rx));
 }
 
-static inline u8_t seg_len(bool ctl)
-{
-	if (ctl)
-	{
-		return 8;
-	}
-	else
-	{
-		return 12;
-	}
-}
-
 static inline bool sdu_len_is_ok(bool ctl, u8_t seg_n)
 {
 	return ((seg_n * seg_len(ctl) + 1) <= CONFIG_BT_MESH_RX_SDU_MAX);
 }
 
-static struct seg_rx *seg_rx_find(struct bt_mesh_net_rx *net_rx,
-								  const u64_t *seq_auth)
+static enum seg_rx_state seg_rx_find(struct bt_mesh_net_rx *net_rx,
+									 const u64_t *seq_auth,
+									 struct seg_rx **rx,
+									 const struct seg_rx_done **done)
 {
-	int i;
+	struct seg_rx *cur = NULL;
+	u8_t i;
 
-	for (i = 0; i < ARRAY_SIZE(seg_rx); i++)
+	*rx = NULL;
+	*done = NULL;
+
+	for (i = *seg_rx_bucket(net_rx->ctx.addr, net_rx->dst);
+		 i != SEG_HASH_NONE; i = cur->hnext)
 	{
-		struct seg_rx *rx = &seg_rx[i];
+		cur = &seg_rx[i];
 
-		if (rx->src != net_rx->ctx.addr || rx->dst != net_rx->dst)
+		if (cur->src == net_rx->ctx.addr && cur->dst == net_rx->dst)
 		{
-			continue;
+			break;
 		}
+	}
 
-		if (rx->seq_auth == *seq_auth)
-		{
-			return rx;
-		}
+	if (i == SEG_HASH_NONE)
+	{
+		cur = NULL;
+	}
+	else if (cur->seq_auth == *seq_auth)
+	{
+		*rx = cur;
+		return SEG_RX_IN_PROGRESS;
+	}
 
-		if (rx->in_use)
+	for (i = 0; i < ARRAY_SIZE(seg_rx_done); i++)
+	{
+		if (seg_rx_done[i].state != SEG_RX_NONE &&
+			seg_rx_done[i].seq_auth == (u32_t)*seq_auth &&
+			seg_rx_done[i].src == net_rx->ctx.addr &&
+			seg_rx_done[i].dst == net_rx->dst)
 		{
-			BT_DBG("Duplicate SDU from src 0x%04x",
-					net_rx->ctx.addr);
+			*done = &seg_rx_done[i];
+			return seg_rx_done[i].state;
+		}
+	}
 
-			/* Clear out the old context since the sender
-			 * has apparently started sending a new SDU.
-			 */
-			seg_rx_reset(rx);
+	if (!cur)
+	{
+		return SEG_RX_NONE;
+	}
 
-			/* Return non-match so caller can re-allocate */
-			return NULL;
-		}
+	/* A late segment of an SDU the sender has given up on */
+	if (cur->seq_auth > *seq_auth)
+	{
+		return SEG_RX_REJECTED;
 	}
 
-	return NULL;
+	/* The sender has started a new SDU, so the old one will not be
+	 * completed.
+	 */
+	BT_DBG("New SDU from src 0x%04x", net_rx->ctx.addr);
+	seg_rx_end(cur, SEG_RX_REJECTED);
+
+	return SEG_RX_NONE;
 }
 
 static bool seg_rx_is_valid(struct seg_rx *rx, struct bt_mesh_net_rx *net_rx,
@@ -1336,8 +2049,14 @@ static struct seg_rx *seg_rx_alloc(struct bt_mesh_net_rx *net_rx,
 			continue;
 		}
 
+		if (!seg_pool_reserve(seg_n))
+		{
+			return NULL;
+		}
+
 		rx->in_use = 1;
-		net_buf_simple_init(&rx->buf, 0);
+		rx->slots = SEG_SLOT_NONE;
+		rx->len = 0;
 		rx->sub = net_rx->sub;
 		rx->ctl = net_rx->ctl;
 		rx->seq_auth = *seq_auth;
@@ -1347,6 +2066,8 @@ static struct seg_rx *seg_rx_alloc(struct bt_mesh_net_rx *net_rx,
 		rx->src = net_rx->ctx.addr;
 		rx->dst = net_rx->dst;
 		rx->block = 0;
+		rx->start = k_uptime_get_32();
+		seg_rx_link(rx);
 
 		BT_DBG("New RX context. Block Complete 0x%08x",
 			   BLOCK_COMPLETE(seg_n));
@@ -1360,7 +2081,8 @@ static struct seg_rx *seg_rx_alloc(struct bt_mesh_net_rx *net_rx,
 static int trans_seg(struct net_buf_simple *buf, struct bt_mesh_net_rx *net_rx,
 					 enum bt_mesh_friend_pdu_type *pdu_type, u64_t *seq_auth)
 {
-	struct seg_rx *rx;
+	const struct seg_rx_done *done = NULL;
+	struct seg_rx *rx = NULL;
 	u8_t *hdr = buf->data;
 	u16_t seq_zero;
 	u8_t seg_n;
@@ -1396,35 +2118,38 @@ static int trans_seg(struct net_buf_simple *buf, struct bt_mesh_net_rx *net_rx,
 						 (net_rx->seq & 0xffffe000) | seq_zero);
 
 	/* Look for old RX sessions */
-	rx = seg_rx_find(net_rx, seq_auth);
-	if (rx)
+	switch (seg_rx_find(net_rx, seq_auth, &rx, &done))
 	{
+	case SEG_RX_IN_PROGRESS:
 		if (!seg_rx_is_valid(rx, net_rx, hdr, seg_n))
 		{
 			return -EINVAL;
 		}
 
-		if (rx->in_use)
+		BT_DBG("Existing RX context. Block 0x%08x", rx->block);
+		goto found_rx;
+	case SEG_RX_COMPLETE:
+		if (done->seg_n != seg_n)
 		{
-			BT_DBG("Existing RX context. Block 0x%08x", rx->block);
-			goto found_rx;
-		}
-
-		if (rx->block == BLOCK_COMPLETE(rx->seg_n))
-		{
-			BT_DBG("Got segment for already complete SDU");
-			send_ack(net_rx->sub, net_rx->dst, net_rx->ctx.addr,
-					 net_rx->ctx.send_ttl, seq_auth, rx->block,
-					 rx->obo);
-			return -EALREADY;
+			BT_ERR("Invalid segment for complete session");
+			return -EINVAL;
 		}
 
+		BT_DBG("Got segment for already complete SDU");
+		seg_stats.rx_dup_acked++;
+		send_ack(net_rx->sub, net_rx->dst, net_rx->ctx.addr,
+				 net_rx->ctx.send_ttl, seq_auth, BLOCK_COMPLETE(seg_n),
+				 done->obo);
+		return -EALREADY;
+	case SEG_RX_REJECTED:
 		/* We ignore instead of sending block ack 0 since the
 		 * ack timer is always smaller than the incomplete
 		 * timer, i.e. the sender is misbehaving.
 		 */
 		BT_WARN("Got segment for canceled SDU");
 		return -EINVAL;
+	default:
+		break;
 	}
 
 	/* Bail out early if we're not ready to receive such a large SDU */
@@ -1465,16 +2190,16 @@ found_rx:
 	if (seg_o == seg_n)
 	{
 		/* Set the expected final buffer length */
-		rx->buf.len = seg_n * seg_len(rx->ctl) + buf->len;
+		rx->len = seg_n * seg_len(rx->ctl) + buf->len;
 		BT_DBG("Target len %u * %u + %u = %u", seg_n, seg_len(rx->ctl),
-			   buf->len, rx->buf.len);
+			   buf->len, rx->len);
 
-		if (rx->buf.len > CONFIG_BT_MESH_RX_SDU_MAX)
+		if (rx->len > CONFIG_BT_MESH_RX_SDU_MAX)
 		{
 			BT_ERR("Too large SDU len");
 			send_ack(net_rx->sub, net_rx->dst, net_rx->ctx.addr,
 					 net_rx->ctx.send_ttl, seq_auth, 0, rx->obo);
-			seg_rx_reset(rx);
+			seg_rx_end(rx, SEG_RX_REJECTED);
 			return -EMSGSIZE;
 		}
 	}
@@ -1496,8 +2221,7 @@ found_rx:
 		k_delayed_work_submit(&rx->ack, ack_timeout(rx));
 	}
 
-	/* Location in buffer can be calculated based on seg_o & rx->ctl */
-	memcpy(rx->buf_data + (seg_o * seg_len(rx->ctl)), buf->data, buf->len);
+	seg_rx_store(rx, seg_o, buf);
 
 	BT_DBG("Received %u/%u", seg_o, seg_n);
 
@@ -1518,6 +2242,7 @@ found_rx:
 				net_rx->ctx.addr, net_rx->dst, net_rx->seq);
 		/* Clear the segment's bit */
 		rx->block &= ~MESH_BIT(seg_o);
+		seg_rx_unstore(rx);
 		return -EINVAL;
 	}
 
@@ -1537,14 +2262,14 @@ found_rx:
 
 	if (net_rx->ctl)
 	{
-		err = ctl_recv(net_rx, *hdr, &rx->buf, seq_auth);
+		err = ctl_recv(net_rx, *hdr, seg_rx_assemble(rx), seq_auth);
 	}
 	else
 	{
-		err = sdu_recv(net_rx, *hdr, ASZMIC(hdr), &rx->buf);
+		err = sdu_recv(net_rx, *hdr, ASZMIC(hdr), seg_rx_assemble(rx));
 	}
 
-	seg_rx_reset(rx);
+	seg_rx_end(rx, SEG_RX_COMPLETE);
 
 	return err;
 }
@@ -1601,6 +2326,7 @@ int bt_mesh_trans_recv(struct net_buf_simple *buf, struct bt_mesh_net_rx *rx)
 		 */
 		if (!rx->local_match && !rx->friend_match)
 		{
+			bt_mesh_sub_skipped(rx->dst, buf->len);
 			return 0;
 		}
 
@@ -1651,6 +2377,36 @@ int bt_mesh_trans_recv(struct net_buf_simple *buf, struct bt_mesh_net_rx *rx)
 	return err;
 }
 
+void bt_mesh_seg_stats_get(struct bt_mesh_seg_stats *stats)
+{
+	*stats = seg_stats;
+	stats->pool_size = ARRAY_SIZE(seg_slot);
+	stats->pool_used = ARRAY_SIZE(seg_slot) - seg_pool.unreserved;
+}
+
+int bt_mesh_seg_rtt_get(struct bt_mesh_seg_rtt rtt[BT_MESH_SEG_RTT_COUNT])
+{
+	int i, count = 0;
+
+	for (i = 0; i < ARRAY_SIZE(seg_rtt); i++)
+	{
+		if (seg_rtt[i].samples)
+		{
+			rtt[count] = seg_rtt[i];
+			rtt[count].rto = seg_rtt_rto(&seg_rtt[i]);
+			count++;
+		}
+	}
+
+	return count;
+}
+
+void bt_mesh_seg_stats_reset(void)
+{
+	memset(&seg_stats, 0, sizeof(seg_stats));
+	seg_stats.pool_peak = ARRAY_SIZE(seg_slot) - seg_pool.unreserved;
+}
+
 void bt_mesh_rx_reset(void)
 {
 	int i;
@@ -1660,9 +2416,9 @@ void bt_mesh_rx_reset(void)
 	for (i = 0; i < ARRAY_SIZE(seg_rx); i++)
 	{
 		seg_rx_reset(&seg_rx[i]);
-		seg_rx[i].src = BT_MESH_ADDR_UNASSIGNED;
-		seg_rx[i].dst = BT_MESH_ADDR_UNASSIGNED;
 	}
+
+	memset(seg_rx_done, 0, sizeof(seg_rx_done));
 }
 
 void bt_mesh_tx_reset(void)
@@ -1690,10 +2446,26 @@ void bt_mesh_trans_init(void)
 	{
 		k_delayed_work_init(&seg_rx[i].ack, seg_ack);
 	}
+
+	seg_pool_init();
+
+	k_delayed_work_init(&rpl_store, rpl_store_timeout);
 }
 
 void bt_mesh_rpl_clear(void)
 {
+	int i;
+
 	BT_DBG("");
+
+	for (i = 0; i < ARRAY_SIZE(bt_mesh.rpl); i++)
+	{
+		if (bt_mesh.rpl[i].src)
+		{
+			rpl_mark_dirty(i);
+		}
+	}
+
 	memset(bt_mesh.rpl, 0, sizeof(bt_mesh.rpl));
+	rpl_idx.stale = true;
 }
@@ -78,13 +78,14 @@ __attribute__((weak)) void krhino_idle_pre_hook(void)
 
 __attribute__((weak)) int32_t _sleep_tick_get()
 {
-    if (is_klist_empty(&g_tick_head))
+    tick_t ticks = krhino_next_sleep_ticks_get();
+
+    if (ticks == RHINO_WAIT_FOREVER)
     {
         return -1;
     }
 
-    ktask_t * p_tcb  = krhino_list_entry(g_tick_head.next, ktask_t, tick_list);
-    return  p_tcb->tick_match > g_tick_count ?  p_tcb->tick_match - g_tick_count : 0;
+    return (int32_t)ticks;
 }
 
 
@@ -144,4 +144,5 @@ endif
 
 GLOBAL_CFLAGS += -D_RTE_ -DARMCM0 -DCFG_CP -DCFG_QFN32 -DCFG_SLEEP_MODE="PWR_MODE_NO_SLEEP" -DDEBUG_INFO="1"
 GLOBAL_DEFINES += CONFIG_BT_MESH_ADV_BUF_COUNT=20
+GLOBAL_DEFINES += CONFIG_BT_MESH_RX_SEG_MSG_COUNT=8 CONFIG_BT_MESH_RX_SEG_POOL_SIZE=64
 GLOBAL_DEFINES += CONFIG_BT_HARD_ECC
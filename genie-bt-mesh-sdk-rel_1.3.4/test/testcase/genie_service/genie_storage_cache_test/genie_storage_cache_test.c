@@ -0,0 +1,280 @@
+/*
+ * Copyright (C) 2015-2019 Alibaba Group Holding Limited
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <yunit.h>
+#include <yts.h>
+
+#include <aos/kernel.h>
+#include <aos/kv.h>
+
+#include "genie_mesh_internal.h"
+
+/*
+ * Writes reliable records through the write-back cache and looks at the
+ * kv store under it: writes to a record are coalesced until a flush, dirty
+ * slots are written back when they are evicted, a flush or a sequence
+ * number save puts every pending record on flash, and what went to flash
+ * reads back through a cold cache.
+ * The records use indexes no service record takes and are deleted after
+ * every case; the sequence number saved on flash is put back as it was.
+ */
+
+#define CACHE_INDEX_BASE 0x7f00
+
+/* More records than cache slots, so that some of them are evicted */
+#define CACHE_RECORD_COUNT (CONFIG_GENIE_STORAGE_CACHE_COUNT + 4)
+
+#define CACHE_RECORD_SIZE 20
+
+/* Too big for a slot, goes to flash on every write */
+#define CACHE_BIG_SIZE (GENIE_STORAGE_CACHE_RECORD_MAX + 8)
+
+static void cache_fill(uint8_t *p_data, uint16_t size, uint8_t value)
+{
+    uint16_t i;
+
+    for (i = 0; i < size; i++) {
+        p_data[i] = value + i;
+    }
+}
+
+static int cache_write(uint16_t index, uint8_t value)
+{
+    uint8_t data[CACHE_RECORD_SIZE];
+
+    cache_fill(data, sizeof(data), value);
+
+    return genie_storage_write_reliable(index, data, sizeof(data));
+}
+
+/* The record reads back as written with the given value */
+static int cache_check(uint16_t index, uint8_t value)
+{
+    uint8_t data[CACHE_RECORD_SIZE];
+    uint8_t expect[CACHE_RECORD_SIZE];
+
+    if (genie_storage_read_reliable(index, data, sizeof(data)) != GENIE_STORAGE_SUCCESS) {
+        return 0;
+    }
+
+    cache_fill(expect, sizeof(expect), value);
+
+    return memcmp(data, expect, sizeof(data)) == 0;
+}
+
+/* Whether the record is on flash, whatever the cache holds */
+static int cache_on_flash(uint16_t index)
+{
+    uint8_t data[GENIE_STORAGE_CACHE_RECORD_MAX * 2];
+    char key[10];
+    int len = sizeof(data);
+
+    snprintf(key, sizeof(key), "key_%d", index);
+
+    return aos_kv_get(key, data, &len) == 0;
+}
+
+static void cache_flash_del(uint16_t index)
+{
+    char key[10];
+
+    snprintf(key, sizeof(key), "key_%d", index);
+    aos_kv_del(key);
+}
+
+/* Writes to a record stay in its slot until the flush, which writes the
+ * last of them once; rewriting what is cached is no write at all.
+ */
+static void test_cache_coalesce(void)
+{
+    uint16_t index = CACHE_INDEX_BASE;
+    uint8_t value;
+
+    for (value = 1; value <= 5; value++) {
+        YUNIT_ASSERT_EQUAL(cache_write(index, value), GENIE_STORAGE_SUCCESS);
+        YUNIT_ASSERT(!cache_on_flash(index));
+    }
+    YUNIT_ASSERT(cache_check(index, 5));
+
+    YUNIT_ASSERT_EQUAL(genie_storage_flush(), GENIE_STORAGE_SUCCESS);
+    YUNIT_ASSERT(cache_on_flash(index));
+
+    /* With the flash copy gone behind its back, the clean slot shows
+     * whether the rewrite dirtied it again.
+     */
+    cache_flash_del(index);
+    YUNIT_ASSERT_EQUAL(cache_write(index, 5), GENIE_STORAGE_SUCCESS);
+    YUNIT_ASSERT_EQUAL(genie_storage_flush(), GENIE_STORAGE_SUCCESS);
+    YUNIT_ASSERT(!cache_on_flash(index));
+
+    YUNIT_ASSERT_EQUAL(cache_write(index, 6), GENIE_STORAGE_SUCCESS);
+    YUNIT_ASSERT_EQUAL(genie_storage_flush(), GENIE_STORAGE_SUCCESS);
+    YUNIT_ASSERT(cache_on_flash(index));
+}
+
+/* With every slot dirty, a new record writes back the oldest one first */
+static void test_cache_evict_dirty(void)
+{
+    int i;
+
+    for (i = 0; i < CACHE_RECORD_COUNT; i++) {
+        YUNIT_ASSERT_EQUAL(cache_write(CACHE_INDEX_BASE + i, i), GENIE_STORAGE_SUCCESS);
+    }
+
+    for (i = 0; i < CACHE_RECORD_COUNT; i++) {
+        YUNIT_ASSERT_EQUAL(cache_on_flash(CACHE_INDEX_BASE + i),
+                           (i < CACHE_RECORD_COUNT - CONFIG_GENIE_STORAGE_CACHE_COUNT));
+    }
+
+    YUNIT_ASSERT_EQUAL(genie_storage_flush(), GENIE_STORAGE_SUCCESS);
+
+    /* The evicted ones come back from flash, decrypted */
+    for (i = 0; i < CACHE_RECORD_COUNT; i++) {
+        YUNIT_ASSERT(cache_on_flash(CACHE_INDEX_BASE + i));
+        YUNIT_ASSERT(cache_check(CACHE_INDEX_BASE + i, i));
+    }
+}
+
+/* A flush writes every dirty slot, and what it wrote reads back once the
+ * records have left the cache.
+ */
+static void test_cache_flush_all(void)
+{
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        YUNIT_ASSERT_EQUAL(cache_write(CACHE_INDEX_BASE + i, 0x40 + i), GENIE_STORAGE_SUCCESS);
+    }
+    YUNIT_ASSERT_EQUAL(genie_storage_flush(), GENIE_STORAGE_SUCCESS);
+
+    for (i = 0; i < 3; i++) {
+        YUNIT_ASSERT(cache_on_flash(CACHE_INDEX_BASE + i));
+    }
+
+    /* Writing other records pushes these out of the clean slots */
+    for (i = 3; i < CACHE_RECORD_COUNT; i++) {
+        YUNIT_ASSERT_EQUAL(cache_write(CACHE_INDEX_BASE + i, i), GENIE_STORAGE_SUCCESS);
+    }
+    YUNIT_ASSERT_EQUAL(genie_storage_flush(), GENIE_STORAGE_SUCCESS);
+
+    for (i = 0; i < 3; i++) {
+        YUNIT_ASSERT(cache_check(CACHE_INDEX_BASE + i, 0x40 + i));
+    }
+}
+
+/* The sequence number is not cached, and saving it writes the pending
+ * records first, so that flash never has a newer sequence number than
+ * the keys it goes with.
+ */
+static void test_cache_seq_barrier(void)
+{
+    uint32_t seq_saved = 0;
+    uint32_t seq = 0x123456;
+    int len = sizeof(seq_saved);
+    int saved;
+
+    saved = aos_kv_get(GENIE_KV_SEQ_KEY, &seq_saved, &len) == 0;
+
+    YUNIT_ASSERT_EQUAL(cache_write(CACHE_INDEX_BASE, 0x21), GENIE_STORAGE_SUCCESS);
+    YUNIT_ASSERT(!cache_on_flash(CACHE_INDEX_BASE));
+
+    YUNIT_ASSERT_EQUAL(genie_storage_write_seq(&seq, true), GENIE_STORAGE_SUCCESS);
+    YUNIT_ASSERT(cache_on_flash(CACHE_INDEX_BASE));
+
+    seq = 0;
+    len = sizeof(seq);
+    YUNIT_ASSERT_EQUAL(aos_kv_get(GENIE_KV_SEQ_KEY, &seq, &len), 0);
+    YUNIT_ASSERT(seq == (0x123456 | ((uint32_t)GENIE_SEQ_MAGIC_NUMBER << 24)));
+
+    if (saved) {
+        aos_kv_set(GENIE_KV_SEQ_KEY, &seq_saved, sizeof(seq_saved), 1);
+    } else {
+        aos_kv_del(GENIE_KV_SEQ_KEY);
+    }
+}
+
+/* Pending records go to flash on their own once writes stop */
+static void test_cache_idle_flush(void)
+{
+    YUNIT_ASSERT_EQUAL(cache_write(CACHE_INDEX_BASE, 0x31), GENIE_STORAGE_SUCCESS);
+    YUNIT_ASSERT(!cache_on_flash(CACHE_INDEX_BASE));
+
+    aos_msleep(GENIE_STORAGE_FLUSH_DELAY + 500);
+    YUNIT_ASSERT(cache_on_flash(CACHE_INDEX_BASE));
+}
+
+/* Records too big for a slot are written through, and a delete drops
+ * the cached copy of a record along with the flash one.
+ */
+static void test_cache_bypass(void)
+{
+    uint8_t big[CACHE_BIG_SIZE];
+    uint8_t data[CACHE_BIG_SIZE];
+
+    cache_fill(big, sizeof(big), 0x55);
+    YUNIT_ASSERT_EQUAL(genie_storage_write_reliable(CACHE_INDEX_BASE, big, sizeof(big)),
+                       GENIE_STORAGE_SUCCESS);
+    YUNIT_ASSERT(cache_on_flash(CACHE_INDEX_BASE));
+    YUNIT_ASSERT_EQUAL(genie_storage_read_reliable(CACHE_INDEX_BASE, data, sizeof(data)),
+                       GENIE_STORAGE_SUCCESS);
+    YUNIT_ASSERT(memcmp(data, big, sizeof(big)) == 0);
+
+    YUNIT_ASSERT_EQUAL(cache_write(CACHE_INDEX_BASE + 1, 0x66), GENIE_STORAGE_SUCCESS);
+    genie_storage_delete_reliable(CACHE_INDEX_BASE + 1);
+    YUNIT_ASSERT(genie_storage_read_reliable(CACHE_INDEX_BASE + 1, data, CACHE_RECORD_SIZE) !=
+                 GENIE_STORAGE_SUCCESS);
+    YUNIT_ASSERT_EQUAL(genie_storage_flush(), GENIE_STORAGE_SUCCESS);
+    YUNIT_ASSERT(!cache_on_flash(CACHE_INDEX_BASE + 1));
+}
+
+static int init(void)
+{
+    return genie_storage_init();
+}
+
+static int cleanup(void)
+{
+    return 0;
+}
+
+/* Every slot clean, so that a case sees only its own records dirty */
+static void setup(void)
+{
+    genie_storage_flush();
+}
+
+static void teardown(void)
+{
+    int i;
+
+    for (i = 0; i < CACHE_RECORD_COUNT; i++) {
+        genie_storage_delete_reliable(CACHE_INDEX_BASE + i);
+    }
+}
+
+static yunit_test_case_t genie_storage_cache_testcases[] = {
+    { "coalesce", test_cache_coalesce },
+    { "evict_dirty", test_cache_evict_dirty },
+    { "flush_all", test_cache_flush_all },
+    { "seq_barrier", test_cache_seq_barrier },
+    { "idle_flush", test_cache_idle_flush },
+    { "bypass", test_cache_bypass },
+    YUNIT_TEST_CASE_NULL
+};
+
+static yunit_test_suite_t suites[] = {
+    { "genie_storage_cache", init, cleanup, setup, teardown,
+      genie_storage_cache_testcases },
+    YUNIT_TEST_SUITE_NULL
+};
+
+void test_genie_storage_cache(void)
+{
+    yunit_add_test_suites(suites);
+}
+AOS_TESTCASE(test_genie_storage_cache);
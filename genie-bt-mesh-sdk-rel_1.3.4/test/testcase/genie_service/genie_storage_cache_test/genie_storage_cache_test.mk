@@ -0,0 +1,13 @@
+NAME := genie_storage_cache_test
+
+$(NAME)_COMPONENTS  += genie_service rhino.fs.kv
+
+$(NAME)_SOURCES     += genie_storage_cache_test.c
+
+$(NAME)_INCLUDES    += ../../../../genie_service \
+                       ../../../../genie_service/core/inc \
+                       ../../../../genie_service/sal/inc \
+                       ../../../../network/bluetooth/bt_mesh/inc \
+                       ../../../../network/bluetooth/bt_mesh/inc/api
+
+$(NAME)_CFLAGS      += -Wall -Werror
@@ -0,0 +1,17 @@
+src = Split('''
+    genie_storage_cache_test.c
+''')
+
+component = aos_component('genie_storage_cache_test', src)
+
+component.add_comp_deps('genie_service')
+component.add_comp_deps('kernel/rhino/fs/kv')
+
+component.add_includes('../../../../genie_service')
+component.add_includes('../../../../genie_service/core/inc')
+component.add_includes('../../../../genie_service/sal/inc')
+component.add_includes('../../../../network/bluetooth/bt_mesh/inc')
+component.add_includes('../../../../network/bluetooth/bt_mesh/inc/api')
+
+component.add_cflags('-Wall')
+component.add_cflags('-Werror')
@@ -0,0 +1,333 @@
+/*
+ * Copyright (C) 2015-2019 Alibaba Group Holding Limited
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <yunit.h>
+#include <yts.h>
+
+#include <aos/kernel.h>
+
+#include "genie_mesh_internal.h"
+
+/*
+ * Drives the time scheduler with the vendor messages the gateway sends:
+ * a UTC push, the timezone, one-shot and periodic timers and their
+ * removal. Timeouts are watched through the service event callback. The
+ * clock runs on from the last push without counting seconds, timers fire
+ * in deadline order when a push jumps past them, stale ones are skipped,
+ * and a timer due in a few seconds fires on its own.
+ * The image needs the vendor timers (genie_time_config=1). The cases
+ * remove every timer and leave the clock at a made-up time.
+ */
+
+#ifdef MESH_MODEL_VENDOR_TIMER
+
+/* 2020-09-13 12:26:00 UTC, a Sunday */
+#define TIME_BASE 1599999960
+
+/* 2020-09-14 00:00:00 UTC, a Monday */
+#define TIME_MONDAY 1600041600
+
+/* Time for the work to run after a push */
+#define TIME_SETTLE 200
+
+#define TIME_EVENT_MAX 8
+
+static user_event_cb g_user_event_cb;
+
+/* Timeouts in the order they came; the data of each timer lives in its
+ * node, so the pointer tells the timers apart.
+ */
+static vendor_attr_data_t *g_event_data[TIME_EVENT_MAX];
+static uint8_t g_event_para[TIME_EVENT_MAX];
+static int g_event_count;
+
+static void time_event_cb(genie_event_e event, void *p_arg)
+{
+    vendor_attr_data_t *p_data = p_arg;
+
+    if (event != GENIE_EVT_TIMEOUT) {
+        g_user_event_cb(event, p_arg);
+        return;
+    }
+
+    if (g_event_count < TIME_EVENT_MAX) {
+        g_event_data[g_event_count] = p_data;
+        g_event_para[g_event_count++] = p_data->para;
+    }
+}
+
+static void time_msg(uint8_t *p_data, uint16_t len)
+{
+    genie_transport_model_param_t msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.p_elem = bt_mesh_elem_find_by_id(0);
+    msg.opid = VENDOR_OP_ATTR_SET_ACK;
+    msg.tid = genie_transport_gen_tid();
+    msg.data = p_data;
+    msg.len = len;
+
+    genie_time_handle_model_mesg(&msg);
+}
+
+static void time_put_le16(uint8_t *p_data, uint16_t value)
+{
+    p_data[0] = value & 0xff;
+    p_data[1] = value >> 8;
+}
+
+static void time_put_le32(uint8_t *p_data, uint32_t value)
+{
+    time_put_le16(p_data, value & 0xffff);
+    time_put_le16(p_data + 2, value >> 16);
+}
+
+/* The gateway pushes its UTC */
+static void time_push(uint32_t unix_time)
+{
+    uint8_t data[6];
+
+    time_put_le16(data, UNIX_TIME_T);
+    time_put_le32(data + 2, unix_time);
+    time_msg(data, sizeof(data));
+
+    aos_msleep(TIME_SETTLE);
+}
+
+static void time_timezone(int8_t timezone)
+{
+    uint8_t data[3];
+
+    time_put_le16(data, TIMEZONE_SETTING_T);
+    data[2] = (uint8_t)timezone;
+    time_msg(data, sizeof(data));
+}
+
+/* A one-shot timer, unix_time on a minute */
+static void time_timer(uint8_t index, uint32_t unix_time, uint8_t onoff)
+{
+    uint8_t data[10];
+
+    time_put_le16(data, TIMING_SETTING_T);
+    data[2] = index;
+    time_put_le32(data + 3, unix_time);
+    time_put_le16(data + 7, ATTR_TYPE_GENERIC_ONOFF);
+    data[9] = onoff;
+    time_msg(data, sizeof(data));
+}
+
+/* A timer at minute of the local day on the days of schedule, bit 0 is
+ * Monday.
+ */
+static void time_periodic(uint8_t index, uint16_t minute, uint8_t schedule, uint8_t onoff)
+{
+    uint8_t data[9];
+
+    time_put_le16(data, TIMING_PERIODIC_SETTING_T);
+    data[2] = index;
+    time_put_le16(data + 3, minute | 0x1000);
+    data[5] = schedule;
+    time_put_le16(data + 6, ATTR_TYPE_GENERIC_ONOFF);
+    data[8] = onoff;
+    time_msg(data, sizeof(data));
+}
+
+static void time_remove(uint8_t index)
+{
+    uint8_t data[3];
+
+    time_put_le16(data, TIMING_DELETE_T);
+    data[2] = index;
+    time_msg(data, sizeof(data));
+}
+
+/* Wall time runs on from the push, local time follows the timezone */
+static void test_time_local(void)
+{
+    utc_time_t local;
+    uint32_t now;
+
+    time_timezone(0);
+    time_push(TIME_BASE);
+    YUNIT_ASSERT_EQUAL(genie_time_local_unixtime_get(), TIME_BASE);
+
+    local = genie_time_local_time_get();
+    YUNIT_ASSERT_EQUAL(local.year, 2020);
+    YUNIT_ASSERT_EQUAL(local.month, 8);
+    YUNIT_ASSERT_EQUAL(local.day, 13);
+    YUNIT_ASSERT_EQUAL(local.hour, 12);
+    YUNIT_ASSERT_EQUAL(local.minutes, 26);
+    YUNIT_ASSERT_EQUAL(local.weekday, 0);
+
+    aos_msleep(2000);
+    now = genie_time_local_unixtime_get();
+    YUNIT_ASSERT(now >= TIME_BASE + 2 && now <= TIME_BASE + 3);
+
+    time_timezone(8);
+    local = genie_time_local_time_get();
+    YUNIT_ASSERT_EQUAL(local.hour, 20);
+    YUNIT_ASSERT_EQUAL(local.day, 13);
+}
+
+/* A push past several deadlines fires them by deadline, not in the
+ * order they were set.
+ */
+static void test_time_deadline_order(void)
+{
+    time_push(TIME_BASE);
+
+    time_timer(1, TIME_BASE + 3 * MINU, 1);
+    time_timer(2, TIME_BASE + 1 * MINU, 1);
+    time_timer(3, TIME_BASE + 2 * MINU, 0);
+    YUNIT_ASSERT_EQUAL(g_event_count, 0);
+
+    time_push(TIME_BASE + 3 * MINU + 1);
+
+    YUNIT_ASSERT_EQUAL(g_event_count, 3);
+    YUNIT_ASSERT_EQUAL(g_event_para[0], 1);
+    YUNIT_ASSERT_EQUAL(g_event_para[1], 0);
+    YUNIT_ASSERT_EQUAL(g_event_para[2], 1);
+    YUNIT_ASSERT(g_event_data[0] != g_event_data[2]);
+
+    /* One-shot timers are gone once fired */
+    time_push(TIME_BASE + 4 * MINU);
+    YUNIT_ASSERT_EQUAL(g_event_count, 3);
+}
+
+/* Timers found long past due are dropped without firing */
+static void test_time_overdue(void)
+{
+    time_push(TIME_BASE);
+
+    time_timer(1, TIME_BASE + MINU, 1);
+    time_timer(2, TIME_BASE + GENIE_TIME_OVERDUE_MAX + 2 * MINU, 0);
+
+    time_push(TIME_BASE + GENIE_TIME_OVERDUE_MAX + 2 * MINU + 1);
+    YUNIT_ASSERT_EQUAL(g_event_count, 1);
+    YUNIT_ASSERT_EQUAL(g_event_para[0], 0);
+
+    time_push(TIME_BASE + GENIE_TIME_OVERDUE_MAX + 3 * MINU);
+    YUNIT_ASSERT_EQUAL(g_event_count, 1);
+}
+
+/* With no push, the scheduler wakes up for a timer by itself */
+static void test_time_wakeup(void)
+{
+    time_push(TIME_BASE + MINU - 2);
+
+    time_timer(1, TIME_BASE + MINU, 1);
+    YUNIT_ASSERT_EQUAL(g_event_count, 0);
+
+    aos_msleep(1000);
+    YUNIT_ASSERT_EQUAL(g_event_count, 0);
+
+    aos_msleep(1000 + TIME_SETTLE);
+    YUNIT_ASSERT_EQUAL(g_event_count, 1);
+}
+
+/* A removed timer does not fire */
+static void test_time_remove(void)
+{
+    time_push(TIME_BASE);
+
+    time_timer(1, TIME_BASE + MINU, 1);
+    time_timer(2, TIME_BASE + 2 * MINU, 0);
+    time_remove(1);
+
+    time_push(TIME_BASE + 2 * MINU + 1);
+    YUNIT_ASSERT_EQUAL(g_event_count, 1);
+    YUNIT_ASSERT_EQUAL(g_event_para[0], 0);
+}
+
+/* A periodic timer goes back in the queue for its next day, on the local
+ * calendar.
+ */
+static void test_time_periodic(void)
+{
+    time_timezone(0);
+    time_push(TIME_MONDAY + 10 * HOUR);
+
+    /* 10:01 on Mondays and Wednesdays */
+    time_periodic(1, 10 * 60 + 1, 0x05, 1);
+
+    time_push(TIME_MONDAY + 10 * HOUR + MINU + 1);
+    YUNIT_ASSERT_EQUAL(g_event_count, 1);
+
+    /* Not on Tuesday */
+    time_push(TIME_MONDAY + DAY + 10 * HOUR + MINU + 1);
+    YUNIT_ASSERT_EQUAL(g_event_count, 1);
+
+    time_push(TIME_MONDAY + 2 * DAY + 10 * HOUR + MINU + 1);
+    YUNIT_ASSERT_EQUAL(g_event_count, 2);
+    YUNIT_ASSERT(g_event_data[0] == g_event_data[1]);
+
+    /* In UTC+8, 10:01 local is 02:01 UTC */
+    time_timezone(8);
+    time_push(TIME_MONDAY + 7 * DAY);
+    time_periodic(1, 10 * 60 + 1, 0x01, 1);
+
+    time_push(TIME_MONDAY + 7 * DAY + 2 * HOUR + MINU + 1);
+    YUNIT_ASSERT_EQUAL(g_event_count, 3);
+}
+
+static int init(void)
+{
+    genie_service_ctx_t *p_ctx = genie_service_get_context();
+
+    g_user_event_cb = p_ctx->event_cb;
+    p_ctx->event_cb = time_event_cb;
+
+    return 0;
+}
+
+static int cleanup(void)
+{
+    time_remove(0xFF);
+    time_timezone(8);
+
+    genie_service_get_context()->event_cb = g_user_event_cb;
+
+    return 0;
+}
+
+static void setup(void)
+{
+    time_remove(0xFF);
+    time_timezone(0);
+    g_event_count = 0;
+}
+
+static void teardown(void)
+{
+}
+
+static yunit_test_case_t genie_time_testcases[] = {
+    { "local", test_time_local },
+    { "deadline_order", test_time_deadline_order },
+    { "overdue", test_time_overdue },
+    { "wakeup", test_time_wakeup },
+    { "remove", test_time_remove },
+    { "periodic", test_time_periodic },
+    YUNIT_TEST_CASE_NULL
+};
+
+static yunit_test_suite_t suites[] = {
+    { "genie_time", init, cleanup, setup, teardown,
+      genie_time_testcases },
+    YUNIT_TEST_SUITE_NULL
+};
+
+#endif
+
+void test_genie_time(void)
+{
+#ifdef MESH_MODEL_VENDOR_TIMER
+    yunit_add_test_suites(suites);
+#endif
+}
+AOS_TESTCASE(test_genie_time);
@@ -0,0 +1,286 @@
+/*
+ * Copyright (C) 2015-2019 Alibaba Group Holding Limited
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <yunit.h>
+#include <yts.h>
+
+#include <aos/kernel.h>
+
+#include "genie_mesh_internal.h"
+
+/*
+ * Sends vendor indications that wait for confirmation and follows them
+ * through the result callbacks and the transport counters: the node pool
+ * turns away messages once it is empty and is whole again after the
+ * acks, unconfirmed messages are resent and dropped in deadline order,
+ * and the tid index finds each message among tids sharing a bucket.
+ * Nothing confirms the messages but the cases, which run in real time.
+ * The node provisions itself unless the image has done so already.
+ */
+
+#define TRANS_ADDR 0x0e21
+
+/* No retransmission within a case */
+#define TRANS_PERIOD_LONG 10000
+
+/* Short enough for a few retransmissions in a case */
+#define TRANS_PERIOD 100
+
+/* Time for the timer to go off past the deadline */
+#define TRANS_SLACK 150
+
+/* Tids that hash to one bucket of the index */
+#define TRANS_TID_STEP GENIE_TRANSPORT_TID_INDEX_SIZE
+
+#define TRANS_RESULT_MAX 16
+
+static const uint8_t g_net_key[16] = {
+    0x7d, 0xd7, 0x36, 0x4c, 0xd8, 0x42, 0xad, 0x18,
+    0xc1, 0x7c, 0x2b, 0x82, 0x0c, 0x84, 0xc3, 0xd6,
+};
+
+static uint8_t g_dev_key[16];
+
+/* Tids and results in the order the callbacks came */
+static uint8_t g_result_tid[TRANS_RESULT_MAX];
+static transport_result_e g_result[TRANS_RESULT_MAX];
+static int g_result_count;
+
+static int trans_result(void *p_params, transport_result_e result)
+{
+    genie_transport_model_param_t *p_msg = p_params;
+
+    if (g_result_count < TRANS_RESULT_MAX) {
+        g_result_tid[g_result_count] = p_msg->tid;
+        g_result[g_result_count++] = result;
+    }
+
+    return 0;
+}
+
+static int trans_count(transport_result_e result)
+{
+    int i, count = 0;
+
+    for (i = 0; i < g_result_count; i++) {
+        if (g_result[i] == result) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+static int trans_send(uint8_t tid, uint8_t retry, uint16_t period, uint16_t len)
+{
+    static uint8_t data[GENIE_TRANSPORT_PAYLOAD_MAX + 1];
+    genie_transport_model_param_t msg;
+
+    memset(data, tid, len);
+    memset(&msg, 0, sizeof(msg));
+    msg.p_elem = bt_mesh_elem_find_by_id(0);
+    msg.result_cb = trans_result;
+    msg.opid = VENDOR_OP_ATTR_INDICATE;
+    msg.tid = tid;
+    msg.retry = retry;
+    msg.retry_period = period;
+    msg.data = data;
+    msg.len = len;
+
+    return genie_transport_send_model(&msg);
+}
+
+/* A full pool turns messages away, the first send still goes out */
+static void test_trans_pool(void)
+{
+    genie_transport_stats_t stats;
+    int i;
+
+    for (i = 0; i < CONFIG_VENDOR_SEND_MSG_MAX; i++) {
+        YUNIT_ASSERT_EQUAL(trans_send(GENIE_TRANSPORT_TID_MIN + i, 1, TRANS_PERIOD_LONG, 4), 0);
+    }
+
+    YUNIT_ASSERT_EQUAL(trans_send(GENIE_TRANSPORT_TID_MIN + i, 1, TRANS_PERIOD_LONG, 4), 0);
+    trans_send(GENIE_TRANSPORT_TID_MIN + i + 1, 1, TRANS_PERIOD_LONG, GENIE_TRANSPORT_PAYLOAD_MAX + 1);
+
+    genie_transport_stats_get(&stats);
+    YUNIT_ASSERT_EQUAL(stats.alloc_fail, 2);
+    YUNIT_ASSERT_EQUAL(stats.peak, CONFIG_VENDOR_SEND_MSG_MAX);
+    YUNIT_ASSERT(stats.sent >= CONFIG_VENDOR_SEND_MSG_MAX + 1);
+
+    /* The messages turned away are not waiting for an ack */
+    genie_transport_ack(GENIE_TRANSPORT_TID_MIN + i);
+    YUNIT_ASSERT_EQUAL(g_result_count, 0);
+
+    for (i = 0; i < CONFIG_VENDOR_SEND_MSG_MAX; i++) {
+        genie_transport_ack(GENIE_TRANSPORT_TID_MIN + i);
+    }
+    YUNIT_ASSERT(!genie_transport_tx_in_progress());
+    YUNIT_ASSERT_EQUAL(trans_count(SEND_RESULT_SUCCESS), CONFIG_VENDOR_SEND_MSG_MAX);
+
+    /* Every node is back */
+    for (i = 0; i < CONFIG_VENDOR_SEND_MSG_MAX; i++) {
+        YUNIT_ASSERT_EQUAL(trans_send(GENIE_TRANSPORT_TID_MIN + 0x20 + i, 1, TRANS_PERIOD_LONG, 4), 0);
+    }
+
+    genie_transport_stats_get(&stats);
+    YUNIT_ASSERT_EQUAL(stats.alloc_fail, 2);
+    YUNIT_ASSERT_EQUAL(stats.acked, CONFIG_VENDOR_SEND_MSG_MAX);
+}
+
+/* Messages with no retry time out in the order of their deadlines, not
+ * in the order they were sent.
+ */
+static void test_trans_deadline(void)
+{
+    static const uint8_t order[] = { 3, 1, 4, 2 };
+    genie_transport_stats_t stats;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(order); i++) {
+        YUNIT_ASSERT_EQUAL(trans_send(GENIE_TRANSPORT_TID_MIN + i, 0, order[i] * TRANS_PERIOD, 4), 0);
+    }
+
+    aos_msleep(ARRAY_SIZE(order) * TRANS_PERIOD + TRANS_SLACK);
+
+    YUNIT_ASSERT_EQUAL(g_result_count, ARRAY_SIZE(order));
+    for (i = 0; i < g_result_count; i++) {
+        YUNIT_ASSERT_EQUAL(g_result[i], SEND_RESULT_TIMEOUT);
+        YUNIT_ASSERT_EQUAL(order[g_result_tid[i] - GENIE_TRANSPORT_TID_MIN], i + 1);
+    }
+
+    genie_transport_stats_get(&stats);
+    YUNIT_ASSERT_EQUAL(stats.timeout, ARRAY_SIZE(order));
+    YUNIT_ASSERT_EQUAL(stats.retransmit, 0);
+    YUNIT_ASSERT(!genie_transport_tx_in_progress());
+}
+
+/* An unconfirmed message is resent retry times, then dropped; an ack
+ * stops the retransmissions.
+ */
+static void test_trans_retransmit(void)
+{
+    genie_transport_stats_t stats;
+    uint32_t retransmit;
+
+    YUNIT_ASSERT_EQUAL(trans_send(GENIE_TRANSPORT_TID_MIN, 2, TRANS_PERIOD, 4), 0);
+    aos_msleep(3 * TRANS_PERIOD + TRANS_SLACK);
+
+    genie_transport_stats_get(&stats);
+    YUNIT_ASSERT_EQUAL(stats.sent, 1);
+    YUNIT_ASSERT_EQUAL(stats.retransmit, 2);
+    YUNIT_ASSERT_EQUAL(stats.timeout, 1);
+    YUNIT_ASSERT_EQUAL(trans_count(SEND_RESULT_TIMEOUT), 1);
+
+    YUNIT_ASSERT_EQUAL(trans_send(GENIE_TRANSPORT_TID_MIN + 1, 5, TRANS_PERIOD, 4), 0);
+    aos_msleep(TRANS_PERIOD + TRANS_SLACK);
+    genie_transport_ack(GENIE_TRANSPORT_TID_MIN + 1);
+
+    genie_transport_stats_get(&stats);
+    retransmit = stats.retransmit;
+    YUNIT_ASSERT(retransmit > 2);
+    YUNIT_ASSERT_EQUAL(stats.acked, 1);
+
+    aos_msleep(3 * TRANS_PERIOD);
+    genie_transport_stats_get(&stats);
+    YUNIT_ASSERT_EQUAL(stats.retransmit, retransmit);
+    YUNIT_ASSERT_EQUAL(stats.timeout, 1);
+    YUNIT_ASSERT_EQUAL(trans_count(SEND_RESULT_SUCCESS), 1);
+}
+
+/* Acks find their message among others in the same bucket, and a send
+ * with a tid still waiting replaces the older message.
+ */
+static void test_trans_tid_index(void)
+{
+    genie_transport_stats_t stats;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        YUNIT_ASSERT_EQUAL(trans_send(GENIE_TRANSPORT_TID_MIN + i * TRANS_TID_STEP, 1,
+                                      TRANS_PERIOD_LONG, 4), 0);
+    }
+
+    genie_transport_ack(GENIE_TRANSPORT_TID_MIN + TRANS_TID_STEP);
+    YUNIT_ASSERT_EQUAL(g_result_count, 1);
+    YUNIT_ASSERT_EQUAL(g_result_tid[0], GENIE_TRANSPORT_TID_MIN + TRANS_TID_STEP);
+
+    /* Same bucket, nothing waiting with it */
+    genie_transport_ack(GENIE_TRANSPORT_TID_MIN + TRANS_TID_STEP);
+    genie_transport_ack(GENIE_TRANSPORT_TID_MIN + 5 * TRANS_TID_STEP);
+    YUNIT_ASSERT_EQUAL(g_result_count, 1);
+
+    /* Replaced without a callback for the old one */
+    YUNIT_ASSERT_EQUAL(trans_send(GENIE_TRANSPORT_TID_MIN + 2 * TRANS_TID_STEP, 1,
+                                  TRANS_PERIOD_LONG, 8), 0);
+    YUNIT_ASSERT_EQUAL(g_result_count, 1);
+
+    for (i = 0; i < 4; i++) {
+        genie_transport_ack(GENIE_TRANSPORT_TID_MIN + i * TRANS_TID_STEP);
+    }
+
+    YUNIT_ASSERT_EQUAL(g_result_count, 4);
+    YUNIT_ASSERT_EQUAL(trans_count(SEND_RESULT_SUCCESS), 4);
+    YUNIT_ASSERT(!genie_transport_tx_in_progress());
+
+    genie_transport_stats_get(&stats);
+    YUNIT_ASSERT_EQUAL(stats.acked, 4);
+    YUNIT_ASSERT_EQUAL(stats.peak, 4);
+}
+
+static int init(void)
+{
+    if (bt_mesh_is_provisioned()) {
+        return 0;
+    }
+
+    bt_rand(g_dev_key, sizeof(g_dev_key));
+
+    return bt_mesh_provision(g_net_key, 0, 0, 0, 0, TRANS_ADDR, g_dev_key);
+}
+
+static int cleanup(void)
+{
+    return 0;
+}
+
+static void setup(void)
+{
+    g_result_count = 0;
+    genie_transport_stats_reset();
+}
+
+/* Nothing left waiting for the next case */
+static void teardown(void)
+{
+    int tid;
+
+    for (tid = GENIE_TRANSPORT_TID_MIN; tid <= GENIE_TRANSPORT_TID_MAX; tid++) {
+        genie_transport_ack(tid);
+    }
+}
+
+static yunit_test_case_t genie_transport_testcases[] = {
+    { "pool", test_trans_pool },
+    { "deadline", test_trans_deadline },
+    { "retransmit", test_trans_retransmit },
+    { "tid_index", test_trans_tid_index },
+    YUNIT_TEST_CASE_NULL
+};
+
+static yunit_test_suite_t suites[] = {
+    { "genie_transport", init, cleanup, setup, teardown,
+      genie_transport_testcases },
+    YUNIT_TEST_SUITE_NULL
+};
+
+void test_genie_transport(void)
+{
+    yunit_add_test_suites(suites);
+}
+AOS_TESTCASE(test_genie_transport);
@@ -0,0 +1,13 @@
+NAME := genie_transport_test
+
+$(NAME)_COMPONENTS  += genie_service
+
+$(NAME)_SOURCES     += genie_transport_test.c
+
+$(NAME)_INCLUDES    += ../../../../genie_service \
+                       ../../../../genie_service/core/inc \
+                       ../../../../genie_service/sal/inc \
+                       ../../../../network/bluetooth/bt_mesh/inc \
+                       ../../../../network/bluetooth/bt_mesh/inc/api
+
+$(NAME)_CFLAGS      += -Wall -Werror
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2015-2019 Alibaba Group Holding Limited
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <yunit.h>
+#include <yts.h>
+
+#include "sig_model_transition_curve.h"
+
+/*
+ * Runs the fixed-point transition curves the way the engine does: one rate
+ * per transition, then progress from the elapsed time on every step.
+ */
+
+static const uint32_t g_durations[] = { 1, 2, 7, 100, 1000, 6200, 620000, 37200000 };
+
+static const uint16_t g_values[][2] = {
+    { 0, 0xFFFF },
+    { 0xFFFF, 0 },
+    { 655, 656 },
+    { 800, 20000 },
+    { 20000, 800 },
+    { 0x1234, 0x1234 },
+};
+
+static uint32_t trans_step(uint32_t duration)
+{
+    return duration > 97 ? duration / 97 : 1;
+}
+
+static void test_trans_endpoints(void)
+{
+    uint32_t d, v, ease, progress;
+    uint32_t duration, rate;
+
+    for (ease = 0; ease < SIG_MODEL_TRANS_EASE_NUM; ease++) {
+        YUNIT_ASSERT(sig_model_trans_ease(0, ease) == 0);
+        YUNIT_ASSERT(sig_model_trans_ease(SIG_MODEL_TRANS_Q16_ONE, ease) == SIG_MODEL_TRANS_Q16_ONE);
+    }
+
+    for (d = 0; d < sizeof(g_durations) / sizeof(g_durations[0]); d++) {
+        duration = g_durations[d];
+        rate = sig_model_trans_rate(duration);
+
+        YUNIT_ASSERT(sig_model_trans_progress(rate, 0, duration) == 0);
+        YUNIT_ASSERT(sig_model_trans_progress(rate, duration, duration) == SIG_MODEL_TRANS_Q16_ONE);
+        /* A late wakeup still stops on the target */
+        YUNIT_ASSERT(sig_model_trans_progress(rate, duration + 20, duration) == SIG_MODEL_TRANS_Q16_ONE);
+
+        for (ease = 0; ease < SIG_MODEL_TRANS_EASE_NUM; ease++) {
+            progress = sig_model_trans_ease(sig_model_trans_progress(rate, duration, duration), ease);
+            for (v = 0; v < sizeof(g_values) / sizeof(g_values[0]); v++) {
+                YUNIT_ASSERT(sig_model_trans_value(g_values[v][0], g_values[v][1], 0) == g_values[v][0]);
+                YUNIT_ASSERT(sig_model_trans_value(g_values[v][0], g_values[v][1], progress) == g_values[v][1]);
+            }
+        }
+    }
+}
+
+static void test_trans_monotonic(void)
+{
+    uint32_t d, v, ease, elapsed;
+    uint32_t duration, rate, progress, last_progress;
+    uint16_t start, target, value, last;
+    uint16_t low, high;
+
+    for (d = 0; d < sizeof(g_durations) / sizeof(g_durations[0]); d++) {
+        duration = g_durations[d];
+        rate = sig_model_trans_rate(duration);
+
+        for (ease = 0; ease < SIG_MODEL_TRANS_EASE_NUM; ease++) {
+            for (v = 0; v < sizeof(g_values) / sizeof(g_values[0]); v++) {
+                start = g_values[v][0];
+                target = g_values[v][1];
+                low = start < target ? start : target;
+                high = start < target ? target : start;
+                last = start;
+                last_progress = 0;
+
+                for (elapsed = 0; elapsed <= duration; elapsed += trans_step(duration)) {
+                    progress = sig_model_trans_ease(sig_model_trans_progress(rate, elapsed, duration), ease);
+                    value = sig_model_trans_value(start, target, progress);
+
+                    YUNIT_ASSERT(progress >= last_progress);
+                    YUNIT_ASSERT(value >= low && value <= high);
+                    YUNIT_ASSERT(start < target ? value >= last : value <= last);
+
+                    last_progress = progress;
+                    last = value;
+                }
+            }
+        }
+    }
+}
+
+static void test_trans_linear(void)
+{
+    uint32_t duration = 1000;
+    uint32_t rate = sig_model_trans_rate(duration);
+    uint32_t elapsed;
+    int32_t value, expect;
+
+    /* The Q16 rate tracks the exact ratio within one lightness unit */
+    for (elapsed = 0; elapsed <= duration; elapsed++) {
+        value = sig_model_trans_value(0, 0xFFFF, sig_model_trans_progress(rate, elapsed, duration));
+        expect = (int32_t)((uint64_t)0xFFFF * elapsed / duration);
+        YUNIT_ASSERT(value - expect <= 1 && expect - value <= 1);
+    }
+
+    /* Eased curves agree with linear at the midpoint only where symmetric */
+    YUNIT_ASSERT(sig_model_trans_ease(SIG_MODEL_TRANS_Q16_ONE / 2, SIG_MODEL_TRANS_EASE_IN_OUT) == SIG_MODEL_TRANS_Q16_ONE / 2);
+    YUNIT_ASSERT(sig_model_trans_ease(SIG_MODEL_TRANS_Q16_ONE / 2, SIG_MODEL_TRANS_EASE_IN) < SIG_MODEL_TRANS_Q16_ONE / 2);
+    YUNIT_ASSERT(sig_model_trans_ease(SIG_MODEL_TRANS_Q16_ONE / 2, SIG_MODEL_TRANS_EASE_OUT) > SIG_MODEL_TRANS_Q16_ONE / 2);
+}
+
+static int init(void)
+{
+    return 0;
+}
+
+static int cleanup(void)
+{
+    return 0;
+}
+
+static void setup(void)
+{
+}
+
+static void teardown(void)
+{
+}
+
+static yunit_test_case_t sig_model_trans_testcases[] = {
+    { "trans_endpoints", test_trans_endpoints },
+    { "trans_monotonic", test_trans_monotonic },
+    { "trans_linear", test_trans_linear },
+    YUNIT_TEST_CASE_NULL
+};
+
+static yunit_test_suite_t suites[] = {
+    { "sig_model_trans", init, cleanup, setup, teardown, sig_model_trans_testcases },
+    YUNIT_TEST_SUITE_NULL
+};
+
+void test_sig_model_trans(void)
+{
+    yunit_add_test_suites(suites);
+}
+AOS_TESTCASE(test_sig_model_trans);
@@ -0,0 +1,7 @@
+NAME := sig_model_trans_test
+
+$(NAME)_SOURCES     += sig_model_trans_test.c
+
+$(NAME)_INCLUDES    += ../../../../genie_service/core/inc/sig_models
+
+$(NAME)_CFLAGS      += -Wall -Werror
@@ -0,0 +1,10 @@
+src = Split('''
+    sig_model_trans_test.c
+''')
+
+component = aos_component('sig_model_trans_test', src)
+
+component.add_includes('../../../../genie_service/core/inc/sig_models')
+
+component.add_cflags('-Wall')
+component.add_cflags('-Werror')
@@ -84,6 +84,113 @@ static void test_kv_del(void)
     YUNIT_ASSERT(len != strlen(g_val_3)+1);
 }
 
+static void test_kv_txn(void)
+{
+    int ret = 0;
+    char buf[10] = {0};
+    int len = sizeof(buf);
+
+    ret = aos_kv_set(g_key_1, g_val_1, strlen(g_val_1), 1);
+    YUNIT_ASSERT(0 == ret);
+
+    /* An aborted batch leaves nothing behind */
+    ret = aos_kv_txn_begin();
+    YUNIT_ASSERT(0 == ret);
+    ret = aos_kv_txn_set(g_key_2, g_val_2, strlen(g_val_2));
+    YUNIT_ASSERT(0 == ret);
+    ret = aos_kv_txn_del(g_key_1);
+    YUNIT_ASSERT(0 == ret);
+    aos_kv_txn_abort();
+
+    ret = aos_kv_get(g_key_2, buf, &len);
+    YUNIT_ASSERT(0 != ret);
+    len = sizeof(buf);
+    ret = aos_kv_get(g_key_1, buf, &len);
+    YUNIT_ASSERT(0 == ret);
+
+    /* A committed one lands as a whole, later records win */
+    ret = aos_kv_txn_begin();
+    YUNIT_ASSERT(0 == ret);
+    ret = aos_kv_txn_set(g_key_2, g_val_3, strlen(g_val_3));
+    YUNIT_ASSERT(0 == ret);
+    ret = aos_kv_txn_set(g_key_2, g_val_2, strlen(g_val_2));
+    YUNIT_ASSERT(0 == ret);
+    ret = aos_kv_txn_set(g_key_3, g_val_3, strlen(g_val_3));
+    YUNIT_ASSERT(0 == ret);
+    ret = aos_kv_txn_del(g_key_1);
+    YUNIT_ASSERT(0 == ret);
+    ret = aos_kv_txn_commit();
+    YUNIT_ASSERT(0 == ret);
+
+    len = sizeof(buf);
+    ret = aos_kv_get(g_key_1, buf, &len);
+    YUNIT_ASSERT(0 != ret);
+
+    memset(buf, 0, sizeof(buf));
+    len = sizeof(buf);
+    ret = aos_kv_get(g_key_2, buf, &len);
+    YUNIT_ASSERT(0 == ret);
+    YUNIT_ASSERT(0 == memcmp(buf, g_val_2, strlen(g_val_2)));
+
+    len = sizeof(buf);
+    ret = aos_kv_get(g_key_3, buf, &len);
+    YUNIT_ASSERT(0 == ret);
+
+    aos_kv_del(g_key_2);
+    aos_kv_del(g_key_3);
+}
+
+static const int g_bench_counts[] = { 4, 16, 48 };
+
+#define KV_BENCH_ROUNDS 10
+
+static void test_kv_bench(void)
+{
+    long long set, get, start;
+    int c, i, round, count, ret, fail = 0;
+    char key[16] = {0};
+    char val[16] = {0};
+    int len;
+
+    for (c = 0; c < sizeof(g_bench_counts) / sizeof(g_bench_counts[0]); c++) {
+        count = g_bench_counts[c];
+        set = 0;
+        get = 0;
+
+        for (round = 0; round < KV_BENCH_ROUNDS; round++) {
+            start = aos_now();
+            for (i = 0; i < count; i++) {
+                snprintf(key, sizeof(key), "bench_%d", i);
+                snprintf(val, sizeof(val), "val_%d_%d", i, round);
+                if (aos_kv_set(key, val, strlen(val), 1) != 0)
+                    fail++;
+            }
+            set += aos_now() - start;
+
+            start = aos_now();
+            for (i = 0; i < count; i++) {
+                snprintf(key, sizeof(key), "bench_%d", i);
+                len = sizeof(val);
+                if (aos_kv_get(key, val, &len) != 0)
+                    fail++;
+            }
+            get += aos_now() - start;
+        }
+
+        for (i = 0; i < count; i++) {
+            snprintf(key, sizeof(key), "bench_%d", i);
+            ret = aos_kv_del(key);
+            if (ret != 0)
+                fail++;
+        }
+
+        printf("%d items: set %lld ns, get %lld ns per call\n", count,
+               set / (KV_BENCH_ROUNDS * count), get / (KV_BENCH_ROUNDS * count));
+    }
+
+    YUNIT_ASSERT(0 == fail);
+}
+
 #ifdef YTS_LINUX
 static void test_kv_loop(void)
 {
@@ -268,6 +375,8 @@ static yunit_test_case_t aos_kv_testcases[] = {
     { "kv_add", test_kv_add },
     { "kv_find", test_kv_find },
     { "kv_del", test_kv_del },
+    { "kv_txn", test_kv_txn },
+    { "kv_bench", test_kv_bench },
 #ifdef YTS_LINUX
     { "kv_loop", test_kv_loop},
     { "kv_error", test_kv_error},
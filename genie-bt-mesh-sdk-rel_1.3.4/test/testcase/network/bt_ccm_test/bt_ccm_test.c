@@ -0,0 +1,274 @@
+/*
+ * Copyright (C) 2015-2019 Alibaba Group Holding Limited
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <yunit.h>
+#include <yts.h>
+
+#include <tinycrypt/constants.h>
+#include <tinycrypt/aes.h>
+#include <tinycrypt/ccm_mode.h>
+
+#include "mesh_crypto.h"
+
+/*
+ * Checks the mesh network and access layer CCM against the Mesh Profile
+ * sample data, then against tinycrypt ccm_mode.c on random messages.
+ */
+
+#ifdef YTS_LINUX
+#define CCM_ROUNDS 5000
+#else
+#define CCM_ROUNDS 200
+#endif
+
+#define CCM_MSG_MAX 380
+
+struct ccm_buf {
+    struct net_buf_simple buf;
+    u8_t data[CCM_MSG_MAX + 8] __net_buf_align;
+};
+
+static u8_t g_msg[CCM_MSG_MAX];
+static u8_t g_ref[CCM_MSG_MAX + 8];
+static struct ccm_buf g_enc;
+static struct ccm_buf g_dec;
+static u32_t g_rand = 1;
+
+static u32_t ccm_rand(void)
+{
+    g_rand = g_rand * 1103515245 + 12345;
+    return g_rand >> 8;
+}
+
+static void ccm_hex(const char *str, u8_t *out)
+{
+    while (str[0] && str[1]) {
+        sscanf(str, "%2hhx", out++);
+        str += 2;
+    }
+}
+
+static int ccm_equal(const u8_t *data, const char *str, size_t len)
+{
+    u8_t exp[64];
+
+    ccm_hex(str, exp);
+    return memcmp(data, exp, len) == 0;
+}
+
+/* Empty the buffer, then copy len bytes of data in */
+static struct net_buf_simple *ccm_buf_set(struct ccm_buf *ccm, const u8_t *data,
+                                          size_t len)
+{
+    ccm->buf.size = sizeof(ccm->data);
+    net_buf_simple_init(&ccm->buf, 0);
+    net_buf_simple_add_mem(&ccm->buf, data, len);
+    return &ccm->buf;
+}
+
+/* Application/device key CCM through tinycrypt, nonce as in 3.8.5.2/3 */
+static void ccm_ref(const u8_t key[16], bool dev_key, u8_t aszmic,
+                    const u8_t *msg, size_t len, const u8_t *ad, u16_t src,
+                    u16_t dst, u32_t seq, u32_t iv_index, u8_t *out)
+{
+    struct tc_aes_key_sched_struct sched;
+    struct tc_ccm_mode_struct ccm;
+    u8_t mic_len = aszmic ? 8 : 4;
+    u8_t nonce[13];
+    u32_t seq_mic = seq | ((u32_t)aszmic << 31);
+
+    nonce[0] = dev_key ? 0x02 : 0x01;
+    nonce[1] = seq_mic >> 24;
+    nonce[2] = seq_mic >> 16;
+    nonce[3] = seq_mic >> 8;
+    nonce[4] = seq_mic;
+    nonce[5] = src >> 8;
+    nonce[6] = src;
+    nonce[7] = dst >> 8;
+    nonce[8] = dst;
+    nonce[9] = iv_index >> 24;
+    nonce[10] = iv_index >> 16;
+    nonce[11] = iv_index >> 8;
+    nonce[12] = iv_index;
+
+    tc_aes128_set_encrypt_key(&sched, key);
+    tc_ccm_config(&ccm, &sched, nonce, sizeof(nonce), mic_len);
+    tc_ccm_generation_encryption(out, len + mic_len, ad, ad ? 16 : 0,
+                                 msg, len, &ccm);
+}
+
+/* Mesh Profile 8.3.1 and 8.3.2, message #1 */
+static void test_ccm_net_sample(void)
+{
+    struct bt_mesh_aes_key enc_key, priv_key;
+    struct net_buf_simple *buf, *out;
+    u8_t net_key[16], enc[16], priv[16], nid, p = 0;
+    u8_t pdu[64];
+
+    ccm_hex("7dd7364cd842ad18c17c2b820c84c3d6", net_key);
+    YUNIT_ASSERT(bt_mesh_k2(net_key, &p, 1, &nid, enc, priv) == 0);
+    YUNIT_ASSERT(ccm_equal(enc, "0953fa93e7caac9638f58820220a398e", 16));
+    YUNIT_ASSERT(ccm_equal(priv, "8b84eedec100067d670971dd2aa700cf", 16));
+    bt_mesh_aes_key_set(&enc_key, enc);
+    bt_mesh_aes_key_set(&priv_key, priv);
+
+    ccm_hex("68800000011201fffd034b50057e400000010000", pdu);
+    buf = ccm_buf_set(&g_enc, pdu, 20);
+    YUNIT_ASSERT(bt_mesh_net_encrypt(&enc_key, buf, 0x12345678, false) == 0);
+    YUNIT_ASSERT(bt_mesh_net_obfuscate(buf->data, 0x12345678, &priv_key) == 0);
+    YUNIT_ASSERT(buf->len == 28);
+    YUNIT_ASSERT(ccm_equal(buf->data, "68eca487516765b5e5bfdacbaf6cb7fb"
+                                      "6bff871f035444ce83a670df", 28));
+
+    /* Out of place, the way the receive path decrypts */
+    out = ccm_buf_set(&g_dec, buf->data, 28);
+    bt_mesh_net_obfuscate(out->data, 0x12345678, &priv_key);
+    YUNIT_ASSERT(bt_mesh_net_decrypt(&enc_key, out, &buf->data[7],
+                                     0x12345678, false) == 0);
+    YUNIT_ASSERT(ccm_equal(out->data, "68800000011201fffd034b50057e400000010000", 20));
+
+    /* In place */
+    bt_mesh_net_obfuscate(buf->data, 0x12345678, &priv_key);
+    YUNIT_ASSERT(bt_mesh_net_decrypt(&enc_key, buf, &buf->data[7],
+                                     0x12345678, false) == 0);
+    YUNIT_ASSERT(ccm_equal(buf->data, "68800000011201fffd034b50057e400000010000", 20));
+}
+
+/* Mesh Profile 8.3.6, message #6: device key, segmented access payload */
+static void test_ccm_app_sample(void)
+{
+    struct bt_mesh_aes_key dev_key;
+    struct net_buf_simple *buf, *out;
+    u8_t key[16], pdu[64];
+
+    ccm_hex("9d6dd0e96eb25dc19a40ed9914f8f03f", key);
+    bt_mesh_aes_key_set(&dev_key, key);
+
+    ccm_hex("0056341263964771734fbd76e3b40519d1d94a48", pdu);
+    buf = ccm_buf_set(&g_enc, pdu, 20);
+    YUNIT_ASSERT(bt_mesh_app_encrypt(&dev_key, true, 0, buf, NULL, 0x0003,
+                                     0x1201, 0x3129ab, 0x12345678) == 0);
+    YUNIT_ASSERT(buf->len == 24);
+    YUNIT_ASSERT(ccm_equal(buf->data, "ee9dddfd2169326d23f3afdfcfdc18c5"
+                                      "2fdef772e0e17308", 24));
+
+    buf->len -= 4;
+    out = ccm_buf_set(&g_dec, NULL, 0);
+    YUNIT_ASSERT(bt_mesh_app_decrypt(&dev_key, true, 0, buf, out, NULL,
+                                     0x0003, 0x1201, 0x3129ab, 0x12345678) == 0);
+    YUNIT_ASSERT(out->len == 20);
+    YUNIT_ASSERT(ccm_equal(out->data, "0056341263964771734fbd76e3b40519d1d94a48", 20));
+}
+
+static void test_ccm_app_random(void)
+{
+    struct bt_mesh_aes_key key_sched;
+    struct net_buf_simple *buf, *out;
+    struct net_buf_simple in;
+    u8_t key[16], ad[16];
+    u8_t aszmic, mic_len;
+    u16_t src, dst;
+    u32_t seq, iv_index;
+    bool dev_key, use_ad;
+    size_t len, i;
+    int n;
+
+    for (n = 0; n < CCM_ROUNDS; n++) {
+        len = 1 + ccm_rand() % CCM_MSG_MAX;
+        aszmic = ccm_rand() & 1;
+        mic_len = aszmic ? 8 : 4;
+        dev_key = ccm_rand() & 1;
+        use_ad = ccm_rand() & 1;
+        src = ccm_rand();
+        dst = ccm_rand();
+        seq = ccm_rand() & 0xffffff;
+        iv_index = ccm_rand();
+
+        for (i = 0; i < 16; i++) {
+            key[i] = ccm_rand();
+            ad[i] = ccm_rand();
+        }
+
+        for (i = 0; i < len; i++) {
+            g_msg[i] = ccm_rand();
+        }
+
+        ccm_ref(key, dev_key, aszmic, g_msg, len, use_ad ? ad : NULL, src,
+                dst, seq, iv_index, g_ref);
+        bt_mesh_aes_key_set(&key_sched, key);
+
+        buf = ccm_buf_set(&g_enc, g_msg, len);
+        YUNIT_ASSERT(bt_mesh_app_encrypt(&key_sched, dev_key, aszmic, buf,
+                                         use_ad ? ad : NULL, src, dst, seq,
+                                         iv_index) == 0);
+        YUNIT_ASSERT(buf->len == len + mic_len);
+        YUNIT_ASSERT(memcmp(buf->data, g_ref, len + mic_len) == 0);
+
+        buf->len = len;
+        out = ccm_buf_set(&g_dec, NULL, 0);
+        YUNIT_ASSERT(bt_mesh_app_decrypt(&key_sched, dev_key, aszmic, buf,
+                                         out, use_ad ? ad : NULL, src, dst,
+                                         seq, iv_index) == 0);
+        YUNIT_ASSERT(out->len == len);
+        YUNIT_ASSERT(memcmp(out->data, g_msg, len) == 0);
+
+        /* In place, the output over the input */
+        out = ccm_buf_set(&g_dec, g_ref, len + mic_len);
+        in = *out;
+        in.len = len;
+        out->len = 0;
+        YUNIT_ASSERT(bt_mesh_app_decrypt(&key_sched, dev_key, aszmic, &in,
+                                         out, use_ad ? ad : NULL, src, dst,
+                                         seq, iv_index) == 0);
+        YUNIT_ASSERT(memcmp(out->data, g_msg, len) == 0);
+
+        /* A tampered MIC must not authenticate */
+        out = ccm_buf_set(&g_dec, NULL, 0);
+        buf->data[len] ^= 1;
+        YUNIT_ASSERT(bt_mesh_app_decrypt(&key_sched, dev_key, aszmic, buf,
+                                         out, use_ad ? ad : NULL, src, dst,
+                                         seq, iv_index) == -EBADMSG);
+    }
+}
+
+static int init(void)
+{
+    return 0;
+}
+
+static int cleanup(void)
+{
+    return 0;
+}
+
+static void setup(void)
+{
+}
+
+static void teardown(void)
+{
+}
+
+static yunit_test_case_t bt_ccm_testcases[] = {
+    { "ccm_net_sample", test_ccm_net_sample },
+    { "ccm_app_sample", test_ccm_app_sample },
+    { "ccm_app_random", test_ccm_app_random },
+    YUNIT_TEST_CASE_NULL
+};
+
+static yunit_test_suite_t suites[] = {
+    { "bt_ccm", init, cleanup, setup, teardown, bt_ccm_testcases },
+    YUNIT_TEST_SUITE_NULL
+};
+
+void test_bt_ccm(void)
+{
+    yunit_add_test_suites(suites);
+}
+AOS_TESTCASE(test_bt_ccm);
@@ -0,0 +1,7 @@
+NAME := bt_ccm_test
+
+$(NAME)_COMPONENTS  += bluetooth.bt_mesh
+
+$(NAME)_SOURCES     += bt_ccm_test.c
+
+$(NAME)_CFLAGS      += -Wall -Werror
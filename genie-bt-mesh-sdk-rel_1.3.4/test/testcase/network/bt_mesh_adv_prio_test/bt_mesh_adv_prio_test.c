@@ -0,0 +1,288 @@
+/*
+ * Copyright (C) 2015-2019 Alibaba Group Holding Limited
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <yunit.h>
+#include <yts.h>
+
+#include <zephyr.h>
+#include <misc/util.h>
+#include <misc/byteorder.h>
+#include <net/buf.h>
+#include <bluetooth.h>
+#include <api/mesh.h>
+
+#include "mesh.h"
+#include "adv.h"
+#include "net.h"
+
+/*
+ * Hands PDUs of the different priority classes to the adv thread and
+ * watches their send callbacks and the scheduler counters: a control PDU
+ * goes out ahead of the local traffic queued before it, relayed PDUs are
+ * refused once they hold half the adv buffers, and a relayed PDU that
+ * waits past its deadline is dropped rather than sent late.
+ * The node provisions itself unless the image has done so already.
+ * The cases run in real time, a few seconds in all.
+ */
+
+#define ADV_ADDR 0x0f01
+
+/* Relayed PDUs the scheduler admits, see adv.c */
+#define ADV_RELAY_MAX (CONFIG_BT_MESH_ADV_BUF_COUNT / 2)
+
+/* Long enough for everything queued by a case to have gone out */
+#define ADV_DRAIN_TIME 2000
+
+/* PDUs a case queues at most, leaving the node a few adv buffers */
+#define ADV_PDU_COUNT 10
+
+/* How long a start callback holds the adv thread; past the relay
+ * deadline.
+ */
+#define ADV_STALL_TIME 300
+
+static const u8_t g_net_key[16] = {
+    0x7d, 0xd7, 0x36, 0x4c, 0xd8, 0x42, 0xad, 0x18,
+    0xc1, 0x7c, 0x2b, 0x82, 0x0c, 0x84, 0xc3, 0xd6,
+};
+
+static u8_t g_dev_key[16];
+static u8_t g_uuid[16];
+
+static struct bt_mesh_model g_root_models[] = {
+    BT_MESH_MODEL_CFG_SRV(),
+};
+
+static struct bt_mesh_elem g_elements[] = {
+    BT_MESH_ELEM(0, g_root_models, BT_MESH_MODEL_NONE, 0),
+};
+
+static const struct bt_mesh_comp g_comp = {
+    .cid = 0x01A8,
+    .elem = g_elements,
+    .elem_count = ARRAY_SIZE(g_elements),
+};
+
+static const struct bt_mesh_prov g_prov = {
+    .uuid = g_uuid,
+};
+
+/* Order the PDUs of a case started in, by their index */
+static int g_started[ADV_PDU_COUNT];
+static int g_start_count;
+static int g_end_err[ADV_PDU_COUNT];
+
+/* PDU whose start callback keeps the adv thread, or -1 */
+static int g_stall = -1;
+
+static void adv_start(u16_t duration, int err, void *cb_data)
+{
+    int index = (int)(long)cb_data;
+
+    if (g_start_count < ADV_PDU_COUNT) {
+        g_started[g_start_count++] = index;
+    }
+
+    /* Callbacks run on the adv thread */
+    if (index == g_stall) {
+        k_sleep(ADV_STALL_TIME);
+    }
+}
+
+static void adv_end(int err, void *cb_data)
+{
+    g_end_err[(int)(long)cb_data] = err;
+}
+
+static const struct bt_mesh_send_cb adv_cb = {
+    .start = adv_start,
+    .end = adv_end,
+};
+
+/* A PDU of the given class with count + 1 transmissions, to the adv
+ * thread; the index identifies it in the callbacks.
+ */
+static int adv_send(enum bt_mesh_adv_prio prio, u8_t count, int index)
+{
+    struct net_buf *buf;
+
+    buf = bt_mesh_adv_create(BT_MESH_ADV_DATA, count, 20, K_NO_WAIT);
+    if (!buf) {
+        return -ENOBUFS;
+    }
+
+    BT_MESH_ADV(buf)->prio = prio;
+    memset(net_buf_add(buf, 20), index, 20);
+
+    g_end_err[index] = 1;
+    bt_mesh_adv_send(buf, &adv_cb, (void *)(long)index);
+    net_buf_unref(buf);
+
+    return 0;
+}
+
+/* A control PDU overtakes the local ones waiting before it */
+static void test_adv_prio(void)
+{
+    struct bt_mesh_adv_stats stats[BT_MESH_ADV_PRIO_COUNT];
+    int i;
+
+    /* The first local PDU holds the adv thread until all are queued */
+    g_stall = 0;
+    for (i = 0; i < ADV_PDU_COUNT - 1; i++) {
+        YUNIT_ASSERT_EQUAL(adv_send(BT_MESH_ADV_PRIO_LOCAL, 1, i), 0);
+    }
+    YUNIT_ASSERT_EQUAL(adv_send(BT_MESH_ADV_PRIO_CTL, 0, i), 0);
+
+    k_sleep(ADV_DRAIN_TIME);
+    g_stall = -1;
+
+    /* The thread takes queued PDUs in one at a time and starts a due one
+     * whenever the radio is free, so the second local PDU is on air
+     * before the rest are in; the control PDU goes right after it.
+     */
+    YUNIT_ASSERT_EQUAL(g_start_count, ADV_PDU_COUNT);
+    YUNIT_ASSERT_EQUAL(g_started[0], 0);
+    YUNIT_ASSERT_EQUAL(g_started[1], 1);
+    YUNIT_ASSERT_EQUAL(g_started[2], ADV_PDU_COUNT - 1);
+
+    for (i = 0; i < ADV_PDU_COUNT; i++) {
+        YUNIT_ASSERT_EQUAL(g_end_err[i], 0);
+    }
+
+    bt_mesh_adv_stats_get(stats);
+    YUNIT_ASSERT_EQUAL(stats[BT_MESH_ADV_PRIO_CTL].queued, 1);
+    YUNIT_ASSERT_EQUAL(stats[BT_MESH_ADV_PRIO_CTL].sent, 1);
+    YUNIT_ASSERT_EQUAL(stats[BT_MESH_ADV_PRIO_LOCAL].sent, ADV_PDU_COUNT - 1);
+    YUNIT_ASSERT_EQUAL(stats[BT_MESH_ADV_PRIO_LOCAL].depth, 0);
+    YUNIT_ASSERT(stats[BT_MESH_ADV_PRIO_LOCAL].depth_max >= ADV_PDU_COUNT / 2);
+}
+
+/* Relayed PDUs are turned away before they take every adv buffer */
+static void test_adv_relay_admission(void)
+{
+    struct bt_mesh_adv_stats stats[BT_MESH_ADV_PRIO_COUNT];
+    int i;
+
+    for (i = 0; i < ADV_RELAY_MAX + 2; i++) {
+        YUNIT_ASSERT_EQUAL(adv_send(BT_MESH_ADV_PRIO_RELAY, 0, i), 0);
+    }
+
+    k_sleep(ADV_DRAIN_TIME);
+
+    bt_mesh_adv_stats_get(stats);
+    YUNIT_ASSERT_EQUAL(stats[BT_MESH_ADV_PRIO_RELAY].rejected, 2);
+    YUNIT_ASSERT_EQUAL(stats[BT_MESH_ADV_PRIO_RELAY].queued, ADV_RELAY_MAX);
+    YUNIT_ASSERT_EQUAL(stats[BT_MESH_ADV_PRIO_RELAY].sent, ADV_RELAY_MAX);
+    YUNIT_ASSERT_EQUAL(stats[BT_MESH_ADV_PRIO_RELAY].depth, 0);
+
+    /* A refused relay is not sent, nor called back */
+    YUNIT_ASSERT_EQUAL(g_start_count, ADV_RELAY_MAX);
+    YUNIT_ASSERT_EQUAL(g_end_err[ADV_RELAY_MAX], 1);
+
+    /* The limit is on the relays held, not on the relays ever sent */
+    YUNIT_ASSERT_EQUAL(adv_send(BT_MESH_ADV_PRIO_RELAY, 0, 0), 0);
+    k_sleep(ADV_DRAIN_TIME);
+    bt_mesh_adv_stats_get(stats);
+    YUNIT_ASSERT_EQUAL(stats[BT_MESH_ADV_PRIO_RELAY].sent, ADV_RELAY_MAX + 1);
+}
+
+/* Relays kept waiting past their deadline, here by a sender holding the
+ * adv thread in its callback, are dropped rather than sent late.
+ */
+static void test_adv_relay_stale(void)
+{
+    struct bt_mesh_adv_stats stats[BT_MESH_ADV_PRIO_COUNT];
+    struct bt_mesh_adv_stats *relay = &stats[BT_MESH_ADV_PRIO_RELAY];
+    int i;
+
+    g_stall = 0;
+    YUNIT_ASSERT_EQUAL(adv_send(BT_MESH_ADV_PRIO_LOCAL, 0, 0), 0);
+    k_sleep(20);
+
+    for (i = 1; i < 4; i++) {
+        YUNIT_ASSERT_EQUAL(adv_send(BT_MESH_ADV_PRIO_RELAY, 0, i), 0);
+    }
+
+    k_sleep(ADV_STALL_TIME + 100);
+    g_stall = -1;
+
+    /* Not started, but still called back */
+    YUNIT_ASSERT_EQUAL(g_start_count, 1);
+    for (i = 1; i < 4; i++) {
+        YUNIT_ASSERT_EQUAL(g_end_err[i], -ETIMEDOUT);
+    }
+
+    /* A relay on time goes out as before */
+    YUNIT_ASSERT_EQUAL(adv_send(BT_MESH_ADV_PRIO_RELAY, 0, i), 0);
+    k_sleep(ADV_DRAIN_TIME);
+    YUNIT_ASSERT_EQUAL(g_end_err[i], 0);
+
+    bt_mesh_adv_stats_get(stats);
+    YUNIT_ASSERT_EQUAL(relay->queued, 4);
+    YUNIT_ASSERT_EQUAL(relay->dropped, 3);
+    YUNIT_ASSERT_EQUAL(relay->late, 3);
+    YUNIT_ASSERT_EQUAL(relay->sent, 1);
+    YUNIT_ASSERT_EQUAL(relay->depth, 0);
+    YUNIT_ASSERT_EQUAL(stats[BT_MESH_ADV_PRIO_LOCAL].sent, 1);
+    YUNIT_ASSERT_EQUAL(stats[BT_MESH_ADV_PRIO_LOCAL].dropped, 0);
+}
+
+static int init(void)
+{
+    int err;
+
+    if (bt_mesh_is_provisioned()) {
+        return 0;
+    }
+
+    bt_rand(g_dev_key, sizeof(g_dev_key));
+    bt_rand(g_uuid, sizeof(g_uuid));
+
+    err = bt_mesh_init(&g_prov, &g_comp);
+    if (err) {
+        return err;
+    }
+
+    return bt_mesh_provision(g_net_key, 0, 0, 0, 0, ADV_ADDR, g_dev_key);
+}
+
+static int cleanup(void)
+{
+    return 0;
+}
+
+static void setup(void)
+{
+    g_start_count = 0;
+    bt_mesh_adv_stats_reset();
+}
+
+static void teardown(void)
+{
+}
+
+static yunit_test_case_t bt_mesh_adv_prio_testcases[] = {
+    { "prio", test_adv_prio },
+    { "relay_admission", test_adv_relay_admission },
+    { "relay_stale", test_adv_relay_stale },
+    YUNIT_TEST_CASE_NULL
+};
+
+static yunit_test_suite_t suites[] = {
+    { "bt_mesh_adv_prio", init, cleanup, setup, teardown,
+      bt_mesh_adv_prio_testcases },
+    YUNIT_TEST_SUITE_NULL
+};
+
+void test_bt_mesh_adv_prio(void)
+{
+    yunit_add_test_suites(suites);
+}
+AOS_TESTCASE(test_bt_mesh_adv_prio);
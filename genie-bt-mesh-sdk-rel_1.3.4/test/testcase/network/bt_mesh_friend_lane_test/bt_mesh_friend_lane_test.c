@@ -0,0 +1,461 @@
+/*
+ * Copyright (C) 2015-2019 Alibaba Group Holding Limited
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <yunit.h>
+#include <yts.h>
+
+#include <zephyr.h>
+#include <misc/util.h>
+#include <misc/byteorder.h>
+#include <net/buf.h>
+#include <bluetooth.h>
+#include <api/mesh.h>
+
+#include "mesh.h"
+#include "net.h"
+#include "transport.h"
+#include "foundation.h"
+#include "friend.h"
+
+/*
+ * Befriends a Low Power Node by playing its Friend Request and Friend
+ * Poll into the friend code, then queues PDUs for it the way the
+ * transport layer does, to check the Friend Queue: which lane each PDU
+ * goes to and the order polls take them off in, that the LPN is held to
+ * its queue size by dropping data before acks and control, that a newer
+ * ack replaces the one queued before it, and how segments wait in their
+ * contexts until the message is complete.
+ * The node provisions itself unless the image has done so already.
+ * Each case befriends the LPN anew and ends the friendship again; they
+ * run in real time, about a second each.
+ */
+
+#define FRND_ADDR 0x0e01
+#define FRND_LPN 0x7e60
+#define FRND_SRC 0x0e40
+
+/* Friend Request values: a minimum queue of 8, the longest ReceiveDelay
+ * and PollTimeout, so that nothing runs out while a case goes on.
+ */
+#define FRND_CRITERIA 0x03
+#define FRND_RECV_DELAY 0xff
+#define FRND_POLL_TO 0x34bbff
+
+/* Long enough for the Friend Offer and for a poll to be answered */
+#define FRND_OFFER_TIME 500
+#define FRND_POLL_TIME 400
+
+/* Network PDU octets of a 16 octet access PDU and of a block ack */
+#define FRND_DATA_LEN 29
+#define FRND_ACK_LEN 24
+
+struct frnd_buf {
+    struct net_buf_simple buf;
+    u8_t data[16] __net_buf_align;
+};
+
+static const u8_t g_net_key[16] = {
+    0x7d, 0xd7, 0x36, 0x4c, 0xd8, 0x42, 0xad, 0x18,
+    0xc1, 0x7c, 0x2b, 0x82, 0x0c, 0x84, 0xc3, 0xd6,
+};
+
+static u8_t g_dev_key[16];
+static u8_t g_uuid[16];
+
+static struct bt_mesh_model g_root_models[] = {
+    BT_MESH_MODEL_CFG_SRV(),
+};
+
+static struct bt_mesh_elem g_elements[] = {
+    BT_MESH_ELEM(0, g_root_models, BT_MESH_MODEL_NONE, 0),
+};
+
+static const struct bt_mesh_comp g_comp = {
+    .cid = 0x01A8,
+    .elem = g_elements,
+    .elem_count = ARRAY_SIZE(g_elements),
+};
+
+static const struct bt_mesh_prov g_prov = {
+    .uuid = g_uuid,
+};
+
+static u16_t g_lpn_counter;
+static u32_t g_seq = 0x100;
+static u8_t g_fsn;
+
+static void frnd_rx_init(struct bt_mesh_net_rx *rx, u16_t src, u16_t dst)
+{
+    memset(rx, 0, sizeof(*rx));
+    rx->sub = &bt_mesh.sub[0];
+    rx->ctx.net_idx = bt_mesh.sub[0].net_idx;
+    rx->ctx.app_idx = BT_MESH_KEY_UNUSED;
+    rx->ctx.addr = src;
+    rx->ctx.recv_ttl = 5;
+    rx->ctx.send_ttl = 5;
+    rx->seq = g_seq++;
+    rx->dst = dst;
+    rx->net_if = BT_MESH_NET_IF_ADV;
+}
+
+/* Friend Poll from the LPN, answered after its ReceiveDelay */
+static int frnd_poll_send(void)
+{
+    struct bt_mesh_net_rx rx;
+    struct frnd_buf msg;
+
+    frnd_rx_init(&rx, FRND_LPN, bt_mesh_primary_addr());
+    rx.ctl = 1;
+
+    msg.buf.size = sizeof(msg.data);
+    net_buf_simple_init(&msg.buf, 0);
+    net_buf_simple_add_u8(&msg.buf, g_fsn);
+    g_fsn ^= 1;
+
+    return bt_mesh_friend_poll(&rx, &msg.buf);
+}
+
+/* Friend Poll, and the time for it to be answered */
+static int frnd_poll(void)
+{
+    int err;
+
+    err = frnd_poll_send();
+    k_sleep(FRND_POLL_TIME);
+
+    return err;
+}
+
+/* Friend Request, Offer and the first Poll, which leaves the LPN with
+ * an empty queue and the Friend Update it got as the last PDU.
+ */
+static int frnd_establish(void)
+{
+    struct bt_mesh_ctl_friend_req *req;
+    struct bt_mesh_net_rx rx;
+    struct frnd_buf msg;
+    int err;
+
+    frnd_rx_init(&rx, FRND_LPN, BT_MESH_ADDR_FRIENDS);
+    rx.ctl = 1;
+
+    msg.buf.size = sizeof(msg.data);
+    net_buf_simple_init(&msg.buf, 0);
+    req = net_buf_simple_add(&msg.buf, sizeof(*req));
+    req->criteria = FRND_CRITERIA;
+    req->recv_delay = FRND_RECV_DELAY;
+    req->poll_to[0] = (FRND_POLL_TO >> 16) & 0xff;
+    req->poll_to[1] = (FRND_POLL_TO >> 8) & 0xff;
+    req->poll_to[2] = FRND_POLL_TO & 0xff;
+    req->prev_addr = sys_cpu_to_be16(BT_MESH_ADDR_UNASSIGNED);
+    req->num_elem = 1;
+    req->lpn_counter = sys_cpu_to_be16(g_lpn_counter);
+    g_lpn_counter++;
+
+    err = bt_mesh_friend_req(&rx, &msg.buf);
+    if (err) {
+        return err;
+    }
+
+    k_sleep(FRND_OFFER_TIME);
+
+    g_fsn = 0;
+    return frnd_poll();
+}
+
+/* Access PDU of a single unsegmented message from src */
+static void frnd_data(u16_t src)
+{
+    struct bt_mesh_net_rx rx;
+    struct frnd_buf msg;
+
+    frnd_rx_init(&rx, src, FRND_LPN);
+    rx.friend_match = 1;
+
+    msg.buf.size = sizeof(msg.data);
+    net_buf_simple_init(&msg.buf, 0);
+    memset(net_buf_simple_add(&msg.buf, 16), 0x5a, 16);
+
+    bt_mesh_friend_enqueue_rx(&rx, BT_MESH_FRIEND_PDU_SINGLE, NULL,
+                              &msg.buf);
+}
+
+/* Segment of a message from src, part of the one of seq_auth */
+static void frnd_seg(u16_t src, u64_t seq_auth,
+                     enum bt_mesh_friend_pdu_type type)
+{
+    struct bt_mesh_net_rx rx;
+    struct frnd_buf msg;
+
+    frnd_rx_init(&rx, src, FRND_LPN);
+    rx.friend_match = 1;
+
+    msg.buf.size = sizeof(msg.data);
+    net_buf_simple_init(&msg.buf, 0);
+    memset(net_buf_simple_add(&msg.buf, 16), 0xa5, 16);
+
+    bt_mesh_friend_enqueue_rx(&rx, type, &seq_auth, &msg.buf);
+}
+
+/* Block ack from src for its message of seq_auth */
+static void frnd_ack(u16_t src, u64_t seq_auth)
+{
+    struct bt_mesh_net_rx rx;
+    struct frnd_buf msg;
+
+    frnd_rx_init(&rx, src, FRND_LPN);
+    rx.friend_match = 1;
+    rx.ctl = 1;
+
+    msg.buf.size = sizeof(msg.data);
+    net_buf_simple_init(&msg.buf, 0);
+    net_buf_simple_add_u8(&msg.buf, 0x00);
+    net_buf_simple_add_be16(&msg.buf, (seq_auth & 0x1fff) << 2);
+    net_buf_simple_add_be32(&msg.buf, 0x1);
+
+    bt_mesh_friend_enqueue_rx(&rx, BT_MESH_FRIEND_PDU_SINGLE, &seq_auth,
+                              &msg.buf);
+}
+
+static int frnd_queue(struct bt_mesh_friend_queue *q)
+{
+    static struct bt_mesh_friend_queue queue[CONFIG_BT_MESH_FRIEND_LPN_COUNT];
+    int i, count;
+
+    count = bt_mesh_friend_queue_get(queue);
+    for (i = 0; i < count; i++) {
+        if (queue[i].lpn == FRND_LPN) {
+            *q = queue[i];
+            return 0;
+        }
+    }
+
+    memset(q, 0, sizeof(*q));
+    return -ENOENT;
+}
+
+static int frnd_queue_size(const struct bt_mesh_friend_queue *q)
+{
+    return q->size[BT_MESH_FRIEND_LANE_CTL] +
+           q->size[BT_MESH_FRIEND_LANE_ACK] +
+           q->size[BT_MESH_FRIEND_LANE_DATA];
+}
+
+/* Control before acks before data, whatever order they came in */
+static void test_frnd_lane_order(void)
+{
+    struct bt_mesh_friend_stats stats;
+    struct bt_mesh_friend_queue q;
+
+    /* A poll on an empty queue gets a Friend Update, which the PDUs
+     * coming in before the answer is due queue up behind.
+     */
+    YUNIT_ASSERT_EQUAL(frnd_poll_send(), 0);
+    frnd_data(FRND_SRC);
+    frnd_data(FRND_SRC);
+    frnd_ack(FRND_SRC + 1, 0x1234);
+
+    YUNIT_ASSERT_EQUAL(frnd_queue(&q), 0);
+    YUNIT_ASSERT_EQUAL(q.size[BT_MESH_FRIEND_LANE_CTL], 1);
+    YUNIT_ASSERT_EQUAL(q.size[BT_MESH_FRIEND_LANE_ACK], 1);
+    YUNIT_ASSERT_EQUAL(q.size[BT_MESH_FRIEND_LANE_DATA], 2);
+
+    /* The Update goes first, then the ack although the data was there
+     * before it.
+     */
+    k_sleep(FRND_POLL_TIME);
+    frnd_queue(&q);
+    YUNIT_ASSERT_EQUAL(q.size[BT_MESH_FRIEND_LANE_CTL], 0);
+    YUNIT_ASSERT_EQUAL(q.size[BT_MESH_FRIEND_LANE_ACK], 1);
+    YUNIT_ASSERT_EQUAL(q.size[BT_MESH_FRIEND_LANE_DATA], 2);
+    YUNIT_ASSERT_EQUAL(q.bytes, FRND_DATA_LEN * 2 + FRND_ACK_LEN);
+
+    YUNIT_ASSERT_EQUAL(frnd_poll(), 0);
+    frnd_queue(&q);
+    YUNIT_ASSERT_EQUAL(q.size[BT_MESH_FRIEND_LANE_ACK], 0);
+    YUNIT_ASSERT_EQUAL(q.size[BT_MESH_FRIEND_LANE_DATA], 2);
+
+    YUNIT_ASSERT_EQUAL(frnd_poll(), 0);
+    YUNIT_ASSERT_EQUAL(frnd_poll(), 0);
+    frnd_queue(&q);
+    YUNIT_ASSERT_EQUAL(frnd_queue_size(&q), 0);
+    YUNIT_ASSERT_EQUAL(q.bytes, 0);
+
+    bt_mesh_friend_stats_get(&stats);
+    YUNIT_ASSERT_EQUAL(stats.queued[BT_MESH_FRIEND_LANE_CTL], 1);
+    YUNIT_ASSERT_EQUAL(stats.queued[BT_MESH_FRIEND_LANE_ACK], 1);
+    YUNIT_ASSERT_EQUAL(stats.queued[BT_MESH_FRIEND_LANE_DATA], 2);
+    YUNIT_ASSERT_EQUAL(stats.sent, 4);
+}
+
+/* An LPN that stops polling keeps its queue size, losing data first */
+static void test_frnd_evict(void)
+{
+    struct bt_mesh_friend_stats stats;
+    struct bt_mesh_friend_queue q;
+    int i, count = CONFIG_BT_MESH_FRIEND_QUEUE_SIZE + 4;
+
+    frnd_ack(FRND_SRC + 1, 0x1234);
+
+    for (i = 0; i < count; i++) {
+        frnd_data(FRND_SRC);
+
+        frnd_queue(&q);
+        YUNIT_ASSERT(frnd_queue_size(&q) <= CONFIG_BT_MESH_FRIEND_QUEUE_SIZE);
+        YUNIT_ASSERT(q.bytes <= CONFIG_BT_MESH_FRIEND_QUEUE_BYTES);
+    }
+
+    YUNIT_ASSERT_EQUAL(frnd_queue_size(&q), CONFIG_BT_MESH_FRIEND_QUEUE_SIZE);
+    YUNIT_ASSERT_EQUAL(q.size[BT_MESH_FRIEND_LANE_ACK], 1);
+    YUNIT_ASSERT_EQUAL(q.size[BT_MESH_FRIEND_LANE_DATA],
+                       CONFIG_BT_MESH_FRIEND_QUEUE_SIZE - 1);
+    YUNIT_ASSERT(q.peak <= CONFIG_BT_MESH_FRIEND_QUEUE_BYTES);
+
+    /* Dropped for the budget or, with the last PDU held, for a buffer */
+    bt_mesh_friend_stats_get(&stats);
+    YUNIT_ASSERT_EQUAL(stats.evict_budget + stats.evict_pool,
+                       count + 1 - CONFIG_BT_MESH_FRIEND_QUEUE_SIZE);
+    YUNIT_ASSERT_EQUAL(stats.alloc_failed, 0);
+
+    /* The ack is still the first to go out */
+    YUNIT_ASSERT_EQUAL(frnd_poll(), 0);
+    frnd_queue(&q);
+    YUNIT_ASSERT_EQUAL(q.size[BT_MESH_FRIEND_LANE_ACK], 0);
+    YUNIT_ASSERT_EQUAL(q.size[BT_MESH_FRIEND_LANE_DATA],
+                       CONFIG_BT_MESH_FRIEND_QUEUE_SIZE - 1);
+}
+
+/* A newer ack for the same message replaces the queued one */
+static void test_frnd_ack_purge(void)
+{
+    struct bt_mesh_friend_stats stats;
+    struct bt_mesh_friend_queue q;
+
+    frnd_ack(FRND_SRC, 0x1234);
+    frnd_ack(FRND_SRC, 0x1234);
+
+    bt_mesh_friend_stats_get(&stats);
+    YUNIT_ASSERT_EQUAL(stats.ack_purged, 1);
+    frnd_queue(&q);
+    YUNIT_ASSERT_EQUAL(q.size[BT_MESH_FRIEND_LANE_ACK], 1);
+    YUNIT_ASSERT_EQUAL(q.bytes, FRND_ACK_LEN);
+
+    /* Another source or another message is a different ack */
+    frnd_ack(FRND_SRC + 1, 0x1234);
+    frnd_ack(FRND_SRC, 0x1235);
+
+    bt_mesh_friend_stats_get(&stats);
+    YUNIT_ASSERT_EQUAL(stats.ack_purged, 1);
+    frnd_queue(&q);
+    YUNIT_ASSERT_EQUAL(q.size[BT_MESH_FRIEND_LANE_ACK], 3);
+    YUNIT_ASSERT_EQUAL(q.bytes, FRND_ACK_LEN * 3);
+}
+
+/* Segments wait in a context of their own until the message completes */
+static void test_frnd_seg(void)
+{
+    struct bt_mesh_friend_stats stats;
+    struct bt_mesh_friend_queue q;
+    u64_t seq_auth = 0x2000;
+    int i;
+
+    for (i = 0; i < CONFIG_BT_MESH_FRIEND_SEG_RX; i++) {
+        frnd_seg(FRND_SRC + i, seq_auth + i, BT_MESH_FRIEND_PDU_PARTIAL);
+        frnd_seg(FRND_SRC + i, seq_auth + i, BT_MESH_FRIEND_PDU_PARTIAL);
+    }
+
+    frnd_queue(&q);
+    YUNIT_ASSERT_EQUAL(frnd_queue_size(&q), 0);
+    YUNIT_ASSERT_EQUAL(q.seg, CONFIG_BT_MESH_FRIEND_SEG_RX);
+
+    /* No context left for one more source */
+    frnd_seg(FRND_SRC + i, seq_auth + i, BT_MESH_FRIEND_PDU_PARTIAL);
+    bt_mesh_friend_stats_get(&stats);
+    YUNIT_ASSERT_EQUAL(stats.seg_no_ctx, 1);
+
+    /* The complete message moves to the data lane, as plain data */
+    frnd_seg(FRND_SRC, seq_auth, BT_MESH_FRIEND_PDU_COMPLETE);
+    frnd_queue(&q);
+    YUNIT_ASSERT_EQUAL(q.size[BT_MESH_FRIEND_LANE_DATA], 3);
+    YUNIT_ASSERT_EQUAL(q.size[BT_MESH_FRIEND_LANE_ACK], 0);
+    YUNIT_ASSERT_EQUAL(q.seg, CONFIG_BT_MESH_FRIEND_SEG_RX - 1);
+
+    /* The freed context takes the next message, given up on later */
+    seq_auth = 0x3000;
+    frnd_seg(FRND_SRC + 8, seq_auth, BT_MESH_FRIEND_PDU_PARTIAL);
+    frnd_queue(&q);
+    YUNIT_ASSERT_EQUAL(q.seg, CONFIG_BT_MESH_FRIEND_SEG_RX);
+
+    bt_mesh_friend_clear_incomplete(&bt_mesh.sub[0], FRND_SRC + 8,
+                                    FRND_LPN, &seq_auth);
+    frnd_queue(&q);
+    YUNIT_ASSERT_EQUAL(q.seg, CONFIG_BT_MESH_FRIEND_SEG_RX - 1);
+    YUNIT_ASSERT_EQUAL(q.size[BT_MESH_FRIEND_LANE_DATA], 3);
+
+    bt_mesh_friend_stats_get(&stats);
+    YUNIT_ASSERT_EQUAL(stats.seg_no_ctx, 1);
+    YUNIT_ASSERT_EQUAL(stats.seg_cleared, 1);
+}
+
+static int init(void)
+{
+    int err;
+
+    if (bt_mesh_is_provisioned()) {
+        return 0;
+    }
+
+    bt_rand(g_dev_key, sizeof(g_dev_key));
+    bt_rand(g_uuid, sizeof(g_uuid));
+
+    err = bt_mesh_init(&g_prov, &g_comp);
+    if (err) {
+        return err;
+    }
+
+    return bt_mesh_provision(g_net_key, 0, 0, 0, 0, FRND_ADDR, g_dev_key);
+}
+
+static int cleanup(void)
+{
+    bt_mesh_friend_clear_net_idx(BT_MESH_KEY_ANY);
+    return 0;
+}
+
+static void setup(void)
+{
+    YUNIT_ASSERT_EQUAL(bt_mesh_friend_get(), BT_MESH_FRIEND_ENABLED);
+    YUNIT_ASSERT_EQUAL(frnd_establish(), 0);
+    bt_mesh_friend_stats_reset();
+}
+
+static void teardown(void)
+{
+    bt_mesh_friend_clear_net_idx(BT_MESH_KEY_ANY);
+}
+
+static yunit_test_case_t bt_mesh_friend_lane_testcases[] = {
+    { "lane_order", test_frnd_lane_order },
+    { "evict", test_frnd_evict },
+    { "ack_purge", test_frnd_ack_purge },
+    { "seg", test_frnd_seg },
+    YUNIT_TEST_CASE_NULL
+};
+
+static yunit_test_suite_t suites[] = {
+    { "bt_mesh_friend_lane", init, cleanup, setup, teardown,
+      bt_mesh_friend_lane_testcases },
+    YUNIT_TEST_SUITE_NULL
+};
+
+void test_bt_mesh_friend_lane(void)
+{
+    yunit_add_test_suites(suites);
+}
+AOS_TESTCASE(test_bt_mesh_friend_lane);
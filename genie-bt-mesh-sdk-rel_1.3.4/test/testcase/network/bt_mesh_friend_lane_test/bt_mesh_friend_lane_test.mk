@@ -0,0 +1,7 @@
+NAME := bt_mesh_friend_lane_test
+
+$(NAME)_COMPONENTS  += bluetooth.bt_mesh
+
+$(NAME)_SOURCES     += bt_mesh_friend_lane_test.c
+
+$(NAME)_CFLAGS      += -Wall -Werror
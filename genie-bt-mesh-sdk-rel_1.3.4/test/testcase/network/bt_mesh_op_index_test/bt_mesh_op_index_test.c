@@ -0,0 +1,472 @@
+/*
+ * Copyright (C) 2015-2019 Alibaba Group Holding Limited
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <yunit.h>
+#include <yts.h>
+
+#include <zephyr.h>
+#include <misc/util.h>
+#include <misc/byteorder.h>
+#include <net/buf.h>
+#include <bluetooth.h>
+#include <api/mesh.h>
+
+#include "mesh.h"
+#include "net.h"
+#include "access.h"
+
+/*
+ * Registers random compositions and checks that the sorted OpCode index
+ * finds the same models as the linear walk over elements and models, for
+ * unicast, group and the genie all-nodes destinations. Messages also go
+ * through bt_mesh_model_recv and the handlers that run are compared with a
+ * walk done here. Oversized compositions must fall back to the walk.
+ * The composition in place before the suite is registered again at the
+ * end, which clears its AppKey bindings.
+ */
+
+#ifdef YTS_LINUX
+#define OP_ROUNDS 500
+#else
+#define OP_ROUNDS 50
+#endif
+
+#define OP_ADDR 0x0c01
+#define OP_CID 0x01A8
+#define OP_ELEM_MAX 6
+#define OP_ELEM_WIDE (ACCESS_ELEM_MAX + 1)
+#define OP_MODEL_POOL 64
+#define OP_VND_POOL 16
+#define OP_LOG_MAX 64
+
+/* Elements the index covers, as in access.c */
+#define ACCESS_ELEM_MAX 32
+
+static void op_handler(struct bt_mesh_model *model,
+                       struct bt_mesh_msg_ctx *ctx,
+                       struct net_buf_simple *buf);
+
+#define OP_SIG(op) { (op), 0, op_handler }
+#define OP_VND(op) { BT_MESH_MODEL_OP_3(op, OP_CID), 0, op_handler }
+
+/* Op lists sharing OpCodes, so that several models and elements compete
+ * for the same message.
+ */
+static const struct bt_mesh_model_op g_sig_ops[][9] = {
+    { OP_SIG(0x01), OP_SIG(0x8201), BT_MESH_MODEL_OP_END },
+    { OP_SIG(0x02), OP_SIG(0x8201), OP_SIG(0x8202), BT_MESH_MODEL_OP_END },
+    { OP_SIG(0x01), OP_SIG(0x02), OP_SIG(0x03), BT_MESH_MODEL_OP_END },
+    { OP_SIG(0x8203), BT_MESH_MODEL_OP_END },
+    { OP_SIG(0x8204), OP_SIG(0x03), BT_MESH_MODEL_OP_END },
+    {
+        OP_SIG(0x01), OP_SIG(0x02), OP_SIG(0x03), OP_SIG(0x8201),
+        OP_SIG(0x8202), OP_SIG(0x8203), OP_SIG(0x8204), OP_SIG(0x8205),
+        BT_MESH_MODEL_OP_END
+    },
+};
+
+static const struct bt_mesh_model_op g_vnd_ops[][4] = {
+    { OP_VND(0x01), OP_VND(0x02), BT_MESH_MODEL_OP_END },
+    { OP_VND(0x02), OP_VND(0x03), BT_MESH_MODEL_OP_END },
+    { OP_VND(0x01), OP_VND(0x03), OP_VND(0x04), BT_MESH_MODEL_OP_END },
+};
+
+static const u32_t g_opcodes[] = {
+    0x01, 0x02, 0x03, 0x04, 0x8201, 0x8202, 0x8203, 0x8204, 0x8205, 0x8206,
+    BT_MESH_MODEL_OP_3(0x01, OP_CID), BT_MESH_MODEL_OP_3(0x02, OP_CID),
+    BT_MESH_MODEL_OP_3(0x03, OP_CID), BT_MESH_MODEL_OP_3(0x04, OP_CID),
+    BT_MESH_MODEL_OP_3(0x05, OP_CID),
+};
+
+static const u16_t g_keys[] = { 0, 1, 2, BT_MESH_KEY_DEV, BT_MESH_KEY_UNUSED };
+
+static const u16_t g_groups[] = {
+    0xc001, 0xc002, 0xc003, 0xc004, BT_MESH_ADDR_UNASSIGNED,
+};
+
+static struct bt_mesh_elem g_elems[OP_ELEM_WIDE];
+static struct bt_mesh_model g_models[OP_MODEL_POOL];
+static struct bt_mesh_model g_vnd_models[OP_VND_POOL];
+static struct bt_mesh_comp g_comp;
+static const struct bt_mesh_comp *g_old_comp;
+static u16_t g_old_addr;
+
+static struct bt_mesh_model *g_log[OP_LOG_MAX];
+static int g_log_count;
+static u32_t g_rand = 1;
+
+static u32_t op_rand(void)
+{
+    g_rand = g_rand * 1103515245 + 12345;
+    return g_rand >> 8;
+}
+
+static void op_handler(struct bt_mesh_model *model,
+                       struct bt_mesh_msg_ctx *ctx,
+                       struct net_buf_simple *buf)
+{
+    if (g_log_count < OP_LOG_MAX) {
+        g_log[g_log_count] = model;
+    }
+    g_log_count++;
+}
+
+/* Models and elements have const members, so they are built on the
+ * stack and copied into place.
+ */
+static void op_model_set(struct bt_mesh_model *dst, bool vnd, u16_t id,
+                         const struct bt_mesh_model_op *op)
+{
+    struct bt_mesh_model sig = BT_MESH_MODEL(0x1000 + id, op, NULL, NULL);
+    struct bt_mesh_model ven = BT_MESH_MODEL_VND(OP_CID, id, op, NULL, NULL);
+
+    memcpy(dst, vnd ? &ven : &sig, sizeof(*dst));
+}
+
+static void op_elem_set(struct bt_mesh_elem *dst, u16_t grop_addr,
+                        struct bt_mesh_model *models, u8_t count,
+                        struct bt_mesh_model *vnd_models, u8_t vnd_count)
+{
+    struct bt_mesh_elem elem = {
+        .grop_addr = grop_addr,
+        .model_count = count,
+        .vnd_model_count = vnd_count,
+        .models = models,
+        .vnd_models = vnd_models,
+    };
+
+    memcpy(dst, &elem, sizeof(*dst));
+}
+
+static void op_model_bind(struct bt_mesh_model *model)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(model->keys); i++) {
+        model->keys[i] = g_keys[op_rand() % ARRAY_SIZE(g_keys)];
+    }
+
+    for (i = 0; i < ARRAY_SIZE(model->groups); i++) {
+        model->groups[i] = g_groups[op_rand() % ARRAY_SIZE(g_groups)];
+    }
+}
+
+/* Registers and provisions g_comp, then binds keys and subscribes, which
+ * registering would have cleared.
+ */
+static int op_comp_apply(int elem_count)
+{
+    int i, j, err;
+
+    g_comp.cid = OP_CID;
+    g_comp.elem = g_elems;
+    g_comp.elem_count = elem_count;
+
+    err = bt_mesh_comp_register(&g_comp);
+    if (err) {
+        return err;
+    }
+
+    bt_mesh_comp_provision(OP_ADDR);
+
+    for (i = 0; i < elem_count; i++) {
+        for (j = 0; j < g_elems[i].model_count; j++) {
+            op_model_bind(&g_elems[i].models[j]);
+        }
+
+        for (j = 0; j < g_elems[i].vnd_model_count; j++) {
+            op_model_bind(&g_elems[i].vnd_models[j]);
+        }
+    }
+
+    bt_mesh_elem_group_rebuild();
+
+    return 0;
+}
+
+static int op_comp_random(void)
+{
+    int elem_count = 1 + op_rand() % OP_ELEM_MAX;
+    int models = 0, vnd_models = 0;
+    u8_t count, vnd_count;
+    int i, j;
+
+    for (i = 0; i < elem_count; i++) {
+        count = 1 + op_rand() % 4;
+        vnd_count = op_rand() % 3;
+
+        for (j = 0; j < count; j++) {
+            op_model_set(&g_models[models + j], false, j,
+                         g_sig_ops[op_rand() % ARRAY_SIZE(g_sig_ops)]);
+        }
+
+        for (j = 0; j < vnd_count; j++) {
+            op_model_set(&g_vnd_models[vnd_models + j], true, j,
+                         g_vnd_ops[op_rand() % ARRAY_SIZE(g_vnd_ops)]);
+        }
+
+        op_elem_set(&g_elems[i], op_rand() % 2 ? 0xc005 : 0,
+                    &g_models[models], count, &g_vnd_models[vnd_models],
+                    vnd_count);
+
+        models += count;
+        vnd_models += vnd_count;
+    }
+
+    return op_comp_apply(elem_count);
+}
+
+static bool op_model_has_op(const struct bt_mesh_model *model, u32_t opcode)
+{
+    const struct bt_mesh_model_op *op;
+
+    for (op = model->op; op->func; op++) {
+        if (op->opcode == opcode) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool op_model_has_key(const struct bt_mesh_model *model, u16_t app_idx)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(model->keys); i++) {
+        if (model->keys[i] == app_idx) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool op_elem_has_dst(const struct bt_mesh_elem *elem, u16_t dst)
+{
+    const struct bt_mesh_model *model;
+    int i, j;
+
+    if (BT_MESH_ADDR_IS_UNICAST(dst)) {
+        return elem->addr == dst;
+    }
+
+    if (dst == elem->grop_addr || dst == BT_MESH_ADDR_GENIE_ALL_NODES) {
+        return elem->model_count || elem->vnd_model_count;
+    }
+
+    for (i = 0; i < elem->model_count + elem->vnd_model_count; i++) {
+        model = i < elem->model_count ? &elem->models[i] :
+                &elem->vnd_models[i - elem->model_count];
+
+        for (j = 0; j < ARRAY_SIZE(model->groups); j++) {
+            if (model->groups[j] == dst) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+/* The models that should take the message: per element to dst, the first
+ * model of the right kind that is bound to the key and has the OpCode.
+ */
+static int op_reference(u16_t dst, u16_t app_idx, u32_t opcode,
+                        struct bt_mesh_model **out)
+{
+    struct bt_mesh_model *models;
+    int i, j, count = 0;
+    u8_t num;
+
+    for (i = 0; i < g_comp.elem_count; i++) {
+        if (!op_elem_has_dst(&g_elems[i], dst)) {
+            continue;
+        }
+
+        models = opcode < 0x10000 ? g_elems[i].models : g_elems[i].vnd_models;
+        num = opcode < 0x10000 ? g_elems[i].model_count :
+              g_elems[i].vnd_model_count;
+
+        for (j = 0; j < num; j++) {
+            if (op_model_has_key(&models[j], app_idx) &&
+                op_model_has_op(&models[j], opcode)) {
+                out[count++] = &models[j];
+                break;
+            }
+        }
+    }
+
+    return count;
+}
+
+static void op_recv(u16_t dst, u16_t app_idx, u32_t opcode)
+{
+    struct bt_mesh_net_rx rx = {
+        .ctx = {
+            .app_idx = app_idx,
+            .addr = 0x0001,
+        },
+        .dst = dst,
+    };
+    struct net_buf_simple *buf = NET_BUF_SIMPLE(8);
+
+    bt_mesh_model_msg_init(buf, opcode);
+
+    g_log_count = 0;
+    bt_mesh_model_recv(&rx, buf);
+}
+
+/* Every destination, key and OpCode against the current composition;
+ * the number of messages some model took.
+ */
+static int op_check_all(int *fails)
+{
+    struct bt_mesh_model *ref[OP_ELEM_WIDE];
+    u16_t dsts[OP_ELEM_WIDE + ARRAY_SIZE(g_groups) + 2];
+    int dst_count = 0, taken = 0;
+    int d, k, o, n, count;
+
+    for (d = 0; d <= g_comp.elem_count; d++) {
+        dsts[dst_count++] = OP_ADDR + d;
+    }
+
+    for (d = 0; d < ARRAY_SIZE(g_groups) - 1; d++) {
+        dsts[dst_count++] = g_groups[d];
+    }
+
+    dsts[dst_count++] = 0xc005;
+    dsts[dst_count++] = BT_MESH_ADDR_GENIE_ALL_NODES;
+
+    for (d = 0; d < dst_count; d++) {
+        for (k = 0; k < ARRAY_SIZE(g_keys) - 1; k++) {
+            for (o = 0; o < ARRAY_SIZE(g_opcodes); o++) {
+                count = op_reference(dsts[d], g_keys[k], g_opcodes[o], ref);
+
+                if (bt_mesh_model_op_match(dsts[d], g_keys[k], g_opcodes[o],
+                                           false) != count ||
+                    bt_mesh_model_op_match(dsts[d], g_keys[k], g_opcodes[o],
+                                           true) != count) {
+                    (*fails)++;
+                    continue;
+                }
+
+                op_recv(dsts[d], g_keys[k], g_opcodes[o]);
+                if (g_log_count != count) {
+                    (*fails)++;
+                    continue;
+                }
+
+                for (n = 0; n < count; n++) {
+                    if (g_log[n] != ref[n]) {
+                        (*fails)++;
+                        break;
+                    }
+                }
+
+                taken += !!count;
+            }
+        }
+    }
+
+    return taken;
+}
+
+static void test_op_index_random(void)
+{
+    int round, fails = 0, taken = 0;
+
+    for (round = 0; round < OP_ROUNDS; round++) {
+        YUNIT_ASSERT_EQUAL(op_comp_random(), 0);
+        taken += op_check_all(&fails);
+    }
+
+    YUNIT_ASSERT_EQUAL(fails, 0);
+    YUNIT_ASSERT(taken > 0);
+}
+
+/* More (element, model, OpCode) entries than the index holds */
+static void test_op_index_full(void)
+{
+    int models = CONFIG_BT_MESH_OP_INDEX_SIZE / 8 + 1;
+    int i, fails = 0;
+
+    YUNIT_ASSERT(models <= OP_MODEL_POOL);
+
+    for (i = 0; i < models; i++) {
+        op_model_set(&g_models[i], false, i, g_sig_ops[5]);
+    }
+
+    op_elem_set(&g_elems[0], 0, g_models, models, g_vnd_models, 0);
+    YUNIT_ASSERT_EQUAL(op_comp_apply(1), 0);
+
+    YUNIT_ASSERT(op_check_all(&fails) > 0);
+    YUNIT_ASSERT_EQUAL(fails, 0);
+}
+
+/* More elements than the index covers */
+static void test_op_index_wide(void)
+{
+    int i, fails = 0;
+
+    for (i = 0; i < OP_ELEM_WIDE; i++) {
+        op_model_set(&g_models[i], false, 0,
+                     g_sig_ops[i % ARRAY_SIZE(g_sig_ops)]);
+        op_elem_set(&g_elems[i], 0, &g_models[i], 1, g_vnd_models, 0);
+    }
+
+    YUNIT_ASSERT_EQUAL(op_comp_apply(OP_ELEM_WIDE), 0);
+
+    YUNIT_ASSERT(op_check_all(&fails) > 0);
+    YUNIT_ASSERT_EQUAL(fails, 0);
+}
+
+static int init(void)
+{
+    g_old_comp = bt_mesh_comp_get();
+    g_old_addr = bt_mesh_primary_addr();
+    return 0;
+}
+
+static int cleanup(void)
+{
+    if (g_old_comp) {
+        bt_mesh_comp_register(g_old_comp);
+        bt_mesh_comp_provision(g_old_addr);
+    }
+
+    return 0;
+}
+
+static void setup(void)
+{
+}
+
+static void teardown(void)
+{
+}
+
+static yunit_test_case_t bt_mesh_op_index_testcases[] = {
+    { "random", test_op_index_random },
+    { "full", test_op_index_full },
+    { "wide", test_op_index_wide },
+    YUNIT_TEST_CASE_NULL
+};
+
+static yunit_test_suite_t suites[] = {
+    { "bt_mesh_op_index", init, cleanup, setup, teardown,
+      bt_mesh_op_index_testcases },
+    YUNIT_TEST_SUITE_NULL
+};
+
+void test_bt_mesh_op_index(void)
+{
+    yunit_add_test_suites(suites);
+}
+AOS_TESTCASE(test_bt_mesh_op_index);
@@ -0,0 +1,355 @@
+/*
+ * Copyright (C) 2015-2019 Alibaba Group Holding Limited
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <yunit.h>
+#include <yts.h>
+
+#include <zephyr.h>
+#include <misc/util.h>
+#include <misc/byteorder.h>
+#include <net/buf.h>
+#include <bluetooth.h>
+#include <crypto.h>
+#include <api/mesh.h>
+
+#include "mesh_crypto.h"
+#include "mesh.h"
+#include "net.h"
+#include "access.h"
+#include "transport.h"
+
+/*
+ * Feeds device key encrypted segmented messages straight into the lower
+ * transport and watches the shared RX segment pool through the segment
+ * counters. Every SDU has to pass its MIC once reassembled, so a segment
+ * stored in the wrong slot shows up as a failed receive.
+ * The node provisions itself unless the image has done so already.
+ */
+
+#ifdef YTS_LINUX
+#define POOL_ROUNDS 200
+#else
+#define POOL_ROUNDS 20
+#endif
+
+#define POOL_ADDR 0x0b01
+#define POOL_SRC 0x7e00
+#define POOL_SEG_LEN 12
+#define POOL_SEG_MAX 32
+#define POOL_MIC_LEN 4
+
+struct pool_buf {
+    struct net_buf_simple buf;
+    u8_t data[CONFIG_BT_MESH_RX_SDU_MAX + BT_MESH_NET_HDR_LEN + 8] __net_buf_align;
+};
+
+struct pool_msg {
+    u16_t src;
+    u32_t seq;
+    u8_t seg_n;
+    u16_t len;
+    u8_t data[POOL_SEG_MAX * POOL_SEG_LEN];
+};
+
+static const u8_t g_net_key[16] = {
+    0x7d, 0xd7, 0x36, 0x4c, 0xd8, 0x42, 0xad, 0x18,
+    0xc1, 0x7c, 0x2b, 0x82, 0x0c, 0x84, 0xc3, 0xd6,
+};
+
+static u8_t g_dev_key[16];
+static u8_t g_uuid[16];
+
+static struct bt_mesh_model g_root_models[] = {
+    BT_MESH_MODEL_CFG_SRV(),
+};
+
+static struct bt_mesh_elem g_elements[] = {
+    BT_MESH_ELEM(0, g_root_models, BT_MESH_MODEL_NONE, 0),
+};
+
+static const struct bt_mesh_comp g_comp = {
+    .cid = 0x01A8,
+    .elem = g_elements,
+    .elem_count = ARRAY_SIZE(g_elements),
+};
+
+static const struct bt_mesh_prov g_prov = {
+    .uuid = g_uuid,
+};
+
+static struct pool_msg g_msgs[CONFIG_BT_MESH_RX_SEG_MSG_COUNT + 1];
+static u16_t g_order[CONFIG_BT_MESH_RX_SEG_POOL_SIZE];
+static struct pool_buf g_pdu;
+static u32_t g_seq = 0x100;
+static u32_t g_rand = 1;
+
+static u32_t pool_rand(void)
+{
+    g_rand = g_rand * 1103515245 + 12345;
+    return g_rand >> 8;
+}
+
+/* An access message of seg_n + 1 segments to the primary element,
+ * opcode 0xffffff so that no model takes it.
+ */
+static void pool_msg_make(struct pool_msg *msg, u16_t src, u8_t seg_n)
+{
+    struct pool_buf sdu;
+    u16_t len = seg_n * POOL_SEG_LEN + 1 + pool_rand() % POOL_SEG_LEN;
+    u16_t i;
+
+    /* Room for the opcode and the MIC in a single segment */
+    len = max(len, 3 + POOL_MIC_LEN + 1);
+
+    msg->src = src;
+    msg->seq = g_seq++;
+    msg->seg_n = seg_n;
+    msg->len = len;
+
+    sdu.buf.size = sizeof(sdu.data);
+    net_buf_simple_init(&sdu.buf, 0);
+    net_buf_simple_add_u8(&sdu.buf, 0xff);
+    net_buf_simple_add_le16(&sdu.buf, 0xffff);
+    for (i = 3; i < len - POOL_MIC_LEN; i++) {
+        net_buf_simple_add_u8(&sdu.buf, pool_rand());
+    }
+
+    bt_mesh_app_encrypt(&bt_mesh.dev_key_sched, true, 0, &sdu.buf, NULL,
+                        src, bt_mesh_primary_addr(), msg->seq,
+                        bt_mesh.iv_index);
+    memcpy(msg->data, sdu.buf.data, len);
+}
+
+/* Lower transport PDU of one segment behind an empty network header */
+static int pool_seg_send(const struct pool_msg *msg, u8_t seg_o)
+{
+    struct bt_mesh_net_rx rx = {
+        .sub = &bt_mesh.sub[0],
+        .ctx = {
+            .net_idx = bt_mesh.sub[0].net_idx,
+            .app_idx = BT_MESH_KEY_UNUSED,
+            .addr = msg->src,
+            .recv_ttl = 5,
+            .send_ttl = 5,
+        },
+        .seq = msg->seq,
+        .dst = bt_mesh_primary_addr(),
+        .local_match = 1,
+        .net_if = BT_MESH_NET_IF_ADV,
+    };
+    u16_t seq_zero = msg->seq & 0x1fff;
+    u16_t off = seg_o * POOL_SEG_LEN;
+
+    g_pdu.buf.size = sizeof(g_pdu.data);
+    net_buf_simple_init(&g_pdu.buf, 0);
+    memset(net_buf_simple_add(&g_pdu.buf, BT_MESH_NET_HDR_LEN), 0,
+           BT_MESH_NET_HDR_LEN);
+    net_buf_simple_add_u8(&g_pdu.buf, 0x80);
+    net_buf_simple_add_u8(&g_pdu.buf, seq_zero >> 6);
+    net_buf_simple_add_u8(&g_pdu.buf, ((seq_zero & 0x3f) << 2) | (seg_o >> 3));
+    net_buf_simple_add_u8(&g_pdu.buf, ((seg_o & 0x07) << 5) | msg->seg_n);
+    net_buf_simple_add_mem(&g_pdu.buf, msg->data + off,
+                           min(msg->len - off, POOL_SEG_LEN));
+
+    return bt_mesh_trans_recv(&g_pdu.buf, &rx);
+}
+
+static void pool_stats(struct bt_mesh_seg_stats *stats)
+{
+    bt_mesh_seg_stats_get(stats);
+}
+
+static void test_pool_accounting(void)
+{
+    struct bt_mesh_seg_stats stats;
+    struct pool_msg *msg = &g_msgs[0];
+    u8_t seg_o;
+    int err;
+
+    pool_msg_make(msg, POOL_SRC, 3);
+
+    err = pool_seg_send(msg, 2);
+    YUNIT_ASSERT_EQUAL(err, 0);
+    pool_stats(&stats);
+    YUNIT_ASSERT_EQUAL(stats.pool_size, CONFIG_BT_MESH_RX_SEG_POOL_SIZE);
+    YUNIT_ASSERT_EQUAL(stats.pool_used, 4);
+
+    /* A repeated segment takes no further slot */
+    err = pool_seg_send(msg, 2);
+    YUNIT_ASSERT_EQUAL(err, -EALREADY);
+
+    for (seg_o = 0; seg_o <= msg->seg_n; seg_o++) {
+        if (seg_o != 2) {
+            err = pool_seg_send(msg, seg_o);
+            YUNIT_ASSERT_EQUAL(err, 0);
+        }
+    }
+
+    pool_stats(&stats);
+    YUNIT_ASSERT_EQUAL(stats.pool_used, 0);
+    YUNIT_ASSERT_EQUAL(stats.pool_peak, 4);
+    YUNIT_ASSERT_EQUAL(stats.rx_complete, 1);
+    YUNIT_ASSERT_EQUAL(stats.pool_rejected, 0);
+}
+
+/* As many sessions as there are contexts, sized to share the pool, with
+ * their segments arriving in one shuffled stream.
+ */
+static void test_pool_interleaved(void)
+{
+    struct bt_mesh_seg_stats stats;
+    int count = CONFIG_BT_MESH_RX_SEG_MSG_COUNT;
+    int share = min(CONFIG_BT_MESH_RX_SEG_POOL_SIZE / count, POOL_SEG_MAX);
+    int round, i, j, total, fails = 0;
+    u8_t got[ARRAY_SIZE(g_msgs)];
+    u16_t tmp;
+
+    for (round = 0; round < POOL_ROUNDS; round++) {
+        total = 0;
+
+        for (i = 0; i < count; i++) {
+            pool_msg_make(&g_msgs[i], POOL_SRC + i, pool_rand() % share);
+
+            for (j = 0; j <= g_msgs[i].seg_n; j++) {
+                g_order[total++] = (i << 8) | j;
+            }
+
+            got[i] = 0;
+        }
+
+        for (i = total - 1; i > 0; i--) {
+            j = pool_rand() % (i + 1);
+            tmp = g_order[i];
+            g_order[i] = g_order[j];
+            g_order[j] = tmp;
+        }
+
+        for (i = 0; i < total; i++) {
+            if (pool_seg_send(&g_msgs[g_order[i] >> 8], g_order[i] & 0xff)) {
+                fails++;
+            }
+            got[g_order[i] >> 8]++;
+        }
+
+        for (i = 0; i < count; i++) {
+            YUNIT_ASSERT_EQUAL(got[i], g_msgs[i].seg_n + 1);
+        }
+    }
+
+    pool_stats(&stats);
+    YUNIT_ASSERT_EQUAL(fails, 0);
+    YUNIT_ASSERT_EQUAL(stats.rx_complete, POOL_ROUNDS * count);
+    YUNIT_ASSERT_EQUAL(stats.pool_used, 0);
+    YUNIT_ASSERT_EQUAL(stats.pool_rejected, 0);
+    YUNIT_ASSERT(stats.pool_peak <= CONFIG_BT_MESH_RX_SEG_POOL_SIZE);
+}
+
+/* Start full size sessions until one is refused, by the pool or for want
+ * of a context, then finish them and check the refused one gets through.
+ */
+static void test_pool_exhaust(void)
+{
+    struct bt_mesh_seg_stats stats;
+    struct pool_msg *late;
+    int admitted, i, err;
+    u8_t seg_o;
+
+    for (admitted = 0; admitted < ARRAY_SIZE(g_msgs); admitted++) {
+        pool_msg_make(&g_msgs[admitted], POOL_SRC + admitted,
+                      POOL_SEG_MAX - 1);
+        err = pool_seg_send(&g_msgs[admitted], 0);
+        if (err) {
+            break;
+        }
+    }
+
+    YUNIT_ASSERT_EQUAL(err, -ENOMEM);
+    YUNIT_ASSERT(admitted > 0);
+    YUNIT_ASSERT(admitted <= CONFIG_BT_MESH_RX_SEG_MSG_COUNT);
+
+    pool_stats(&stats);
+    YUNIT_ASSERT_EQUAL(stats.pool_used, admitted * POOL_SEG_MAX);
+    if (admitted < CONFIG_BT_MESH_RX_SEG_MSG_COUNT) {
+        YUNIT_ASSERT_EQUAL(stats.pool_rejected, 1);
+        YUNIT_ASSERT(stats.pool_size - stats.pool_used < POOL_SEG_MAX);
+    } else {
+        YUNIT_ASSERT_EQUAL(stats.pool_rejected, 0);
+    }
+
+    for (i = 0; i < admitted; i++) {
+        for (seg_o = 1; seg_o < POOL_SEG_MAX; seg_o++) {
+            err = pool_seg_send(&g_msgs[i], seg_o);
+            YUNIT_ASSERT_EQUAL(err, 0);
+        }
+    }
+
+    late = &g_msgs[admitted];
+    for (seg_o = 0; seg_o < POOL_SEG_MAX; seg_o++) {
+        err = pool_seg_send(late, seg_o);
+        YUNIT_ASSERT_EQUAL(err, 0);
+    }
+
+    pool_stats(&stats);
+    YUNIT_ASSERT_EQUAL(stats.rx_complete, admitted + 1);
+    YUNIT_ASSERT_EQUAL(stats.pool_used, 0);
+}
+
+static int init(void)
+{
+    int err;
+
+    if (bt_mesh_is_provisioned()) {
+        return 0;
+    }
+
+    bt_rand(g_dev_key, sizeof(g_dev_key));
+    bt_rand(g_uuid, sizeof(g_uuid));
+
+    err = bt_mesh_init(&g_prov, &g_comp);
+    if (err) {
+        return err;
+    }
+
+    return bt_mesh_provision(g_net_key, 0, 0, 0, 0, POOL_ADDR, g_dev_key);
+}
+
+static int cleanup(void)
+{
+    bt_mesh_rx_reset();
+    return 0;
+}
+
+static void setup(void)
+{
+    bt_mesh_rx_reset();
+    bt_mesh_seg_stats_reset();
+}
+
+static void teardown(void)
+{
+}
+
+static yunit_test_case_t bt_mesh_seg_pool_testcases[] = {
+    { "accounting", test_pool_accounting },
+    { "interleaved", test_pool_interleaved },
+    { "exhaust", test_pool_exhaust },
+    YUNIT_TEST_CASE_NULL
+};
+
+static yunit_test_suite_t suites[] = {
+    { "bt_mesh_seg_pool", init, cleanup, setup, teardown,
+      bt_mesh_seg_pool_testcases },
+    YUNIT_TEST_SUITE_NULL
+};
+
+void test_bt_mesh_seg_pool(void)
+{
+    yunit_add_test_suites(suites);
+}
+AOS_TESTCASE(test_bt_mesh_seg_pool);
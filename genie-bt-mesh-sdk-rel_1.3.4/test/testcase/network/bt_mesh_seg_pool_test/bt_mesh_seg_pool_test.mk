@@ -0,0 +1,7 @@
+NAME := bt_mesh_seg_pool_test
+
+$(NAME)_COMPONENTS  += bluetooth.bt_mesh
+
+$(NAME)_SOURCES     += bt_mesh_seg_pool_test.c
+
+$(NAME)_CFLAGS      += -Wall -Werror
@@ -0,0 +1,388 @@
+/*
+ * Copyright (C) 2015-2019 Alibaba Group Holding Limited
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <yunit.h>
+#include <yts.h>
+
+#include <zephyr.h>
+#include <misc/util.h>
+#include <misc/byteorder.h>
+#include <net/buf.h>
+#include <bluetooth.h>
+#include <crypto.h>
+#include <api/mesh.h>
+
+#include "mesh.h"
+#include "net.h"
+#include "access.h"
+#include "transport.h"
+
+/*
+ * Sends segmented messages to addresses nobody answers for and plays the
+ * destination's block acks back into bt_mesh_trans_recv, to check the
+ * round trip estimate each destination keeps: when a sample is taken
+ * (never for a round that was resent), and how the retransmit timeout
+ * follows it, the TTL floor and the backoff.
+ * The node provisions itself unless the image has done so already.
+ * The cases run in real time, a few seconds in all.
+ */
+
+#define RTT_ADDR 0x0b01
+#define RTT_DST 0x7e40
+#define RTT_SDU_LEN 24
+
+/* Retransmit timeout bounds in transport.c, in ms */
+#define RTT_RTO_MIN 200
+#define RTT_RTO_PER_HOP 50
+#define RTT_RTO_MAX 3200
+
+/* Long enough for every segment of a round to have gone out */
+#define RTT_AIR_TIME 100
+
+struct rtt_buf {
+    struct net_buf_simple buf;
+    u8_t data[RTT_SDU_LEN + 8] __net_buf_align;
+};
+
+struct rtt_ack_buf {
+    struct net_buf_simple buf;
+    u8_t data[BT_MESH_NET_HDR_LEN + 8] __net_buf_align;
+};
+
+static const u8_t g_net_key[16] = {
+    0x7d, 0xd7, 0x36, 0x4c, 0xd8, 0x42, 0xad, 0x18,
+    0xc1, 0x7c, 0x2b, 0x82, 0x0c, 0x84, 0xc3, 0xd6,
+};
+
+static u8_t g_dev_key[16];
+static u8_t g_uuid[16];
+
+static struct bt_mesh_model g_root_models[] = {
+    BT_MESH_MODEL_CFG_SRV(),
+};
+
+static struct bt_mesh_elem g_elements[] = {
+    BT_MESH_ELEM(0, g_root_models, BT_MESH_MODEL_NONE, 0),
+};
+
+static const struct bt_mesh_comp g_comp = {
+    .cid = 0x01A8,
+    .elem = g_elements,
+    .elem_count = ARRAY_SIZE(g_elements),
+};
+
+static const struct bt_mesh_prov g_prov = {
+    .uuid = g_uuid,
+};
+
+static u16_t g_dst = RTT_DST;
+static u32_t g_ack_seq = 0x100;
+static volatile int g_end_err;
+static volatile int g_ended;
+
+static void rtt_send_end(int err, void *cb_data)
+{
+    g_end_err = err;
+    g_ended = 1;
+}
+
+static const struct bt_mesh_send_cb rtt_send_cb = {
+    .end = rtt_send_end,
+};
+
+/* Device key message of three segments to dst; its SeqZero */
+static u16_t rtt_send(u16_t dst, u8_t ttl)
+{
+    struct bt_mesh_msg_ctx ctx = {
+        .net_idx = bt_mesh.sub[0].net_idx,
+        .app_idx = BT_MESH_KEY_DEV,
+        .addr = dst,
+        .send_ttl = ttl,
+    };
+    struct bt_mesh_net_tx tx = {
+        .sub = &bt_mesh.sub[0],
+        .ctx = &ctx,
+        .src = bt_mesh_primary_addr(),
+        /* One transmission per segment keeps the rounds short */
+        .xmit = BT_MESH_TRANSMIT(0, 20),
+    };
+    struct rtt_buf msg;
+    u16_t seq_zero = bt_mesh.seq & 0x1fff;
+    int err;
+
+    msg.buf.size = sizeof(msg.data);
+    net_buf_simple_init(&msg.buf, 0);
+    memset(net_buf_simple_add(&msg.buf, RTT_SDU_LEN), 0xa5, RTT_SDU_LEN);
+
+    g_ended = 0;
+    err = bt_mesh_trans_send(&tx, &msg.buf, &rtt_send_cb, NULL);
+    YUNIT_ASSERT_EQUAL(err, 0);
+
+    return seq_zero;
+}
+
+/* Block ack from dst, as it arrives from the network */
+static int rtt_ack(u16_t dst, u16_t seq_zero, u32_t block)
+{
+    struct bt_mesh_net_rx rx = {
+        .sub = &bt_mesh.sub[0],
+        .ctx = {
+            .net_idx = bt_mesh.sub[0].net_idx,
+            .app_idx = BT_MESH_KEY_UNUSED,
+            .addr = dst,
+            .recv_ttl = 5,
+            .send_ttl = 5,
+        },
+        .seq = g_ack_seq++,
+        .dst = bt_mesh_primary_addr(),
+        .ctl = 1,
+        .local_match = 1,
+        .net_if = BT_MESH_NET_IF_ADV,
+    };
+    struct rtt_ack_buf ack;
+
+    ack.buf.size = sizeof(ack.data);
+    net_buf_simple_init(&ack.buf, 0);
+    memset(net_buf_simple_add(&ack.buf, BT_MESH_NET_HDR_LEN), 0,
+           BT_MESH_NET_HDR_LEN);
+    net_buf_simple_add_u8(&ack.buf, 0x00);
+    net_buf_simple_add_be16(&ack.buf, seq_zero << 2);
+    net_buf_simple_add_be32(&ack.buf, block);
+
+    return bt_mesh_trans_recv(&ack.buf, &rx);
+}
+
+/* The estimate for addr, or NULL before its first sample */
+static const struct bt_mesh_seg_rtt *rtt_find(u16_t addr)
+{
+    static struct bt_mesh_seg_rtt rtt[BT_MESH_SEG_RTT_COUNT];
+    int i, count;
+
+    count = bt_mesh_seg_rtt_get(rtt);
+    for (i = 0; i < count; i++) {
+        if (rtt[i].addr == addr) {
+            return &rtt[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* Poll the segment counters until the retransmit timer has fired count
+ * times, for at most ms; the time it took, or -1.
+ */
+static int rtt_wait_timeouts(u32_t count, int ms)
+{
+    struct bt_mesh_seg_stats stats;
+    u32_t start = k_uptime_get_32();
+
+    do {
+        bt_mesh_seg_stats_get(&stats);
+        if (stats.tx_timeouts >= count) {
+            return k_uptime_get_32() - start;
+        }
+        k_sleep(10);
+    } while (k_uptime_get_32() - start < ms);
+
+    return -1;
+}
+
+/* Each destination gets a fresh estimate */
+static u16_t rtt_next_dst(void)
+{
+    return g_dst++;
+}
+
+static void test_rtt_sample(void)
+{
+    const struct bt_mesh_seg_rtt *rtt;
+    struct bt_mesh_seg_stats stats;
+    u16_t dst = rtt_next_dst();
+    u16_t seq_zero;
+    int i, err;
+
+    YUNIT_ASSERT(rtt_find(dst) == NULL);
+
+    for (i = 0; i < 3; i++) {
+        seq_zero = rtt_send(dst, 3);
+        k_sleep(RTT_AIR_TIME);
+
+        err = rtt_ack(dst, seq_zero, 0x7);
+        YUNIT_ASSERT_EQUAL(err, 0);
+        YUNIT_ASSERT(g_ended && g_end_err == 0);
+    }
+
+    rtt = rtt_find(dst);
+    YUNIT_ASSERT(rtt != NULL);
+    if (rtt) {
+        YUNIT_ASSERT_EQUAL(rtt->samples, 3);
+        YUNIT_ASSERT(rtt->srtt < RTT_AIR_TIME);
+        YUNIT_ASSERT(rtt->rto >= RTT_RTO_MIN && rtt->rto <= RTT_RTO_MAX);
+    }
+
+    bt_mesh_seg_stats_get(&stats);
+    YUNIT_ASSERT_EQUAL(stats.tx_timeouts, 0);
+    YUNIT_ASSERT_EQUAL(stats.tx_retransmit, 0);
+}
+
+/* An ack after a retransmit might answer either round, so it must not
+ * feed the estimate (Karn's rule).
+ */
+static void test_rtt_karn(void)
+{
+    struct bt_mesh_seg_stats stats;
+    u16_t dst = rtt_next_dst();
+    u16_t seq_zero;
+    int err;
+
+    seq_zero = rtt_send(dst, 3);
+    YUNIT_ASSERT(rtt_wait_timeouts(1, 2000) >= 0);
+    k_sleep(RTT_AIR_TIME);
+
+    bt_mesh_seg_stats_get(&stats);
+    YUNIT_ASSERT_EQUAL(stats.tx_retransmit, 3);
+
+    err = rtt_ack(dst, seq_zero, 0x7);
+    YUNIT_ASSERT_EQUAL(err, 0);
+    YUNIT_ASSERT(g_ended && g_end_err == 0);
+    YUNIT_ASSERT(rtt_find(dst) == NULL);
+}
+
+/* A partial ack drives a resend of the missing segment right away; the
+ * ack that completes it comes after a resend and gives no sample either.
+ */
+static void test_rtt_partial_ack(void)
+{
+    const struct bt_mesh_seg_rtt *rtt;
+    struct bt_mesh_seg_stats stats;
+    u16_t dst = rtt_next_dst();
+    u16_t seq_zero;
+    int err;
+
+    seq_zero = rtt_send(dst, 3);
+    k_sleep(RTT_AIR_TIME);
+
+    err = rtt_ack(dst, seq_zero, 0x5);
+    YUNIT_ASSERT_EQUAL(err, 0);
+    YUNIT_ASSERT(!g_ended);
+
+    bt_mesh_seg_stats_get(&stats);
+    YUNIT_ASSERT_EQUAL(stats.tx_ack_resends, 1);
+    YUNIT_ASSERT_EQUAL(stats.tx_retransmit, 1);
+
+    k_sleep(RTT_AIR_TIME);
+    err = rtt_ack(dst, seq_zero, 0x7);
+    YUNIT_ASSERT_EQUAL(err, 0);
+    YUNIT_ASSERT(g_ended && g_end_err == 0);
+
+    rtt = rtt_find(dst);
+    YUNIT_ASSERT(rtt != NULL);
+    if (rtt) {
+        YUNIT_ASSERT_EQUAL(rtt->samples, 1);
+    }
+}
+
+/* However short the estimate, a far destination gets the per hop floor */
+static void test_rtt_ttl_floor(void)
+{
+    u16_t dst = rtt_next_dst();
+    u8_t ttl = 20;
+    u16_t seq_zero;
+    int err;
+
+    seq_zero = rtt_send(dst, ttl);
+    YUNIT_ASSERT(rtt_wait_timeouts(1, (RTT_RTO_MIN + RTT_RTO_PER_HOP * ttl) -
+                                      RTT_AIR_TIME * 2) < 0);
+
+    err = rtt_ack(dst, seq_zero, 0x7);
+    YUNIT_ASSERT_EQUAL(err, 0);
+    YUNIT_ASSERT(g_ended && g_end_err == 0);
+}
+
+/* Without acks the message times out after the retransmit, which waits
+ * twice as long as the first round.
+ */
+static void test_rtt_timeout(void)
+{
+    struct bt_mesh_seg_stats stats;
+    u16_t dst = rtt_next_dst();
+    int first, second;
+
+    rtt_send(dst, 3);
+
+    first = rtt_wait_timeouts(1, 2000);
+    YUNIT_ASSERT(first >= 0);
+    second = rtt_wait_timeouts(2, 4000);
+    YUNIT_ASSERT(second >= 0);
+    YUNIT_ASSERT(second > first);
+
+    k_sleep(RTT_AIR_TIME);
+    YUNIT_ASSERT(g_ended && g_end_err == -ETIMEDOUT);
+
+    bt_mesh_seg_stats_get(&stats);
+    YUNIT_ASSERT_EQUAL(stats.tx_retransmit, 3);
+    YUNIT_ASSERT(rtt_find(dst) == NULL);
+}
+
+static int init(void)
+{
+    int err;
+
+    if (bt_mesh_is_provisioned()) {
+        return 0;
+    }
+
+    bt_rand(g_dev_key, sizeof(g_dev_key));
+    bt_rand(g_uuid, sizeof(g_uuid));
+
+    err = bt_mesh_init(&g_prov, &g_comp);
+    if (err) {
+        return err;
+    }
+
+    return bt_mesh_provision(g_net_key, 0, 0, 0, 0, RTT_ADDR, g_dev_key);
+}
+
+static int cleanup(void)
+{
+    bt_mesh_tx_reset();
+    return 0;
+}
+
+static void setup(void)
+{
+    bt_mesh_tx_reset();
+    bt_mesh_seg_stats_reset();
+}
+
+static void teardown(void)
+{
+    bt_mesh_tx_reset();
+}
+
+static yunit_test_case_t bt_mesh_seg_rtt_testcases[] = {
+    { "sample", test_rtt_sample },
+    { "karn", test_rtt_karn },
+    { "partial_ack", test_rtt_partial_ack },
+    { "ttl_floor", test_rtt_ttl_floor },
+    { "timeout", test_rtt_timeout },
+    YUNIT_TEST_CASE_NULL
+};
+
+static yunit_test_suite_t suites[] = {
+    { "bt_mesh_seg_rtt", init, cleanup, setup, teardown,
+      bt_mesh_seg_rtt_testcases },
+    YUNIT_TEST_SUITE_NULL
+};
+
+void test_bt_mesh_seg_rtt(void)
+{
+    yunit_add_test_suites(suites);
+}
+AOS_TESTCASE(test_bt_mesh_seg_rtt);
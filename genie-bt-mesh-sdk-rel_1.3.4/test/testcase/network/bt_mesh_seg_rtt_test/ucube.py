@@ -0,0 +1,10 @@
+src = Split('''
+    bt_mesh_seg_rtt_test.c
+''')
+
+component = aos_component('bt_mesh_seg_rtt_test', src)
+
+component.add_comp_deps('network/bluetooth/bt_mesh')
+
+component.add_cflags('-Wall')
+component.add_cflags('-Werror')
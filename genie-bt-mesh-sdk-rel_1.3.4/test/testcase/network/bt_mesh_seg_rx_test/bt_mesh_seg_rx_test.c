@@ -0,0 +1,408 @@
+/*
+ * Copyright (C) 2015-2019 Alibaba Group Holding Limited
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <yunit.h>
+#include <yts.h>
+
+#include <zephyr.h>
+#include <misc/util.h>
+#include <misc/byteorder.h>
+#include <net/buf.h>
+#include <bluetooth.h>
+#include <crypto.h>
+#include <api/mesh.h>
+
+#include "mesh_crypto.h"
+#include "mesh.h"
+#include "net.h"
+#include "access.h"
+#include "transport.h"
+
+/*
+ * Walks lower transport RX sessions through their states: in progress,
+ * complete, superseded by a newer SeqAuth, and the completion cache that
+ * acks late segments of SDUs already passed up. Segments are fed straight
+ * into bt_mesh_trans_recv, device key encrypted, so a completed SDU has to
+ * pass its MIC.
+ * The node provisions itself unless the image has done so already.
+ */
+
+#ifdef YTS_LINUX
+#define SEG_ROUNDS 100
+#else
+#define SEG_ROUNDS 10
+#endif
+
+#define SEG_ADDR 0x0b01
+#define SEG_SRC 0x7e20
+#define SEG_LEN 12
+#define SEG_MAX 32
+#define SEG_MIC_LEN 4
+
+/* Entries of the completion cache in transport.c */
+#define SEG_DONE_COUNT (2 * CONFIG_BT_MESH_RX_SEG_MSG_COUNT)
+
+struct seg_buf {
+    struct net_buf_simple buf;
+    u8_t data[CONFIG_BT_MESH_RX_SDU_MAX + BT_MESH_NET_HDR_LEN + 8] __net_buf_align;
+};
+
+struct seg_msg {
+    u16_t src;
+    u32_t seq;
+    u8_t seg_n;
+    u16_t len;
+    u8_t data[SEG_MAX * SEG_LEN];
+};
+
+static const u8_t g_net_key[16] = {
+    0x7d, 0xd7, 0x36, 0x4c, 0xd8, 0x42, 0xad, 0x18,
+    0xc1, 0x7c, 0x2b, 0x82, 0x0c, 0x84, 0xc3, 0xd6,
+};
+
+static u8_t g_dev_key[16];
+static u8_t g_uuid[16];
+
+static struct bt_mesh_model g_root_models[] = {
+    BT_MESH_MODEL_CFG_SRV(),
+};
+
+static struct bt_mesh_elem g_elements[] = {
+    BT_MESH_ELEM(0, g_root_models, BT_MESH_MODEL_NONE, 0),
+};
+
+static const struct bt_mesh_comp g_comp = {
+    .cid = 0x01A8,
+    .elem = g_elements,
+    .elem_count = ARRAY_SIZE(g_elements),
+};
+
+static const struct bt_mesh_prov g_prov = {
+    .uuid = g_uuid,
+};
+
+static struct seg_msg g_msgs[SEG_DONE_COUNT + 1];
+static struct seg_buf g_pdu;
+static u32_t g_seq = 0x100;
+static u32_t g_rand = 1;
+
+static u32_t seg_rand(void)
+{
+    g_rand = g_rand * 1103515245 + 12345;
+    return g_rand >> 8;
+}
+
+/* An access message of seg_n + 1 segments to the primary element,
+ * opcode 0xffffff so that no model takes it.
+ */
+static void seg_msg_make(struct seg_msg *msg, u16_t src, u8_t seg_n)
+{
+    struct seg_buf sdu;
+    u16_t len = seg_n * SEG_LEN + 1 + seg_rand() % SEG_LEN;
+    u16_t i;
+
+    /* Room for the opcode and the MIC in a single segment */
+    len = max(len, 3 + SEG_MIC_LEN + 1);
+
+    msg->src = src;
+    msg->seq = g_seq++;
+    msg->seg_n = seg_n;
+    msg->len = len;
+
+    sdu.buf.size = sizeof(sdu.data);
+    net_buf_simple_init(&sdu.buf, 0);
+    net_buf_simple_add_u8(&sdu.buf, 0xff);
+    net_buf_simple_add_le16(&sdu.buf, 0xffff);
+    for (i = 3; i < len - SEG_MIC_LEN; i++) {
+        net_buf_simple_add_u8(&sdu.buf, seg_rand());
+    }
+
+    bt_mesh_app_encrypt(&bt_mesh.dev_key_sched, true, 0, &sdu.buf, NULL,
+                        src, bt_mesh_primary_addr(), msg->seq,
+                        bt_mesh.iv_index);
+    memcpy(msg->data, sdu.buf.data, len);
+}
+
+/* Lower transport PDU of one segment behind an empty network header,
+ * claiming seg_n segments in all.
+ */
+static int seg_send_as(const struct seg_msg *msg, u8_t seg_o, u8_t seg_n)
+{
+    struct bt_mesh_net_rx rx = {
+        .sub = &bt_mesh.sub[0],
+        .ctx = {
+            .net_idx = bt_mesh.sub[0].net_idx,
+            .app_idx = BT_MESH_KEY_UNUSED,
+            .addr = msg->src,
+            .recv_ttl = 5,
+            .send_ttl = 5,
+        },
+        .seq = msg->seq,
+        .dst = bt_mesh_primary_addr(),
+        .local_match = 1,
+        .net_if = BT_MESH_NET_IF_ADV,
+    };
+    u16_t seq_zero = msg->seq & 0x1fff;
+    u16_t off = seg_o * SEG_LEN;
+
+    g_pdu.buf.size = sizeof(g_pdu.data);
+    net_buf_simple_init(&g_pdu.buf, 0);
+    memset(net_buf_simple_add(&g_pdu.buf, BT_MESH_NET_HDR_LEN), 0,
+           BT_MESH_NET_HDR_LEN);
+    net_buf_simple_add_u8(&g_pdu.buf, 0x80);
+    net_buf_simple_add_u8(&g_pdu.buf, seq_zero >> 6);
+    net_buf_simple_add_u8(&g_pdu.buf, ((seq_zero & 0x3f) << 2) | (seg_o >> 3));
+    net_buf_simple_add_u8(&g_pdu.buf, ((seg_o & 0x07) << 5) | seg_n);
+    net_buf_simple_add_mem(&g_pdu.buf, msg->data + off,
+                           min(msg->len - off, SEG_LEN));
+
+    return bt_mesh_trans_recv(&g_pdu.buf, &rx);
+}
+
+static int seg_send(const struct seg_msg *msg, u8_t seg_o)
+{
+    return seg_send_as(msg, seg_o, msg->seg_n);
+}
+
+/* Every segment of msg but skip, in order; the last result */
+static int seg_send_all(const struct seg_msg *msg, int skip)
+{
+    int seg_o, err = 0;
+
+    for (seg_o = 0; seg_o <= msg->seg_n; seg_o++) {
+        if (seg_o != skip) {
+            err = seg_send(msg, seg_o);
+        }
+    }
+
+    return err;
+}
+
+static void test_seg_rx_complete(void)
+{
+    struct bt_mesh_seg_stats stats;
+    struct seg_msg *msg = &g_msgs[0];
+    int round, seg_o, err;
+
+    for (round = 0; round < SEG_ROUNDS; round++) {
+        seg_msg_make(msg, SEG_SRC, seg_rand() % SEG_MAX);
+
+        for (seg_o = msg->seg_n; seg_o >= 0; seg_o--) {
+            err = seg_send(msg, seg_o);
+            YUNIT_ASSERT_EQUAL(err, 0);
+        }
+    }
+
+    bt_mesh_seg_stats_get(&stats);
+    YUNIT_ASSERT_EQUAL(stats.rx_complete, SEG_ROUNDS);
+    YUNIT_ASSERT_EQUAL(stats.rx_canceled, 0);
+    YUNIT_ASSERT_EQUAL(stats.pool_used, 0);
+}
+
+static void test_seg_rx_in_progress(void)
+{
+    struct bt_mesh_seg_stats stats;
+    struct seg_msg *msg = &g_msgs[0];
+    int err;
+
+    seg_msg_make(msg, SEG_SRC, 4);
+
+    err = seg_send(msg, 1);
+    YUNIT_ASSERT_EQUAL(err, 0);
+
+    /* Same segment again, and one that disagrees on SegN */
+    err = seg_send(msg, 1);
+    YUNIT_ASSERT_EQUAL(err, -EALREADY);
+    err = seg_send_as(msg, 2, msg->seg_n + 1);
+    YUNIT_ASSERT_EQUAL(err, -EINVAL);
+
+    err = seg_send_all(msg, 1);
+    YUNIT_ASSERT_EQUAL(err, 0);
+
+    bt_mesh_seg_stats_get(&stats);
+    YUNIT_ASSERT_EQUAL(stats.rx_complete, 1);
+}
+
+/* Late segments of a complete SDU are acked from the cache and never
+ * passed up again.
+ */
+static void test_seg_rx_duplicate(void)
+{
+    struct bt_mesh_seg_stats stats;
+    struct seg_msg *msg = &g_msgs[0];
+    int seg_o, err;
+
+    seg_msg_make(msg, SEG_SRC, 3);
+    err = seg_send_all(msg, -1);
+    YUNIT_ASSERT_EQUAL(err, 0);
+
+    for (seg_o = 0; seg_o <= msg->seg_n; seg_o++) {
+        err = seg_send(msg, seg_o);
+        YUNIT_ASSERT_EQUAL(err, -EALREADY);
+    }
+
+    err = seg_send_as(msg, 0, msg->seg_n + 1);
+    YUNIT_ASSERT_EQUAL(err, -EINVAL);
+
+    bt_mesh_seg_stats_get(&stats);
+    YUNIT_ASSERT_EQUAL(stats.rx_complete, 1);
+    YUNIT_ASSERT_EQUAL(stats.rx_dup_acked, msg->seg_n + 1);
+}
+
+/* A newer SeqAuth from the same source cancels the session in progress,
+ * whose late segments are then dropped, and an older SeqAuth than the one
+ * in progress is dropped too.
+ */
+static void test_seg_rx_superseded(void)
+{
+    struct bt_mesh_seg_stats stats;
+    struct seg_msg *old = &g_msgs[0];
+    struct seg_msg *cur = &g_msgs[1];
+    struct seg_msg *stale = &g_msgs[2];
+    int err;
+
+    seg_msg_make(stale, SEG_SRC, 2);
+    seg_msg_make(old, SEG_SRC, 2);
+    seg_msg_make(cur, SEG_SRC, 2);
+
+    err = seg_send(old, 0);
+    YUNIT_ASSERT_EQUAL(err, 0);
+    err = seg_send(cur, 0);
+    YUNIT_ASSERT_EQUAL(err, 0);
+
+    bt_mesh_seg_stats_get(&stats);
+    YUNIT_ASSERT_EQUAL(stats.rx_canceled, 1);
+
+    err = seg_send(old, 1);
+    YUNIT_ASSERT_EQUAL(err, -EINVAL);
+    err = seg_send(stale, 0);
+    YUNIT_ASSERT_EQUAL(err, -EINVAL);
+
+    err = seg_send_all(cur, 0);
+    YUNIT_ASSERT_EQUAL(err, 0);
+
+    bt_mesh_seg_stats_get(&stats);
+    YUNIT_ASSERT_EQUAL(stats.rx_complete, 1);
+    YUNIT_ASSERT_EQUAL(stats.rx_canceled, 1);
+    YUNIT_ASSERT_EQUAL(stats.pool_used, 0);
+}
+
+/* Sessions of different sources run side by side */
+static void test_seg_rx_parallel(void)
+{
+    struct bt_mesh_seg_stats stats;
+    int count = CONFIG_BT_MESH_RX_SEG_MSG_COUNT;
+    int share = min(CONFIG_BT_MESH_RX_SEG_POOL_SIZE / count, SEG_MAX);
+    int round, i, seg_o, fails = 0;
+
+    for (round = 0; round < SEG_ROUNDS; round++) {
+        for (i = 0; i < count; i++) {
+            seg_msg_make(&g_msgs[i], SEG_SRC + i, seg_rand() % share);
+        }
+
+        for (seg_o = 0; seg_o < share; seg_o++) {
+            for (i = 0; i < count; i++) {
+                if (seg_o <= g_msgs[i].seg_n && seg_send(&g_msgs[i], seg_o)) {
+                    fails++;
+                }
+            }
+        }
+    }
+
+    bt_mesh_seg_stats_get(&stats);
+    YUNIT_ASSERT_EQUAL(fails, 0);
+    YUNIT_ASSERT_EQUAL(stats.rx_complete, SEG_ROUNDS * count);
+    YUNIT_ASSERT_EQUAL(stats.rx_canceled, 0);
+}
+
+/* The cache holds the last SEG_DONE_COUNT sessions, from any source. Past
+ * that a late single segment SDU is taken for a new one and then caught
+ * by replay protection.
+ */
+static void test_seg_rx_done_cache(void)
+{
+    struct bt_mesh_seg_stats stats;
+    int count = ARRAY_SIZE(g_msgs);
+    int i, err;
+
+    for (i = 0; i < count; i++) {
+        seg_msg_make(&g_msgs[i], SEG_SRC + i % 3, 0);
+        err = seg_send(&g_msgs[i], 0);
+        YUNIT_ASSERT_EQUAL(err, 0);
+    }
+
+    for (i = count - 1; i > 0; i--) {
+        err = seg_send(&g_msgs[i], 0);
+        YUNIT_ASSERT_EQUAL(err, -EALREADY);
+    }
+
+    err = seg_send(&g_msgs[0], 0);
+    YUNIT_ASSERT_EQUAL(err, -EINVAL);
+
+    bt_mesh_seg_stats_get(&stats);
+    YUNIT_ASSERT_EQUAL(stats.rx_complete, count);
+    YUNIT_ASSERT_EQUAL(stats.rx_dup_acked, count - 1);
+}
+
+static int init(void)
+{
+    int err;
+
+    if (bt_mesh_is_provisioned()) {
+        return 0;
+    }
+
+    bt_rand(g_dev_key, sizeof(g_dev_key));
+    bt_rand(g_uuid, sizeof(g_uuid));
+
+    err = bt_mesh_init(&g_prov, &g_comp);
+    if (err) {
+        return err;
+    }
+
+    return bt_mesh_provision(g_net_key, 0, 0, 0, 0, SEG_ADDR, g_dev_key);
+}
+
+static int cleanup(void)
+{
+    bt_mesh_rx_reset();
+    return 0;
+}
+
+static void setup(void)
+{
+    bt_mesh_rx_reset();
+    bt_mesh_seg_stats_reset();
+}
+
+static void teardown(void)
+{
+}
+
+static yunit_test_case_t bt_mesh_seg_rx_testcases[] = {
+    { "complete", test_seg_rx_complete },
+    { "in_progress", test_seg_rx_in_progress },
+    { "duplicate", test_seg_rx_duplicate },
+    { "superseded", test_seg_rx_superseded },
+    { "parallel", test_seg_rx_parallel },
+    { "done_cache", test_seg_rx_done_cache },
+    YUNIT_TEST_CASE_NULL
+};
+
+static yunit_test_suite_t suites[] = {
+    { "bt_mesh_seg_rx", init, cleanup, setup, teardown,
+      bt_mesh_seg_rx_testcases },
+    YUNIT_TEST_SUITE_NULL
+};
+
+void test_bt_mesh_seg_rx(void)
+{
+    yunit_add_test_suites(suites);
+}
+AOS_TESTCASE(test_bt_mesh_seg_rx);
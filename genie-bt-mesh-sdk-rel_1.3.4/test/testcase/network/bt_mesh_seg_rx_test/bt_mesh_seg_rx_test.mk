@@ -0,0 +1,7 @@
+NAME := bt_mesh_seg_rx_test
+
+$(NAME)_COMPONENTS  += bluetooth.bt_mesh
+
+$(NAME)_SOURCES     += bt_mesh_seg_rx_test.c
+
+$(NAME)_CFLAGS      += -Wall -Werror
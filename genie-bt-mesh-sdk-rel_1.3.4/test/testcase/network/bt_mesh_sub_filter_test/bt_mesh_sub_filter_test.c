@@ -0,0 +1,370 @@
+/*
+ * Copyright (C) 2015-2019 Alibaba Group Holding Limited
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <yunit.h>
+#include <yts.h>
+
+#include <zephyr.h>
+#include <misc/util.h>
+#include <misc/byteorder.h>
+#include <net/buf.h>
+#include <bluetooth.h>
+#include <api/mesh.h>
+
+#include "mesh.h"
+#include "net.h"
+#include "access.h"
+
+/*
+ * Subscribes and unsubscribes models of a three element composition the
+ * way the Configuration Server does, then checks which element
+ * bt_mesh_elem_find gives for group addresses, against the subscription
+ * lists themselves. Also measures how much of the traffic to other
+ * groups the node wide filter turns away, and that lookups stay right
+ * when the group map overflows.
+ * The composition in place before the suite is registered again at the
+ * end, which clears its AppKey bindings.
+ */
+
+#ifdef YTS_LINUX
+#define SUB_ROUNDS 200
+#define SUB_LOOKUPS 20000
+#else
+#define SUB_ROUNDS 20
+#define SUB_LOOKUPS 2000
+#endif
+
+#define SUB_ADDR 0x0d01
+#define SUB_GROUP_BASE 0xc000
+#define SUB_GROUP_SPAN 0x3000
+
+static void sub_handler(struct bt_mesh_model *model,
+                        struct bt_mesh_msg_ctx *ctx,
+                        struct net_buf_simple *buf)
+{
+}
+
+static const struct bt_mesh_model_op g_ops[] = {
+    { BT_MESH_MODEL_OP_2(0x82, 0x01), 0, sub_handler },
+    BT_MESH_MODEL_OP_END,
+};
+
+static struct bt_mesh_model g_models0[] = {
+    BT_MESH_MODEL(0x1000, g_ops, NULL, NULL),
+    BT_MESH_MODEL(0x1002, g_ops, NULL, NULL),
+};
+
+static struct bt_mesh_model g_models1[] = {
+    BT_MESH_MODEL(0x1000, g_ops, NULL, NULL),
+};
+
+static struct bt_mesh_model g_models2[] = {
+    BT_MESH_MODEL(0x1000, g_ops, NULL, NULL),
+};
+
+static struct bt_mesh_elem g_elems[] = {
+    BT_MESH_ELEM(0, g_models0, BT_MESH_MODEL_NONE, 0),
+    BT_MESH_ELEM(0, g_models1, BT_MESH_MODEL_NONE, 0),
+    BT_MESH_ELEM(0, g_models2, BT_MESH_MODEL_NONE, 0),
+};
+
+static const struct bt_mesh_comp g_comp = {
+    .cid = 0x01A8,
+    .elem = g_elems,
+    .elem_count = ARRAY_SIZE(g_elems),
+};
+
+/* Every model of the composition, for picking one at random */
+static struct bt_mesh_model *g_all[] = {
+    &g_models0[0], &g_models0[1], &g_models1[0], &g_models2[0],
+};
+
+static const struct bt_mesh_comp *g_old_comp;
+static u16_t g_old_addr;
+static u32_t g_rand = 1;
+
+static u32_t sub_rand(void)
+{
+    g_rand = g_rand * 1103515245 + 12345;
+    return g_rand >> 8;
+}
+
+/* A group address that is not the genie all-nodes one */
+static u16_t sub_group_rand(void)
+{
+    u16_t addr;
+
+    do {
+        addr = SUB_GROUP_BASE + sub_rand() % SUB_GROUP_SPAN;
+    } while (addr == BT_MESH_ADDR_GENIE_ALL_NODES);
+
+    return addr;
+}
+
+/* The element bt_mesh_elem_find should give, from the lists themselves */
+static struct bt_mesh_elem *sub_reference(u16_t addr)
+{
+    int i, j, k;
+
+    for (i = 0; i < ARRAY_SIZE(g_elems); i++) {
+        for (j = 0; j < g_elems[i].model_count; j++) {
+            for (k = 0; k < CONFIG_BT_MESH_MODEL_GROUP_COUNT; k++) {
+                if (g_elems[i].models[j].groups[k] == addr) {
+                    return &g_elems[i];
+                }
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static bool sub_add(struct bt_mesh_model *model, u16_t addr)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(model->groups); i++) {
+        if (model->groups[i] == BT_MESH_ADDR_UNASSIGNED) {
+            model->groups[i] = addr;
+            bt_mesh_elem_group_update(addr);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void sub_del(struct bt_mesh_model *model, int i)
+{
+    u16_t addr = model->groups[i];
+
+    model->groups[i] = BT_MESH_ADDR_UNASSIGNED;
+    bt_mesh_elem_group_update(addr);
+}
+
+static void sub_clear(void)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(g_all); i++) {
+        memset(g_all[i]->groups, 0, sizeof(g_all[i]->groups));
+    }
+
+    bt_mesh_elem_group_rebuild();
+}
+
+/* Every address subscribed somewhere, checked against the reference */
+static int sub_check_subscribed(void)
+{
+    int i, k, fails = 0;
+    u16_t addr;
+
+    for (i = 0; i < ARRAY_SIZE(g_all); i++) {
+        for (k = 0; k < ARRAY_SIZE(g_all[i]->groups); k++) {
+            addr = g_all[i]->groups[k];
+            if (addr != BT_MESH_ADDR_UNASSIGNED &&
+                bt_mesh_elem_find(addr) != sub_reference(addr)) {
+                fails++;
+            }
+        }
+    }
+
+    return fails;
+}
+
+static void test_sub_add_del(void)
+{
+    struct bt_mesh_sub_stats stats;
+    u16_t base;
+
+    bt_mesh_sub_stats_get(&stats);
+    base = stats.addrs;
+
+    YUNIT_ASSERT(bt_mesh_elem_find(0xc101) == NULL);
+
+    /* Lowest element subscribed wins */
+    YUNIT_ASSERT(sub_add(&g_models2[0], 0xc101));
+    YUNIT_ASSERT(bt_mesh_elem_find(0xc101) == &g_elems[2]);
+    YUNIT_ASSERT(sub_add(&g_models1[0], 0xc101));
+    YUNIT_ASSERT(bt_mesh_elem_find(0xc101) == &g_elems[1]);
+    YUNIT_ASSERT(sub_add(&g_models0[1], 0xc102));
+
+    bt_mesh_sub_stats_get(&stats);
+    YUNIT_ASSERT_EQUAL(stats.addrs, base + 2);
+
+    sub_del(&g_models1[0], 0);
+    YUNIT_ASSERT(bt_mesh_elem_find(0xc101) == &g_elems[2]);
+    sub_del(&g_models2[0], 0);
+    YUNIT_ASSERT(bt_mesh_elem_find(0xc101) == NULL);
+    YUNIT_ASSERT(bt_mesh_elem_find(0xc102) == &g_elems[0]);
+
+    bt_mesh_sub_stats_get(&stats);
+    YUNIT_ASSERT_EQUAL(stats.addrs, base + 1);
+
+    /* Element group and genie all-nodes address match every element */
+    YUNIT_ASSERT(bt_mesh_elem_find(BT_MESH_ADDR_GENIE_ALL_NODES) ==
+                 &g_elems[0]);
+}
+
+/* Random subscribe and unsubscribe, staying within the group map */
+static void test_sub_random(void)
+{
+    struct bt_mesh_model *model;
+    int round, k, fails = 0;
+
+    for (round = 0; round < SUB_ROUNDS; round++) {
+        model = g_all[sub_rand() % ARRAY_SIZE(g_all)];
+        k = sub_rand() % ARRAY_SIZE(model->groups);
+
+        if (model->groups[k] != BT_MESH_ADDR_UNASSIGNED) {
+            sub_del(model, k);
+        } else {
+            /* A few addresses, so that models share them */
+            sub_add(model, SUB_GROUP_BASE + 1 + sub_rand() % 12);
+        }
+
+        fails += sub_check_subscribed();
+    }
+
+    YUNIT_ASSERT_EQUAL(fails, 0);
+}
+
+/* Traffic to groups nobody here is in: all turned away, and most by the
+ * filter alone.
+ */
+static void test_sub_filter_rate(void)
+{
+    struct bt_mesh_sub_stats stats;
+    int i, wrong = 0, count = 0;
+    u16_t addr;
+
+    for (i = 0; i < CONFIG_BT_MESH_MODEL_GROUP_COUNT; i++) {
+        sub_add(g_all[i % ARRAY_SIZE(g_all)], sub_group_rand());
+    }
+
+    bt_mesh_sub_stats_reset();
+
+    for (i = 0; i < SUB_LOOKUPS; i++) {
+        addr = sub_group_rand();
+        if (sub_reference(addr)) {
+            continue;
+        }
+
+        if (bt_mesh_elem_find(addr)) {
+            wrong++;
+        }
+        count++;
+    }
+
+    bt_mesh_sub_stats_get(&stats);
+    YUNIT_ASSERT_EQUAL(wrong, 0);
+    YUNIT_ASSERT_EQUAL(stats.lookups, count);
+    YUNIT_ASSERT_EQUAL(stats.filtered + stats.false_pos, count);
+    YUNIT_ASSERT(stats.false_pos * 10 < count);
+    YUNIT_ASSERT_EQUAL(sub_check_subscribed(), 0);
+}
+
+/* More addresses than the group map holds: lookups fall back to the
+ * subscription lists until the next rebuild finds room again.
+ */
+static void test_sub_map_full(void)
+{
+    struct bt_mesh_sub_stats stats;
+    int i, added = 0;
+    u16_t addr;
+
+    while (added <= CONFIG_BT_MESH_GROUP_INDEX_SIZE) {
+        addr = sub_group_rand();
+        if (sub_reference(addr)) {
+            continue;
+        }
+
+        if (!sub_add(g_all[added % ARRAY_SIZE(g_all)], addr)) {
+            break;
+        }
+        added++;
+    }
+
+    YUNIT_ASSERT(added > CONFIG_BT_MESH_GROUP_INDEX_SIZE);
+    YUNIT_ASSERT_EQUAL(sub_check_subscribed(), 0);
+
+    for (i = 0; i < 1000; i++) {
+        addr = sub_group_rand();
+        YUNIT_ASSERT(bt_mesh_elem_find(addr) == sub_reference(addr));
+    }
+
+    /* Down to a few addresses, then the map is back */
+    sub_clear();
+    for (i = 0; i < 4; i++) {
+        sub_add(g_all[i], SUB_GROUP_BASE + 0x100 + i);
+    }
+
+    bt_mesh_sub_stats_get(&stats);
+    YUNIT_ASSERT(stats.addrs >= 4);
+    YUNIT_ASSERT_EQUAL(sub_check_subscribed(), 0);
+}
+
+static int init(void)
+{
+    int err;
+
+    g_old_comp = bt_mesh_comp_get();
+    g_old_addr = bt_mesh_primary_addr();
+
+    err = bt_mesh_comp_register(&g_comp);
+    if (err) {
+        return err;
+    }
+
+    bt_mesh_comp_provision(SUB_ADDR);
+
+    return 0;
+}
+
+static int cleanup(void)
+{
+    sub_clear();
+
+    if (g_old_comp) {
+        bt_mesh_comp_register(g_old_comp);
+        bt_mesh_comp_provision(g_old_addr);
+    }
+
+    return 0;
+}
+
+static void setup(void)
+{
+    sub_clear();
+    bt_mesh_sub_stats_reset();
+}
+
+static void teardown(void)
+{
+}
+
+static yunit_test_case_t bt_mesh_sub_filter_testcases[] = {
+    { "add_del", test_sub_add_del },
+    { "random", test_sub_random },
+    { "filter_rate", test_sub_filter_rate },
+    { "map_full", test_sub_map_full },
+    YUNIT_TEST_CASE_NULL
+};
+
+static yunit_test_suite_t suites[] = {
+    { "bt_mesh_sub_filter", init, cleanup, setup, teardown,
+      bt_mesh_sub_filter_testcases },
+    YUNIT_TEST_SUITE_NULL
+};
+
+void test_bt_mesh_sub_filter(void)
+{
+    yunit_add_test_suites(suites);
+}
+AOS_TESTCASE(test_bt_mesh_sub_filter);
@@ -0,0 +1,260 @@
+/*
+ * Copyright (C) 2015-2019 Alibaba Group Holding Limited
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <yunit.h>
+#include <yts.h>
+#include <aos/kernel.h>
+
+#include <zephyr.h>
+
+/*
+ * Drives the bt_common delayed work queue directly: nothing here starts
+ * the BLE task, so works only leave the queue when a case takes them off.
+ */
+
+#ifdef YTS_LINUX
+#define WORK_COUNT 4096
+#else
+#define WORK_COUNT 256
+#endif
+
+#define WORK_BENCH_ROUNDS 8
+
+static struct k_delayed_work g_works[WORK_COUNT];
+static uint32_t g_rand = 1;
+
+static uint32_t work_rand(void)
+{
+    g_rand = g_rand * 1103515245 + 12345;
+    return g_rand >> 8;
+}
+
+static void work_handler(struct k_work *work)
+{
+}
+
+static uint32_t work_expiry(struct k_work *work)
+{
+    return work->start_ms + work->timeout;
+}
+
+static int work_index(struct k_work *work)
+{
+    return (struct k_delayed_work *)work - g_works;
+}
+
+/* Take every pending work off in queue order, checking that expiries
+ * never go back and that equal expiries keep submit order.
+ */
+static int work_drain(void)
+{
+    struct k_work *work, *prev = NULL;
+    int count = 0;
+
+    while ((work = k_work_q_first()) != NULL) {
+        if (prev) {
+            int32_t diff = (int32_t)(work_expiry(work) - work_expiry(prev));
+
+            YUNIT_ASSERT(diff >= 0);
+            if (diff == 0) {
+                YUNIT_ASSERT(work_index(work) > work_index(prev));
+            }
+        }
+
+        k_delayed_work_cancel((struct k_delayed_work *)work);
+        YUNIT_ASSERT(!atomic_test_bit(work->flags, K_WORK_STATE_PENDING));
+        prev = work;
+        count++;
+    }
+
+    return count;
+}
+
+static void test_work_order(void)
+{
+    int i;
+
+    /* Few distinct delays, so many works share an expiry */
+    for (i = 0; i < WORK_COUNT; i++) {
+        k_delayed_work_submit(&g_works[i], (work_rand() % 64) * 1000);
+    }
+
+    YUNIT_ASSERT(work_drain() == WORK_COUNT);
+    YUNIT_ASSERT(k_work_q_first() == NULL);
+}
+
+static void test_work_cancel(void)
+{
+    int pending = 0;
+    int i;
+
+    for (i = 0; i < WORK_COUNT; i++) {
+        k_delayed_work_submit(&g_works[i], work_rand() % 100000);
+    }
+
+    for (i = 0; i < WORK_COUNT; i++) {
+        if (work_rand() & 1) {
+            k_delayed_work_cancel(&g_works[i]);
+        }
+    }
+
+    for (i = 0; i < WORK_COUNT; i++) {
+        pending += atomic_test_bit(g_works[i].work.flags,
+                                   K_WORK_STATE_PENDING);
+    }
+
+    YUNIT_ASSERT(work_drain() == pending);
+}
+
+static void test_work_resubmit(void)
+{
+    int i;
+
+    for (i = 0; i < WORK_COUNT; i++) {
+        k_delayed_work_submit(&g_works[i], 1000 + work_rand() % 100000);
+    }
+
+    /* Resubmitting moves pending work instead of adding it again. */
+    for (i = 0; i < WORK_COUNT; i++) {
+        k_delayed_work_submit(&g_works[work_rand() % WORK_COUNT],
+                              1000 + work_rand() % 100000);
+    }
+
+    k_delayed_work_submit(&g_works[0], 0);
+    YUNIT_ASSERT(k_work_q_first() == &g_works[0].work);
+    YUNIT_ASSERT(k_work_q_get_expired() == &g_works[0].work);
+    YUNIT_ASSERT(!atomic_test_bit(g_works[0].work.flags, K_WORK_STATE_PENDING));
+
+    YUNIT_ASSERT(work_drain() == WORK_COUNT - 1);
+}
+
+static void test_work_init_garbage(void)
+{
+    struct k_delayed_work stale;
+    int i;
+
+    for (i = 0; i < WORK_COUNT; i++) {
+        k_delayed_work_submit(&g_works[i], work_rand() % 100000);
+    }
+
+    /* Stack memory with the pending bit set must not touch the queue */
+    memset(&stale, 0xff, sizeof(stale));
+    k_delayed_work_init(&stale, work_handler);
+    YUNIT_ASSERT(!atomic_test_bit(stale.work.flags, K_WORK_STATE_PENDING));
+
+    /* Re-initialising pending work takes it off the queue */
+    k_delayed_work_init(&g_works[0], work_handler);
+    YUNIT_ASSERT(!atomic_test_bit(g_works[0].work.flags, K_WORK_STATE_PENDING));
+
+    YUNIT_ASSERT(work_drain() == WORK_COUNT - 1);
+}
+
+static void test_work_restart(void)
+{
+    int i;
+
+    for (i = 0; i < WORK_COUNT; i++) {
+        k_delayed_work_submit(&g_works[i], work_rand() % 100000);
+    }
+
+    /* A restart drops the pending works, they can be submitted again */
+    k_work_q_start();
+    YUNIT_ASSERT(k_work_q_first() == NULL);
+    for (i = 0; i < WORK_COUNT; i++) {
+        YUNIT_ASSERT(!atomic_test_bit(g_works[i].work.flags,
+                                      K_WORK_STATE_PENDING));
+    }
+
+    for (i = 0; i < WORK_COUNT; i++) {
+        k_delayed_work_submit(&g_works[i], work_rand() % 100000);
+    }
+
+    YUNIT_ASSERT(work_drain() == WORK_COUNT);
+}
+
+static void test_work_bench(void)
+{
+    long long submit = 0, resubmit = 0, cancel = 0, start;
+    int round, i;
+
+    for (round = 0; round < WORK_BENCH_ROUNDS; round++) {
+        start = aos_now();
+        for (i = 0; i < WORK_COUNT; i++) {
+            k_delayed_work_submit(&g_works[i], work_rand() % 100000);
+        }
+        submit += aos_now() - start;
+
+        /* The mesh pattern: timers restarted while pending */
+        start = aos_now();
+        for (i = 0; i < WORK_COUNT; i++) {
+            k_delayed_work_submit(&g_works[work_rand() % WORK_COUNT],
+                                  work_rand() % 100000);
+        }
+        resubmit += aos_now() - start;
+
+        start = aos_now();
+        for (i = 0; i < WORK_COUNT; i++) {
+            k_delayed_work_cancel(&g_works[i]);
+        }
+        cancel += aos_now() - start;
+    }
+
+    YUNIT_ASSERT(k_work_q_first() == NULL);
+
+    printf("%d pending works: submit %lld ns, resubmit %lld ns, "
+           "cancel %lld ns per call\n", WORK_COUNT,
+           submit / (WORK_BENCH_ROUNDS * WORK_COUNT),
+           resubmit / (WORK_BENCH_ROUNDS * WORK_COUNT),
+           cancel / (WORK_BENCH_ROUNDS * WORK_COUNT));
+}
+
+static int init(void)
+{
+    int i;
+
+    k_work_q_start();
+    for (i = 0; i < WORK_COUNT; i++) {
+        k_delayed_work_init(&g_works[i], work_handler);
+    }
+
+    return 0;
+}
+
+static int cleanup(void)
+{
+    return 0;
+}
+
+static void setup(void)
+{
+}
+
+static void teardown(void)
+{
+}
+
+static yunit_test_case_t bt_work_testcases[] = {
+    { "work_order", test_work_order },
+    { "work_cancel", test_work_cancel },
+    { "work_resubmit", test_work_resubmit },
+    { "work_init_garbage", test_work_init_garbage },
+    { "work_restart", test_work_restart },
+    { "work_bench", test_work_bench },
+    YUNIT_TEST_CASE_NULL
+};
+
+static yunit_test_suite_t suites[] = {
+    { "bt_work", init, cleanup, setup, teardown, bt_work_testcases },
+    YUNIT_TEST_SUITE_NULL
+};
+
+void test_bt_work(void)
+{
+    yunit_add_test_suites(suites);
+}
+AOS_TESTCASE(test_bt_work);
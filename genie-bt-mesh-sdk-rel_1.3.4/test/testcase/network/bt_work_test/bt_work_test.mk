@@ -0,0 +1,7 @@
+NAME := bt_work_test
+
+$(NAME)_COMPONENTS  += bluetooth.bt_common
+
+$(NAME)_SOURCES     += bt_work_test.c
+
+$(NAME)_CFLAGS      += -Wall -Werror
@@ -0,0 +1,10 @@
+src = Split('''
+    bt_work_test.c
+''')
+
+component = aos_component('bt_work_test', src)
+
+component.add_comp_deps('network/bluetooth/bt_common')
+
+component.add_cflags('-Wall')
+component.add_cflags('-Werror')